@@ -62,6 +62,7 @@ void IPC_FIFOinit(u8 proc)
 
 void IPC_FIFOsend(u8 proc, u32 val)
 {
+	NDS_ThreadSync sync;
 	u16 cnt_l = T1ReadWord(MMU.MMU_MEM[proc][0x40], 0x184);
 	if (!(cnt_l & IPCFIFOCNT_FIFOENABLE)) return;			// FIFO disabled
 	u8	proc_remote = proc ^ 1;
@@ -97,11 +98,13 @@ void IPC_FIFOsend(u8 proc, u32 val)
 	if(cnt_r&IPCFIFOCNT_RECVIRQEN)
 		NDS_makeIrq(proc_remote, IRQ_BIT_IPCFIFO_RECVNONEMPTY);
 
+	armcpu_idleLoopWake(proc_remote);
 	NDS_Reschedule();
 }
 
 u32 IPC_FIFOrecv(u8 proc)
 {
+	NDS_ThreadSync sync;
 	u16 cnt_l = T1ReadWord(MMU.MMU_MEM[proc][0x40], 0x184);
 	if (!(cnt_l & IPCFIFOCNT_FIFOENABLE)) return (0);									// FIFO disabled
 	u8	proc_remote = proc ^ 1;
@@ -140,6 +143,7 @@ u32 IPC_FIFOrecv(u8 proc)
 	T1WriteWord(MMU.MMU_MEM[proc][0x40], 0x184, cnt_l);
 	T1WriteWord(MMU.MMU_MEM[proc_remote][0x40], 0x184, cnt_r);
 
+	armcpu_idleLoopWake(proc_remote);
 	NDS_Reschedule();
 
 	return (val);
@@ -147,6 +151,7 @@ u32 IPC_FIFOrecv(u8 proc)
 
 void IPC_FIFOcnt(u8 proc, u16 val)
 {
+	NDS_ThreadSync sync;
 	u16 cnt_l = T1ReadWord(MMU.MMU_MEM[proc][0x40], 0x184);
 	u16 cnt_r = T1ReadWord(MMU.MMU_MEM[proc^1][0x40], 0x184);
 
@@ -182,6 +187,7 @@ void IPC_FIFOcnt(u8 proc, u16 val)
 	T1WriteWord(MMU.MMU_MEM[proc][0x40], 0x184, cnt_l);
 	T1WriteWord(MMU.MMU_MEM[proc^1][0x40], 0x184, cnt_r);
 
+	armcpu_idleLoopWake(proc^1);
 	NDS_Reschedule();
 }
 
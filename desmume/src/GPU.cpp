@@ -3885,6 +3885,8 @@ void GPUEngineA::_RenderLine_DisplayCapture(const GPUEngineCompositorInfo &compI
 	const void *srcAPtr;
 	const void *srcBPtr;
 	u16 *dstNative16 = this->_VRAMNativeBlockPtr[DISPCAPCNT.VRAMWriteBlock] + dstNativeOffset;
+	MMU_MarkDirtyRange(dstNative16, CAPTURELENGTH * sizeof(u16));
+	MMU_VRAMTouchRange(dstNative16, CAPTURELENGTH * sizeof(u16));
 	
 	if (!willWriteVRAMLineNative)
 	{
@@ -754,6 +754,10 @@ static FORCEINLINE void CopyLinesForVerticalCount(void *__restrict dstLineHead,
 	}
 }
 
+// The 2D compositor is not covered by CPU_GetSIMDLevel() dispatch. Both
+// variants define the same GPUEngineBase members, and GPU.cpp sizes its
+// loops from VECTORSIZE, so the instruction set is fixed at build time and
+// --simd-level does not affect it.
 #if defined(ENABLE_AVX2)
 	#include "GPU_Operations_AVX2.cpp"
 #elif defined(ENABLE_SSE2)
@@ -163,6 +163,7 @@ void mmu_log_debug_ARM7(u32 adr, const char *fmt, ...)
 
 MMU_struct MMU;
 MMU_struct_new MMU_new;
+MMU_DIRTY_TRACKER MMU_dirty;
 MMU_struct_timing MMU_timing;
 
 u8 * MMU_struct::MMU_MEM[2][256] = {
@@ -279,6 +280,14 @@ u32 MMU_struct::MMU_MASK[2][256] = {
 #define VRAM_LCDC_PAGES 41
 u8 vram_lcdc_map[VRAM_LCDC_PAGES];
 
+u32 MMU_vramGeneration[MMU_VRAM_GENERATION_PAGES];
+
+void MMU_VRAMTouchAll()
+{
+	for (int i = 0; i < VRAM_LCDC_PAGES; i++)
+		MMU_vramGeneration[i]++;
+}
+
 //in the range of 0x06000000 - 0x06800000 in 16KB pages (the ARM9 vram mappable area)
 //this maps to 16KB pages in the LCDC buffer which is what will actually contain the data
 u8 vram_arm9_map[VRAM_ARM9_PAGES];
@@ -788,6 +797,14 @@ void MMU_VRAM_unmap_all()
 
 static inline void MMU_VRAMmapControl(u8 block, u8 VRAMBankCnt)
 {
+	//the ARM7 may be running on another thread, reading through the WRAM and VRAM maps.
+	//stop it before they change; it picks up the new mapping when the main loop resumes it
+	if(nds_arm7_threaded)
+	{
+		NDS_ThreadSyncHalt();
+		NDS_Reschedule();
+	}
+
 	//handle WRAM, first of all
 	if(block == 7)
 	{
@@ -945,11 +962,38 @@ void MMU_DeInit(void) {
 	Mic_DeInit();
 }
 
+void MMU_DirtyTrackingStart()
+{
+	memset(MMU_dirty.page, 0, sizeof(MMU_dirty.page));
+	if (MMU_dirty.enabled)
+		return;
+	MMU_dirty.enabled = true;
+#ifdef HAVE_JIT
+	// fastmem stores don't pass through here, so send them back to the MMU
+	arm_jit_memory_changed();
+#endif
+}
+
+void MMU_DirtyTrackingStop()
+{
+	if (!MMU_dirty.enabled)
+		return;
+	MMU_dirty.enabled = false;
+#ifdef HAVE_JIT
+	arm_jit_memory_changed();
+#endif
+}
+
 void MMU_Reset()
 {
+	// the memory gets wiped without marking anything, so whatever base was being
+	// tracked is gone. arm_jit_reset() remaps fastmem after this.
+	MMU_dirty.enabled = false;
+
 	memset(MMU.ARM9_DTCM, 0, sizeof(MMU.ARM9_DTCM));
 	memset(MMU.ARM9_ITCM, 0, sizeof(MMU.ARM9_ITCM));
 	memset(MMU.ARM9_LCD,  0, sizeof(MMU.ARM9_LCD));
+	MMU_VRAMTouchAll();
 	memset(MMU.ARM9_OAM,  0, sizeof(MMU.ARM9_OAM));
 	memset(MMU.ARM9_REG,  0, sizeof(MMU.ARM9_REG));
 	memset(MMU.ARM9_VMEM, 0, sizeof(MMU.ARM9_VMEM));
@@ -1064,7 +1108,7 @@ static void execsqrt() {
 	MMU.sqrtCycles = nds_timer + 26;
 	MMU.sqrtResult = ret;
 	MMU.sqrtRunning = TRUE;
-	NDS_Reschedule();
+	NDS_RescheduleSqrt();
 }
 
 static void execdiv() {
@@ -1136,7 +1180,7 @@ static void execdiv() {
 	MMU.divResult = res;
 	MMU.divMod = mod;
 	MMU.divRunning = TRUE;
-	NDS_Reschedule();
+	NDS_RescheduleDivider();
 }
 
 DSI_TSC::DSI_TSC()
@@ -1707,6 +1751,7 @@ template<int PROCNUM> static void REG_IF_WriteByte(u32 addr, u8 val)
 	//ZERO 01-dec-2010 : I am no longer sure this approach is correct.. it proved to be wrong for IPC fifo.......
 	//it seems as if IF bits should always be cached (only the user can clear them)
 	
+	NDS_ThreadSync sync;
 	MMU.reg_IF_bits[PROCNUM] &= (~(((u32)val)<<(addr<<3)));
 	NDS_Reschedule();
 }
@@ -1835,6 +1880,7 @@ static void writereg_POWCNT1(const int size, const u32 adr, const u32 val)
 
 static INLINE void MMU_IPCSync(u8 proc, u32 val)
 {
+	NDS_ThreadSync sync;
 
 	u32 sync_l = T1ReadLong(MMU.MMU_MEM[proc][0x40], 0x180) & 0xFFFF;
 	u32 sync_r = T1ReadLong(MMU.MMU_MEM[proc^1][0x40], 0x180) & 0xFFFF;
@@ -1875,6 +1921,7 @@ static INLINE void MMU_IPCSync(u8 proc, u32 val)
 	if ((sync_l & IPCSYNC_IRQ_SEND) && (sync_r & IPCSYNC_IRQ_RECV))
 		NDS_makeIrq(proc^1, IRQ_BIT_IPCSYNC);
 
+	armcpu_idleLoopWake(proc^1);
 	NDS_Reschedule();
 }
 
@@ -3268,8 +3315,8 @@ bool MMU_WriteFromExternal(const int targetProc, const u32 targetAddress, T newV
 			break;
 	}
 	
-	bool needsJitReset = ( (targetAddress >= 0x02000000) && (targetAddress < 0x02400000) );
-	if (needsJitReset)
+	bool didWriteCode = ( (targetAddress >= 0x02000000) && (targetAddress < 0x02400000) );
+	if (didWriteCode)
 	{
 		bool willValueChange = false;
 		
@@ -3294,8 +3341,8 @@ bool MMU_WriteFromExternal(const int targetProc, const u32 targetAddress, T newV
 		
 		if (!willValueChange)
 		{
-			needsJitReset = false;
-			return needsJitReset;
+			didWriteCode = false;
+			return didWriteCode;
 		}
 	}
 	
@@ -3318,7 +3365,7 @@ bool MMU_WriteFromExternal(const int targetProc, const u32 targetAddress, T newV
 			break;
 	}
 	
-	return needsJitReset;
+	return didWriteCode;
 }
 
 template bool MMU_WriteFromExternal< u8, 1>(const int targetProc, const u32 targetAddress,  u8 newValue);
@@ -3342,9 +3389,10 @@ void FASTCALL _MMU_ARM9_write08(u32 adr, u8 val)
 	if (adrBank < 0x02)
 	{
 #ifdef HAVE_JIT
-		JIT_COMPILED_FUNC_KNOWNBANK(adr, ARM9_ITCM, 0x7FFF, 0) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_KNOWNBANK(adr, ARM9_ITCM, 0x7FFF, 0), 1);
 #endif
 		T1WriteByte(MMU.ARM9_ITCM, adr & 0x7FFF, val);
+		MMU_MarkDirty(MMU.ARM9_ITCM + (adr & 0x7FFF));
 		return;
 	}
 
@@ -3870,6 +3918,7 @@ void FASTCALL _MMU_ARM9_write08(u32 adr, u8 val)
 			
 		case 0x07: // OAM attributes
 			T1WriteByte(MMU.ARM9_OAM, adr & 0x07FF, val);
+			MMU_MarkDirty(MMU.ARM9_OAM + (adr & 0x07FF));
 			return;
 	}
 	
@@ -3880,11 +3929,13 @@ void FASTCALL _MMU_ARM9_write08(u32 adr, u8 val)
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM9))
-		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM9, 0) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM9, 0), 1);
 #endif
+	MMU_VRAMTouch(adr);
 
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	MMU.MMU_MEM[ARMCPU_ARM9][adr>>20][adr&MMU.MMU_MASK[ARMCPU_ARM9][adr>>20]]=val;
+	MMU_MarkDirty(MMU.MMU_MEM[ARMCPU_ARM9][adr>>20] + (adr&MMU.MMU_MASK[ARMCPU_ARM9][adr>>20]));
 }
 
 //================================================= MMU ARM9 write 16
@@ -3898,9 +3949,10 @@ void FASTCALL _MMU_ARM9_write16(u32 adr, u16 val)
 	if (adrBank < 0x02)
 	{
 #ifdef HAVE_JIT
-		JIT_COMPILED_FUNC_KNOWNBANK(adr, ARM9_ITCM, 0x7FFF, 0) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_KNOWNBANK(adr, ARM9_ITCM, 0x7FFF, 0), 1);
 #endif
 		T1WriteWord(MMU.ARM9_ITCM, adr & 0x7FFF, val);
+		MMU_MarkDirty(MMU.ARM9_ITCM + (adr & 0x7FFF));
 		return;
 	}
 
@@ -4587,6 +4639,7 @@ void FASTCALL _MMU_ARM9_write16(u32 adr, u16 val)
 			
 		case 0x07: // OAM attributes
 			T1WriteWord(MMU.ARM9_OAM, adr & 0x07FF, val);
+			MMU_MarkDirty(MMU.ARM9_OAM + (adr & 0x07FF));
 			return;
 	}
 	
@@ -4596,11 +4649,13 @@ void FASTCALL _MMU_ARM9_write16(u32 adr, u16 val)
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM9))
-		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM9, 0) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM9, 0), 1);
 #endif
+	MMU_VRAMTouch(adr);
 
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteWord(MMU.MMU_MEM[ARMCPU_ARM9][adr>>20], adr&MMU.MMU_MASK[ARMCPU_ARM9][adr>>20], val);
+	MMU_MarkDirty(MMU.MMU_MEM[ARMCPU_ARM9][adr>>20] + (adr&MMU.MMU_MASK[ARMCPU_ARM9][adr>>20]));
 } 
 
 //================================================= MMU ARM9 write 32
@@ -4614,10 +4669,10 @@ void FASTCALL _MMU_ARM9_write32(u32 adr, u32 val)
 	if (adrBank < 0x02)
 	{
 #ifdef HAVE_JIT
-		JIT_COMPILED_FUNC_KNOWNBANK(adr, ARM9_ITCM, 0x7FFF, 0) = 0;
-		JIT_COMPILED_FUNC_KNOWNBANK(adr, ARM9_ITCM, 0x7FFF, 1) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_KNOWNBANK(adr, ARM9_ITCM, 0x7FFF, 0), 2);
 #endif
 		T1WriteLong(MMU.ARM9_ITCM, adr & 0x7FFF, val);
+		MMU_MarkDirty(MMU.ARM9_ITCM + (adr & 0x7FFF));
 		return ;
 	}
 
@@ -5127,6 +5182,7 @@ void FASTCALL _MMU_ARM9_write32(u32 adr, u32 val)
 			
 		case 0x07: // OAM attributes
 			T1WriteLong(MMU.ARM9_OAM, adr & 0x07FF, val);
+			MMU_MarkDirty(MMU.ARM9_OAM + (adr & 0x07FF));
 			return;
 	}
 
@@ -5136,14 +5192,13 @@ void FASTCALL _MMU_ARM9_write32(u32 adr, u32 val)
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM9))
-	{
-		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM9, 0) = 0;
-		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM9, 1) = 0;
-	}
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM9, 0), 2);
 #endif
+	MMU_VRAMTouch(adr);
 
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteLong(MMU.MMU_MEM[ARMCPU_ARM9][adr>>20], adr&MMU.MMU_MASK[ARMCPU_ARM9][adr>>20], val);
+	MMU_MarkDirty(MMU.MMU_MEM[ARMCPU_ARM9][adr>>20] + (adr&MMU.MMU_MASK[ARMCPU_ARM9][adr>>20]));
 }
 
 //================================================= MMU ARM9 read 08
@@ -5650,11 +5705,13 @@ void FASTCALL _MMU_ARM7_write08(u32 adr, u8 val)
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM7))
-		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 0) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 0), 1);
 #endif
+	MMU_VRAMTouch(adr);
 	
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	MMU.MMU_MEM[ARMCPU_ARM7][adr>>20][adr&MMU.MMU_MASK[ARMCPU_ARM7][adr>>20]]=val;
+	MMU_MarkDirty(MMU.MMU_MEM[ARMCPU_ARM7][adr>>20] + (adr&MMU.MMU_MASK[ARMCPU_ARM7][adr>>20]));
 }
 
 //================================================= MMU ARM7 write 16
@@ -5680,6 +5737,7 @@ void FASTCALL _MMU_ARM7_write16(u32 adr, u16 val)
 	{
 		WIFI_write16(adr,val);
 		T1WriteWord(MMU.MMU_MEM[ARMCPU_ARM7][0x48], adr&MMU.MMU_MASK[ARMCPU_ARM7][0x48], val);
+		MMU_MarkDirty(MMU.MMU_MEM[ARMCPU_ARM7][0x48] + (adr&MMU.MMU_MASK[ARMCPU_ARM7][0x48]));
 		return;
 	}
 
@@ -5836,11 +5894,13 @@ void FASTCALL _MMU_ARM7_write16(u32 adr, u16 val)
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM7))
-		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 0) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 0), 1);
 #endif
+	MMU_VRAMTouch(adr);
 
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteWord(MMU.MMU_MEM[ARMCPU_ARM7][adr>>20], adr&MMU.MMU_MASK[ARMCPU_ARM7][adr>>20], val);
+	MMU_MarkDirty(MMU.MMU_MEM[ARMCPU_ARM7][adr>>20] + (adr&MMU.MMU_MASK[ARMCPU_ARM7][adr>>20]));
 }
 //================================================= MMU ARM7 write 32
 void FASTCALL _MMU_ARM7_write32(u32 adr, u32 val)
@@ -5865,6 +5925,7 @@ void FASTCALL _MMU_ARM7_write32(u32 adr, u32 val)
 		WIFI_write16(adr, val & 0xFFFF);
 		WIFI_write16(adr+2, val >> 16);
 		T1WriteLong(MMU.MMU_MEM[ARMCPU_ARM7][0x48], adr&MMU.MMU_MASK[ARMCPU_ARM7][0x48], val);
+		MMU_MarkDirty(MMU.MMU_MEM[ARMCPU_ARM7][0x48] + (adr&MMU.MMU_MASK[ARMCPU_ARM7][0x48]));
 		return;
 	}
 
@@ -5935,14 +5996,13 @@ void FASTCALL _MMU_ARM7_write32(u32 adr, u32 val)
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM7))
-	{
-		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 0) = 0;
-		JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 1) = 0;
-	}
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 0), 2);
 #endif
+	MMU_VRAMTouch(adr);
 
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteLong(MMU.MMU_MEM[ARMCPU_ARM7][adr>>20], adr&MMU.MMU_MASK[ARMCPU_ARM7][adr>>20], val);
+	MMU_MarkDirty(MMU.MMU_MEM[ARMCPU_ARM7][adr>>20] + (adr&MMU.MMU_MASK[ARMCPU_ARM7][adr>>20]));
 }
 
 //================================================= MMU ARM7 read 08
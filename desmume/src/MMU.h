@@ -366,12 +366,13 @@ typedef union
 struct MMU_struct 
 {
 	//ARM9 mem
-	u8 ARM9_ITCM[0x8000];
-	u8 ARM9_DTCM[0x4000];
+	// the RAM that the JIT's fastmem maps into its arenas has to start on a page
+	PAGE_ALIGN u8 ARM9_ITCM[0x8000];
+	PAGE_ALIGN u8 ARM9_DTCM[0x4000];
 
 	//u8 MAIN_MEM[4*1024*1024]; //expanded from 4MB to 8MB to support debug consoles
 	//u8 MAIN_MEM[8*1024*1024]; //expanded from 8MB to 16MB to support dsi
-	u8 MAIN_MEM[16*1024*1024]; //expanded from 8MB to 16MB to support dsi
+	PAGE_ALIGN u8 MAIN_MEM[16*1024*1024]; //expanded from 8MB to 16MB to support dsi
 	u8 ARM9_REG[0x1000000]; //this variable is evil and should be removed by correctly emulating all registers.
 	u8 ARM9_BIOS[0x8000];
 	CACHE_ALIGN u8 ARM9_VMEM[0x800];
@@ -394,7 +395,7 @@ struct MMU_struct
 
 	//ARM7 mem
 	u8 ARM7_BIOS[0x4000];
-	u8 ARM7_ERAM[0x10000]; //64KB of exclusive WRAM
+	PAGE_ALIGN u8 ARM7_ERAM[0x10000]; //64KB of exclusive WRAM
 	u8 ARM7_REG[0x10000];
 	u8 ARM7_WIRAM[0x10000]; //WIFI ram
 
@@ -510,6 +511,66 @@ struct MMU_struct_new
 extern MMU_struct MMU;
 extern MMU_struct_new MMU_new;
 
+// Pages of MMU_struct written since MMU_DirtyTrackingStart(), which incremental
+// savestates use to emit only the RAM that changed since their base. Every path that
+// stores into emulated memory marks the page it touched; with tracking off that's a
+// single test.
+#define MMU_DIRTY_PAGE_SHIFT 12
+#define MMU_DIRTY_PAGES ((sizeof(MMU_struct) >> MMU_DIRTY_PAGE_SHIFT) + 1)
+
+struct MMU_DIRTY_TRACKER
+{
+	bool enabled;
+	u8 page[MMU_DIRTY_PAGES];
+};
+extern MMU_DIRTY_TRACKER MMU_dirty;
+
+void MMU_DirtyTrackingStart();
+void MMU_DirtyTrackingStop();
+
+FORCEINLINE void MMU_MarkDirty(const void *host)
+{
+	if (!MMU_dirty.enabled) return;
+	const uintptr_t ofs = (uintptr_t)host - (uintptr_t)&MMU;
+	if (ofs < sizeof(MMU_struct))
+		MMU_dirty.page[ofs >> MMU_DIRTY_PAGE_SHIFT] = 1;
+}
+
+FORCEINLINE void MMU_MarkDirtyRange(const void *host, u32 size)
+{
+	if (!MMU_dirty.enabled || size == 0) return;
+	const u8 *p = (const u8 *)host;
+	for (u32 ofs = 0; ofs < size; ofs += (1 << MMU_DIRTY_PAGE_SHIFT))
+		MMU_MarkDirty(p + ofs);
+	MMU_MarkDirty(p + size - 1);
+}
+
+// Write generation of each 16KB page of ARM9_LCD. Every store into VRAM bumps the count
+// of the page it landed in, so the texture cache can tell whether the pages backing a
+// texture were written since it last read them, without comparing their contents.
+// Pages past the 41 real ones are the blank memory, which nothing ever writes.
+#define MMU_VRAM_GENERATION_PAGES 64
+extern u32 MMU_vramGeneration[MMU_VRAM_GENERATION_PAGES];
+
+// <adr> as returned by MMU_LCDmap()
+FORCEINLINE void MMU_VRAMTouch(u32 adr)
+{
+	if ((adr & 0x0F000000) == 0x06000000)
+		MMU_vramGeneration[(adr >> 14) & (MMU_VRAM_GENERATION_PAGES - 1)]++;
+}
+
+FORCEINLINE void MMU_VRAMTouchRange(const void *host, u32 size)
+{
+	const uintptr_t ofs = (uintptr_t)host - (uintptr_t)MMU.ARM9_LCD;
+	if (size == 0 || ofs >= 0xA4000) return;
+	const uintptr_t last = (ofs + size - 1 < 0xA4000) ? ofs + size - 1 : 0xA3FFF;
+	for (uintptr_t page = ofs >> 14; page <= (last >> 14); page++)
+		MMU_vramGeneration[page]++;
+}
+
+// For when VRAM is replaced wholesale, as by a reset or a loaded savestate.
+void MMU_VRAMTouchAll();
+
 
 struct armcpu_memory_iface
 {
@@ -628,7 +689,8 @@ FORCEINLINE void* MMU_gpu_map(const u32 vram_addr)
 
 // Call MMU_WriteFromExternal() when modifying memory outside of the normal execution process, such
 // as when using cheats or when the client wants to write to memory directly. This function returns
-// true if memory is modified in such a way that requires the JIT execution be reset.
+// true if the write changed main memory, where game code lives. The write itself discards any JIT
+// blocks compiled from the written addresses, so there is no need to reset the JIT afterwards.
 template<typename T, size_t LENGTH> bool MMU_WriteFromExternal(const int targetProc, const u32 targetAddress, T newValue);
 
 template<int PROCNUM, MMU_ACCESS_TYPE AT> u8 _MMU_read08(u32 addr);
@@ -898,6 +960,7 @@ FORCEINLINE void _MMU_write08(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 		if((addr&(~0x3FFF)) == MMU.DTCMRegion)
 		{
 			T1WriteByte(MMU.ARM9_DTCM, addr & 0x3FFF, val);
+			MMU_MarkDirty(MMU.ARM9_DTCM + (addr & 0x3FFF));
 #ifdef HAVE_LUA
 			CallRegisteredLuaMemHook(addr, 1, val, LUAMEMHOOK_WRITE);
 #endif
@@ -909,9 +972,10 @@ FORCEINLINE void _MMU_write08(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 
 	if ( (addr & 0x0F000000) == 0x02000000) {
 #ifdef HAVE_JIT
-		JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK, 0) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK, 0), 1);
 #endif
 		T1WriteByte( MMU.MAIN_MEM, addr & _MMU_MAIN_MEM_MASK, val);
+		MMU_MarkDirty(MMU.MAIN_MEM + (addr & _MMU_MAIN_MEM_MASK));
 #ifdef HAVE_LUA
 		CallRegisteredLuaMemHook(addr, 1, val, LUAMEMHOOK_WRITE);
 #endif
@@ -956,6 +1020,7 @@ FORCEINLINE void _MMU_write16(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 		if((addr&(~0x3FFF)) == MMU.DTCMRegion)
 		{
 			T1WriteWord(MMU.ARM9_DTCM, addr & 0x3FFE, val);
+			MMU_MarkDirty(MMU.ARM9_DTCM + (addr & 0x3FFE));
 #ifdef HAVE_LUA
 			CallRegisteredLuaMemHook(addr, 2, val, LUAMEMHOOK_WRITE);
 #endif
@@ -967,9 +1032,10 @@ FORCEINLINE void _MMU_write16(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 
 	if ( (addr & 0x0F000000) == 0x02000000) {
 #ifdef HAVE_JIT
-		JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK16, 0) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK16, 0), 1);
 #endif
 		T1WriteWord( MMU.MAIN_MEM, addr & _MMU_MAIN_MEM_MASK16, val);
+		MMU_MarkDirty(MMU.MAIN_MEM + (addr & _MMU_MAIN_MEM_MASK16));
 #ifdef HAVE_LUA
 		CallRegisteredLuaMemHook(addr, 2, val, LUAMEMHOOK_WRITE);
 #endif
@@ -1011,6 +1077,7 @@ FORCEINLINE void _MMU_write32(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 		if((addr&(~0x3FFF)) == MMU.DTCMRegion)
 		{
 			T1WriteLong(MMU.ARM9_DTCM, addr & 0x3FFC, val);
+			MMU_MarkDirty(MMU.ARM9_DTCM + (addr & 0x3FFC));
 #ifdef HAVE_LUA
 			CallRegisteredLuaMemHook(addr, 4, val, LUAMEMHOOK_WRITE);
 #endif
@@ -1022,10 +1089,10 @@ FORCEINLINE void _MMU_write32(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 
 	if ( (addr & 0x0F000000) == 0x02000000) {
 #ifdef HAVE_JIT
-		JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK32, 0) = 0;
-		JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK32, 1) = 0;
+		JIT_INVALIDATE(JIT_COMPILED_FUNC_KNOWNBANK(addr, MAIN_MEM, _MMU_MAIN_MEM_MASK32, 0), 2);
 #endif
 		T1WriteLong( MMU.MAIN_MEM, addr & _MMU_MAIN_MEM_MASK32, val);
+		MMU_MarkDirty(MMU.MAIN_MEM + (addr & _MMU_MAIN_MEM_MASK32));
 #ifdef HAVE_LUA
 		CallRegisteredLuaMemHook(addr, 4, val, LUAMEMHOOK_WRITE);
 #endif
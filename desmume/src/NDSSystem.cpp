@@ -22,6 +22,9 @@
 #include <algorithm>
 #include <math.h>
 #include <zlib.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 
 #include <features/features_cpu.h>
 
@@ -57,6 +60,7 @@
 #include "emufile.h"
 #include "SPU.h"
 #include "wifi.h"
+#include "saves.h"
 #include "Database.h"
 #include "frontend/modules/Disassembler.h"
 
@@ -207,6 +211,8 @@ int NDS_Init()
 
 void NDS_DeInit(void)
 {
+	rewind_disable();
+	savestate_shutdown_workers();
 	gameInfo.closeROM();
 	SPU_DeInit();
 	
@@ -224,6 +230,8 @@ void NDS_DeInit(void)
 	delete cheatSearch;
 	cheatSearch = NULL;
 
+	NDS_ShutdownARM7Thread();
+
 #ifdef HAVE_JIT
 	arm_jit_close();
 #endif
@@ -804,6 +812,9 @@ int NDS_LoadROM(const char *filename, const char *physicalName, const char *logi
 		cheats->init(buf);
 	}
 
+	//snapshots of the previous game can't be stepped back to
+	rewind_clear();
+
 	//UnloadMovieEmulationSettings(); called in NDS_Reset()
 	NDS_Reset();
 
@@ -813,6 +824,7 @@ int NDS_LoadROM(const char *filename, const char *physicalName, const char *logi
 void NDS_FreeROM(void)
 {
 	FCEUI_StopMovie();
+	rewind_clear();
 	gameInfo.closeROM();
 	UnloadMovieEmulationSettings();
 }
@@ -938,6 +950,12 @@ u64 nds_arm9_timer, nds_arm7_timer;
 
 static const u64 kNever = 0xFFFFFFFFFFFFFFFFULL;
 
+//set to 1 to measure the sequencer's event queue against the old linear scan of every event source.
+//both are run for every lookup (and must agree); the host cycles each one spent per emulated frame
+//are printed every SEQUENCER_BENCHMARK_FRAMES frames
+#define SEQUENCER_BENCHMARK 0
+#define SEQUENCER_BENCHMARK_FRAMES 600
+
 struct TSequenceItem
 {
 	u64 timestamp;
@@ -1202,10 +1220,109 @@ struct TSequenceItem_sqrtunit : public TSequenceItem
 
 };
 
+//ids of the events kept in the sequencer's queue
+enum ESequencerEvent
+{
+	ESE_DISPCNT, ESE_WIFI, ESE_DIVIDER, ESE_SQRT, ESE_GXFIFO, ESE_READSLOT1,
+	ESE_DMA, //procnum*4+chan
+	ESE_TIMER = ESE_DMA+8, //procnum*4+num
+	ESE_COUNT = ESE_TIMER+8
+};
+
+static const u32 kAllSequencerEvents = (1<<ESE_COUNT)-1;
+
+//a binary min-heap of the enabled events, keyed on their timestamps.
+//every event remembers where it sits in the heap, so enabling, disabling or rescheduling a source
+//only moves that one entry, and the next event is always found at the top
+struct TSequenceQueue
+{
+	u64 when[ESE_COUNT];
+	u8 heap[ESE_COUNT];
+	s8 slot[ESE_COUNT]; //-1 when the event isn't queued
+	u32 count;
+
+	void clear()
+	{
+		count = 0;
+		memset(slot, -1, sizeof(slot));
+	}
+
+	FORCEINLINE u64 next() const
+	{
+		return count ? when[heap[0]] : kNever;
+	}
+
+	void set(u32 id, u64 timestamp)
+	{
+		when[id] = timestamp;
+		const s32 i = slot[id];
+		if(i < 0)
+		{
+			heap[count] = id;
+			up(count++);
+		}
+		else if(i > 0 && timestamp < when[heap[(i-1)>>1]]) up(i);
+		else down(i);
+	}
+
+	void remove(u32 id)
+	{
+		const s32 i = slot[id];
+		if(i < 0) return;
+		slot[id] = -1;
+		const u8 last = heap[--count];
+		if((u32)i == count) return;
+		heap[i] = last;
+		if(i > 0 && when[last] < when[heap[(i-1)>>1]]) up(i);
+		else down(i);
+	}
+
+	FORCEINLINE void update(u32 id, bool enabled, u64 timestamp)
+	{
+		if(enabled) set(id,timestamp);
+		else remove(id);
+	}
+
+private:
+	void up(u32 i)
+	{
+		const u8 id = heap[i];
+		while(i > 0)
+		{
+			const u32 parent = (i-1)>>1;
+			if(when[heap[parent]] <= when[id]) break;
+			heap[i] = heap[parent];
+			slot[heap[i]] = i;
+			i = parent;
+		}
+		heap[i] = id;
+		slot[id] = i;
+	}
+
+	void down(u32 i)
+	{
+		const u8 id = heap[i];
+		for(;;)
+		{
+			u32 child = i*2+1;
+			if(child >= count) break;
+			if(child+1 < count && when[heap[child+1]] < when[heap[child]]) child++;
+			if(when[id] <= when[heap[child]]) break;
+			heap[i] = heap[child];
+			slot[heap[i]] = i;
+			i = child;
+		}
+		heap[i] = id;
+		slot[id] = i;
+	}
+};
+
 struct Sequencer
 {
 	bool nds_vblankEnded;
 	bool reschedule;
+	TSequenceQueue queue;
+	u32 dirty; //events whose source may have changed since they were last queued
 	TSequenceItem dispcnt;
 	TSequenceItem wifi;
 	TSequenceItem_divider divider;
@@ -1225,6 +1342,10 @@ struct Sequencer
 
 	void execHardware();
 	u64 findNext();
+	u64 findNextScan();
+	void requeue(u32 id);
+
+	FORCEINLINE void touch(u32 id) { dirty |= 1<<id; }
 
 	void save(EMUFILE &os)
 	{
@@ -1263,6 +1384,9 @@ struct Sequencer
 		LOAD(dma,1,0); LOAD(dma,1,1); LOAD(dma,1,2); LOAD(dma,1,3); 
 #undef LOAD
 
+		//the rest of the hardware state may not be loaded yet, so requeue everything on the next lookup
+		dirty = kAllSequencerEvents;
+
 		return true;
 	}
 
@@ -1270,26 +1394,31 @@ struct Sequencer
 
 void NDS_RescheduleGXFIFO(u32 cost)
 {
+	NDS_ThreadSync sync;
 	if(!sequencer.gxfifo.enabled) {
 		MMU.gfx3dCycles = nds_timer;
 		sequencer.gxfifo.enabled = true;
 	}
 	MMU.gfx3dCycles += cost;
+	sequencer.touch(ESE_GXFIFO);
 	NDS_Reschedule();
 }
 
 void NDS_RescheduleTimers()
 {
+	NDS_ThreadSync sync;
 #define check(X,Y) sequencer.timer_##X##_##Y .schedule();
 	check(0,0); check(0,1); check(0,2); check(0,3);
 	check(1,0); check(1,1); check(1,2); check(1,3);
 #undef check
 
+	sequencer.dirty |= 0xFF<<ESE_TIMER;
 	NDS_Reschedule();
 }
 
 void NDS_RescheduleReadSlot1(int procnum, int size)
 {
+	NDS_ThreadSync sync;
 	u32 gcromctrl = T1ReadLong(MMU.MMU_MEM[procnum][0x40], 0x1A4);
 	
 	u32 clocks = (gcromctrl & (1<<27)) ? 8 : 5;
@@ -1307,15 +1436,31 @@ void NDS_RescheduleReadSlot1(int procnum, int size)
 	sequencer.readslot1.param = procnum;
 	sequencer.readslot1.timestamp = nds_timer + delay;
 	sequencer.readslot1.enabled = true;
+	sequencer.touch(ESE_READSLOT1);
 
 	NDS_Reschedule();
 }
 
 void NDS_RescheduleDMA()
 {
-	//TBD
+	NDS_ThreadSync sync;
+	//a channel's nextEvent may still be adjusted after this is called, so they're only requeued on the next lookup
+	sequencer.dirty |= 0xFF<<ESE_DMA;
 	NDS_Reschedule();
+}
+
+void NDS_RescheduleDivider()
+{
+	NDS_ThreadSync sync;
+	sequencer.touch(ESE_DIVIDER);
+	NDS_Reschedule();
+}
 
+void NDS_RescheduleSqrt()
+{
+	NDS_ThreadSync sync;
+	sequencer.touch(ESE_SQRT);
+	NDS_Reschedule();
 }
 
 static void initSchedule()
@@ -1340,6 +1485,9 @@ const u64 kWifiCycles = 67;//34*2;
 
 void Sequencer::init()
 {
+	queue.clear();
+	dirty = kAllSequencerEvents;
+
 	NDS_RescheduleTimers();
 	NDS_RescheduleDMA();
 
@@ -1641,10 +1789,17 @@ static void execHardware_hstart()
 	}
 }
 
+static void arm7ThreadStop();
+
 void NDS_Reschedule()
 {
 	IF_DEVELOPER(if(!sequencer.reschedule) DEBUG_statistics.sequencerExecutionCounters[0]++;);
 	sequencer.reschedule = true;
+	if(nds_arm7_threaded) arm7ThreadStop();
+#ifdef HAVE_JIT
+	// stop following block links so that the CPU loop notices right away
+	jit_link.budget = 0;
+#endif
 }
 
 FORCEINLINE u32 _fast_min32(u32 a, u32 b, u32 c, u32 d)
@@ -1677,7 +1832,78 @@ FORCEINLINE u64 _fast_min(u64 a, u64 b)
 
 
 
+#if SEQUENCER_BENCHMARK
+static struct
+{
+	u64 queueTicks, scanTicks;
+	u64 lookups;
+	u32 frames;
+} sequencerBenchmark;
+
+static void sequencerBenchmarkFrame()
+{
+	if(++sequencerBenchmark.frames < SEQUENCER_BENCHMARK_FRAMES) return;
+	const u32 frames = sequencerBenchmark.frames;
+	printf("sequencer: %llu lookups/frame, queue %llu cycles/frame, scan %llu cycles/frame\n",
+		(unsigned long long)(sequencerBenchmark.lookups/frames),
+		(unsigned long long)(sequencerBenchmark.queueTicks/frames),
+		(unsigned long long)(sequencerBenchmark.scanTicks/frames));
+	memset(&sequencerBenchmark, 0, sizeof(sequencerBenchmark));
+}
+#endif
+
+void Sequencer::requeue(u32 id)
+{
+	switch(id)
+	{
+	case ESE_DISPCNT: queue.set(id,dispcnt.next()); break; //always enabled
+	case ESE_WIFI: queue.update(id,wifi.enabled,wifi.next()); break;
+	case ESE_DIVIDER: queue.update(id,divider.isEnabled(),divider.next()); break;
+	case ESE_SQRT: queue.update(id,sqrtunit.isEnabled(),sqrtunit.next()); break;
+	case ESE_GXFIFO: queue.update(id,gxfifo.enabled,gxfifo.next()); break;
+	case ESE_READSLOT1: queue.update(id,readslot1.isEnabled(),readslot1.next()); break;
+#define test(X,Y) case ESE_DMA+X*4+Y: queue.update(id,dma_##X##_##Y .isEnabled(),dma_##X##_##Y .next()); break;
+	test(0,0); test(0,1); test(0,2); test(0,3);
+	test(1,0); test(1,1); test(1,2); test(1,3);
+#undef test
+#define test(X,Y) case ESE_TIMER+X*4+Y: queue.update(id,timer_##X##_##Y .enabled,timer_##X##_##Y .next()); break;
+	test(0,0); test(0,1); test(0,2); test(0,3);
+	test(1,0); test(1,1); test(1,2); test(1,3);
+#undef test
+	}
+}
+
 u64 Sequencer::findNext()
+{
+#if SEQUENCER_BENCHMARK
+	const retro_perf_tick_t start = cpu_features_get_perf_counter();
+#endif
+
+	//only the events whose sources changed need to move
+	for(u32 id=0;dirty;id++)
+	{
+		if(!(dirty & (1<<id))) continue;
+		dirty &= ~(1<<id);
+		requeue(id);
+	}
+	const u64 next = queue.next();
+
+#if SEQUENCER_BENCHMARK
+	const retro_perf_tick_t mid = cpu_features_get_perf_counter();
+	const u64 scan = findNextScan();
+	const retro_perf_tick_t end = cpu_features_get_perf_counter();
+	sequencerBenchmark.queueTicks += mid-start;
+	sequencerBenchmark.scanTicks += end-mid;
+	sequencerBenchmark.lookups++;
+	if(next != scan)
+		printf("sequencer: queue found %llu but scan found %llu\n",(unsigned long long)next,(unsigned long long)scan);
+#endif
+
+	return next;
+}
+
+//the linear scan over every event source that the queue replaced, kept to check and benchmark it against
+u64 Sequencer::findNextScan()
 {
 	//this one is always enabled so dont bother to check it
 	u64 next = dispcnt.next();
@@ -1740,6 +1966,7 @@ void Sequencer::execHardware()
 			dispcnt.param = ESI_DISPCNT_HStart;
 			break;
 		}
+		touch(ESE_DISPCNT);
 	}
 
 	if (wifiHandler->GetCurrentEmulationLevel() != WifiEmulationLevel_Off)
@@ -1748,20 +1975,21 @@ void Sequencer::execHardware()
 		{
 			wifiHandler->CommTrigger();
 			wifi.timestamp += kWifiCycles;
+			touch(ESE_WIFI);
 		}
 	}
 	
-	if(divider.isTriggered()) divider.exec();
-	if(sqrtunit.isTriggered()) sqrtunit.exec();
-	if(gxfifo.isTriggered()) gxfifo.exec();
-	if(readslot1.isTriggered()) readslot1.exec();
+	if(divider.isTriggered()) { divider.exec(); touch(ESE_DIVIDER); }
+	if(sqrtunit.isTriggered()) { sqrtunit.exec(); touch(ESE_SQRT); }
+	if(gxfifo.isTriggered()) { gxfifo.exec(); touch(ESE_GXFIFO); }
+	if(readslot1.isTriggered()) { readslot1.exec(); touch(ESE_READSLOT1); }
 
 
-#define test(X,Y) if(dma_##X##_##Y .isTriggered()) dma_##X##_##Y .exec();
+#define test(X,Y) if(dma_##X##_##Y .isTriggered()) { dma_##X##_##Y .exec(); touch(ESE_DMA+X*4+Y); }
 	test(0,0); test(0,1); test(0,2); test(0,3);
 	test(1,0); test(1,1); test(1,2); test(1,3);
 #undef test
-#define test(X,Y) if(timer_##X##_##Y .enabled) if(timer_##X##_##Y .isTriggered()) timer_##X##_##Y .exec();
+#define test(X,Y) if(timer_##X##_##Y .enabled) if(timer_##X##_##Y .isTriggered()) { timer_##X##_##Y .exec(); touch(ESE_TIMER+X*4+Y); }
 	test(0,0); test(0,1); test(0,2); test(0,3);
 	test(1,0); test(1,1); test(1,2); test(1,3);
 #undef test
@@ -1947,11 +2175,14 @@ static /*donotinline*/ std::pair<s32,s32> armInnerLoop(
 
 		if(doarm9 && (!doarm7 || arm9 <= timer))
 		{
-			if(!(NDS_ARM9.freeze & CPU_FREEZE_WAIT_IRQ) && !nds.freezeBus)
+			if(!(NDS_ARM9.freeze & (CPU_FREEZE_WAIT_IRQ|CPU_FREEZE_IDLE_LOOP)) && !nds.freezeBus)
 			{
 				arm9log();
 				debug();
 #ifdef HAVE_JIT
+				// linked blocks may keep running for as long as this loop would have kept picking the ARM9
+				if (jit)
+					arm_jit_set_link_budget(minarmtime<true,doarm7>(s32next, arm7 + 1) - arm9);
 				arm9 += armcpu_exec<ARMCPU_ARM9,jit>();
 #else
 				arm9 += armcpu_exec<ARMCPU_ARM9>();
@@ -1988,11 +2219,13 @@ static /*donotinline*/ std::pair<s32,s32> armInnerLoop(
 		}
 		if(doarm7 && (!doarm9 || arm7 <= timer))
 		{
-			bool cpufreeze = !!(NDS_ARM7.freeze & (CPU_FREEZE_WAIT_IRQ|CPU_FREEZE_OVERCLOCK_HACK));
+			bool cpufreeze = !!(NDS_ARM7.freeze & (CPU_FREEZE_WAIT_IRQ|CPU_FREEZE_OVERCLOCK_HACK|CPU_FREEZE_IDLE_LOOP));
 			if(!cpufreeze && !nds.freezeBus)
 			{
 				arm7log();
 #ifdef HAVE_JIT
+				if (jit)
+					arm_jit_set_link_budget((minarmtime<true,doarm9>(s32next, arm9 + 1) - arm7 + 1) >> 1);
 				arm7 += (armcpu_exec<ARMCPU_ARM7,jit>()<<1);
 #else
 				arm7 += (armcpu_exec<ARMCPU_ARM7>()<<1);
@@ -2042,6 +2275,252 @@ static /*donotinline*/ std::pair<s32,s32> armInnerLoop(
 	return std::make_pair(arm9, arm7);
 }
 
+//the ARM7 on its own host thread (CommonSettings.arm7_thread).
+//the ARM7 runs each work unit on the worker thread while the ARM9 runs it here. each core publishes
+//how far it has got through an atomic, and may run at most arm7_thread_skew cycles past the other,
+//so the cores only wait for each other when one of them gets that far ahead.
+//state that both cores touch (IPC sync and fifo, WRAMCNT, IF and the sequencer) is only changed
+//under NDS_ThreadSync, and any such change calls NDS_Reschedule, which ends the unit for both
+//cores so that interrupts and hardware events are handled by the main loop before either goes on.
+//state that the ARM7 reads without locking (the WRAM and VRAM maps) is only changed after
+//NDS_ThreadSyncHalt has waited for it to leave the unit.
+//within a unit, the order in which the cores see each other's writes depends on host timing,
+//so runs are not deterministic in this mode and movies may not replay the same way.
+//the jit isn't thread safe, so this is only used with the interpreter.
+bool nds_arm7_threaded = false;
+
+static std::recursive_mutex arm7ThreadLock;
+static Task arm7Thread;
+static bool arm7ThreadStarted = false; //the worker thread exists
+static bool arm7ThreadBusy = false; //the worker is running arm7ThreadProc, which lasts until the end of the frame
+
+static struct
+{
+	std::atomic<u32> go; //bumped to hand the worker a work unit
+	std::atomic<u32> done; //set to go once the worker has finished that unit
+	std::atomic<bool> stop; //ends the current unit for both cores
+	std::atomic<s32> arm9, arm7; //how far each core has got in the unit, which is the other's budget
+	bool exit; //the unit handed over with go is actually the end of the frame
+	s32 horizon, skew;
+} arm7Slice;
+
+//a core that runs out of budget spins for a while, since the other one is running and usually
+//catches up within microseconds. only then does it sleep on this, and the other core only takes
+//the lock to wake it when somebody is actually asleep.
+static std::mutex arm7SliceMutex;
+static std::condition_variable arm7SliceCond;
+static std::atomic<u32> arm7SliceSleepers(0);
+
+void NDS_ThreadSyncLock() { arm7ThreadLock.lock(); }
+void NDS_ThreadSyncUnlock() { arm7ThreadLock.unlock(); }
+
+static void arm7ThreadWake()
+{
+	if(arm7SliceSleepers.load() == 0) return;
+	{
+		std::lock_guard<std::mutex> lock(arm7SliceMutex);
+	}
+	arm7SliceCond.notify_all();
+}
+
+static void arm7ThreadStop()
+{
+	arm7Slice.stop.store(true);
+	arm7ThreadWake();
+}
+
+static FORCEINLINE bool arm7ThreadStopped()
+{
+	return arm7Slice.stop.load(std::memory_order_relaxed);
+}
+
+template<typename READY>
+static void arm7ThreadWait(READY ready)
+{
+	for(u32 spins = 0; spins < 4096; spins++)
+	{
+		if(ready()) return;
+#ifdef ENABLE_SSE2
+		_mm_pause();
+#endif
+	}
+
+	std::unique_lock<std::mutex> lock(arm7SliceMutex);
+	arm7SliceSleepers.fetch_add(1);
+	while(!ready())
+		arm7SliceCond.wait(lock);
+	arm7SliceSleepers.fetch_sub(1);
+}
+
+static u32 arm7ThreadWaitChange(const std::atomic<u32> &seq, u32 value)
+{
+	arm7ThreadWait([&]() { return seq.load() != value; });
+	return seq.load();
+}
+
+static void arm7ThreadSignal(std::atomic<u32> &seq, u32 value)
+{
+	seq.store(value);
+	arm7ThreadWake();
+}
+
+void NDS_ThreadSyncHalt()
+{
+	if(!nds_arm7_threaded) return;
+	arm7ThreadStop();
+	arm7ThreadWaitChange(arm7Slice.done, arm7Slice.go.load(std::memory_order_relaxed) - 1);
+	nds_arm7_threaded = false;
+}
+
+static s32 arm9ExecSlice(s32 arm9, const s32 horizon)
+{
+	while(arm9 < horizon && !arm7ThreadStopped())
+	{
+		if(!(NDS_ARM9.freeze & (CPU_FREEZE_WAIT_IRQ|CPU_FREEZE_IDLE_LOOP)) && !nds.freezeBus)
+		{
+			arm9log();
+			debug();
+#ifdef HAVE_JIT
+			arm9 += armcpu_exec<ARMCPU_ARM9,false>();
+#else
+			arm9 += armcpu_exec<ARMCPU_ARM9>();
+#endif
+		}
+		else
+		{
+			s32 temp = arm9;
+			arm9 = min(horizon, arm9 + kIrqWait);
+			nds.idleCycles[0] += arm9-temp;
+			if (gxFIFO.size < 255) nds.freezeBus &= ~1;
+		}
+	}
+	return arm9;
+}
+
+static s32 arm7ExecSlice(s32 arm7, const s32 horizon)
+{
+	while(arm7 < horizon && !arm7ThreadStopped())
+	{
+		if(!(NDS_ARM7.freeze & (CPU_FREEZE_WAIT_IRQ|CPU_FREEZE_OVERCLOCK_HACK|CPU_FREEZE_IDLE_LOOP)) && !nds.freezeBus)
+		{
+			arm7log();
+#ifdef HAVE_JIT
+			arm7 += (armcpu_exec<ARMCPU_ARM7,false>()<<1);
+#else
+			arm7 += (armcpu_exec<ARMCPU_ARM7>()<<1);
+#endif
+		}
+		else
+		{
+			s32 temp = arm7;
+			arm7 = min(horizon, arm7 + kIrqWait);
+			nds.idleCycles[1] += arm7-temp;
+		}
+	}
+	return arm7;
+}
+
+//runs one core to the end of the unit, never more than the skew ahead of the other. progress is
+//published every quarter of the skew, so the other core's budget grows while this one runs and
+//neither has to stop and hand over at fixed slice boundaries.
+template<typename EXEC>
+static s32 armThreadedRun(EXEC exec, s32 mine, std::atomic<s32> &published, const std::atomic<s32> &other)
+{
+	const s32 horizon = arm7Slice.horizon;
+	const s32 skew = arm7Slice.skew;
+	const s32 step = max<s32>(skew >> 2, 1);
+	while(mine < horizon && !arm7ThreadStopped())
+	{
+		const s32 budget = min(horizon, other.load(std::memory_order_acquire) + skew);
+		if(mine >= budget)
+		{
+			arm7ThreadWait([&]() { return arm7ThreadStopped() || other.load() + skew > mine; });
+			continue;
+		}
+		mine = exec(mine, min(budget, mine + step));
+		published.store(mine);
+		arm7ThreadWake();
+	}
+	return mine;
+}
+
+static void* arm7ThreadProc(void *)
+{
+	u32 seen = arm7Slice.done.load(std::memory_order_relaxed);
+	for(;;)
+	{
+		seen = arm7ThreadWaitChange(arm7Slice.go, seen);
+		if(arm7Slice.exit) break;
+		armThreadedRun(arm7ExecSlice, arm7Slice.arm7.load(std::memory_order_relaxed), arm7Slice.arm7, arm7Slice.arm9);
+		arm7ThreadSignal(arm7Slice.done, seen);
+	}
+	arm7ThreadSignal(arm7Slice.done, seen);
+	return NULL;
+}
+
+//hands the worker a work unit, and returns its sequence number
+static u32 arm7ThreadPost(bool exit)
+{
+	arm7Slice.exit = exit;
+	const u32 seq = arm7Slice.go.load(std::memory_order_relaxed) + 1;
+	arm7ThreadSignal(arm7Slice.go, seq);
+	return seq;
+}
+
+//lets the worker go back to sleep at the end of the frame
+static void arm7ThreadFinishFrame()
+{
+	if(!arm7ThreadBusy) return;
+	arm7ThreadPost(true);
+	arm7Thread.finish();
+	arm7ThreadBusy = false;
+}
+
+void NDS_ShutdownARM7Thread()
+{
+	arm7ThreadFinishFrame();
+	if(!arm7ThreadStarted) return;
+	arm7Thread.shutdown();
+	arm7ThreadStarted = false;
+}
+
+static std::pair<s32,s32> armThreadedLoop(
+	const u64 nds_timer_base, const s32 s32next, s32 arm9, s32 arm7)
+{
+	if(!arm7ThreadStarted)
+	{
+		arm7Thread.start(false, 0, "arm7 core");
+		arm7ThreadStarted = true;
+	}
+	if(!arm7ThreadBusy)
+	{
+		arm7Slice.done.store(arm7Slice.go.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		arm7Thread.execute(arm7ThreadProc, NULL);
+		arm7ThreadBusy = true;
+	}
+
+	if(min(arm9,arm7) < s32next && !sequencer.reschedule && execute)
+	{
+		arm7Slice.horizon = s32next;
+		arm7Slice.skew = max<s32>(CommonSettings.arm7_thread_skew, 16);
+		arm7Slice.arm9.store(arm9, std::memory_order_relaxed);
+		arm7Slice.arm7.store(arm7, std::memory_order_relaxed);
+		arm7Slice.stop.store(false, std::memory_order_relaxed);
+		nds_arm7_threaded = true;
+		const u32 seq = arm7ThreadPost(false);
+
+		arm9 = armThreadedRun(arm9ExecSlice, arm9, arm7Slice.arm9, arm7Slice.arm7);
+
+		arm7ThreadWaitChange(arm7Slice.done, seq - 1);
+		nds_arm7_threaded = false;
+		arm7 = arm7Slice.arm7.load(std::memory_order_relaxed);
+
+		nds_timer = nds_timer_base + min(arm9,arm7);
+	}
+
+	return std::make_pair(arm9, arm7);
+}
+
 void NDS_debug_break()
 {
 	NDS_ARM9.stalled = NDS_ARM7.stalled = 1;
@@ -2144,11 +2623,20 @@ void NDS_exec(s32 nb)
 			#endif
 
 #ifdef HAVE_JIT
-			std::pair<s32,s32> arm9arm7 = CommonSettings.use_jit
-				? armInnerLoop<true,true,true>(nds_timer_base,s32next,arm9,arm7)
-				: armInnerLoop<true,true,false>(nds_timer_base,s32next,arm9,arm7);
+			if(CommonSettings.use_jit)
+				arm_jit_check_hooks();
+#endif
+
+			std::pair<s32,s32> arm9arm7;
+			if(CommonSettings.arm7_thread && !CommonSettings.use_jit)
+				arm9arm7 = armThreadedLoop(nds_timer_base,s32next,arm9,arm7);
+			else
+#ifdef HAVE_JIT
+				arm9arm7 = CommonSettings.use_jit
+					? armInnerLoop<true,true,true>(nds_timer_base,s32next,arm9,arm7)
+					: armInnerLoop<true,true,false>(nds_timer_base,s32next,arm9,arm7);
 #else
-				std::pair<s32,s32> arm9arm7 = armInnerLoop<true,true>(nds_timer_base,s32next,arm9,arm7);
+				arm9arm7 = armInnerLoop<true,true>(nds_timer_base,s32next,arm9,arm7);
 #endif
 
 			#ifdef DEVELOPER
@@ -2171,19 +2659,24 @@ void NDS_exec(s32 nb)
 
 			//if we were waiting for an irq, don't wait too long:
 			//let's re-analyze it after this hardware event (this rolls back a big burst of irq waiting which may have been interrupted by a resynch)
-			if(NDS_ARM9.freeze & CPU_FREEZE_WAIT_IRQ)
+			//the same goes for idle loops, which go back to polling in case the event changed what they're waiting on
+			if(NDS_ARM9.freeze & (CPU_FREEZE_WAIT_IRQ|CPU_FREEZE_IDLE_LOOP))
 			{
+				NDS_ARM9.freeze &= ~CPU_FREEZE_IDLE_LOOP;
 				nds.idleCycles[0] -= (s32)(nds_arm9_timer-nds_timer);
 				nds_arm9_timer = nds_timer;
 			}
-			if(NDS_ARM7.freeze & CPU_FREEZE_WAIT_IRQ)
+			if(NDS_ARM7.freeze & (CPU_FREEZE_WAIT_IRQ|CPU_FREEZE_IDLE_LOOP))
 			{
+				NDS_ARM7.freeze &= ~CPU_FREEZE_IDLE_LOOP;
 				nds.idleCycles[1] -= (s32)(nds_arm7_timer-nds_timer);
 				nds_arm7_timer = nds_timer;
 			}
 		}
 	}
 
+	arm7ThreadFinishFrame();
+
 	//DEBUG_statistics.printSequencerExecutionCounters();
 	//DEBUG_statistics.print();
 
@@ -2200,12 +2693,18 @@ void NDS_exec(s32 nb)
 	}
 	currFrameCounter++;
 	DEBUG_Notify.NextFrame();
+#if SEQUENCER_BENCHMARK
+	sequencerBenchmarkFrame();
+#endif
 	if (cheats != NULL)
 	{
 		cheats->process(CHEAT_TYPE_INTERNAL);
 		CHEATS::ResetJitIfNeeded();
 	}
 
+	rewind_frame();
+	MMU_new.backupDevice.frameEnd();
+
 	GDBSTUB_MUTEX_UNLOCK();
 }
 
@@ -198,6 +198,24 @@ void NDS_RescheduleGXFIFO(u32 cost);
 void NDS_RescheduleDMA();
 void NDS_RescheduleReadSlot1(int procnum, int size);
 void NDS_RescheduleTimers();
+void NDS_RescheduleDivider();
+void NDS_RescheduleSqrt();
+
+//true while the ARM7 is running concurrently on its own host thread (see CommonSettings.arm7_thread).
+//state that both cores can touch must then be changed under an NDS_ThreadSync
+extern bool nds_arm7_threaded;
+void NDS_ThreadSyncLock();
+void NDS_ThreadSyncUnlock();
+//ends the work unit and waits for the ARM7 to leave it, before changing state it reads without locking
+void NDS_ThreadSyncHalt();
+void NDS_ShutdownARM7Thread();
+
+struct NDS_ThreadSync
+{
+	const bool locked;
+	NDS_ThreadSync() : locked(nds_arm7_threaded) { if(locked) NDS_ThreadSyncLock(); }
+	~NDS_ThreadSync() { if(locked) NDS_ThreadSyncUnlock(); }
+};
 
 enum ENSATA_HANDSHAKE
 {
@@ -513,6 +531,11 @@ extern struct TCommonSettings
 		, OpenGL_Emulation_NDSDepthCalculation(true)
 		, OpenGL_Emulation_DepthLEqualPolygonFacing(false)
 		, jit_max_block_size(12)
+		, jit_fastmem(false)
+		, arm7_thread(false)
+		, arm7_thread_skew(2000)
+		, idle_loop_skip(false)
+		, savestate_codec(SavestateCodec_Zlib)
 		, loadToMemory(false)
 		, UseExtBIOS(false)
 		, SWIFromBIOS(false)
@@ -627,6 +650,19 @@ extern struct TCommonSettings
 
 	bool use_jit;
 	u32	jit_max_block_size;
+	bool jit_fastmem; // compiled loads and stores access RAM directly where the host supports it
+
+	bool arm7_thread; // run the ARM7 on its own host thread (interpreter only). not deterministic, so movies may desync
+	s32 arm7_thread_skew; // how many cycles either core may run ahead of the other while threaded
+
+	bool idle_loop_skip; // freeze a cpu spinning in a polling loop until the next hardware event (reset the jit after changing it)
+
+	enum SavestateCodec
+	{
+		SavestateCodec_Zlib        = 0, // one zlib stream, the format older versions read
+		SavestateCodec_ZlibChunked = 1, // zlib blocks compressed on num_cores threads
+		SavestateCodec_Fast        = 2  // LZ blocks compressed on num_cores threads; bigger files, far less time
+	} savestate_codec; // used for compressed savestates; uncompressed ones always use the plain format. the block codecs are opt-in, since older versions can't load them
 	
 	int WifiBridgeDeviceID;
 
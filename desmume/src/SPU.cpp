@@ -31,6 +31,7 @@
 #include <queue>
 #include <vector>
 
+#include "common.h"
 #include "debug.h"
 #include "driver.h"
 #include "MMU.h"
@@ -70,6 +71,7 @@ SPU_struct *SPU_core = 0;
 SPU_struct *SPU_user = 0;
 int SPU_currentCoreNum = SNDCORE_DUMMY;
 static int _currentVolume = 100;
+static bool _blockMixEnabled = true;
 
 
 static size_t _currentBufferSize = 0;
@@ -268,6 +270,11 @@ void SPU_CloneUser()
 }
 
 
+void SPU_SetBlockMixing(bool enable)
+{
+	_blockMixEnabled = enable;
+}
+
 void SPU_SetSynchMode(int mode, int method)
 {
 	_currentSynchMode = (ESynchMode)mode;
@@ -1088,6 +1095,90 @@ template<SPUInterpolationMode INTERPOLATE_MODE> static FORCEINLINE s32 Interpola
 	}
 }
 
+// Channels are rendered in blocks of up to SPU_MIXBLOCK_SAMPLES output samples.
+// Stepping through the sample data is serial by nature (looping, ADPCM state,
+// PSG noise), so that part stays scalar and only records the history taps and
+// interpolation weights of each output sample. Interpolation, volume and panning
+// then run over the whole block at once.
+#define SPU_MIXBLOCK_SAMPLES 64
+
+struct SPUMixBlock
+{
+	s32 tap[4][SPU_MIXBLOCK_SAMPLES]; // tap[3] is the newest sample, tap[0] the oldest
+	s32 weight[4][SPU_MIXBLOCK_SAMPLES];
+	s32 data[SPU_MIXBLOCK_SAMPLES]; // interpolated samples, before volume and panning
+};
+
+template<SPUInterpolationMode INTERPOLATE_MODE> static FORCEINLINE void RecordTaps(SPUMixBlock &block, size_t i, const s16 *pcm16b, u8 pcm16bOffs, u32 subPos)
+{
+	switch (INTERPOLATE_MODE)
+	{
+		case SPUInterpolation_CatmullRom:
+		{
+			const u16 *w = catmullrom_lut[subPos >> (32 - CATMULLROM_INTERPOLATION_RESOLUTION_BITS)];
+			block.tap[0][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs - 3)];
+			block.tap[1][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs - 2)];
+			block.tap[2][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs - 1)];
+			block.tap[3][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs - 0)];
+			block.weight[0][i] = (s32)w[0];
+			block.weight[1][i] = (s32)w[1];
+			block.weight[2][i] = (s32)w[2];
+			block.weight[3][i] = (s32)w[3];
+			break;
+		}
+
+		case SPUInterpolation_Cosine:
+			block.tap[2][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs - 1)];
+			block.tap[3][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs - 0)];
+			block.weight[0][i] = (s32)cos_lut[subPos >> (32 - COSINE_INTERPOLATION_RESOLUTION_BITS)];
+			break;
+
+		case SPUInterpolation_Linear:
+			block.tap[2][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs - 1)];
+			block.tap[3][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs - 0)];
+			block.weight[0][i] = subPos >> (32 - 16);
+			break;
+
+		default:
+			block.tap[3][i] = pcm16b[SPUCHAN_PCM16B_AT(pcm16bOffs)];
+			break;
+	}
+}
+
+// Same math as Interpolate<>, over the taps that RecordTaps<> stored.
+template<SPUInterpolationMode INTERPOLATE_MODE> static void InterpolateBlock(SPUMixBlock &block, size_t i, size_t length)
+{
+	switch (INTERPOLATE_MODE)
+	{
+		case SPUInterpolation_CatmullRom:
+			for (; i < length; i++)
+			{
+				const s32 a = block.tap[0][i];
+				const s32 b = block.tap[1][i];
+				const s32 c = block.tap[2][i];
+				const s32 d = block.tap[3][i];
+				block.data[i] = (-a*block.weight[0][i] + b*block.weight[1][i] + c*block.weight[2][i] - d*block.weight[3][i]) >> 15;
+			}
+			break;
+
+		case SPUInterpolation_Cosine:
+		case SPUInterpolation_Linear:
+			// These only differ in how the ratio is looked up, which RecordTaps<> already did.
+			for (; i < length; i++)
+			{
+				const s32 a = block.tap[2][i];
+				const s32 b = block.tap[3][i];
+				block.data[i] = a + ((b - a)*block.weight[0][i] >> 16);
+			}
+			break;
+
+		default:
+			for (; i < length; i++)
+				block.data[i] = block.tap[3][i];
+			break;
+	}
+}
+
 static FORCEINLINE s32 Fetch8BitData(channel_struct *chan, s32 pos)
 {
 	if(pos < 0) return 0;
@@ -1168,6 +1259,234 @@ static FORCEINLINE void MixLR(SPU_struct* SPU, channel_struct *chan, s32 data)
 	SPU->sndbuf[(SPU->bufpos<<1)+1] += spumuldiv7(data, chan->pan);
 }
 
+// Same math as SPU_Mix<>. CHANNELS is 0 for the left output only, 1 for both and 2 for the right only.
+template<int CHANNELS> static void PanBlock(s32 *sndbuf, const s32 *data, size_t i, size_t length, u8 vol, u8 volumeDiv, u8 pan)
+{
+	for (; i < length; i++)
+	{
+		const s32 sample = spumuldiv7(data[i], vol) >> volume_shift[volumeDiv];
+
+		switch (CHANNELS)
+		{
+			case 0: sndbuf[i<<1] += sample; break;
+			case 1:
+				sndbuf[i<<1] += spumuldiv7(sample, 127 - pan);
+				sndbuf[(i<<1)+1] += spumuldiv7(sample, pan);
+				break;
+			case 2: sndbuf[(i<<1)+1] += sample; break;
+			default: break;
+		}
+	}
+}
+
+// The SIMD versions use the same wrapping 32-bit integer math as the scalar ones,
+// so their output is bit-identical. Whatever is left past the last full vector is
+// handed to the scalar versions.
+
+#if defined(ENABLE_AVX2) || defined(ENABLE_SIMD_DISPATCH)
+SIMD_TARGET_BEGIN_AVX2
+
+static FORCEINLINE v256s32 MulDiv7_AVX2(const v256s32 &val, const u8 multiplier)
+{
+	return (multiplier == 127) ? val : _mm256_srai_epi32( _mm256_mullo_epi32(val, _mm256_set1_epi32(multiplier)), 7 );
+}
+
+template<SPUInterpolationMode INTERPOLATE_MODE> static void InterpolateBlock_AVX2(SPUMixBlock &block, size_t length)
+{
+	const size_t vecLength = length - (length % (sizeof(v256s32)/sizeof(s32)));
+	size_t i = 0;
+
+	switch (INTERPOLATE_MODE)
+	{
+		case SPUInterpolation_CatmullRom:
+			for (; i < vecLength; i+=(sizeof(v256s32)/sizeof(s32)))
+			{
+				v256s32 sum =      _mm256_mullo_epi32( _mm256_loadu_si256((v256s32 *)(block.tap[1] + i)), _mm256_loadu_si256((v256s32 *)(block.weight[1] + i)) );
+				sum = _mm256_sub_epi32( sum, _mm256_mullo_epi32(_mm256_loadu_si256((v256s32 *)(block.tap[0] + i)), _mm256_loadu_si256((v256s32 *)(block.weight[0] + i))) );
+				sum = _mm256_add_epi32( sum, _mm256_mullo_epi32(_mm256_loadu_si256((v256s32 *)(block.tap[2] + i)), _mm256_loadu_si256((v256s32 *)(block.weight[2] + i))) );
+				sum = _mm256_sub_epi32( sum, _mm256_mullo_epi32(_mm256_loadu_si256((v256s32 *)(block.tap[3] + i)), _mm256_loadu_si256((v256s32 *)(block.weight[3] + i))) );
+				_mm256_storeu_si256( (v256s32 *)(block.data + i), _mm256_srai_epi32(sum, 15) );
+			}
+			break;
+
+		case SPUInterpolation_Cosine:
+		case SPUInterpolation_Linear:
+			for (; i < vecLength; i+=(sizeof(v256s32)/sizeof(s32)))
+			{
+				const v256s32 a = _mm256_loadu_si256((v256s32 *)(block.tap[2] + i));
+				const v256s32 b = _mm256_loadu_si256((v256s32 *)(block.tap[3] + i));
+				const v256s32 w = _mm256_loadu_si256((v256s32 *)(block.weight[0] + i));
+				_mm256_storeu_si256( (v256s32 *)(block.data + i), _mm256_add_epi32(a, _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(b, a), w), 16)) );
+			}
+			break;
+
+		default:
+			for (; i < vecLength; i+=(sizeof(v256s32)/sizeof(s32)))
+				_mm256_storeu_si256( (v256s32 *)(block.data + i), _mm256_loadu_si256((v256s32 *)(block.tap[3] + i)) );
+			break;
+	}
+
+	InterpolateBlock<INTERPOLATE_MODE>(block, i, length);
+}
+
+template<int CHANNELS> static void PanBlock_AVX2(s32 *sndbuf, const s32 *data, size_t length, u8 vol, u8 volumeDiv, u8 pan)
+{
+	const size_t vecLength = length - (length % (sizeof(v256s32)/sizeof(s32)));
+	const v128s32 shift = _mm_cvtsi32_si128(volume_shift[volumeDiv]);
+	size_t i = 0;
+
+	for (; i < vecLength; i+=(sizeof(v256s32)/sizeof(s32)))
+	{
+		const v256s32 sample = _mm256_sra_epi32( MulDiv7_AVX2(_mm256_loadu_si256((v256s32 *)(data + i)), vol), shift );
+		v256s32 l = _mm256_setzero_si256();
+		v256s32 r = _mm256_setzero_si256();
+
+		switch (CHANNELS)
+		{
+			case 0: l = sample; break;
+			case 1:
+				l = MulDiv7_AVX2(sample, 127 - pan);
+				r = MulDiv7_AVX2(sample, pan);
+				break;
+			case 2: r = sample; break;
+			default: break;
+		}
+
+		// unpack works within each 128-bit lane, so put the halves back in sample order.
+		const v256s32 lo = _mm256_unpacklo_epi32(l, r);
+		const v256s32 hi = _mm256_unpackhi_epi32(l, r);
+		v256s32 *out = (v256s32 *)(sndbuf + (i<<1));
+		_mm256_storeu_si256( out + 0, _mm256_add_epi32(_mm256_loadu_si256(out + 0), _mm256_permute2x128_si256(lo, hi, 0x20)) );
+		_mm256_storeu_si256( out + 1, _mm256_add_epi32(_mm256_loadu_si256(out + 1), _mm256_permute2x128_si256(lo, hi, 0x31)) );
+	}
+
+	PanBlock<CHANNELS>(sndbuf, data, i, length, vol, volumeDiv, pan);
+}
+
+SIMD_TARGET_END
+#endif
+
+#if defined(ENABLE_SSE2) && !defined(ENABLE_AVX2)
+
+static FORCEINLINE v128s32 MulLo32_SSE2(const v128s32 &a, const v128s32 &b)
+{
+#ifdef ENABLE_SSE4_1
+	return _mm_mullo_epi32(a, b);
+#else
+	// SSE2 has no 32-bit multiply that keeps the low half, so multiply the even and odd
+	// lanes separately. The low 32 bits are the same as those of a signed multiply.
+	const v128s32 even = _mm_mul_epu32(a, b);
+	const v128s32 odd = _mm_mul_epu32( _mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32) );
+	return _mm_unpacklo_epi32( _mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)) );
+#endif
+}
+
+static FORCEINLINE v128s32 MulDiv7_SSE2(const v128s32 &val, const u8 multiplier)
+{
+	return (multiplier == 127) ? val : _mm_srai_epi32( MulLo32_SSE2(val, _mm_set1_epi32(multiplier)), 7 );
+}
+
+template<SPUInterpolationMode INTERPOLATE_MODE> static void InterpolateBlock_SSE2(SPUMixBlock &block, size_t length)
+{
+	const size_t vecLength = length - (length % (sizeof(v128s32)/sizeof(s32)));
+	size_t i = 0;
+
+	switch (INTERPOLATE_MODE)
+	{
+		case SPUInterpolation_CatmullRom:
+			for (; i < vecLength; i+=(sizeof(v128s32)/sizeof(s32)))
+			{
+				v128s32 sum =      MulLo32_SSE2( _mm_loadu_si128((v128s32 *)(block.tap[1] + i)), _mm_loadu_si128((v128s32 *)(block.weight[1] + i)) );
+				sum = _mm_sub_epi32( sum, MulLo32_SSE2(_mm_loadu_si128((v128s32 *)(block.tap[0] + i)), _mm_loadu_si128((v128s32 *)(block.weight[0] + i))) );
+				sum = _mm_add_epi32( sum, MulLo32_SSE2(_mm_loadu_si128((v128s32 *)(block.tap[2] + i)), _mm_loadu_si128((v128s32 *)(block.weight[2] + i))) );
+				sum = _mm_sub_epi32( sum, MulLo32_SSE2(_mm_loadu_si128((v128s32 *)(block.tap[3] + i)), _mm_loadu_si128((v128s32 *)(block.weight[3] + i))) );
+				_mm_storeu_si128( (v128s32 *)(block.data + i), _mm_srai_epi32(sum, 15) );
+			}
+			break;
+
+		case SPUInterpolation_Cosine:
+		case SPUInterpolation_Linear:
+			for (; i < vecLength; i+=(sizeof(v128s32)/sizeof(s32)))
+			{
+				const v128s32 a = _mm_loadu_si128((v128s32 *)(block.tap[2] + i));
+				const v128s32 b = _mm_loadu_si128((v128s32 *)(block.tap[3] + i));
+				const v128s32 w = _mm_loadu_si128((v128s32 *)(block.weight[0] + i));
+				_mm_storeu_si128( (v128s32 *)(block.data + i), _mm_add_epi32(a, _mm_srai_epi32(MulLo32_SSE2(_mm_sub_epi32(b, a), w), 16)) );
+			}
+			break;
+
+		default:
+			for (; i < vecLength; i+=(sizeof(v128s32)/sizeof(s32)))
+				_mm_storeu_si128( (v128s32 *)(block.data + i), _mm_loadu_si128((v128s32 *)(block.tap[3] + i)) );
+			break;
+	}
+
+	InterpolateBlock<INTERPOLATE_MODE>(block, i, length);
+}
+
+template<int CHANNELS> static void PanBlock_SSE2(s32 *sndbuf, const s32 *data, size_t length, u8 vol, u8 volumeDiv, u8 pan)
+{
+	const size_t vecLength = length - (length % (sizeof(v128s32)/sizeof(s32)));
+	const v128s32 shift = _mm_cvtsi32_si128(volume_shift[volumeDiv]);
+	size_t i = 0;
+
+	for (; i < vecLength; i+=(sizeof(v128s32)/sizeof(s32)))
+	{
+		const v128s32 sample = _mm_sra_epi32( MulDiv7_SSE2(_mm_loadu_si128((v128s32 *)(data + i)), vol), shift );
+		v128s32 l = _mm_setzero_si128();
+		v128s32 r = _mm_setzero_si128();
+
+		switch (CHANNELS)
+		{
+			case 0: l = sample; break;
+			case 1:
+				l = MulDiv7_SSE2(sample, 127 - pan);
+				r = MulDiv7_SSE2(sample, pan);
+				break;
+			case 2: r = sample; break;
+			default: break;
+		}
+
+		v128s32 *out = (v128s32 *)(sndbuf + (i<<1));
+		_mm_storeu_si128( out + 0, _mm_add_epi32(_mm_loadu_si128(out + 0), _mm_unpacklo_epi32(l, r)) );
+		_mm_storeu_si128( out + 1, _mm_add_epi32(_mm_loadu_si128(out + 1), _mm_unpackhi_epi32(l, r)) );
+	}
+
+	PanBlock<CHANNELS>(sndbuf, data, i, length, vol, volumeDiv, pan);
+}
+
+#endif
+
+// Interpolates the block recorded for <chan> and mixes it into sndbuf at bufpos.
+template<SPUInterpolationMode INTERPOLATE_MODE, int CHANNELS> static void MixBlock(SPU_struct *SPU, channel_struct *chan, SPUMixBlock &block, size_t length)
+{
+	s32 *sndbuf = SPU->sndbuf + (SPU->bufpos<<1);
+
+#if defined(ENABLE_AVX2)
+	InterpolateBlock_AVX2<INTERPOLATE_MODE>(block, length);
+	PanBlock_AVX2<CHANNELS>(sndbuf, block.data, length, chan->vol, chan->volumeDiv, chan->pan);
+#elif defined(ENABLE_SIMD_DISPATCH)
+	if (CPU_GetSIMDLevel() >= CPUSIMDLevel_AVX2)
+	{
+		InterpolateBlock_AVX2<INTERPOLATE_MODE>(block, length);
+		PanBlock_AVX2<CHANNELS>(sndbuf, block.data, length, chan->vol, chan->volumeDiv, chan->pan);
+	}
+	else
+	{
+		InterpolateBlock_SSE2<INTERPOLATE_MODE>(block, length);
+		PanBlock_SSE2<CHANNELS>(sndbuf, block.data, length, chan->vol, chan->volumeDiv, chan->pan);
+	}
+#elif defined(ENABLE_SSE2)
+	InterpolateBlock_SSE2<INTERPOLATE_MODE>(block, length);
+	PanBlock_SSE2<CHANNELS>(sndbuf, block.data, length, chan->vol, chan->volumeDiv, chan->pan);
+#else
+	InterpolateBlock<INTERPOLATE_MODE>(block, 0, length);
+	PanBlock<CHANNELS>(sndbuf, block.data, 0, length, chan->vol, chan->volumeDiv, chan->pan);
+#endif
+
+	SPU->lastdata = block.data[length - 1];
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 template<int FORMAT> static FORCEINLINE void TestForLoop(SPU_struct *SPU, channel_struct *chan)
@@ -1221,85 +1540,217 @@ template<int CHANNELS> FORCEINLINE static void SPU_Mix(SPU_struct* SPU, channel_
 	SPU->lastdata = data;
 }
 
-//WORK
-template<int FORMAT, SPUInterpolationMode INTERPOLATE_MODE, int CHANNELS> 
-	FORCEINLINE static void ____SPU_ChanUpdate(SPU_struct* const SPU, channel_struct* const chan)
+template<int FORMAT> FORCEINLINE static void StepChannel(SPU_struct* const SPU, channel_struct* const chan)
 {
-	for (; SPU->bufpos < SPU->buflength; SPU->bufpos++)
+	// Advance sampcnt one sample at a time. This is
+	// needed to keep pcm16b[] filled for interpolation.
+	u32 nSamplesToSkip = chan->sampincInt + AddAndReturnCarry(&chan->sampcntFrac, chan->sampincFrac);
+	while(nSamplesToSkip--)
 	{
-		// Advance sampcnt one sample at a time. This is
-		// needed to keep pcm16b[] filled for interpolation.
-		u32 nSamplesToSkip = chan->sampincInt + AddAndReturnCarry(&chan->sampcntFrac, chan->sampincFrac);
-		while(nSamplesToSkip--)
+		s16 data = 0;
+		s32 pos = chan->sampcntInt;
+		if(chan->status != CHANSTAT_STOPPED)
 		{
-			s16 data = 0;
-			s32 pos = chan->sampcntInt;
-			if(chan->status != CHANSTAT_STOPPED)
+			switch(FORMAT)
 			{
-				switch(FORMAT)
-				{
-					case 0: data = Fetch8BitData (chan, pos); break;
-					case 1: data = Fetch16BitData(chan, pos); break;
-					case 2: data = FetchADPCMData(chan, pos); break;
-					case 3: data = FetchPSGData  (chan, pos); break;
-					default: break;
-				}
+				case 0: data = Fetch8BitData (chan, pos); break;
+				case 1: data = Fetch16BitData(chan, pos); break;
+				case 2: data = FetchADPCMData(chan, pos); break;
+				case 3: data = FetchPSGData  (chan, pos); break;
+				default: break;
 			}
-			chan->pcm16bOffs++;
-			chan->pcm16b[SPUCHAN_PCM16B_AT(chan->pcm16bOffs)] = data;
+		}
+		chan->pcm16bOffs++;
+		chan->pcm16b[SPUCHAN_PCM16B_AT(chan->pcm16bOffs)] = data;
+
+		chan->sampcntInt++;
+		if (FORMAT != 3) TestForLoop<FORMAT>(SPU, chan);
+	}
+}
 
-			chan->sampcntInt++;
-			if (FORMAT != 3) TestForLoop<FORMAT>(SPU, chan);
+//WORK
+//stopAtKeyOff ends the update after the sample where the channel stops, leaving bufpos there.
+template<int FORMAT, SPUInterpolationMode INTERPOLATE_MODE, int CHANNELS> 
+	FORCEINLINE static void ____SPU_ChanUpdate(SPU_struct* const SPU, channel_struct* const chan, const bool stopAtKeyOff)
+{
+	if(CHANNELS == -1)
+	{
+		while (SPU->bufpos < SPU->buflength)
+		{
+			StepChannel<FORMAT>(SPU, chan);
+			SPU->bufpos++;
+			if (stopAtKeyOff && chan->status != CHANSTAT_PLAY) break;
 		}
+		return;
+	}
 
-		if(CHANNELS != -1)
+	// The advanced mixer asks for one sample at a time while it captures,
+	// which the per-sample functions handle better than a block would.
+	// With block mixing turned off, everything goes this way.
+	if(SPU->buflength - SPU->bufpos == 1 || !_blockMixEnabled)
+	{
+		while (SPU->bufpos < SPU->buflength)
 		{
+			StepChannel<FORMAT>(SPU, chan);
 			s32 data = Interpolate<INTERPOLATE_MODE>(chan->pcm16b, chan->pcm16bOffs, chan->sampcntFrac);
 			SPU_Mix<CHANNELS>(SPU, chan, data);
+			SPU->bufpos++;
+			if (stopAtKeyOff && chan->status != CHANSTAT_PLAY) break;
 		}
+		return;
+	}
+
+	SPUMixBlock block;
+	while (SPU->bufpos < SPU->buflength)
+	{
+		size_t length = SPU->buflength - SPU->bufpos;
+		if (length > SPU_MIXBLOCK_SAMPLES) length = SPU_MIXBLOCK_SAMPLES;
+
+		for (size_t i = 0; i < length; i++)
+		{
+			StepChannel<FORMAT>(SPU, chan);
+			RecordTaps<INTERPOLATE_MODE>(block, i, chan->pcm16b, chan->pcm16bOffs, chan->sampcntFrac);
+
+			if (stopAtKeyOff && chan->status != CHANSTAT_PLAY)
+			{
+				length = i + 1;
+				break;
+			}
+		}
+
+		MixBlock<INTERPOLATE_MODE,CHANNELS>(SPU, chan, block, length);
+		SPU->bufpos += length;
+		if (stopAtKeyOff && chan->status != CHANSTAT_PLAY) break;
 	}
 }
 
 template<int FORMAT, SPUInterpolationMode INTERPOLATE_MODE> 
-	FORCEINLINE static void ___SPU_ChanUpdate(const bool actuallyMix, SPU_struct* const SPU, channel_struct* const chan)
+	FORCEINLINE static void ___SPU_ChanUpdate(const bool actuallyMix, SPU_struct* const SPU, channel_struct* const chan, const bool stopAtKeyOff)
 {
 	if(!actuallyMix)
-		____SPU_ChanUpdate<FORMAT,INTERPOLATE_MODE,-1>(SPU,chan);
+		____SPU_ChanUpdate<FORMAT,INTERPOLATE_MODE,-1>(SPU,chan,stopAtKeyOff);
 	else if (chan->pan == 0)
-		____SPU_ChanUpdate<FORMAT,INTERPOLATE_MODE,0>(SPU,chan);
+		____SPU_ChanUpdate<FORMAT,INTERPOLATE_MODE,0>(SPU,chan,stopAtKeyOff);
 	else if (chan->pan == 127)
-		____SPU_ChanUpdate<FORMAT,INTERPOLATE_MODE,2>(SPU,chan);
+		____SPU_ChanUpdate<FORMAT,INTERPOLATE_MODE,2>(SPU,chan,stopAtKeyOff);
 	else
-		____SPU_ChanUpdate<FORMAT,INTERPOLATE_MODE,1>(SPU,chan);
+		____SPU_ChanUpdate<FORMAT,INTERPOLATE_MODE,1>(SPU,chan,stopAtKeyOff);
 }
 
 template<SPUInterpolationMode INTERPOLATE_MODE> 
-	FORCEINLINE static void __SPU_ChanUpdate(const bool actuallyMix, SPU_struct* const SPU, channel_struct* const chan)
+	FORCEINLINE static void __SPU_ChanUpdate(const bool actuallyMix, SPU_struct* const SPU, channel_struct* const chan, const bool stopAtKeyOff)
 {
 	// NOTE: PSG doesn't use interpolation, or it would try to
 	// interpolate between the raw sample points (very bad)
 	switch(chan->format)
 	{
-		case 0: ___SPU_ChanUpdate<0,INTERPOLATE_MODE>(actuallyMix, SPU, chan); break;
-		case 1: ___SPU_ChanUpdate<1,INTERPOLATE_MODE>(actuallyMix, SPU, chan); break;
-		case 2: ___SPU_ChanUpdate<2,INTERPOLATE_MODE>(actuallyMix, SPU, chan); break;
-		case 3: ___SPU_ChanUpdate<3,SPUInterpolation_None>(actuallyMix, SPU, chan); break;
+		case 0: ___SPU_ChanUpdate<0,INTERPOLATE_MODE>(actuallyMix, SPU, chan, stopAtKeyOff); break;
+		case 1: ___SPU_ChanUpdate<1,INTERPOLATE_MODE>(actuallyMix, SPU, chan, stopAtKeyOff); break;
+		case 2: ___SPU_ChanUpdate<2,INTERPOLATE_MODE>(actuallyMix, SPU, chan, stopAtKeyOff); break;
+		case 3: ___SPU_ChanUpdate<3,SPUInterpolation_None>(actuallyMix, SPU, chan, stopAtKeyOff); break;
 		default: assert(false);
 	}
 }
 
-FORCEINLINE static void _SPU_ChanUpdate(const bool actuallyMix, SPU_struct* const SPU, channel_struct* const chan)
+FORCEINLINE static void _SPU_ChanUpdate(const bool actuallyMix, SPU_struct* const SPU, channel_struct* const chan, const bool stopAtKeyOff = false)
 {
 	switch(CommonSettings.spuInterpolationMode)
 	{
-	case SPUInterpolation_None:       __SPU_ChanUpdate<SPUInterpolation_None>(actuallyMix, SPU, chan); break;
-	case SPUInterpolation_Linear:     __SPU_ChanUpdate<SPUInterpolation_Linear>(actuallyMix, SPU, chan); break;
-	case SPUInterpolation_Cosine:     __SPU_ChanUpdate<SPUInterpolation_Cosine>(actuallyMix, SPU, chan); break;
-	case SPUInterpolation_CatmullRom: __SPU_ChanUpdate<SPUInterpolation_CatmullRom>(actuallyMix, SPU, chan); break;
+	case SPUInterpolation_None:       __SPU_ChanUpdate<SPUInterpolation_None>(actuallyMix, SPU, chan, stopAtKeyOff); break;
+	case SPUInterpolation_Linear:     __SPU_ChanUpdate<SPUInterpolation_Linear>(actuallyMix, SPU, chan, stopAtKeyOff); break;
+	case SPUInterpolation_Cosine:     __SPU_ChanUpdate<SPUInterpolation_Cosine>(actuallyMix, SPU, chan, stopAtKeyOff); break;
+	case SPUInterpolation_CatmullRom: __SPU_ChanUpdate<SPUInterpolation_CatmullRom>(actuallyMix, SPU, chan, stopAtKeyOff); break;
 	default: assert(false);
 	}
 }
 
+//while no capture unit is running, nothing gets written to memory during the mix,
+//so each channel can be generated a whole block at a time and routed afterwards.
+//a channel that stops mid-block is cut off at that sample, as it would be in the per-sample loop.
+static void SPU_MixAudio_AdvancedBlocks(SPU_struct *SPU, int length)
+{
+	s32 mixbuf[SPU_MIXBLOCK_SAMPLES*2];
+	s32 ch1buf[SPU_MIXBLOCK_SAMPLES*2];
+	s32 ch3buf[SPU_MIXBLOCK_SAMPLES*2];
+	s32 capbuf[SPU_MIXBLOCK_SAMPLES*2];
+	s32 *outbuf = SPU->sndbuf;
+	s32 lastdata = SPU->lastdata;
+
+	for (int samp = 0; samp < length; samp += SPU_MIXBLOCK_SAMPLES)
+	{
+		const int blockLength = (length - samp < SPU_MIXBLOCK_SAMPLES) ? (length - samp) : SPU_MIXBLOCK_SAMPLES;
+
+		memset(mixbuf, 0, sizeof(mixbuf));
+		memset(ch1buf, 0, sizeof(ch1buf));
+		memset(ch3buf, 0, sizeof(ch3buf));
+		memset(capbuf, 0, sizeof(capbuf));
+
+		for (int i = 0; i < 16; i++)
+		{
+			channel_struct *chan = &SPU->channels[i];
+			if (chan->status != CHANSTAT_PLAY)
+				continue;
+
+			bool bypass = false;
+			if (i==1 && SPU->regs.ctl_ch1bypass) bypass=true;
+			if (i==3 && SPU->regs.ctl_ch3bypass) bypass=true;
+
+			bool outputToMix = true;
+			if (CommonSettings.spu_muteChannels[i]) outputToMix = false;
+			if (bypass) outputToMix = false;
+			bool outputToCap = outputToMix;
+			if (CommonSettings.spu_captureMuted && !bypass) outputToCap = true;
+			bool domix = outputToCap || outputToMix || i==1 || i==3;
+
+			//the capture mix itself isn't needed, but channels only heard by it still go through
+			//the mixer so that lastdata ends up the same as in the per-sample loop
+			if (i == 1) SPU->sndbuf = ch1buf;
+			else if (i == 3) SPU->sndbuf = ch3buf;
+			else if (outputToMix) SPU->sndbuf = mixbuf;
+			else SPU->sndbuf = capbuf;
+			SPU->bufpos = 0;
+			SPU->buflength = blockLength;
+			_SPU_ChanUpdate(domix, SPU, chan, true);
+
+			//keep lastdata as the per-sample loop would leave it: from the last channel mixed at the last sample
+			if (domix && SPU->bufpos == (u32)blockLength)
+				lastdata = SPU->lastdata;
+
+			if ((i == 1 || i == 3) && outputToMix)
+			{
+				for (int j = 0; j < blockLength*2; j++)
+					mixbuf[j] += SPU->sndbuf[j];
+			}
+		}
+
+		SPU->sndbuf = outbuf;
+
+		for (int j = 0; j < blockLength; j++)
+		{
+			s32 *sndout = &outbuf[(samp + j)*2];
+
+			switch (SPU->regs.ctl_left)
+			{
+				case SPU_struct::REGS::LOM_LEFT_MIXER: sndout[0] = mixbuf[j*2+0]; break;
+				case SPU_struct::REGS::LOM_CH1: sndout[0] = ch1buf[j*2+0]; break;
+				case SPU_struct::REGS::LOM_CH3: sndout[0] = ch3buf[j*2+0]; break;
+				case SPU_struct::REGS::LOM_CH1_PLUS_CH3: sndout[0] = ch1buf[j*2+0] + ch3buf[j*2+0]; break;
+				default: break;
+			}
+			switch (SPU->regs.ctl_right)
+			{
+				case SPU_struct::REGS::ROM_RIGHT_MIXER: sndout[1] = mixbuf[j*2+1]; break;
+				case SPU_struct::REGS::ROM_CH1: sndout[1] = ch1buf[j*2+1]; break;
+				case SPU_struct::REGS::ROM_CH3: sndout[1] = ch3buf[j*2+1]; break;
+				case SPU_struct::REGS::ROM_CH1_PLUS_CH3: sndout[1] = ch1buf[j*2+1] + ch3buf[j*2+1]; break;
+				default: break;
+			}
+		}
+	}
+
+	SPU->lastdata = lastdata;
+}
+
 //ENTERNEW
 static void SPU_MixAudio_Advanced(bool actuallyMix, SPU_struct *SPU, int length)
 {
@@ -1318,6 +1769,12 @@ static void SPU_MixAudio_Advanced(bool actuallyMix, SPU_struct *SPU, int length)
 	bool skipcap = false;
 	//-----------------
 
+	if (_blockMixEnabled && !SPU->regs.cap[0].runtime.running && !SPU->regs.cap[1].runtime.running)
+	{
+		SPU_MixAudio_AdvancedBlocks(SPU, length);
+		return;
+	}
+
 	s32 samp0[2] = {0,0};
 	
 	//believe it or not, we are going to do this one sample at a time.
@@ -1515,7 +1972,7 @@ static void SPU_MixAudio_Advanced(bool actuallyMix, SPU_struct *SPU, int length)
 }
 
 //ENTER
-static void SPU_MixAudio(bool actuallyMix, SPU_struct *SPU, int length)
+void SPU_MixAudio(bool actuallyMix, SPU_struct *SPU, int length)
 {
 	if (actuallyMix)
 	{
@@ -1618,6 +2075,28 @@ static void SPU_MixAudio(bool actuallyMix, SPU_struct *SPU, int length)
 
 //////////////////////////////////////////////////////////////////////////////
 
+static bool spuCaptureActive = false;
+static std::vector<s16> spuCaptureSamples;
+
+void SPU_CaptureStart()
+{
+	spuCaptureSamples.clear();
+	spuCaptureActive = true;
+}
+
+void SPU_CaptureStop()
+{
+	spuCaptureActive = false;
+}
+
+const s16* SPU_CaptureGetSamples(size_t &sampleCount)
+{
+	sampleCount = spuCaptureSamples.size() / 2;
+	return sampleCount ? &spuCaptureSamples[0] : NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
 
 //emulates one hline of the cpu core.
 //this will produce a variable number of samples, calculated to keep a 44100hz output
@@ -1636,12 +2115,14 @@ void SPU_Emulate_core()
 	// However, recording still needs to mix the audio, so make sure we're also
 	// not recording before we disable mixing.
 	if ( _currentSynchMode == ESynchMode_DualSynchAsynch &&
-		!(driver->AVI_IsRecording() || driver->WAV_IsRecording()) )
+		!(driver->AVI_IsRecording() || driver->WAV_IsRecording() || spuCaptureActive) )
 	{
 		needToMix = false;
 	}
 	
 	SPU_MixAudio(needToMix, SPU_core, spu_core_samples);
+	if (spuCaptureActive)
+		spuCaptureSamples.insert(spuCaptureSamples.end(), SPU_core->outbuf, SPU_core->outbuf + spu_core_samples*2);
 	
 	if (soundProcessor == NULL)
 	{
@@ -237,6 +237,11 @@ void SPU_ClearOutputBuffer(void);
 void SPU_Reset(void);
 void SPU_DeInit(void);
 void SPU_KeyOn(int channel);
+// Mixes <length> samples of <SPU> into its sndbuf and outbuf; SPU_Emulate_core() calls it once per hline.
+void SPU_MixAudio(bool actuallyMix, SPU_struct *SPU, int length);
+// Channels are normally mixed a block of samples at a time. With block mixing off, every
+// channel goes through the per-sample path instead, which the mixer tests compare against.
+void SPU_SetBlockMixing(bool enable);
 static FORCEINLINE void SPU_WriteByte(u32 addr, u8 val)
 {
 	addr &= 0xFFF;
@@ -266,6 +271,12 @@ static FORCEINLINE u16 SPU_ReadWord(u32 addr) { return SPU_core->ReadWord(addr &
 static FORCEINLINE u32 SPU_ReadLong(u32 addr) { return SPU_core->ReadLong(addr & 0x0FFF); }
 void SPU_Emulate_core(void);
 void SPU_Emulate_user(bool mix = true);
+// Collects the stereo samples that SPU_core mixes, for frontends that take the audio of
+// the emulation directly instead of through a sound core. The samples stay available
+// until the next SPU_CaptureStart().
+void SPU_CaptureStart();
+void SPU_CaptureStop();
+const s16* SPU_CaptureGetSamples(size_t &sampleCount);
 void SPU_DefaultFetchSamples(s16 *sampleBuffer, size_t sampleCount, ESynchMode synchMode, ISynchronizingAudioBuffer *theSynchronizer);
 size_t SPU_DefaultPostProcessSamples(s16 *postProcessBuffer, size_t requestedSampleCount, ESynchMode synchMode, ISynchronizingAudioBuffer *theSynchronizer);
 
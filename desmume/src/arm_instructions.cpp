@@ -3134,6 +3134,9 @@ TEMPLATE static u32 FASTCALL OP_B(const u32 i)
 	cpu->R[15] &= (0xFFFFFFFC|(cpu->CPSR.bits.T<<1));
 	cpu->next_instruction = cpu->R[15];
 
+	if(CommonSettings.idle_loop_skip && cpu->next_instruction < cpu->instruct_adr && CONDITION(i)!=0xF)
+		armcpu_idleLoopCheck<PROCNUM>(cpu->instruct_adr, cpu->next_instruction);
+
 	return 3;
 }
 
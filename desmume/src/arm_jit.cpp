@@ -38,6 +38,13 @@
 #ifndef __APPLE__
 #define HAVE_STATIC_CODE_BUFFER
 #endif
+// Fastmem needs the emitted code within reach of its tables, and decodes the faulting
+// x86_64 instructions from the Linux signal context.
+#if defined(HAVE_STATIC_CODE_BUFFER) && defined(HOST_64) && defined(__linux__) && defined(__x86_64__)
+#define HAVE_JIT_FASTMEM
+#include <signal.h>
+#include <ucontext.h>
+#endif
 #endif
 
 #include "utils/bits.h"
@@ -53,9 +60,10 @@
 #define LOG_JIT_LEVEL 0
 #define PROFILER_JIT_LEVEL 0
 
-#if (PROFILER_JIT_LEVEL > 0)
+#include <string>
+#include <vector>
+#include <map>
 #include <algorithm>
-#endif
 
 using namespace AsmJit;
 
@@ -197,8 +205,6 @@ static void init_jit_mem()
 DS_ALIGN(4096) uintptr_t compiled_funcs[1<<26] = {0};
 #endif
 
-static u8 recompile_counts[(1<<26)/16];
-
 #ifdef HAVE_STATIC_CODE_BUFFER
 // On x86_64, allocate jitted code from a static buffer to ensure that it's within 2GB of .text
 // Allows call instructions to use pcrel offsets, as opposed to slower indirect calls.
@@ -208,6 +214,71 @@ static u8 recompile_counts[(1<<26)/16];
 DS_ALIGN(4096) static u8 scratchpad[1<<25];
 static u8 *scratchptr;
 
+// Blocks are carved out of the scratchpad in JIT_CODE_ALIGN units. Freed blocks go on a
+// free list per size (the last list holds everything larger) and are reused before
+// the scratchpad pointer advances, so invalidated code no longer leaks until the next reset.
+#define JIT_CODE_ALIGN 16
+#define JIT_CODE_FREE_LISTS 256
+static std::vector<u8*> code_free[JIT_CODE_FREE_LISTS];
+static std::vector<std::pair<u8*,u32> > code_free_large;
+static u32 code_last_size;
+
+static void code_release(u8 *p, u32 size)
+{
+	const u32 units = size / JIT_CODE_ALIGN;
+	if (units < JIT_CODE_FREE_LISTS)
+		code_free[units].push_back(p);
+	else
+		code_free_large.push_back(std::make_pair(p, size));
+}
+
+static u8* code_alloc(u32 size)
+{
+	const u32 units = size / JIT_CODE_ALIGN;
+	if (units < JIT_CODE_FREE_LISTS && !code_free[units].empty())
+	{
+		u8 *p = code_free[units].back();
+		code_free[units].pop_back();
+		return p;
+	}
+
+	if (size <= (uintptr_t)(scratchpad+sizeof(scratchpad)-scratchptr))
+	{
+		u8 *p = scratchptr;
+		scratchptr += size;
+		return p;
+	}
+
+	// the scratchpad is exhausted, so split the smallest larger free block
+	for (u32 i = units+1; i < JIT_CODE_FREE_LISTS; i++)
+	{
+		if (code_free[i].empty()) continue;
+		u8 *p = code_free[i].back();
+		code_free[i].pop_back();
+		code_release(p + size, (i - units) * JIT_CODE_ALIGN);
+		return p;
+	}
+	for (size_t i = 0; i < code_free_large.size(); i++)
+	{
+		if (code_free_large[i].second < size) continue;
+		u8 *p = code_free_large[i].first;
+		const u32 rest = code_free_large[i].second - size;
+		code_free_large.erase(code_free_large.begin() + i);
+		if (rest) code_release(p + size, rest);
+		return p;
+	}
+
+	return NULL;
+}
+
+static void code_reset()
+{
+	scratchptr = scratchpad;
+	for (int i = 0; i < JIT_CODE_FREE_LISTS; i++)
+		code_free[i].clear();
+	code_free_large.clear();
+}
+
 struct ASMJIT_API StaticCodeGenerator : public Context
 {
 	StaticCodeGenerator()
@@ -230,7 +301,9 @@ struct ASMJIT_API StaticCodeGenerator : public Context
 			*dest = NULL;
 			return kErrorNoFunction;
 		}
-		if(size > (uintptr_t)(scratchpad+sizeof(scratchpad)-scratchptr))
+		size = (size + JIT_CODE_ALIGN - 1) & ~(uintptr_t)(JIT_CODE_ALIGN - 1);
+		u8 *p = code_alloc((u32)size);
+		if(p == NULL)
 		{
 			fprintf(stderr, "Out of memory for asmjit. Clearing code cache.\n");
 			arm_jit_reset(1);
@@ -238,9 +311,8 @@ struct ASMJIT_API StaticCodeGenerator : public Context
 			*dest = NULL;
 			return kErrorOk;
 		}
-		void *p = scratchptr;
-		size = assembler->relocCode(p);
-		scratchptr += size;
+		assembler->relocCode(p);
+		code_last_size = (u32)size;
 		*dest = p;
 		return kErrorOk;
 	}
@@ -252,6 +324,411 @@ static X86Compiler c(&codegen);
 static X86Compiler c;
 #endif
 
+//-----------------------------------------------------------------------------
+//   Block tracking
+//-----------------------------------------------------------------------------
+
+// An entry point whose blocks keep getting invalidated soon after being compiled is
+// self-modifying code; once it has thrashed JIT_MAX_THRASH times in a row it is handed
+// to the interpreter until its code is rewritten after a longer quiet period.
+#define JIT_MAX_THRASH 8
+#define JIT_THRASH_WINDOW 1120380 // one frame, in ARM9 cycles
+// Entry points remembered at most; beyond that the ones that no longer steer compilation are forgotten.
+#define JIT_MAX_HISTORY 65536
+
+// A block ending in a branch whose destination is known at compile time calls the
+// destination block directly through a link, as long as the cycle budget set by the
+// dispatcher lasts. A link's target is the destination's code, or 0 until that is compiled.
+#define JIT_MAX_EXITS 2
+#define JIT_MAX_LINKS (1<<18)
+#define JIT_NO_LINK 0xFFFFFFFF
+
+// Blocks start out at tier 0, compiled with the jit_max_block_size limit. A tier 0 block
+// counts down a heat counter on entry, and once that has seen JIT_HOT_THRESHOLD runs the
+// block is recompiled at tier 1, as a superblock that keeps going past unconditional
+// branches with static targets, over up to JIT_MAX_RANGES runs of code.
+// Counters are shared by hashing the entry slot; a collision only tiers up a block early.
+#define JIT_MAX_RANGES 4
+#define JIT_HOT_THRESHOLD 1000
+#define JIT_HEAT_BITS 16
+#define JIT_HEAT(slot) jit_heat[((slot) * 2654435761U) >> (32 - JIT_HEAT_BITS)]
+
+struct JIT_RANGE
+{
+	u32 adr;
+	u32 slot;
+	u32 size;       // slots covered
+};
+
+struct JIT_LINK
+{
+	uintptr_t target; // read by emitted code
+	u32 adr;
+	u32 slot;
+	u8 proc;
+	u8 thumb;
+};
+
+struct JIT_BLOCK
+{
+	u32 slot;       // entry point
+	void *code;     // NULL for an interpreter entry
+	u32 codeSize;
+	u64 timestamp;  // nds_timer when compiled
+	u8 proc;
+	u8 thumb;
+	u8 tier;
+	u8 hot;         // asked to be recompiled at the next tier
+	u8 exitCount;
+	u8 rangeCount;  // 0 if this record is unused
+	u32 exits[JIT_MAX_EXITS]; // outgoing links
+	JIT_RANGE ranges[JIT_MAX_RANGES]; // the first one starts at the entry point
+};
+
+struct JIT_ENTRY_HISTORY
+{
+	u32 thrash;
+	u32 size;       // slots covered by the last block compiled here
+	u8 slowmem;     // its loads kept faulting, so compile them without fastmem
+};
+
+u8 jit_page_has_code[JIT_PAGE_COUNT];
+static std::vector<u32> jit_page_blocks[JIT_PAGE_COUNT];
+static std::vector<JIT_BLOCK> jit_blocks;
+static std::vector<u32> jit_blocks_free;
+static std::map<u32, JIT_ENTRY_HISTORY> jit_history;
+static std::vector<std::pair<void*,u32> > jit_code_retired;
+
+static void jit_history_prune()
+{
+	for (std::map<u32, JIT_ENTRY_HISTORY>::iterator it = jit_history.begin(); it != jit_history.end(); )
+	{
+		if (it->second.thrash == 0 && !it->second.slowmem)
+			jit_history.erase(it++);
+		else
+			++it;
+	}
+	// everything left is still thrashing; start over rather than grow
+	if (jit_history.size() >= JIT_MAX_HISTORY / 2)
+		jit_history.clear();
+}
+
+static JIT_ENTRY_HISTORY& jit_history_get(u32 slot)
+{
+	if (jit_history.size() >= JIT_MAX_HISTORY && jit_history.find(slot) == jit_history.end())
+		jit_history_prune();
+	return jit_history[slot];
+}
+static JIT_LINK jit_links[JIT_MAX_LINKS]; // static, since emitted code holds pointers into it
+static u32 jit_links_top;
+static std::vector<u32> jit_links_free;
+static std::map<u32, std::vector<u32> > jit_links_incoming; // entry slot -> links to it
+static std::map<u32, u32> jit_entry_blocks; // entry slot -> block compiled there
+static JIT_STATS jit_stats;
+static u16 jit_heat[1<<JIT_HEAT_BITS];
+JIT_LINK_STATE jit_link;
+
+static void jit_code_free(void *code, u32 size)
+{
+#ifdef HAVE_STATIC_CODE_BUFFER
+	code_release((u8*)code, size);
+#else
+	MemoryManager::getGlobal()->free(code);
+#endif
+}
+
+// Blocks discarded by a write may still be on the host stack (a block can overwrite
+// its own code), so their memory is only handed back before the next compile.
+static void jit_release_retired_code()
+{
+	for (size_t i = 0; i < jit_code_retired.size(); i++)
+		jit_code_free(jit_code_retired[i].first, jit_code_retired[i].second);
+	jit_code_retired.clear();
+}
+
+static void jit_fastmem_code_changed(u32 page);
+
+static void jit_page_link(u32 page, u32 id)
+{
+	jit_page_blocks[page].push_back(id);
+	if (!jit_page_has_code[page])
+	{
+		jit_page_has_code[page] = 1;
+		jit_fastmem_code_changed(page);
+	}
+}
+
+static void jit_page_unlink(u32 page, u32 id);
+
+// Calls <fn> once for every page that one of the block's ranges touches.
+static void jit_block_pages(const JIT_BLOCK &b, u32 id, void (*fn)(u32 page, u32 id))
+{
+	for (u32 r = 0; r < b.rangeCount; r++)
+	{
+		const u32 first = b.ranges[r].slot >> JIT_PAGE_SHIFT;
+		const u32 last = (b.ranges[r].slot + b.ranges[r].size - 1) >> JIT_PAGE_SHIFT;
+		for (u32 page = first; page <= last; page++)
+		{
+			bool seen = false;
+			for (u32 q = 0; q < r && !seen; q++)
+				seen = page >= (b.ranges[q].slot >> JIT_PAGE_SHIFT)
+					&& page <= ((b.ranges[q].slot + b.ranges[q].size - 1) >> JIT_PAGE_SHIFT);
+			if (!seen)
+				fn(page, id);
+		}
+	}
+}
+
+static void jit_page_unlink(u32 page, u32 id)
+{
+	std::vector<u32> &list = jit_page_blocks[page];
+	for (size_t i = 0; i < list.size(); i++)
+	{
+		if (list[i] != id) continue;
+		list[i] = list.back();
+		list.pop_back();
+		break;
+	}
+	if (list.empty())
+	{
+		jit_page_has_code[page] = 0;
+		jit_fastmem_code_changed(page);
+	}
+}
+
+static void jit_link_init(u32 id, u32 adr, u32 slot, u8 proc, u8 thumb)
+{
+	JIT_LINK &link = jit_links[id];
+	link.target = 0;
+	link.adr = adr;
+	link.slot = slot;
+	link.proc = proc;
+	link.thumb = thumb;
+
+	std::map<u32, u32>::iterator entry = jit_entry_blocks.find(slot);
+	if (entry != jit_entry_blocks.end())
+	{
+		const JIT_BLOCK &b = jit_blocks[entry->second];
+		if (b.proc == proc && b.thumb == thumb)
+			link.target = (uintptr_t)b.code;
+	}
+	jit_links_incoming[slot].push_back(id);
+}
+
+static u32 jit_link_alloc(u32 adr, u32 slot, u8 proc, u8 thumb)
+{
+	u32 id;
+	if (!jit_links_free.empty())
+	{
+		id = jit_links_free.back();
+		jit_links_free.pop_back();
+	}
+	else if (jit_links_top < JIT_MAX_LINKS)
+		id = jit_links_top++;
+	else
+		return JIT_NO_LINK;
+
+	jit_link_init(id, adr, slot, proc, thumb);
+	return id;
+}
+
+static void jit_link_free(u32 id)
+{
+	JIT_LINK &link = jit_links[id];
+	std::vector<u32> &incoming = jit_links_incoming[link.slot];
+	for (size_t i = 0; i < incoming.size(); i++)
+	{
+		if (incoming[i] != id) continue;
+		incoming[i] = incoming.back();
+		incoming.pop_back();
+		break;
+	}
+	if (incoming.empty())
+		jit_links_incoming.erase(link.slot);
+
+	link.target = 0;
+	jit_links_free.push_back(id);
+}
+
+// Points every link waiting on <slot> at <code>, or unlinks them all if <code> is NULL.
+static void jit_link_resolve(u32 slot, void *code, u8 proc, u8 thumb)
+{
+	std::map<u32, std::vector<u32> >::iterator incoming = jit_links_incoming.find(slot);
+	if (incoming == jit_links_incoming.end())
+		return;
+
+	for (size_t i = 0; i < incoming->second.size(); i++)
+	{
+		JIT_LINK &link = jit_links[incoming->second[i]];
+		if (code == NULL)
+			link.target = 0;
+		else if (link.proc == proc && link.thumb == thumb)
+			link.target = (uintptr_t)code;
+	}
+}
+
+static u32 jit_block_register(const JIT_RANGE *ranges, u32 rangeCount, void *code, u32 codeSize, u8 proc, u8 thumb, u8 tier)
+{
+	const u32 slot = ranges[0].slot;
+	u32 id;
+	if (jit_blocks_free.empty())
+	{
+		id = (u32)jit_blocks.size();
+		jit_blocks.push_back(JIT_BLOCK());
+	}
+	else
+	{
+		id = jit_blocks_free.back();
+		jit_blocks_free.pop_back();
+	}
+
+	JIT_BLOCK &b = jit_blocks[id];
+	b.slot = slot;
+	b.code = code;
+	b.codeSize = codeSize;
+	b.timestamp = nds_timer;
+	b.proc = proc;
+	b.thumb = thumb;
+	b.tier = tier;
+	b.hot = 0;
+	b.exitCount = 0;
+	b.rangeCount = rangeCount;
+	for (u32 r = 0; r < rangeCount; r++)
+		b.ranges[r] = ranges[r];
+
+	jit_block_pages(b, id, jit_page_link);
+
+	if (code)
+	{
+		jit_entry_blocks[slot] = id;
+		jit_link_resolve(slot, code, proc, thumb);
+	}
+
+	jit_stats.blocks++;
+	jit_stats.codeBytes += codeSize;
+
+	return id;
+}
+
+static void jit_block_discard(u32 id, bool retire)
+{
+	JIT_BLOCK &b = jit_blocks[id];
+
+	jit_block_pages(b, id, jit_page_unlink);
+
+	for (u32 i = 0; i < b.exitCount; i++)
+		jit_link_free(b.exits[i]);
+	b.exitCount = 0;
+
+	JIT_SLOT_BASE[b.slot] = 0;
+	if (b.code)
+	{
+		jit_entry_blocks.erase(b.slot);
+		jit_link_resolve(b.slot, NULL, 0, 0);
+		if (retire)
+			jit_code_retired.push_back(std::make_pair(b.code, b.codeSize));
+		else
+			jit_code_free(b.code, b.codeSize);
+	}
+
+	jit_stats.blocks--;
+	jit_stats.codeBytes -= b.codeSize;
+	b.rangeCount = 0;
+	b.code = NULL;
+	jit_blocks_free.push_back(id);
+}
+
+void arm_jit_invalidate(u32 slot, u32 count)
+{
+	std::vector<u32> &list = jit_page_blocks[slot >> JIT_PAGE_SHIFT];
+	bool discarded = false;
+
+	for (size_t i = 0; i < list.size(); )
+	{
+		const u32 id = list[i];
+		const JIT_BLOCK &b = jit_blocks[id];
+		bool overlaps = false;
+		for (u32 r = 0; r < b.rangeCount && !overlaps; r++)
+			overlaps = b.ranges[r].slot < slot + count && b.ranges[r].slot + b.ranges[r].size > slot;
+		if (!overlaps)
+		{
+			i++;
+			continue;
+		}
+
+		JIT_ENTRY_HISTORY &history = jit_history_get(b.slot);
+		if (nds_timer - b.timestamp < JIT_THRASH_WINDOW)
+			history.thrash++;
+		else
+			history.thrash = 0;
+		history.size = b.ranges[0].size;
+
+		// unlinking swaps the last entry of this page into position i
+		jit_block_discard(id, true);
+		jit_stats.blocksInvalidated++;
+		discarded = true;
+	}
+
+	if (discarded)
+		jit_stats.invalidations++;
+}
+
+static void jit_discard_all()
+{
+	for (u32 id = 0; id < jit_blocks.size(); id++)
+		if (jit_blocks[id].rangeCount)
+			jit_block_discard(id, false);
+
+	jit_release_retired_code();
+	jit_blocks.clear();
+	jit_blocks_free.clear();
+	jit_history.clear();
+	jit_links_top = 0;
+	jit_links_free.clear();
+	jit_links_incoming.clear();
+	jit_entry_blocks.clear();
+	for (u32 i = 0; i < (1<<JIT_HEAT_BITS); i++)
+		jit_heat[i] = JIT_HOT_THRESHOLD;
+#ifdef HAVE_STATIC_CODE_BUFFER
+	code_reset();
+#endif
+}
+
+// Called by a tier 0 block whose heat counter ran out. Clearing its entry slot and the
+// links into it sends the next run through arm_jit_compile(), which replaces it.
+static void FASTCALL jit_block_hot(u32 slot)
+{
+	JIT_HEAT(slot) = JIT_HOT_THRESHOLD;
+
+	std::map<u32, u32>::iterator entry = jit_entry_blocks.find(slot);
+	if (entry == jit_entry_blocks.end())
+		return;
+	JIT_BLOCK &b = jit_blocks[entry->second];
+	if (b.tier > 0 || b.hot)
+		return;
+
+	b.hot = 1;
+	JIT_SLOT_BASE[slot] = 0;
+	jit_link_resolve(slot, NULL, 0, 0);
+}
+
+void arm_jit_get_stats(JIT_STATS *stats)
+{
+	*stats = jit_stats;
+#ifndef HAVE_STATIC_CODE_BUFFER
+	stats->codeBytes = (u32)MemoryManager::getGlobal()->getUsedBytes();
+#endif
+}
+
+void arm_jit_clear_stats()
+{
+	const u32 blocks = jit_stats.blocks;
+	const u32 codeBytes = jit_stats.codeBytes;
+	memset(&jit_stats, 0, sizeof(jit_stats));
+	jit_stats.blocks = blocks;
+	jit_stats.codeBytes = codeBytes;
+}
+
 static void emit_branch(int cond, Label to);
 static void _armlog(u8 proc, u32 addr, u32 opcode);
 
@@ -266,6 +743,16 @@ static GpVar bb_cpu;
 static GpVar bb_cycles;
 static GpVar bb_total_cycles;
 static u32 bb_constant_cycles;
+static u32 bb_flags_live; // CPSR flags still read after the instruction being compiled
+
+struct JIT_TRACE_OP
+{
+	u32 adr;
+	u32 opcode;
+	u32 live;      // flags read after this instruction
+	u32 end;
+};
+static std::vector<JIT_TRACE_OP> bb_trace;
 
 #define cpu (&ARMPROC)
 #define bb_next_instruction (bb_adr + bb_opcodesize)
@@ -332,10 +819,29 @@ static GpVar bb_profiler_entry;
 #endif
 
 #endif
+//-----------------------------------------------------------------------------
+//   Flag liveness
+//-----------------------------------------------------------------------------
+// Bits of the CPSR flags byte. A flag that every path out of the current
+// instruction overwrites before reading is not stored at all.
+#define FLAG_N 0x80
+#define FLAG_Z 0x40
+#define FLAG_C 0x20
+#define FLAG_V 0x10
+#define FLAGS_NZCV (FLAG_N|FLAG_Z|FLAG_C|FLAG_V)
+
+static bool flags_live(u32 mask)
+{
+	if (bb_flags_live & mask) return true;
+	JIT_COMMENT("flags dead");
+	jit_stats.flagsSkipped++;
+	return false;
+}
+
 //-----------------------------------------------------------------------------
 //   Shifting macros
 //-----------------------------------------------------------------------------
-#define SET_NZCV(sign) { \
+#define SET_NZCV(sign) if (flags_live(FLAGS_NZCV)) { \
 	JIT_COMMENT("SET_NZCV"); \
 	GpVar x = c.newGpVar(kX86VarTypeGpd); \
 	GpVar y = c.newGpVar(kX86VarTypeGpd); \
@@ -356,7 +862,7 @@ static GpVar bb_profiler_entry;
 	JIT_COMMENT("end SET_NZCV"); \
 }
 
-#define SET_NZC { \
+#define SET_NZC if (flags_live(FLAG_N|FLAG_Z|(cf_change?FLAG_C:0))) { \
 	JIT_COMMENT("SET_NZC"); \
 	GpVar x = c.newGpVar(kX86VarTypeGpd); \
 	GpVar y = c.newGpVar(kX86VarTypeGpd); \
@@ -372,7 +878,7 @@ static GpVar bb_profiler_entry;
 	JIT_COMMENT("end SET_NZC"); \
 }
 
-#define SET_NZC_SHIFTS_ZERO(cf) { \
+#define SET_NZC_SHIFTS_ZERO(cf) if (flags_live(FLAG_N|FLAG_Z|FLAG_C)) { \
 	JIT_COMMENT("SET_NZC_SHIFTS_ZERO"); \
 	c.and_(flags_ptr, 0x1F); \
 	if(cf) \
@@ -386,7 +892,7 @@ static GpVar bb_profiler_entry;
 	JIT_COMMENT("end SET_NZC_SHIFTS_ZERO"); \
 }
 
-#define SET_NZ(clear_cv) { \
+#define SET_NZ(clear_cv) if (flags_live(FLAG_N|FLAG_Z|((clear_cv)?FLAG_C|FLAG_V:0))) { \
 	JIT_COMMENT("SET_NZ"); \
 	GpVar x = c.newGpVar(kX86VarTypeGpz); \
 	GpVar y = c.newGpVar(kX86VarTypeGpz); \
@@ -401,7 +907,7 @@ static GpVar bb_profiler_entry;
 	JIT_COMMENT("end SET_NZ"); \
 }
 
-#define SET_N { \
+#define SET_N if (flags_live(FLAG_N)) { \
 	JIT_COMMENT("SET_N"); \
 	GpVar x = c.newGpVar(kX86VarTypeGpz); \
 	GpVar y = c.newGpVar(kX86VarTypeGpz); \
@@ -414,7 +920,7 @@ static GpVar bb_profiler_entry;
 	JIT_COMMENT("end SET_N"); \
 }
 
-#define SET_Z { \
+#define SET_Z if (flags_live(FLAG_Z)) { \
 	JIT_COMMENT("SET_Z"); \
 	GpVar x = c.newGpVar(kX86VarTypeGpz); \
 	GpVar y = c.newGpVar(kX86VarTypeGpz); \
@@ -1521,10 +2027,655 @@ static int OP_MRS_SPSR(const u32 i)
 	changeCPSR; \
 	return 1;
 
-static int OP_MSR_CPSR(const u32 i) { OP_MSR_(CPSR, REG_OFF, 1); }
-static int OP_MSR_SPSR(const u32 i) { OP_MSR_(SPSR, REG_OFF, 0); }
-static int OP_MSR_CPSR_IMM_VAL(const u32 i) { OP_MSR_(CPSR, IMM_VAL, 1); }
-static int OP_MSR_SPSR_IMM_VAL(const u32 i) { OP_MSR_(SPSR, IMM_VAL, 0); }
+static int OP_MSR_CPSR(const u32 i) { OP_MSR_(CPSR, REG_OFF, 1); }
+static int OP_MSR_SPSR(const u32 i) { OP_MSR_(SPSR, REG_OFF, 0); }
+static int OP_MSR_CPSR_IMM_VAL(const u32 i) { OP_MSR_(CPSR, IMM_VAL, 1); }
+static int OP_MSR_SPSR_IMM_VAL(const u32 i) { OP_MSR_(SPSR, IMM_VAL, 0); }
+
+//-----------------------------------------------------------------------------
+//   Fastmem
+//-----------------------------------------------------------------------------
+// With CommonSettings.jit_fastmem set, each CPU gets a 4GB host range laid out like
+// its address space, with main RAM, the TCMs and ARM7 ERAM mapped into it (mirrors
+// included) from one shared memory object that also backs the MMU arrays. Loads and
+// stores whose first execution hit one of those regions are compiled to a direct
+// access at base+address. A load that later lands on I/O or other unmapped memory
+// faults, and fastmem_segv() sends it to a stub that completes it through the MMU and
+// resumes the block; an instruction that keeps faulting gets its block recompiled with
+// the slow calls.
+// Stores check a per-page table first instead, since pages holding compiled code must
+// still go through the MMU to invalidate it.
+// VRAM and shared WRAM are left out, since VRAMCNT and WRAMCNT remap them at runtime.
+// The direct accesses don't call the memory hooks or check breakpoints, so while any
+// are registered, or the gdb stub is attached, blocks are compiled without fastmem.
+// While incremental savestates track dirty pages no page is writable, so every store
+// gets marked by the MMU.
+#ifdef HAVE_JIT_FASTMEM
+
+#define FASTMEM_ARENA_SIZE ((1ULL << 32) + 4096) // every u32 address, plus the bytes past the last word
+#define FASTMEM_PAGE_SHIFT 12
+#define FASTMEM_PAGES (1 << (32 - FASTMEM_PAGE_SHIFT))
+#define FASTMEM_MAPPED 1   // the page is backed by host memory
+#define FASTMEM_WRITABLE 2 // and stores to it can't hit compiled code
+#define FASTMEM_HEAT_BITS 12
+#define FASTMEM_MAX_FAULTS 16
+
+enum {
+	FASTMEM_MAIN = 0,
+	FASTMEM_ITCM = 1,
+	FASTMEM_DTCM = 2,
+	FASTMEM_ERAM = 3,
+};
+
+// where each region lives in the shared memory object
+static const u32 fastmem_backing_ofs[4] = { 0, 0x1000000, 0x1008000, 0x100C000 };
+#define FASTMEM_BACKING_SIZE 0x101C000
+
+struct FASTMEM_ALIAS
+{
+	u8 proc;
+	u32 page;      // guest page whose stores write this code
+};
+
+static bool fastmem_active;
+static int fastmem_fd = -1;
+static u8 *fastmem_base[2];
+static u8 fastmem_pages[2][FASTMEM_PAGES];
+static u8 fastmem_cycles[2][3][2][256]; // [proc][size 8/16/32][dir][region]: cycles without advanced timing
+static u8 fastmem_heat[1<<FASTMEM_HEAT_BITS];
+static std::map<u32, std::vector<FASTMEM_ALIAS> > fastmem_aliases; // code page -> guest pages mapped onto it
+static struct sigaction fastmem_old_segv;
+
+// The code page that the MMU invalidates for a store to <adr>, as in the slow write path.
+static u32 fastmem_code_page(u8 region, u32 adr)
+{
+	switch (region)
+	{
+		case FASTMEM_MAIN: return JIT_SLOT(JIT_COMPILED_FUNC_KNOWNBANK(adr, MAIN_MEM, _MMU_MAIN_MEM_MASK, 0)) >> JIT_PAGE_SHIFT;
+		case FASTMEM_ITCM: return JIT_SLOT(JIT_COMPILED_FUNC_KNOWNBANK(adr, ARM9_ITCM, 0x7FFF, 0)) >> JIT_PAGE_SHIFT;
+		default: return JIT_SLOT(JIT_COMPILED_FUNC_PREMASKED(adr, ARMCPU_ARM7, 0)) >> JIT_PAGE_SHIFT;
+	}
+}
+
+// The flags of a mapped page whose stores would write code page <codePage>.
+static u8 fastmem_page_flags(u32 codePage)
+{
+	if (jit_page_has_code[codePage] || MMU_dirty.enabled)
+		return FASTMEM_MAPPED;
+	return FASTMEM_MAPPED | FASTMEM_WRITABLE;
+}
+
+static void jit_fastmem_code_changed(u32 page)
+{
+	if (!fastmem_active)
+		return;
+	std::map<u32, std::vector<FASTMEM_ALIAS> >::iterator it = fastmem_aliases.find(page);
+	if (it == fastmem_aliases.end())
+		return;
+	const std::vector<FASTMEM_ALIAS> &list = it->second;
+	for (size_t i = 0; i < list.size(); i++)
+	{
+		fastmem_pages[list[i].proc][list[i].page] = fastmem_page_flags(page);
+	}
+}
+
+static bool fastmem_map(u8 proc, u8 region, u32 adr, u32 size)
+{
+	if (mmap(fastmem_base[proc] + adr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fastmem_fd, fastmem_backing_ofs[region]) == MAP_FAILED)
+		return false;
+
+	for (u32 ofs = 0; ofs < size; ofs += (1 << FASTMEM_PAGE_SHIFT))
+	{
+		const u32 page = (adr + ofs) >> FASTMEM_PAGE_SHIFT;
+		if (region == FASTMEM_DTCM)
+		{
+			fastmem_pages[proc][page] = MMU_dirty.enabled ? FASTMEM_MAPPED : FASTMEM_MAPPED | FASTMEM_WRITABLE;
+			continue;
+		}
+		// the DTCM gets mapped over this page afterwards
+		if (proc == ARMCPU_ARM9 && ((adr + ofs) & ~0x3FFF) == MMU.DTCMRegion)
+			continue;
+		const u32 codePage = fastmem_code_page(region, adr + ofs);
+		FASTMEM_ALIAS alias = { proc, page };
+		fastmem_aliases[codePage].push_back(alias);
+		fastmem_pages[proc][page] = fastmem_page_flags(codePage);
+	}
+	return true;
+}
+
+// Puts back the bare reservation over all of both arenas. The DTCM alias can be anywhere
+// CP15 placed it, so nothing short of the whole arena is known to be clear of aliases.
+static void fastmem_unmap_all()
+{
+	for (int proc = 0; proc < 2; proc++)
+		if (fastmem_base[proc])
+			mmap(fastmem_base[proc], FASTMEM_ARENA_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+	memset(fastmem_pages, 0, sizeof(fastmem_pages));
+	fastmem_aliases.clear();
+}
+
+// Lays out both arenas for the current main memory size and DTCM position.
+static bool fastmem_remap()
+{
+	fastmem_unmap_all();
+
+	bool ok = true;
+	for (int proc = 0; proc < 2; proc++)
+		for (u32 adr = 0x02000000; adr < 0x03000000; adr += _MMU_MAIN_MEM_MASK + 1)
+			ok &= fastmem_map(proc, FASTMEM_MAIN, adr, _MMU_MAIN_MEM_MASK + 1);
+	for (u32 adr = 0; adr < 0x02000000; adr += 0x8000)
+		ok &= fastmem_map(ARMCPU_ARM9, FASTMEM_ITCM, adr, 0x8000);
+	for (u32 adr = 0x03800000; adr < 0x04000000; adr += 0x10000)
+		ok &= fastmem_map(ARMCPU_ARM7, FASTMEM_ERAM, adr, 0x10000);
+	// a DTCM base that isn't 16KB aligned never matches an address
+	if ((MMU.DTCMRegion & 0x3FFF) == 0)
+		ok &= fastmem_map(ARMCPU_ARM9, FASTMEM_DTCM, MMU.DTCMRegion, 0x4000);
+
+	if (!ok)
+		printf("JIT: fastmem mapping failed (%s)\n", strerror(errno));
+	return ok;
+}
+
+template<int PROCNUM>
+static u32 fastmem_read(u32 adr, s32 size)
+{
+	switch (size)
+	{
+		case 32: return READ32(cpu->mem_if->data, adr);
+		case 16: return READ16(cpu->mem_if->data, adr);
+		case -16: return (u32)(s16)READ16(cpu->mem_if->data, adr);
+		case 8: return READ8(cpu->mem_if->data, adr);
+		default: return (u32)(s8)READ8(cpu->mem_if->data, adr);
+	}
+}
+
+// Decodes the loads emit_fastmem_load() generates: mov r32,[base+index] and movzx/movsx
+// r32,byte/word [base+index], with an optional REX prefix. Returns the length, or 0.
+static u32 fastmem_decode(const u8 *p, u32 *reg, s32 *size)
+{
+	const u8 *start = p;
+	u8 rex = 0;
+	if ((*p & 0xF0) == 0x40)
+		rex = *p++;
+	if (rex & 8)
+		return 0;
+	if (p[0] == 0x8B)
+	{
+		*size = 32;
+		p++;
+	}
+	else if (p[0] == 0x0F && (p[1] & 0xF6) == 0xB6)
+	{
+		*size = (p[1] & 1) ? 16 : 8;
+		if (p[1] & 8)
+			*size = -*size;
+		p += 2;
+	}
+	else
+		return 0;
+
+	const u8 modrm = *p++;
+	const u8 mod = modrm >> 6;
+	const u8 rm = modrm & 7;
+	if (mod == 3)
+		return 0;
+	*reg = ((modrm >> 3) & 7) | ((rex & 4) << 1);
+	if (rm == 4 && (*p++ & 7) == 5 && mod == 0)
+		p += 4;
+	else if (rm == 5 && mod == 0)
+		p += 4;
+	if (mod == 1)
+		p += 1;
+	else if (mod == 2)
+		p += 4;
+	return (u32)(p - start);
+}
+
+// Recompiles the block holding <rip> without fastmem.
+static void fastmem_demote(const u8 *rip)
+{
+	for (u32 id = 0; id < jit_blocks.size(); id++)
+	{
+		const JIT_BLOCK &b = jit_blocks[id];
+		if (!b.code || rip < (u8*)b.code || rip >= (u8*)b.code + b.codeSize)
+			continue;
+		jit_history_get(b.slot).slowmem = 1;
+		jit_stats.fastmemDemoted++;
+		// the block is still running, so its code is only retired
+		jit_block_discard(id, true);
+		return;
+	}
+}
+
+// A faulting load is not completed inside the signal handler, since reading I/O through
+// the MMU has side effects and the MMU and block bookkeeping aren't async-signal-safe.
+// The handler only records the load here and points the CPU at fastmem_stub[proc], which
+// saves the host registers, calls fastmem_complete() on the regular stack, and resumes
+// after the load with its destination register written.
+// The JIT only runs on the emulation thread, so one record per CPU is enough.
+struct FASTMEM_FAULT
+{
+	const u8 *resume;  // the instruction after the load; the stub jumps through this
+	const u8 *rip;
+	u32 adr;
+	s32 size;
+	u32 reg;
+};
+
+static FASTMEM_FAULT fastmem_fault[2];
+DS_ALIGN(4096) static u8 fastmem_stub_code[4096];
+static u8 *fastmem_stub[2];
+
+static void fastmem_complete(u64 *regs, u32 proc)
+{
+	const FASTMEM_FAULT &f = fastmem_fault[proc];
+	regs[f.reg] = proc ? fastmem_read<1>(f.adr, f.size) : fastmem_read<0>(f.adr, f.size);
+	jit_stats.fastmemFaults++;
+
+	u8 &heat = fastmem_heat[((uintptr_t)f.rip >> 2) & ((1<<FASTMEM_HEAT_BITS) - 1)];
+	if (++heat >= FASTMEM_MAX_FAULTS)
+	{
+		heat = 0;
+		fastmem_demote(f.rip);
+	}
+}
+
+static u8 *fastmem_emit(u8 *p, const u8 *bytes, u32 count)
+{
+	memcpy(p, bytes, count);
+	return p + count;
+}
+
+static u8 *fastmem_emit32(u8 *p, u32 val)
+{
+	memcpy(p, &val, 4);
+	return p + 4;
+}
+
+// movdqu between xmm<reg> and [rsp+disp32]
+static u8 *fastmem_emit_movdqu(u8 *p, u8 op, u32 reg, u32 disp)
+{
+	*p++ = 0xF3;
+	if (reg >= 8)
+		*p++ = 0x44;
+	*p++ = 0x0F;
+	*p++ = op;
+	*p++ = 0x84 | ((reg & 7) << 3);
+	*p++ = 0x24;
+	return fastmem_emit32(p, disp);
+}
+
+static u8 *fastmem_emit_stub(u8 *p, u32 proc)
+{
+	static const u8 enter[] = {
+		0x48, 0x8D, 0x64, 0x24, 0x80,   // lea rsp,[rsp-128]  (the red zone)
+		0x9C,                           // pushfq
+		0x41, 0x57, 0x41, 0x56, 0x41, 0x55, 0x41, 0x54, // push r15..r12
+		0x41, 0x53, 0x41, 0x52, 0x41, 0x51, 0x41, 0x50, // push r11..r8
+		0x57, 0x56, 0x55, 0x54, 0x53, 0x52, 0x51, 0x50, // push rdi..rax, so [rsp+8*n] is register n
+		0x48, 0x89, 0xE3,               // mov rbx,rsp
+		0x48, 0x83, 0xE4, 0xF0,         // and rsp,-16
+		0x48, 0x81, 0xEC, 0x00, 0x01, 0x00, 0x00, // sub rsp,256
+	};
+	static const u8 leave[] = {
+		0x48, 0x89, 0xDC,               // mov rsp,rbx
+		0x58, 0x59, 0x5A, 0x5B,         // pop rax..rbx
+		0x48, 0x83, 0xC4, 0x08,         // add rsp,8  (the saved rsp)
+		0x5D, 0x5E, 0x5F,               // pop rbp..rdi
+		0x41, 0x58, 0x41, 0x59, 0x41, 0x5A, 0x41, 0x5B, // pop r8..r11
+		0x41, 0x5C, 0x41, 0x5D, 0x41, 0x5E, 0x41, 0x5F, // pop r12..r15
+		0x9D,                           // popfq
+		0x48, 0x8D, 0xA4, 0x24, 0x80, 0x00, 0x00, 0x00, // lea rsp,[rsp+128]
+	};
+
+	p = fastmem_emit(p, enter, sizeof(enter));
+	for (u32 i = 0; i < 16; i++)
+		p = fastmem_emit_movdqu(p, 0x7F, i, i * 16);
+	static const u8 args[] = { 0x48, 0x89, 0xDF, 0xBE }; // mov rdi,rbx; mov esi,imm32
+	p = fastmem_emit(p, args, sizeof(args));
+	p = fastmem_emit32(p, proc);
+	*p++ = 0x48; *p++ = 0xB8; // mov rax,imm64
+	const u64 func = (uintptr_t)fastmem_complete;
+	memcpy(p, &func, 8);
+	p += 8;
+	*p++ = 0xFF; *p++ = 0xD0; // call rax
+	for (u32 i = 0; i < 16; i++)
+		p = fastmem_emit_movdqu(p, 0x6F, i, i * 16);
+	p = fastmem_emit(p, leave, sizeof(leave));
+	*p++ = 0xFF; *p++ = 0x25; // jmp [rip+rel32]
+	return fastmem_emit32(p, (u32)((const u8*)&fastmem_fault[proc].resume - (p + 4)));
+}
+
+static bool fastmem_init_stubs()
+{
+	if (mprotect(fastmem_stub_code, sizeof(fastmem_stub_code), PROT_READ|PROT_WRITE|PROT_EXEC) != 0)
+		return false;
+	u8 *p = fastmem_stub_code;
+	for (u32 proc = 0; proc < 2; proc++)
+	{
+		fastmem_stub[proc] = p;
+		p = fastmem_emit_stub(p, proc);
+	}
+	return true;
+}
+
+static void fastmem_segv(int sig, siginfo_t *info, void *context)
+{
+	ucontext_t *uc = (ucontext_t*)context;
+	greg_t *gregs = uc->uc_mcontext.gregs;
+	const u8 *rip = (const u8*)gregs[REG_RIP];
+	const u8 *fault = (const u8*)info->si_addr;
+
+	for (int proc = 0; proc < 2; proc++)
+	{
+		if (!fastmem_base[proc] || fault < fastmem_base[proc] || fault >= fastmem_base[proc] + FASTMEM_ARENA_SIZE)
+			continue;
+		if (rip < scratchpad || rip >= scratchpad + sizeof(scratchpad))
+			break;
+		u32 reg;
+		s32 size;
+		const u32 len = fastmem_decode(rip, &reg, &size);
+		if (!len || reg == 4)
+			break;
+
+		FASTMEM_FAULT &f = fastmem_fault[proc];
+		f.resume = rip + len;
+		f.rip = rip;
+		f.adr = (u32)(fault - fastmem_base[proc]);
+		f.size = size;
+		f.reg = reg;
+		gregs[REG_RIP] = (greg_t)fastmem_stub[proc];
+		return;
+	}
+
+	// not ours; returning with the default action restored re-raises the fault
+	if (fastmem_old_segv.sa_flags & SA_SIGINFO)
+		fastmem_old_segv.sa_sigaction(sig, info, context);
+	else if (fastmem_old_segv.sa_handler != SIG_DFL && fastmem_old_segv.sa_handler != SIG_IGN)
+		fastmem_old_segv.sa_handler(sig);
+	else
+		signal(sig, SIG_DFL);
+}
+
+template<int PROCNUM, int SIZE, MMU_ACCESS_DIRECTION DIRECTION>
+static void fastmem_fill_cycles(u8 *table)
+{
+	const u32 alu = (DIRECTION == MMU_AD_READ) ? 3 : 2;
+	for (u32 region = 0; region < 256; region++)
+		table[region] = (u8)MMU_aluMemCycles<PROCNUM>(alu, _MMU_accesstime<PROCNUM, MMU_AT_DATA, SIZE, DIRECTION, false>(region << 24, true));
+}
+
+template<int PROCNUM>
+static void fastmem_fill_cycles()
+{
+	fastmem_fill_cycles<PROCNUM, 8, MMU_AD_READ>(fastmem_cycles[PROCNUM][0][MMU_AD_READ]);
+	fastmem_fill_cycles<PROCNUM, 8, MMU_AD_WRITE>(fastmem_cycles[PROCNUM][0][MMU_AD_WRITE]);
+	fastmem_fill_cycles<PROCNUM, 16, MMU_AD_READ>(fastmem_cycles[PROCNUM][1][MMU_AD_READ]);
+	fastmem_fill_cycles<PROCNUM, 16, MMU_AD_WRITE>(fastmem_cycles[PROCNUM][1][MMU_AD_WRITE]);
+	fastmem_fill_cycles<PROCNUM, 32, MMU_AD_READ>(fastmem_cycles[PROCNUM][2][MMU_AD_READ]);
+	fastmem_fill_cycles<PROCNUM, 32, MMU_AD_WRITE>(fastmem_cycles[PROCNUM][2][MMU_AD_WRITE]);
+}
+
+// Moves the MMU arrays onto the shared memory object and reserves the arenas.
+static bool fastmem_init()
+{
+	static u8 * const regions[4] = { MMU.MAIN_MEM, MMU.ARM9_ITCM, MMU.ARM9_DTCM, MMU.ARM7_ERAM };
+	static const u32 sizes[4] = { sizeof(MMU.MAIN_MEM), sizeof(MMU.ARM9_ITCM), sizeof(MMU.ARM9_DTCM), sizeof(MMU.ARM7_ERAM) };
+
+	// the arrays keep their contents when moved, even onto a second object after a failure
+	fastmem_fd = memfd_create("desmume-fastmem", MFD_CLOEXEC);
+	if (fastmem_fd < 0 || ftruncate(fastmem_fd, FASTMEM_BACKING_SIZE) != 0)
+		goto fail;
+	for (int i = 0; i < 4; i++)
+	{
+		if (((uintptr_t)regions[i] & 4095) || pwrite(fastmem_fd, regions[i], sizes[i], fastmem_backing_ofs[i]) != (ssize_t)sizes[i])
+			goto fail;
+		if (mmap(regions[i], sizes[i], PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fastmem_fd, fastmem_backing_ofs[i]) == MAP_FAILED)
+			goto fail;
+	}
+
+	// one reservation, wherever the kernel puts it, split between the two processors
+	{
+		void *base = mmap(NULL, 2 * FASTMEM_ARENA_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (base == MAP_FAILED)
+			goto fail;
+		fastmem_base[0] = (u8*)base;
+		fastmem_base[1] = (u8*)base + FASTMEM_ARENA_SIZE;
+	}
+
+	if (!fastmem_init_stubs())
+		goto fail;
+
+	{
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction = fastmem_segv;
+		sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+		sigemptyset(&sa.sa_mask);
+		if (sigaction(SIGSEGV, &sa, &fastmem_old_segv) != 0)
+			goto fail;
+	}
+
+	fastmem_fill_cycles<0>();
+	fastmem_fill_cycles<1>();
+	return true;
+
+fail:
+	printf("JIT: fastmem unavailable (%s)\n", strerror(errno));
+	if (fastmem_base[0])
+		munmap(fastmem_base[0], 2 * FASTMEM_ARENA_SIZE);
+	fastmem_base[0] = fastmem_base[1] = NULL;
+	if (fastmem_fd >= 0)
+		close(fastmem_fd);
+	fastmem_fd = -1;
+	return false;
+}
+
+static bool fastmem_hooks_seen; // fastmem_hooked() when the live blocks were compiled
+
+// Whether anything needs to see every memory access: the gdb stub, breakpoints, or
+// memory hooks set by Lua scripts or the frontend interface.
+static bool fastmem_hooked()
+{
+	if (NDS_ARM9.mem_if != &NDS_ARM9.base_mem_if || NDS_ARM7.mem_if != &NDS_ARM7.base_mem_if)
+		return true;
+	if (!memReadBreakPoints.empty() || !memWriteBreakPoints.empty())
+		return true;
+#ifdef HAVE_LUA
+	if (hookedRegions[LUAMEMHOOK_READ].NotEmpty() || hookedRegions[LUAMEMHOOK_WRITE].NotEmpty()
+		|| hookedRegions[LUAMEMHOOK_READ_SUB].NotEmpty() || hookedRegions[LUAMEMHOOK_WRITE_SUB].NotEmpty())
+		return true;
+#endif
+#ifdef TARGET_INTERFACE
+	if (hooked_regions[HOOK_READ].NotEmpty() || hooked_regions[HOOK_WRITE].NotEmpty())
+		return true;
+#endif
+	return false;
+}
+
+static void fastmem_reset()
+{
+	fastmem_active = false;
+	fastmem_hooks_seen = fastmem_hooked();
+	memset(fastmem_heat, 0, sizeof(fastmem_heat));
+	if (!CommonSettings.jit_fastmem)
+	{
+		if (fastmem_base[0])
+			fastmem_unmap_all();
+		return;
+	}
+	if (!fastmem_base[0] && !fastmem_init())
+		return;
+	fastmem_active = fastmem_remap();
+	if (fastmem_active)
+		printf("JIT: fastmem enabled\n");
+}
+
+void arm_jit_memory_changed()
+{
+	if (fastmem_active)
+		fastmem_active = fastmem_remap();
+}
+
+// Whether the block entered at <slot> may access memory directly.
+static bool fastmem_allowed(const armcpu_t &proc, u32 slot)
+{
+	if (!fastmem_active || fastmem_hooked())
+		return false;
+	std::map<u32, JIT_ENTRY_HISTORY>::const_iterator history = jit_history.find(slot);
+	return history == jit_history.end() || !history->second.slowmem;
+}
+
+void arm_jit_check_hooks()
+{
+	const bool hooked = fastmem_hooked();
+	if (hooked == fastmem_hooks_seen)
+		return;
+	fastmem_hooks_seen = hooked;
+	if (!fastmem_active)
+		return;
+	// recompile everything, with or without fastmem
+	for (u32 id = 0; id < jit_blocks.size(); id++)
+		if (jit_blocks[id].rangeCount)
+			jit_block_discard(id, false);
+	jit_release_retired_code();
+}
+
+static bool bb_fastmem; // the block being compiled may access memory directly
+
+static bool fastmem_inline(u32 adr)
+{
+	return bb_fastmem && (fastmem_pages[PROCNUM][adr >> FASTMEM_PAGE_SHIFT] & FASTMEM_MAPPED);
+}
+
+template<int PROCNUM, int SIZE, MMU_ACCESS_DIRECTION DIRECTION>
+static u32 FASTCALL fastmem_timed_cycles(u32 adr)
+{
+	return MMU_aluMemAccessCycles<PROCNUM,SIZE,DIRECTION>(DIRECTION == MMU_AD_READ ? 3 : 2, adr);
+}
+
+typedef u32 (FASTCALL* FastmemCycles)(u32);
+#define T(PROCNUM) { \
+	{ fastmem_timed_cycles<PROCNUM,8,MMU_AD_READ>, fastmem_timed_cycles<PROCNUM,8,MMU_AD_WRITE> }, \
+	{ fastmem_timed_cycles<PROCNUM,16,MMU_AD_READ>, fastmem_timed_cycles<PROCNUM,16,MMU_AD_WRITE> }, \
+	{ fastmem_timed_cycles<PROCNUM,32,MMU_AD_READ>, fastmem_timed_cycles<PROCNUM,32,MMU_AD_WRITE> } }
+static const FastmemCycles fastmem_timed_tab[2][3][2] = { T(0), T(1) };
+#undef T
+
+// Sets bb_cycles the way the slow helpers' MMU_aluMemAccessCycles() does. Without
+// advanced timing that only depends on the region, so it comes from a table.
+static void emit_fastmem_cycles(u32 size, MMU_ACCESS_DIRECTION dir, GpVar adr)
+{
+	const u32 sizeIndex = (size == 8) ? 0 : (size == 16) ? 1 : 2;
+#ifdef ENABLE_ADVANCED_TIMING
+	Label timed = c.newLabel();
+	Label done = c.newLabel();
+	c.cmp(byte_ptr_abs(&CommonSettings.advanced_timing), 0);
+	c.jne(timed);
+#endif
+	GpVar region = c.newGpVar(kX86VarTypeGpz);
+	c.mov(region.r32(), adr);
+	c.shr(region.r32(), 24);
+	c.movzx(bb_cycles, byte_ptr_abs(fastmem_cycles[PROCNUM][sizeIndex][dir], region, kScaleNone));
+#ifdef ENABLE_ADVANCED_TIMING
+	c.jmp(done);
+	c.bind(timed);
+	X86CompilerFuncCall *ctx = c.call((void*)fastmem_timed_tab[PROCNUM][sizeIndex][dir]);
+	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder1<u32, u32>());
+	ctx->setArgument(0, adr);
+	ctx->setReturn(bb_cycles);
+	c.bind(done);
+#endif
+}
+
+// Emits a load of <size> bits (negative to sign extend) from <adr> into <dst>, with the
+// rotation of unaligned words that the slow helpers do. Returns false if the caller
+// should call the slow helper instead.
+static bool emit_fastmem_load(s32 size, GpVar adr, u32 adr_first, const Mem &dst)
+{
+	if (!fastmem_inline(adr_first))
+		return false;
+
+	GpVar ofs = c.newGpVar(kX86VarTypeGpz);
+	GpVar host = c.newGpVar(kX86VarTypeGpz);
+	GpVar data = c.newGpVar(kX86VarTypeGpd);
+	c.mov(ofs.r32(), adr);
+	if (size == 32)
+		c.and_(ofs.r32(), ~3);
+	else if (size == 16 || size == -16)
+		c.and_(ofs.r32(), ~1);
+	c.mov(host, (uintptr_t)fastmem_base[PROCNUM]);
+	switch (size)
+	{
+		case 32: c.mov(data, dword_ptr(host, ofs)); break;
+		case 16: c.movzx(data, word_ptr(host, ofs)); break;
+		case -16: c.movsx(data, word_ptr(host, ofs)); break;
+		case 8: c.movzx(data, byte_ptr(host, ofs)); break;
+		default: c.movsx(data, byte_ptr(host, ofs)); break;
+	}
+	if (size == 32)
+	{
+		GpVar shift = c.newGpVar(kX86VarTypeGpd);
+		c.mov(shift, adr);
+		c.and_(shift, 3);
+		c.shl(shift, 3);
+		c.ror(data, shift.r8Lo());
+	}
+	c.mov(dst, data);
+	emit_fastmem_cycles(size < 0 ? -size : size, MMU_AD_READ, adr);
+	return true;
+}
+
+// Emits a store of the low <size> bits of <data> to <adr>, which calls <slow> when the
+// page isn't writable. Returns false if the caller should only call <slow>.
+static bool emit_fastmem_store(u32 size, GpVar adr, u32 adr_first, GpVar data, void *slow)
+{
+	if (!fastmem_inline(adr_first))
+		return false;
+
+	Label slowpath = c.newLabel();
+	Label done = c.newLabel();
+	GpVar page = c.newGpVar(kX86VarTypeGpz);
+	c.mov(page.r32(), adr);
+	c.shr(page.r32(), FASTMEM_PAGE_SHIFT);
+	c.test(byte_ptr_abs(fastmem_pages[PROCNUM], page, kScaleNone), FASTMEM_WRITABLE);
+	c.jz(slowpath);
+
+	GpVar ofs = c.newGpVar(kX86VarTypeGpz);
+	GpVar host = c.newGpVar(kX86VarTypeGpz);
+	c.mov(ofs.r32(), adr);
+	if (size == 32)
+		c.and_(ofs.r32(), ~3);
+	else if (size == 16)
+		c.and_(ofs.r32(), ~1);
+	c.mov(host, (uintptr_t)fastmem_base[PROCNUM]);
+	switch (size)
+	{
+		case 32: c.mov(dword_ptr(host, ofs), data); break;
+		case 16: c.mov(word_ptr(host, ofs), data.r16()); break;
+		default: c.mov(byte_ptr(host, ofs), data.r8Lo()); break;
+	}
+	emit_fastmem_cycles(size, MMU_AD_WRITE, adr);
+	c.jmp(done);
+
+	c.bind(slowpath);
+	X86CompilerFuncCall *ctx = c.call(slow);
+	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<u32, u32, u32>());
+	ctx->setArgument(0, adr);
+	ctx->setArgument(1, data);
+	ctx->setReturn(bb_cycles);
+	c.bind(done);
+	return true;
+}
+
+#else
+static void jit_fastmem_code_changed(u32 page) {}
+static void fastmem_reset() {}
+void arm_jit_memory_changed() {}
+void arm_jit_check_hooks() {}
+static bool emit_fastmem_load(s32 size, GpVar adr, u32 adr_first, const Mem &dst) { return false; }
+static bool emit_fastmem_store(u32 size, GpVar adr, u32 adr_first, GpVar data, void *slow) { return false; }
+#endif
 
 //-----------------------------------------------------------------------------
 //   LDR
@@ -1605,14 +2756,15 @@ static const OpLDR LDRB_tab[2][5]  = { T(OP_LDRB) };
 static const OpLDR LDRSB_tab[2][5]  = { T(OP_LDRSB) };
 #undef T
 
+// access size of each helper for the fastmem path, negative if sign extended
+static const s32 LDR_bits = 32, LDRH_bits = 16, LDRSH_bits = -16, LDRB_bits = 8, LDRSB_bits = -8;
+
 static u32 add(u32 lhs, u32 rhs) { return lhs + rhs; }
 static u32 sub(u32 lhs, u32 rhs) { return lhs - rhs; }
 
 #define OP_LDR_(mem_op, arg, sign_op, writeback) \
 	GpVar adr = c.newGpVar(kX86VarTypeGpd); \
-	GpVar dst = c.newGpVar(kX86VarTypeGpz); \
 	c.mov(adr, reg_pos_ptr(16)); \
-	c.lea(dst, reg_pos_ptr(12)); \
 	arg; \
 	if(!rhs_is_imm || *(u32*)&rhs) \
 	{ \
@@ -1632,11 +2784,16 @@ static u32 sub(u32 lhs, u32 rhs) { return lhs - rhs; }
 		} \
 	} \
 	u32 adr_first = sign_op(cpu->R[REG_POS(i,16)], rhs_first); \
-	X86CompilerFuncCall *ctx = c.call((void*)mem_op##_tab[PROCNUM][classify_adr(adr_first,0)]); \
-	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<u32, u32, u32*>()); \
-	ctx->setArgument(0, adr); \
-	ctx->setArgument(1, dst); \
-	ctx->setReturn(bb_cycles); \
+	if(!emit_fastmem_load(mem_op##_bits, adr, adr_first, reg_pos_ptr(12))) \
+	{ \
+		GpVar dst = c.newGpVar(kX86VarTypeGpz); \
+		c.lea(dst, reg_pos_ptr(12)); \
+		X86CompilerFuncCall *ctx = c.call((void*)mem_op##_tab[PROCNUM][classify_adr(adr_first,0)]); \
+		ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<u32, u32, u32*>()); \
+		ctx->setArgument(0, adr); \
+		ctx->setArgument(1, dst); \
+		ctx->setReturn(bb_cycles); \
+	} \
 	if(REG_POS(i,12)==15) \
 	{ \
 		GpVar tmp = c.newGpVar(kX86VarTypeGpd); \
@@ -1800,6 +2957,8 @@ static const OpSTR STRH_tab[2][3]  = { T(OP_STRH) };
 static const OpSTR STRB_tab[2][3]  = { T(OP_STRB) };
 #undef T
 
+static const u32 STR_bits = 32, STRH_bits = 16, STRB_bits = 8;
+
 #define OP_STR_(mem_op, arg, sign_op, writeback) \
 	GpVar adr = c.newGpVar(kX86VarTypeGpd); \
 	GpVar data = c.newGpVar(kX86VarTypeGpd); \
@@ -1824,11 +2983,15 @@ static const OpSTR STRB_tab[2][3]  = { T(OP_STRB) };
 		} \
 	} \
 	u32 adr_first = sign_op(cpu->R[REG_POS(i,16)], rhs_first); \
-	X86CompilerFuncCall *ctx = c.call((void*)mem_op##_tab[PROCNUM][classify_adr(adr_first,1)]); \
-	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<u32, u32, u32>()); \
-	ctx->setArgument(0, adr); \
-	ctx->setArgument(1, data); \
-	ctx->setReturn(bb_cycles); \
+	void *fn = (void*)mem_op##_tab[PROCNUM][classify_adr(adr_first,1)]; \
+	if(!emit_fastmem_store(mem_op##_bits, adr, adr_first, data, fn)) \
+	{ \
+		X86CompilerFuncCall *ctx = c.call(fn); \
+		ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<u32, u32, u32>()); \
+		ctx->setArgument(0, adr); \
+		ctx->setArgument(1, data); \
+		ctx->setReturn(bb_cycles); \
+	} \
 	return 1;
 
 static int OP_STR_P_IMM_OFF(const u32 i) { OP_STR_(STR, IMM_OFF_12, add, 0); }
@@ -2218,7 +3381,10 @@ static u32 FASTCALL OP_LDM_STM(u32 adr, u64 regs, int n)
 		ptr = MMU.ARM9_DTCM + (adr & 0x3FFC);
 		cycles = n * MMU_memAccessCycles<PROCNUM,32,store?MMU_AD_WRITE:MMU_AD_READ>(adr);
 		if(store)
+		{
+			MMU_MarkDirtyRange(dir > 0 ? ptr : ptr - (n-1)*4, n*4);
 			return OP_LDM_STM_main<PROCNUM, store, dir, 0>(adr, regs, n, ptr, cycles);
+		}
 	}
 	else if((adr & 0x0F000000) == 0x02000000)
 	{
@@ -2238,6 +3404,7 @@ static u32 FASTCALL OP_LDM_STM(u32 adr, u64 regs, int n)
 	else
 		return OP_LDM_STM_other<PROCNUM, store, dir>(adr, regs, n);
 
+	if(store) MMU_MarkDirtyRange(dir > 0 ? ptr : ptr - (n-1)*4, n*4);
 	return OP_LDM_STM_main<PROCNUM, store, dir, store>(adr, regs, n, ptr, cycles);
 }
 
@@ -2432,6 +3599,24 @@ static int OP_STMDB2_W(const u32 i) { return op_ldm_stm2(i, 1, -1, 1, 1); }
 #define SIGNEXTEND_11(i) (((s32)i<<21)>>21)
 #define SIGNEXTEND_24(i) (((s32)i<<8)>>8)
 
+// Short backward branches that might close an idle loop have armcpu_idleLoopCheck
+// look at the loop whenever they're taken.
+static void emit_idle_loop_check(u32 dst)
+{
+	if (!CommonSettings.idle_loop_skip || dst >= (u32)bb_adr
+		|| !armcpu_idleLoopCandidate(PROCNUM, bb_adr, dst, bb_thumb))
+		return;
+
+	GpVar branch = c.newGpVar(kX86VarTypeGpd);
+	GpVar target = c.newGpVar(kX86VarTypeGpd);
+	c.mov(branch, bb_adr);
+	c.mov(target, dst);
+	X86CompilerFuncCall *ctx = c.call((void*)(PROCNUM ? armcpu_idleLoopCheck<1> : armcpu_idleLoopCheck<0>));
+	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<Void, u32, u32>());
+	ctx->setArgument(0, branch);
+	ctx->setArgument(1, target);
+}
+
 static int op_b(u32 i, bool bl)
 {
 	u32 dst = bb_r15 + (SIGNEXTEND_24(i) << 2);
@@ -2445,6 +3630,8 @@ static int op_b(u32 i, bool bl)
 		c.mov(reg_ptr(14), bb_next_instruction);
 
 	c.mov(cpu_ptr(instruct_adr), dst);
+	if(!bl && CONDITION(i)!=0xF)
+		emit_idle_loop_check(dst);
 	return 1;
 }
 
@@ -3527,16 +4714,19 @@ static int OP_TST(const u32 i)
 		adr_first += cpu->R[_REG_NUM(i, 6)]; \
 	} \
 	c.mov(data, reg_pos_thumb(0)); \
-	X86CompilerFuncCall *ctx = c.call((void*)mem_op##_tab[PROCNUM][classify_adr(adr_first,1)]); \
-	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<Void, u32, u32>()); \
-	ctx->setArgument(0, addr); \
-	ctx->setArgument(1, data); \
-	ctx->setReturn(bb_cycles); \
+	void *fn = (void*)mem_op##_tab[PROCNUM][classify_adr(adr_first,1)]; \
+	if(!emit_fastmem_store(mem_op##_bits, addr, adr_first, data, fn)) \
+	{ \
+		X86CompilerFuncCall *ctx = c.call(fn); \
+		ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<Void, u32, u32>()); \
+		ctx->setArgument(0, addr); \
+		ctx->setArgument(1, data); \
+		ctx->setReturn(bb_cycles); \
+	} \
 	return 1;
 
 #define LDR_THUMB(mem_op, offset) \
 	GpVar addr = c.newGpVar(kX86VarTypeGpd); \
-	GpVar data = c.newGpVar(kX86VarTypeGpz); \
 	u32 adr_first = cpu->R[_REG_NUM(i, 3)]; \
 	 \
 	c.mov(addr, reg_pos_thumb(3)); \
@@ -3553,12 +4743,16 @@ static int OP_TST(const u32 i)
 		c.add(addr, reg_pos_thumb(6)); \
 		adr_first += cpu->R[_REG_NUM(i, 6)]; \
 	} \
-	c.lea(data, reg_pos_thumb(0)); \
-	X86CompilerFuncCall *ctx = c.call((void*)mem_op##_tab[PROCNUM][classify_adr(adr_first,0)]); \
-	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<Void, u32, u32*>()); \
-	ctx->setArgument(0, addr); \
-	ctx->setArgument(1, data); \
-	ctx->setReturn(bb_cycles); \
+	if(!emit_fastmem_load(mem_op##_bits, addr, adr_first, reg_pos_thumb(0))) \
+	{ \
+		GpVar data = c.newGpVar(kX86VarTypeGpz); \
+		c.lea(data, reg_pos_thumb(0)); \
+		X86CompilerFuncCall *ctx = c.call((void*)mem_op##_tab[PROCNUM][classify_adr(adr_first,0)]); \
+		ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<Void, u32, u32*>()); \
+		ctx->setArgument(0, addr); \
+		ctx->setArgument(1, data); \
+		ctx->setReturn(bb_cycles); \
+	} \
 	return 1;
 
 static int OP_STRB_IMM_OFF(const u32 i) { STR_THUMB(STRB, ((i>>6)&0x1F)); }
@@ -3588,7 +4782,10 @@ static int OP_STR_SPREL(const u32 i)
 	if (imm) c.add(addr, imm);
 	GpVar data = c.newGpVar(kX86VarTypeGpd);
 	c.mov(data, reg_pos_thumb(8));
-	X86CompilerFuncCall *ctx = c.call((void*)STR_tab[PROCNUM][classify_adr(adr_first,1)]);
+	void *fn = (void*)STR_tab[PROCNUM][classify_adr(adr_first,1)];
+	if (emit_fastmem_store(STR_bits, addr, adr_first, data, fn))
+		return 1;
+	X86CompilerFuncCall *ctx = c.call(fn);
 	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<Void, u32, u32>());
 	ctx->setArgument(0, addr);
 	ctx->setArgument(1, data);
@@ -3604,6 +4801,8 @@ static int OP_LDR_SPREL(const u32 i)
 	GpVar addr = c.newGpVar(kX86VarTypeGpd);
 	c.mov(addr, reg_ptr(13));
 	if (imm) c.add(addr, imm);
+	if (emit_fastmem_load(LDR_bits, addr, adr_first, reg_pos_thumb(8)))
+		return 1;
 	GpVar data = c.newGpVar(kX86VarTypeGpz);
 	c.lea(data, reg_pos_thumb(8));
 	X86CompilerFuncCall *ctx = c.call((void*)LDR_tab[PROCNUM][classify_adr(adr_first,0)]);
@@ -3619,8 +4818,10 @@ static int OP_LDR_PCREL(const u32 i)
 	u32 imm = ((i&0xFF)<<2);
 	u32 adr_first = (bb_r15 & 0xFFFFFFFC) + imm;
 	GpVar addr = c.newGpVar(kX86VarTypeGpd);
-	GpVar data = c.newGpVar(kX86VarTypeGpz);
 	c.mov(addr, adr_first);
+	if (emit_fastmem_load(LDR_bits, addr, adr_first, reg_pos_thumb(8)))
+		return 1;
+	GpVar data = c.newGpVar(kX86VarTypeGpz);
 	c.lea(data, reg_pos_thumb(8));
 	X86CompilerFuncCall *ctx = c.call((void*)LDR_tab[PROCNUM][classify_adr(adr_first,0)]);
 	ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder2<Void, u32, u32*>());
@@ -3714,6 +4915,7 @@ static int OP_B_COND(const u32 i)
 	emit_branch((i>>8)&0xF, skip);
 	c.mov(cpu_ptr(instruct_adr), dst);
 	c.add(bb_total_cycles, 2);
+	emit_idle_loop_check(dst);
 	c.bind(skip);	
 
 	return 1;
@@ -3723,6 +4925,7 @@ static int OP_B_UNCOND(const u32 i)
 {
 	u32 dst = bb_r15 + (SIGNEXTEND_11(i)<<1);
 	c.mov(cpu_ptr(instruct_adr), dst);
+	emit_idle_loop_check(dst);
 	return 1;
 }
 
@@ -3932,6 +5135,140 @@ static bool instr_is_conditional(u32 opcode)
 	         || (CONDITION(opcode) == 0xF && CODE(opcode) == 5));
 }
 
+// Which flags an instruction reads, and which it always overwrites. Reads may be
+// overestimated and overwrites underestimated; anything that can see the whole
+// CPSR (MRS, MSR, exceptions, mode changes) counts as reading every flag.
+static void instr_flags(u32 opcode, u32 *reads, u32 *kills)
+{
+	static const u8 cond_reads[16] = {
+		FLAG_Z, FLAG_Z, FLAG_C, FLAG_C, FLAG_N, FLAG_N, FLAG_V, FLAG_V,
+		FLAG_C|FLAG_Z, FLAG_C|FLAG_Z, FLAG_N|FLAG_V, FLAG_N|FLAG_V,
+		FLAG_N|FLAG_Z|FLAG_V, FLAG_N|FLAG_Z|FLAG_V, 0, 0
+	};
+
+	*reads = 0;
+	*kills = 0;
+
+	if(bb_thumb)
+	{
+		switch(opcode >> 11)
+		{
+			case 0x00: // LSL imm, which leaves C alone when shifting by 0
+				*kills = ((opcode >> 6) & 0x1F) ? (FLAG_N|FLAG_Z|FLAG_C) : (FLAG_N|FLAG_Z);
+				break;
+			case 0x01: case 0x02: // LSR, ASR imm
+				*kills = FLAG_N|FLAG_Z|FLAG_C;
+				break;
+			case 0x03: // ADD, SUB
+			case 0x05: case 0x06: case 0x07: // CMP, ADD, SUB imm8
+				*kills = FLAGS_NZCV;
+				break;
+			case 0x04: // MOV imm8
+				*kills = FLAG_N|FLAG_Z;
+				break;
+			case 0x08:
+				if(!BIT10(opcode))
+				{
+					switch((opcode >> 6) & 0xF)
+					{
+						case 0x5: case 0x6: // ADC, SBC
+							*reads = FLAG_C;
+							*kills = FLAGS_NZCV;
+							break;
+						case 0x9: case 0xA: case 0xB: // NEG, CMP, CMN
+							*kills = FLAGS_NZCV;
+							break;
+						default: // logical ops, register shifts, MUL
+							*kills = FLAG_N|FLAG_Z;
+							break;
+					}
+				}
+				else if(((opcode >> 8) & 3) == 1) // CMP with high registers
+					*kills = FLAGS_NZCV;
+				break;
+			case 0x16: case 0x17: // ADD SP, PUSH, POP; the rest is BKPT or undefined
+				switch((opcode >> 8) & 0xF)
+				{
+					case 0x0: case 0x4: case 0x5: case 0xC: case 0xD: break;
+					default: *reads = FLAGS_NZCV; break;
+				}
+				break;
+			case 0x1A: case 0x1B: // B cond; condition 0xE is undefined and 0xF is SWI
+				*reads = ((opcode >> 8) & 0xF) >= 0xE ? FLAGS_NZCV : cond_reads[(opcode >> 8) & 0xF];
+				break;
+		}
+		return;
+	}
+
+	const u32 cond = CONDITION(opcode);
+	if(cond == 0xF)
+	{
+		// BLX imm and PLD
+		if(CODE(opcode) != 5 && (opcode & 0x0D70F000) != 0x0550F000)
+			*reads = FLAGS_NZCV;
+		return;
+	}
+
+	u32 reads_op = 0, kills_op = 0;
+	switch(CODE(opcode))
+	{
+		case 0: case 1:
+			if(CODE(opcode) == 0 && (opcode & 0x90) == 0x90)
+			{
+				// multiplies, SWP and the halfword transfers
+				if((opcode & 0x0F0000F0) == 0x00000090 && BIT20(opcode))
+					kills_op = FLAG_N|FLAG_Z;
+			}
+			else if((opcode & 0x01900000) == 0x01000000)
+			{
+				// BX, BLX, CLZ, the saturating and halfword multiplies only touch Q;
+				// MRS, MSR and BKPT see the whole CPSR
+				const u32 op = opcode & 0xF0;
+				if(CODE(opcode) == 1 || !(op == 0x10 || op == 0x30 || op == 0x50 || (op & 0x90) == 0x80))
+					reads_op = FLAGS_NZCV;
+			}
+			else
+			{
+				const u32 op = (opcode >> 21) & 0xF;
+				if(op >= 0x5 && op <= 0x7) // ADC, SBC, RSC
+					reads_op = FLAG_C;
+				if(CODE(opcode) == 0 && (opcode & 0xFF0) == 0x060) // RRX
+					reads_op = FLAG_C;
+				if(BIT20(opcode))
+				{
+					if(REG_POS(opcode,12) == 15) // copies SPSR to CPSR
+						reads_op = FLAGS_NZCV;
+					else if((op >= 0x2 && op <= 0x7) || op == 0xA || op == 0xB)
+						kills_op = FLAGS_NZCV;
+					else
+						kills_op = FLAG_N|FLAG_Z;
+				}
+			}
+			break;
+		case 2: // LDR, STR
+		case 5: // B, BL
+			break;
+		case 3: // LDR, STR or undefined
+			if(BIT4(opcode))
+				reads_op = FLAGS_NZCV;
+			else if((opcode & 0xFF0) == 0x060) // RRX offset
+				reads_op = FLAG_C;
+			break;
+		case 4: // LDM, STM
+			if(BIT22(opcode))
+				reads_op = FLAGS_NZCV;
+			break;
+		default: // coprocessor, SWI
+			reads_op = FLAGS_NZCV;
+			break;
+	}
+
+	*reads = cond_reads[cond] | reads_op;
+	// an instruction that may be skipped overwrites nothing for sure
+	if(cond == 0xE)
+		*kills = kills_op;
+}
+
 static int instr_cycles(u32 opcode)
 {
 	u32 x = instr_attributes(opcode);
@@ -4053,6 +5390,136 @@ static void emit_armop_call(u32 opcode)
 	ctx->setReturn(bb_cycles);
 }
 
+// Blocks never straddle a discontinuity in the slot tables (the end of a bank or a
+// mirror boundary), so every block covers one contiguous range of slots.
+template<int PROCNUM>
+static bool instr_slot_continues(u32 adr)
+{
+	const u32 next = adr + bb_opcodesize;
+	if (!JIT_MAPPED(next & 0x0FFFFFFF, PROCNUM))
+		return false;
+	return &JIT_COMPILED_FUNC(next, PROCNUM) == &JIT_COMPILED_FUNC(adr, PROCNUM) + (bb_opcodesize >> 1);
+}
+
+// Guest addresses the block can continue at that are known at compile time: the target
+// of a B/BL (and its fall-through if conditional), or the next instruction if the block
+// was cut short. Branches that may switch between ARM and THUMB are never linked.
+static u32 instr_static_exits(u32 opcode, u32 prev_opcode, u32 *exits)
+{
+	if (!instr_is_branch(opcode))
+	{
+		exits[0] = bb_next_instruction;
+		return 1;
+	}
+
+	if (bb_thumb)
+	{
+		if ((opcode & 0xF000) == 0xD000 && ((opcode >> 8) & 0xF) < 0xE) // B cond
+		{
+			exits[0] = bb_r15 + ((u32)((s8)(opcode&0xFF))<<1);
+			exits[1] = bb_next_instruction;
+			return 2;
+		}
+		if ((opcode & 0xF800) == 0xE000) // B
+		{
+			exits[0] = bb_r15 + (SIGNEXTEND_11(opcode)<<1);
+			return 1;
+		}
+		if ((opcode & 0xF800) == 0xF800 && (prev_opcode & 0xF800) == 0xF000) // BL pair
+		{
+			exits[0] = bb_adr + 2 + (SIGNEXTEND_11(prev_opcode)<<12) + ((opcode&0x7FF)<<1);
+			return 1;
+		}
+		return 0;
+	}
+
+	if ((opcode & 0x0E000000) == 0x0A000000 && CONDITION(opcode) != 0xF) // B, BL
+	{
+		exits[0] = bb_r15 + (SIGNEXTEND_24(opcode) << 2);
+		if (!instr_is_conditional(opcode))
+			return 1;
+		exits[1] = bb_next_instruction;
+		return 2;
+	}
+	return 0;
+}
+
+// The destination of an unconditional branch with a static target, which a superblock
+// can carry on compiling at.
+template<int PROCNUM>
+static bool instr_superblock_target(u32 opcode, u32 prev_opcode, u32 *target)
+{
+	u32 exits[JIT_MAX_EXITS];
+	if (!instr_is_branch(opcode) || instr_static_exits(opcode, prev_opcode, exits) != 1)
+		return false;
+	if (!JIT_MAPPED(exits[0] & 0x0FFFFFFF, PROCNUM))
+		return false;
+	*target = exits[0];
+	return true;
+}
+
+template<int PROCNUM>
+static u32 alloc_exit_links(u32 opcode, u32 prev_opcode, u32 *links)
+{
+	u32 exits[JIT_MAX_EXITS];
+	u32 count = 0;
+	const u32 n = instr_static_exits(opcode, prev_opcode, exits);
+	for (u32 i = 0; i < n; i++)
+	{
+		if (!JIT_MAPPED(exits[i] & 0x0FFFFFFF, PROCNUM))
+			continue;
+		const u32 slot = JIT_SLOT(JIT_COMPILED_FUNC(exits[i], PROCNUM));
+		const u32 id = jit_link_alloc(exits[i], slot, PROCNUM, bb_thumb);
+		if (id != JIT_NO_LINK)
+			links[count++] = id;
+	}
+	return count;
+}
+
+static void emit_exit_links(const u32 *links, u32 count)
+{
+	JIT_COMMENT("block links");
+	Label done = c.newLabel();
+
+	// a CPU that just halted or parked in an idle loop must get back to the dispatcher
+	c.cmp(cpu_ptr(freeze), 0);
+	c.jne(done);
+
+	GpVar state = c.newGpVar(kX86VarTypeGpz);
+	c.mov(state, (uintptr_t)&jit_link);
+	c.sub(dword_ptr(state, offsetof(JIT_LINK_STATE, budget)), bb_total_cycles.r32());
+	c.jle(done);
+	c.sub(dword_ptr(state, offsetof(JIT_LINK_STATE, links)), 1);
+	c.jl(done);
+	c.unuse(state);
+
+	for (u32 i = 0; i < count; i++)
+	{
+		const JIT_LINK &link = jit_links[links[i]];
+		Label next = c.newLabel();
+		c.cmp(cpu_ptr(instruct_adr), link.adr);
+		c.jne(next);
+
+		GpVar target = c.newGpVar(kX86VarTypeGpz);
+		c.mov(target, (uintptr_t)&link.target);
+		c.mov(target, ptr(target));
+		c.test(target, target);
+		c.jz(done);
+
+		GpVar cycles = c.newGpVar(kX86VarTypeGpz);
+		X86CompilerFuncCall* ctx = c.call(target);
+		ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder0<u32>());
+		ctx->setReturn(cycles);
+		c.add(bb_total_cycles, cycles);
+		c.unuse(cycles);
+		c.jmp(done);
+
+		c.bind(next);
+	}
+
+	c.bind(done);
+}
+
 static void _armlog(u8 proc, u32 addr, u32 opcode)
 {
 #if 0
@@ -4095,6 +5562,43 @@ static u32 compile_basicblock()
 		return 1;
 	}
 
+	const u32 entry = JIT_SLOT(JIT_COMPILED_FUNC(start_adr, PROCNUM));
+	JIT_RANGE ranges[JIT_MAX_RANGES];
+	u32 rangeCount = 1;
+	ranges[0].adr = start_adr;
+	ranges[0].slot = entry;
+	ranges[0].size = 0;
+
+	// a block still registered here has asked to be replaced by a superblock
+	u8 tier = 0;
+	std::map<u32, u32>::iterator hot = jit_entry_blocks.find(entry);
+	if (hot != jit_entry_blocks.end())
+	{
+		const JIT_BLOCK &b = jit_blocks[hot->second];
+		if (b.hot && b.proc == PROCNUM && b.thumb == bb_thumb)
+			tier = 1;
+		jit_block_discard(hot->second, true);
+	}
+
+	std::map<u32, JIT_ENTRY_HISTORY>::iterator history = jit_history.find(entry);
+	if (history != jit_history.end())
+	{
+		if (history->second.thrash > JIT_MAX_THRASH)
+		{
+			ArmOpCompiled f = op_decode[PROCNUM][bb_thumb];
+			JIT_COMPILED_FUNC(start_adr, PROCNUM) = (uintptr_t)f;
+			ranges[0].size = history->second.size;
+			jit_block_register(ranges, 1, NULL, 0, PROCNUM, bb_thumb, 0);
+			jit_stats.interpreted++;
+			return f();
+		}
+		jit_stats.recompiled++;
+	}
+
+#ifdef HAVE_JIT_FASTMEM
+	bb_fastmem = fastmem_allowed(*cpu, entry);
+#endif
+
 #if LOG_JIT
 	fprintf(stderr, "adr %08Xh %s%c\n", start_adr, ARMPROC.CPSR.bits.T ? "THUMB":"ARM", PROCNUM?'7':'9');
 #endif
@@ -4112,21 +5616,90 @@ static u32 compile_basicblock()
 	bb_total_cycles = c.newGpVar(kX86VarTypeGpz);
 	c.mov(bb_total_cycles, 0);
 
+	if (tier == 0)
+	{
+		JIT_COMMENT("heat counter");
+		Label cold = c.newLabel();
+		c.sub(word_ptr_abs(&JIT_HEAT(entry)), 1);
+		c.jnz(cold);
+		GpVar slot = c.newGpVar(kX86VarTypeGpd);
+		c.mov(slot, entry);
+		X86CompilerFuncCall* ctx = c.call((void*)jit_block_hot);
+		ctx->setPrototype(ASMJIT_CALL_CONV, FuncBuilder1<Void, u32>());
+		ctx->setArgument(0, slot);
+		c.unuse(slot);
+		c.bind(cold);
+	}
+
 #if (PROFILER_JIT_LEVEL > 0)
 	JIT_COMMENT("Profiler ptr");
 	bb_profiler = c.newGpVar(kX86VarTypeGpz);
 	c.mov(bb_profiler, (uintptr_t)&profiler_counter[PROCNUM]);
 #endif
 
-	bb_constant_cycles = 0;
-	for(u32 i=0, bEndBlock = 0; bEndBlock == 0; i++)
+	// Decode the whole block before emitting any of it, so that flag liveness
+	// can be worked out backwards from its end.
+	bb_trace.clear();
+	u32 prev_opcode = 0;
+	u32 next_adr = start_adr;
+	u32 range_len = 0; // instructions in the current range
+	for(u32 bEndBlock = 0; bEndBlock == 0; )
 	{
-		bb_adr = start_adr + (i * bb_opcodesize);
+		prev_opcode = opcode;
+		bb_adr = next_adr;
 		if(bb_thumb)
 			opcode = _MMU_read16<PROCNUM, MMU_AT_CODE>(bb_adr);
 		else
 			opcode = _MMU_read32<PROCNUM, MMU_AT_CODE>(bb_adr);
 
+		bEndBlock = instr_is_branch(opcode) || (range_len >= (CommonSettings.jit_max_block_size - 1)) || !instr_slot_continues<PROCNUM>(bb_adr);
+		ranges[rangeCount-1].size += bb_opcodesize >> 1;
+		range_len++;
+		next_adr = bb_next_instruction;
+
+		u32 target;
+		if (bEndBlock && tier > 0 && rangeCount < JIT_MAX_RANGES && instr_superblock_target<PROCNUM>(opcode, prev_opcode, &target))
+		{
+			bool seen = false;
+			for (u32 r = 0; r < rangeCount && !seen; r++)
+				seen = ranges[r].adr == target;
+			if (!seen)
+			{
+				JIT_COMMENT("superblock continues at %08X", target);
+				bEndBlock = 0;
+				next_adr = target;
+				range_len = 0;
+				ranges[rangeCount].adr = target;
+				ranges[rangeCount].slot = JIT_SLOT(JIT_COMPILED_FUNC(target, PROCNUM));
+				ranges[rangeCount].size = 0;
+				rangeCount++;
+			}
+		}
+
+		JIT_TRACE_OP op = { (u32)bb_adr, opcode, FLAGS_NZCV, bEndBlock };
+		bb_trace.push_back(op);
+	}
+
+	// whatever runs after the block may read any flag
+	u32 live = FLAGS_NZCV;
+	for(size_t i = bb_trace.size(); i-- > 0; )
+	{
+		u32 reads, kills;
+		instr_flags(bb_trace[i].opcode, &reads, &kills);
+		bb_trace[i].live = live;
+		live = reads | (live & ~kills);
+	}
+
+	bb_constant_cycles = 0;
+	opcode = 0;
+	for(size_t i = 0; i < bb_trace.size(); i++)
+	{
+		const u32 bEndBlock = bb_trace[i].end;
+		prev_opcode = opcode;
+		bb_adr = bb_trace[i].adr;
+		opcode = bb_trace[i].opcode;
+		bb_flags_live = bb_trace[i].live;
+
 #if LOG_JIT
 		char dasmbuf[1024] = {0};
 		if(bb_thumb)
@@ -4138,8 +5711,6 @@ static u32 compile_basicblock()
 
 		u32 cycles = instr_cycles(opcode);
 
-		bEndBlock = instr_is_branch(opcode) || (i >= (CommonSettings.jit_max_block_size - 1));
-		
 #if LOG_JIT
 		if (instr_is_conditional(opcode) && (cycles > 1) || (cycles == 0))
 			has_variable_cycles = TRUE;
@@ -4193,6 +5764,16 @@ static u32 compile_basicblock()
 		}
 		interpreted_cycles += op_decode[PROCNUM][bb_thumb]();
 	}
+	bb_flags_live = FLAGS_NZCV;
+
+	// the block was decoded before any of it ran, so if running it rewrote
+	// its own code the emitted code is already stale
+	bool stale = false;
+	for(size_t i = 0; i < bb_trace.size() && !stale; i++)
+	{
+		const u32 adr = bb_trace[i].adr;
+		stale = bb_trace[i].opcode != (bb_thumb ? _MMU_read16<PROCNUM, MMU_AT_CODE>(adr) : _MMU_read32<PROCNUM, MMU_AT_CODE>(adr));
+	}
 	
 	if(!instr_does_prefetch(opcode))
 	{
@@ -4219,6 +5800,11 @@ static u32 compile_basicblock()
 	profiler_entry[PROCNUM][padr].addr = start_adr;
 #endif
 
+	u32 links[JIT_MAX_EXITS];
+	const u32 linkCount = alloc_exit_links<PROCNUM>(opcode, prev_opcode, links);
+	if (linkCount)
+		emit_exit_links(links, linkCount);
+
 	c.ret(bb_total_cycles);
 #if LOG_JIT
 	fprintf(stderr, "cycles %d%s\n", bb_constant_cycles, has_variable_cycles ? " + variable" : "");
@@ -4226,11 +5812,37 @@ static u32 compile_basicblock()
 	c.endFunc();
 
 	ArmOpCompiled f = (ArmOpCompiled)c.make();
+	u32 codeSize = 0;
+#ifdef HAVE_STATIC_CODE_BUFFER
+	codeSize = code_last_size;
+#endif
 	if(c.getError())
 	{
 		fprintf(stderr, "JIT error at %s%c-%08X: %s\n", bb_thumb?"THUMB":"ARM", PROCNUM?'7':'9', start_adr, getErrorString(c.getError()));
 		f = op_decode[PROCNUM][bb_thumb];
+		jit_block_register(ranges, rangeCount, NULL, 0, PROCNUM, bb_thumb, tier);
+		for (u32 i = 0; i < linkCount; i++)
+			jit_link_free(links[i]);
+	}
+	else if (f && stale)
+	{
+		// compile it again the next time it is reached
+		jit_code_free((void*)f, codeSize);
+		for (u32 i = 0; i < linkCount; i++)
+			jit_link_free(links[i]);
+		f = NULL;
 	}
+	else if (f)
+	{
+		JIT_BLOCK &b = jit_blocks[jit_block_register(ranges, rangeCount, (void*)f, codeSize, PROCNUM, bb_thumb, tier)];
+		for (u32 i = 0; i < linkCount; i++)
+			b.exits[i] = links[i];
+		b.exitCount = linkCount;
+		jit_stats.compiled++;
+		if (tier > 0)
+			jit_stats.superblocks++;
+	}
+	// else the code cache was flushed while generating, which dropped the links as well
 #if LOG_JIT
 	uintptr_t baddr = (uintptr_t)f;
 	fprintf(stderr, "Block address %08lX\n\n", baddr);
@@ -4245,17 +5857,8 @@ template<int PROCNUM> u32 arm_jit_compile()
 {
 	*PROCNUM_ptr = PROCNUM;
 
-	// prevent endless recompilation of self-modifying code, which would be a memleak since we only free code all at once.
-	// also allows us to clear compiled_funcs[] while leaving it sparsely allocated, if the OS does memory overcommit.
-	u32 adr = cpu->instruct_adr;
-	u32 mask_adr = (adr & 0x07FFFFFE) >> 4;
-	if(((recompile_counts[mask_adr >> 1] >> 4*(mask_adr & 1)) & 0xF) > 8)
-	{
-		ArmOpCompiled f = op_decode[PROCNUM][cpu->CPSR.bits.T];
-		JIT_COMPILED_FUNC(adr, PROCNUM) = (uintptr_t)f;
-		return f();
-	}
-	recompile_counts[mask_adr >> 1] += 1 << 4*(mask_adr & 1);
+	// no block is running here, so code discarded by earlier writes can be reused
+	jit_release_retired_code();
 
 	return compile_basicblock<PROCNUM>();
 }
@@ -4268,9 +5871,6 @@ void arm_jit_reset(bool enable, bool suppress_msg)
 #if LOG_JIT
 	c.setLogger(&logger);
 	freopen("desmume_jit.log", "w", stderr);
-#endif
-#ifdef HAVE_STATIC_CODE_BUFFER
-	scratchptr = scratchpad;
 #endif
 	if (!suppress_msg)
 		printf("CPU mode: %s\n", enable?"JIT":"Interpreter");
@@ -4281,30 +5881,13 @@ void arm_jit_reset(bool enable, bool suppress_msg)
 		printf("JIT: max block size %d instruction(s)\n", CommonSettings.jit_max_block_size);
 
 #ifdef MAPPED_JIT_FUNCS
-
-		//these pointers are allocated by asmjit and need freeing
-		#define JITFREE(x)  for(int iii=0;iii<ARRAY_SIZE(x);iii++) if(x[iii]) AsmJit::MemoryManager::getGlobal()->free((void*)x[iii]);  memset(x,0,sizeof(x));
-			JITFREE(JIT.MAIN_MEM);
-			JITFREE(JIT.SWIRAM);
-			JITFREE(JIT.ARM9_ITCM);
-			JITFREE(JIT.ARM9_LCDC);
-			JITFREE(JIT.ARM9_BIOS);
-			JITFREE(JIT.ARM7_BIOS);
-			JITFREE(JIT.ARM7_ERAM);
-			JITFREE(JIT.ARM7_WIRAM);
-			JITFREE(JIT.ARM7_WRAM);
-		#undef JITFREE
-
-		memset(recompile_counts, 0, sizeof(recompile_counts));
 		init_jit_mem();
-#else
-		for(int i=0; i<sizeof(recompile_counts)/8; i++)
-			if(((u64*)recompile_counts)[i])
-			{
-				((u64*)recompile_counts)[i] = 0;
-				memset(compiled_funcs+128*i, 0, 128*sizeof(*compiled_funcs));
-			}
 #endif
+		// every non-zero slot belongs to a tracked block, so this also clears the slot tables
+		// while leaving compiled_funcs[] sparsely allocated, if the OS does memory overcommit.
+		jit_discard_all();
+		jit_stats.flushes++;
+		fastmem_reset();
 	}
 
 	c.clear();
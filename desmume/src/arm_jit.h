@@ -29,6 +29,11 @@ typedef u32 (FASTCALL* ArmOpCompiled)();
 void arm_jit_reset(bool enable, bool suppress_msg = false);
 void arm_jit_close();
 void arm_jit_sync();
+// Call when the DTCM moves, so that fastmem maps it at its new address.
+void arm_jit_memory_changed();
+// Call between blocks; recompiles everything when memory hooks or breakpoints come or go,
+// since fastmem accesses bypass them.
+void arm_jit_check_hooks();
 template<int PROCNUM> u32 arm_jit_compile();
 
 //#define MAPPED_JIT_FUNCS: to define or not to define?
@@ -77,6 +82,68 @@ extern uintptr_t compiled_funcs[];
 #define JIT_MAPPED(adr, PROCNUM) true
 #endif
 
+// Compiled blocks are tracked per page of entry slots (one slot per halfword of code),
+// so a write only has to discard the blocks that actually overlap it.
+#ifdef MAPPED_JIT_FUNCS
+#define JIT_SLOT_BASE ((uintptr_t *)&JIT)
+#define JIT_SLOT_COUNT (sizeof(JIT_struct) / sizeof(uintptr_t))
+#else
+#define JIT_SLOT_BASE compiled_funcs
+#define JIT_SLOT_COUNT (1<<26)
+#endif
+#define JIT_PAGE_SHIFT 11 // 2048 slots, i.e. 4KB of code
+#define JIT_PAGE_COUNT ((JIT_SLOT_COUNT + (1<<JIT_PAGE_SHIFT) - 1) >> JIT_PAGE_SHIFT)
+#define JIT_SLOT(entry) ((u32)(&(entry) - JIT_SLOT_BASE))
+
+extern u8 jit_page_has_code[];
+void arm_jit_invalidate(u32 slot, u32 count);
+
+// Discards whatever compiled code overlaps the <count> slots starting at <entry>.
+// Writes to pages that never held code cost a single table lookup.
+#define JIT_INVALIDATE(entry, count) do { \
+	const u32 jit_slot = JIT_SLOT(entry); \
+	if (jit_page_has_code[jit_slot >> JIT_PAGE_SHIFT]) arm_jit_invalidate(jit_slot, (count)); \
+} while (0)
+
+struct JIT_STATS
+{
+	u64 compiled;            // blocks compiled
+	u64 recompiled;          // blocks compiled at an entry point whose previous block was invalidated
+	u64 invalidations;       // writes that discarded at least one block
+	u64 blocksInvalidated;   // blocks discarded by writes
+	u64 interpreted;         // entry points handed to the interpreter because their code keeps changing
+	u64 superblocks;         // hot blocks recompiled as superblocks
+	u64 flagsSkipped;        // flag updates left out because no later instruction reads them
+	u64 fastmemFaults;       // fastmem loads that hit unmapped memory and were completed by the MMU
+	u64 fastmemDemoted;      // blocks recompiled without fastmem because their loads kept faulting
+	u64 flushes;             // whole cache resets
+	u32 blocks;              // blocks currently live
+	u32 codeBytes;           // host code held by live blocks
+};
+
+void arm_jit_get_stats(JIT_STATS *stats);
+void arm_jit_clear_stats();
+
+// Compiled blocks call straight into the block at a static branch target while the
+// running CPU still has cycles left in its slice, instead of returning to armInnerLoop.
+#define JIT_LINK_MAX 64
+// Timers and the divider/sqrt units only see time advance when a block returns to the
+// dispatcher, so a chain of linked blocks may not run longer than this many cycles.
+#define JIT_LINK_MAX_CYCLES 128
+
+struct JIT_LINK_STATE
+{
+	s32 budget;   // cycles the running CPU may still spend before returning to the dispatcher
+	s32 links;    // links that may still be followed, which bounds the host stack depth
+};
+extern JIT_LINK_STATE jit_link;
+
+FORCEINLINE void arm_jit_set_link_budget(s32 cycles)
+{
+	jit_link.budget = (cycles < JIT_LINK_MAX_CYCLES) ? cycles : JIT_LINK_MAX_CYCLES;
+	jit_link.links = JIT_LINK_MAX;
+}
+
 extern u32 saveBlockSizeJIT;
 
 #endif
@@ -241,6 +241,7 @@ void armcpu_init(armcpu_t *armcpu, u32 adr)
 	armcpu->intVector = 0xFFFF0000 * (armcpu->proc_ID==0);
 	armcpu->freeze = CPU_FREEZE_NONE;
 	armcpu->intrWaitARM_state = 0;
+	armcpu_idleLoopReset(armcpu->proc_ID);
 
 //#ifdef GDB_STUB
 //    armcpu->irq_flag = 0;
@@ -547,7 +548,7 @@ BOOL armcpu_irqException(armcpu_t *armcpu)
 	armcpu->CPSR.bits.T = 0;
 	armcpu->CPSR.bits.I = 1;
 	armcpu->next_instruction = armcpu->intVector + 0x18;
-	armcpu->freeze &= ~CPU_FREEZE_IRQ_IE_IF;
+	armcpu->freeze &= ~(CPU_FREEZE_IRQ_IE_IF|CPU_FREEZE_IDLE_LOOP);
 
 	//must retain invariant of having next instruction to be executed prefetched
 	//(yucky)
@@ -734,6 +735,8 @@ void arm_jit_sync()
 	NDS_ARM9.next_instruction = NDS_ARM9.instruct_adr;
 	armcpu_prefetch<0>();
 	armcpu_prefetch<1>();
+	// a loaded state may have moved the DTCM
+	arm_jit_memory_changed();
 }
 
 template<int PROCNUM, bool jit>
@@ -755,11 +758,438 @@ template u32 armcpu_exec<1,false>();
 template u32 armcpu_exec<1,true>();
 #endif
 
+//-----------------------------------------------------------------------------
+//   Idle loop detection
+//-----------------------------------------------------------------------------
+
+//A short backward branch closes an idle loop when nothing in the loop writes memory, and every
+//register it writes is recomputed from scratch each time round (from memory, constants or registers
+//the loop leaves alone). Once such a loop has gone round, it will keep going round until something
+//else changes the memory it reads, so the CPU can be frozen like it is for SWI Halt until the end of
+//the current work unit, when NDS_exec wakes it up to have another look.
+
+static IDLE_LOOP_STATS idleLoopStats;
+
+//loops already found not to be idle, so that short copy and wait loops aren't decoded every time round
+struct IdleLoopReject
+{
+	u32 branch;
+	u32 target;
+};
+static IdleLoopReject idleLoopRejects[2][64];
+
+enum
+{
+	IDLE_FLAG_V = 1<<16,
+	IDLE_FLAG_C = 1<<17,
+	IDLE_FLAG_Z = 1<<18,
+	IDLE_FLAG_N = 1<<19,
+	IDLE_FLAGS_NZ = IDLE_FLAG_N|IDLE_FLAG_Z,
+	IDLE_FLAGS = IDLE_FLAG_N|IDLE_FLAG_Z|IDLE_FLAG_C|IDLE_FLAG_V
+};
+
+//what is known about a register's value while the loop is decoded
+enum IdleLoopValue
+{
+	IDLE_VALUE_UNKNOWN,   //computed from memory or other registers
+	IDLE_VALUE_CONSTANT,  //the same every time round (immediates, literal pool loads)
+	IDLE_VALUE_INVARIANT  //not written by the loop, so it still holds what the CPU has in it now
+};
+
+struct IdleLoopDecoder
+{
+	int procnum;
+	const armcpu_t *cpu; //NULL when only the code is checked, without looking at the registers
+	u32 loopWrites; //registers (and flags) written anywhere in the loop
+	u32 written; //registers (and flags) written so far this time round
+	u8 kind[16];
+	u32 value[16];
+
+	//the flags each condition code looks at
+	static u32 condFlags(u32 cond)
+	{
+		static const u32 flags[16] = {
+			IDLE_FLAG_Z, IDLE_FLAG_Z, IDLE_FLAG_C, IDLE_FLAG_C, IDLE_FLAG_N, IDLE_FLAG_N, IDLE_FLAG_V, IDLE_FLAG_V,
+			IDLE_FLAG_C|IDLE_FLAG_Z, IDLE_FLAG_C|IDLE_FLAG_Z, IDLE_FLAG_N|IDLE_FLAG_V, IDLE_FLAG_N|IDLE_FLAG_V,
+			IDLE_FLAGS_NZ|IDLE_FLAG_V, IDLE_FLAGS_NZ|IDLE_FLAG_V, 0, 0
+		};
+		return flags[cond];
+	}
+
+	//reading something the loop writes is only fine if it was already written this time round
+	bool use(u32 reads, u32 writes)
+	{
+		if(reads & loopWrites & ~written) return false;
+		written |= writes;
+		return true;
+	}
+
+	bool known(u32 reg, u32 &val) const
+	{
+		if(kind[reg] == IDLE_VALUE_CONSTANT) { val = value[reg]; return true; }
+		if(kind[reg] == IDLE_VALUE_INVARIANT) { val = cpu ? cpu->R[reg] : 0; return true; }
+		return false;
+	}
+
+	void set(u32 reg, u8 k, u32 val = 0)
+	{
+		kind[reg] = k;
+		value[reg] = val;
+	}
+
+	//i/o registers that can only change at a hardware event or when the other CPU writes the IPC
+	//registers (which calls armcpu_idleLoopWake), and have no side effects when read.
+	//memory the other CPU can write doesn't count, since its writes don't wake a frozen CPU before the next event.
+	static bool quietRead(int procnum, u32 adr)
+	{
+		if((adr & 0xFF000000) == 0x02000000) return false; //main RAM
+		if((adr & 0xFF000000) == 0x03000000) return procnum == ARMCPU_ARM7 && (adr & 0x00800000); //shared WRAM (arm7 WRAM is private)
+		if((adr & 0xFF000000) != 0x04000000) return true;
+		adr &= 0x00FFFFFF;
+		return (adr >= 0x004 && adr < 0x008) //DISPSTAT, VCOUNT
+			|| (adr >= 0x0B0 && adr < 0x0E0) //DMA
+			|| (adr >= 0x130 && adr < 0x138) //KEYINPUT, KEYCNT, EXTKEYIN
+			|| (adr >= 0x180 && adr < 0x188) //IPCSYNC, IPCFIFOCNT
+			|| (adr >= 0x1A0 && adr < 0x1A8) //AUXSPICNT, ROMCTRL
+			|| (adr >= 0x1C0 && adr < 0x1C4) //SPICNT
+			|| (adr >= 0x208 && adr < 0x218) //IME, IE, IF
+			|| (adr >= 0x280 && adr < 0x2C0) //divider, sqrt
+			|| (adr >= 0x400 && adr < 0x520) //sound
+			|| (adr >= 0x600 && adr < 0x604); //GXSTAT
+	}
+
+	//a load from base+offset. its address has to be known, so that it can be checked for side effects
+	//(without a cpu, addresses that depend on the registers can only be checked later)
+	bool load(u32 rd, u32 base, u32 offset, u8 offsetKind, bool literal)
+	{
+		u32 adr;
+		if(offsetKind == IDLE_VALUE_UNKNOWN || !known(base, adr)) return false;
+		adr += offset;
+		const bool exact = cpu || (kind[base] == IDLE_VALUE_CONSTANT && offsetKind == IDLE_VALUE_CONSTANT);
+		if(exact && !quietRead(procnum, adr)) return false;
+		if(literal) set(rd, IDLE_VALUE_CONSTANT, _MMU_read32(procnum, MMU_AT_DEBUG, adr & ~3));
+		else set(rd, IDLE_VALUE_UNKNOWN);
+		return true;
+	}
+
+	bool arm(u32 adr, u32 i, bool last);
+	bool thumb(u32 adr, u32 i, bool last);
+	u32 armWrites(u32 i);
+	u32 thumbWrites(u32 i);
+};
+
+//registers and flags an instruction writes, or ~0 if it can't be part of an idle loop
+u32 IdleLoopDecoder::armWrites(u32 i)
+{
+	const u32 rd = REG_POS(i,12);
+	if((i & 0x0C000000) == 0)
+	{
+		if(!BIT25(i) && (i & 0x90) == 0x90)
+		{
+			//halfword and signed loads, without writeback
+			if(BIT24(i) && !BIT21(i) && BIT20(i) && (i & 0x60)) return 1<<rd;
+			return ~0U;
+		}
+		const u32 op = (i>>21)&0xF;
+		const bool s = BIT20(i);
+		if(op >= 8 && op <= 11 && !s) return ~0U; //MRS, MSR, BX and friends
+		u32 flags = 0;
+		if(s)
+		{
+			const bool logical = (op <= 1) || (op >= 8 && op <= 9) || op >= 12;
+			if(!logical) flags = IDLE_FLAGS;
+			else
+			{
+				flags = IDLE_FLAGS_NZ;
+				if(BIT25(i) ? ((i>>8)&0xF) != 0 : (i & 0xFF0) != 0) flags |= IDLE_FLAG_C;
+			}
+		}
+		return ((op >= 8 && op <= 11) ? 0 : 1<<rd) | flags;
+	}
+	if((i & 0x0C000000) == 0x04000000)
+	{
+		//LDR and LDRB without writeback
+		if(BIT25(i) && BIT4(i)) return ~0U;
+		if(BIT20(i) && BIT24(i) && !BIT21(i)) return 1<<rd;
+		return ~0U;
+	}
+	return ~0U;
+}
+
+bool IdleLoopDecoder::arm(u32 adr, u32 i, bool last)
+{
+	const u32 cond = CONDITION(i);
+	if(last)
+		return (i & 0x0F000000) == 0x0A000000 && cond != 0xF && use(condFlags(cond), 0);
+	if(cond != 0xE) return false;
+
+	const u32 rd = REG_POS(i,12);
+	const u32 rn = REG_POS(i,16);
+	const u32 rm = REG_POS(i,0);
+	const u32 writes = armWrites(i);
+	if(writes == ~0U || (writes & (1<<15))) return false;
+
+	if((i & 0x0C000000) == 0x04000000 || (!BIT25(i) && (i & 0x90) == 0x90))
+	{
+		//loads
+		const bool word = (i & 0x0C000000) == 0x04000000;
+		const bool immOffset = word ? !BIT25(i) : BIT22(i);
+		u32 offset = 0;
+		u8 offsetKind = IDLE_VALUE_CONSTANT;
+		u32 reads = rn == 15 ? 0 : 1<<rn;
+		if(immOffset) offset = word ? (i & 0xFFF) : (((i>>4)&0xF0)|(i&0xF));
+		else
+		{
+			if(word && (i & 0xFF0)) return false; //shifted register offsets
+			if(rm == 15) return false;
+			reads |= 1<<rm;
+			offsetKind = kind[rm];
+			known(rm, offset);
+		}
+		if(!BIT23(i)) offset = 0-offset;
+		if(!use(reads, writes)) return false;
+		if(rn == 15)
+		{
+			set(15, IDLE_VALUE_CONSTANT, adr + 8);
+			return load(rd, 15, offset, offsetKind, word && immOffset && !BIT22(i));
+		}
+		return load(rd, rn, offset, offsetKind, false);
+	}
+
+	//data processing
+	const u32 op = (i>>21)&0xF;
+	u32 reads = 0;
+	if(op != 0xD && op != 0xF) reads |= 1<<rn;
+	if(!BIT25(i))
+	{
+		reads |= 1<<rm;
+		if(BIT4(i)) reads |= 1<<REG_POS(i,8);
+		else if((i & 0xFF0) == 0x060) reads |= IDLE_FLAG_C; //RRX
+	}
+	if(op >= 5 && op <= 7) reads |= IDLE_FLAG_C; //ADC, SBC, RSC
+	if(reads & (1<<15)) return false;
+	if(!use(reads, writes)) return false;
+	if(op >= 8 && op <= 11) return true;
+	if(op == 0xD && BIT25(i)) set(rd, IDLE_VALUE_CONSTANT, ROR(i & 0xFF, (i>>7) & 0x1E));
+	else set(rd, IDLE_VALUE_UNKNOWN);
+	return true;
+}
+
+u32 IdleLoopDecoder::thumbWrites(u32 i)
+{
+	switch(i>>11)
+	{
+	case 0x00: return (1<<(i&7)) | IDLE_FLAGS_NZ | ((i & 0x07C0) ? IDLE_FLAG_C : 0); //LSL imm
+	case 0x01: case 0x02: return (1<<(i&7)) | IDLE_FLAGS_NZ | IDLE_FLAG_C; //LSR, ASR imm
+	case 0x03: return (1<<(i&7)) | IDLE_FLAGS; //ADD, SUB
+	case 0x04: return (1<<((i>>8)&7)) | IDLE_FLAGS_NZ; //MOV imm
+	case 0x05: return IDLE_FLAGS; //CMP imm
+	case 0x06: case 0x07: return (1<<((i>>8)&7)) | IDLE_FLAGS; //ADD, SUB imm
+	case 0x08:
+		if(!(i & 0x0400))
+		{
+			static const u32 flags[16] = {
+				IDLE_FLAGS_NZ, IDLE_FLAGS_NZ, IDLE_FLAGS_NZ|IDLE_FLAG_C, IDLE_FLAGS_NZ|IDLE_FLAG_C,
+				IDLE_FLAGS_NZ|IDLE_FLAG_C, IDLE_FLAGS, IDLE_FLAGS, IDLE_FLAGS_NZ|IDLE_FLAG_C,
+				IDLE_FLAGS_NZ, IDLE_FLAGS, IDLE_FLAGS, IDLE_FLAGS,
+				IDLE_FLAGS_NZ, IDLE_FLAGS_NZ|IDLE_FLAG_C, IDLE_FLAGS_NZ, IDLE_FLAGS_NZ
+			};
+			const u32 op = (i>>6)&0xF;
+			const bool test = op == 8 || op == 10 || op == 11;
+			return (test ? 0 : 1<<(i&7)) | flags[op];
+		}
+		else
+		{
+			//hi register ADD, CMP and MOV
+			const u32 op = (i>>8)&3;
+			const u32 rd = (i&7)|((i>>4)&8);
+			if(op == 3) return ~0U;
+			return op == 1 ? IDLE_FLAGS : 1<<rd;
+		}
+	case 0x09: return 1<<((i>>8)&7); //LDR pc-relative
+	case 0x0A: case 0x0B: return ((i>>9)&7) >= 3 ? 1<<(i&7) : ~0U; //register offset loads
+	case 0x0D: case 0x0F: case 0x11: return 1<<(i&7); //LDR, LDRB, LDRH imm
+	case 0x13: return 1<<((i>>8)&7); //LDR sp-relative
+	default: return ~0U;
+	}
+}
+
+bool IdleLoopDecoder::thumb(u32 adr, u32 i, bool last)
+{
+	if(last)
+	{
+		if((i & 0xF800) == 0xE000) return true;
+		return (i & 0xF000) == 0xD000 && ((i>>8)&0xF) < 0xE && use(condFlags((i>>8)&0xF), 0);
+	}
+
+	const u32 writes = thumbWrites(i);
+	if(writes == ~0U || (writes & (1<<15))) return false;
+
+	const u32 rd = i&7;
+	const u32 rs = (i>>3)&7;
+	switch(i>>11)
+	{
+	case 0x00: case 0x01: case 0x02:
+		if(!use(1<<rs, writes)) return false;
+		set(rd, IDLE_VALUE_UNKNOWN);
+		return true;
+	case 0x03:
+		if(!use((1<<rs) | (BIT10(i) ? 0 : 1<<((i>>6)&7)), writes)) return false;
+		set(rd, IDLE_VALUE_UNKNOWN);
+		return true;
+	case 0x04:
+		if(!use(0, writes)) return false;
+		set((i>>8)&7, IDLE_VALUE_CONSTANT, i&0xFF);
+		return true;
+	case 0x05: case 0x06: case 0x07:
+		if(!use(1<<((i>>8)&7), writes)) return false;
+		if(writes & (1<<((i>>8)&7))) set((i>>8)&7, IDLE_VALUE_UNKNOWN);
+		return true;
+	case 0x08:
+		if(!(i & 0x0400))
+		{
+			const u32 op = (i>>6)&0xF;
+			u32 reads = 1<<rs;
+			if(op != 9 && op != 15) reads |= 1<<rd; //NEG and MVN only read the source
+			if(op == 5 || op == 6) reads |= IDLE_FLAG_C; //ADC, SBC
+			if(!use(reads, writes)) return false;
+			if(writes & (1<<rd)) set(rd, IDLE_VALUE_UNKNOWN);
+			return true;
+		}
+		else
+		{
+			const u32 op = (i>>8)&3;
+			const u32 hd = (i&7)|((i>>4)&8);
+			const u32 hs = (i>>3)&0xF;
+			if(hd == 15 || hs == 15) return false;
+			if(!use((1<<hs) | (op == 2 ? 0 : 1<<hd), writes)) return false;
+			if(op == 2) set(hd, kind[hs], value[hs]);
+			else if(op == 0) set(hd, IDLE_VALUE_UNKNOWN);
+			return true;
+		}
+	case 0x09:
+		if(!use(0, writes)) return false;
+		set(15, IDLE_VALUE_CONSTANT, (adr + 4) & ~3);
+		return load((i>>8)&7, 15, (i&0xFF)<<2, IDLE_VALUE_CONSTANT, true);
+	case 0x0A: case 0x0B:
+	{
+		const u32 ro = (i>>6)&7;
+		u32 offset = 0;
+		if(!use((1<<rs)|(1<<ro), writes)) return false;
+		known(ro, offset);
+		return load(rd, rs, offset, kind[ro], false);
+	}
+	case 0x0D: case 0x0F: case 0x11:
+	{
+		const u32 scale = (i>>11) == 0x0D ? 4 : (i>>11) == 0x0F ? 1 : 2;
+		if(!use(1<<rs, writes)) return false;
+		return load(rd, rs, ((i>>6)&0x1F) * scale, IDLE_VALUE_CONSTANT, false);
+	}
+	case 0x13:
+		if(!use(1<<13, writes)) return false;
+		return load((i>>8)&7, 13, (i&0xFF)<<2, IDLE_VALUE_CONSTANT, false);
+	}
+	return false;
+}
+
+//decodes the loop running from <target> up to the branch at <branch>
+static bool idleLoopDecode(int PROCNUM, u32 branch, u32 target, bool thumb, const armcpu_t *cpu)
+{
+	const u32 size = thumb ? 2 : 4;
+	if(target >= branch || (branch - target) / size >= IDLE_LOOP_MAX_INSTRUCTIONS) return false;
+	const u32 count = (branch - target) / size + 1;
+
+	u32 code[IDLE_LOOP_MAX_INSTRUCTIONS];
+	IdleLoopDecoder d;
+	d.procnum = PROCNUM;
+	d.cpu = cpu;
+	d.loopWrites = 0;
+	d.written = 0;
+	for(u32 n = 0; n < count; n++)
+	{
+		const u32 adr = target + n*size;
+		code[n] = thumb ? _MMU_read16(PROCNUM, MMU_AT_DEBUG, adr) : _MMU_read32(PROCNUM, MMU_AT_DEBUG, adr);
+		if(n == count-1) break;
+		const u32 writes = thumb ? d.thumbWrites(code[n]) : d.armWrites(code[n]);
+		if(writes == ~0U) return false;
+		d.loopWrites |= writes;
+	}
+	for(u32 r = 0; r < 16; r++)
+		d.set(r, (d.loopWrites & (1<<r)) ? IDLE_VALUE_UNKNOWN : IDLE_VALUE_INVARIANT);
+
+	for(u32 n = 0; n < count; n++)
+	{
+		const u32 adr = target + n*size;
+		if(!(thumb ? d.thumb(adr, code[n], n == count-1) : d.arm(adr, code[n], n == count-1)))
+			return false;
+	}
+	return true;
+}
+
+bool armcpu_idleLoopCandidate(int PROCNUM, u32 branch, u32 target, bool thumb)
+{
+	return idleLoopDecode(PROCNUM, branch, target, thumb, NULL);
+}
+
+template<int PROCNUM> void FASTCALL armcpu_idleLoopCheck(u32 branch, u32 target)
+{
+	if(!CommonSettings.idle_loop_skip) return;
+	IdleLoopReject &reject = idleLoopRejects[PROCNUM][(branch>>1) & 63];
+	if(reject.branch == branch && reject.target == target) return;
+
+	armcpu_t *cpu = &ARMPROC;
+	if(!idleLoopDecode(PROCNUM, branch, target, cpu->CPSR.bits.T, cpu))
+	{
+		reject.branch = branch;
+		reject.target = target;
+		idleLoopStats.rejected[PROCNUM]++;
+		return;
+	}
+
+	idleLoopStats.detected[PROCNUM]++;
+	idleLoopStats.lastLoop[PROCNUM] = branch;
+	cpu->freeze |= CPU_FREEZE_IDLE_LOOP;
+#ifdef HAVE_JIT
+	// don't follow block links any further
+	jit_link.budget = 0;
+#endif
+}
+
+template void FASTCALL armcpu_idleLoopCheck<0>(u32 branch, u32 target);
+template void FASTCALL armcpu_idleLoopCheck<1>(u32 branch, u32 target);
+
+void armcpu_idleLoopReset(int PROCNUM)
+{
+	memset(idleLoopRejects[PROCNUM], 0xFF, sizeof(idleLoopRejects[PROCNUM]));
+}
+
+//the other cpu changed an IPC register that <PROCNUM> may be polling. if it is frozen in an idle
+//loop, end the work unit: the main loop then unfreezes it and rolls its clock back to the write,
+//so it sees the new value as soon as it would have by polling.
+void armcpu_idleLoopWake(int PROCNUM)
+{
+	armcpu_t &cpu = PROCNUM ? NDS_ARM7 : NDS_ARM9;
+	if(!(cpu.freeze & CPU_FREEZE_IDLE_LOOP)) return;
+	idleLoopStats.woken[PROCNUM]++;
+	NDS_Reschedule();
+}
+
+void armcpu_getIdleLoopStats(IDLE_LOOP_STATS *stats)
+{
+	*stats = idleLoopStats;
+}
+
+void armcpu_clearIdleLoopStats()
+{
+	memset(&idleLoopStats, 0, sizeof(idleLoopStats));
+}
+
 void setIF(int PROCNUM, u32 flag)
 {
 	//don't set generated bits!!!
 	assert(!(flag&0x00200000));
 	
+	NDS_ThreadSync sync;
 	MMU.reg_IF_bits[PROCNUM] |= flag;
 	
 	NDS_Reschedule();
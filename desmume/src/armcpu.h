@@ -47,6 +47,7 @@
 #define CPU_FREEZE_IE_IF 0x02 //waiting for IE&IF to signal something (probably edge triggered on IRQ too)
 #define CPU_FREEZE_IRQ_IE_IF (CPU_FREEZE_WAIT_IRQ|CPU_FREEZE_IE_IF)
 #define CPU_FREEZE_OVERCLOCK_HACK 0x04
+#define CPU_FREEZE_IDLE_LOOP 0x08 //spinning in a loop that can't exit until something else changes memory
 
 #define INSTRUCTION_INDEX(i) ((((i)>>16)&0xFF0)|(((i)>>4)&0xF))
 
@@ -356,6 +357,26 @@ template<int PROCNUM> u32 armcpu_exec();
 template<int PROCNUM, bool jit> u32 armcpu_exec();
 #endif
 
+//idle loop detection (CommonSettings.idle_loop_skip)
+//the interpreter and the jit check short backward branches when they're taken. if the loop they close
+//only reads memory that can't change by itself, the cpu is frozen until the end of the current work unit
+#define IDLE_LOOP_MAX_INSTRUCTIONS 8
+
+struct IDLE_LOOP_STATS
+{
+	u64 detected[2];   // times each cpu was frozen in an idle loop
+	u64 rejected[2];   // short loops found not to be idle
+	u64 woken[2];      // idle loops ended early by the other cpu writing an IPC register
+	u32 lastLoop[2];   // address of the branch closing the last idle loop detected
+};
+
+bool armcpu_idleLoopCandidate(int PROCNUM, u32 branch, u32 target, bool thumb);
+template<int PROCNUM> void FASTCALL armcpu_idleLoopCheck(u32 branch, u32 target);
+void armcpu_idleLoopReset(int PROCNUM);
+void armcpu_idleLoopWake(int PROCNUM);
+void armcpu_getIdleLoopStats(IDLE_LOOP_STATS *stats);
+void armcpu_clearIdleLoopStats();
+
 void setIF(int PROCNUM, u32 flag);
 
 static INLINE void NDS_makeIrq(int PROCNUM, u32 num)
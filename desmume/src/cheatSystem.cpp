@@ -23,6 +23,8 @@
 #include "MMU.h"
 #include "debug.h"
 #include "emufile.h"
+#include "common.h"
+#include "utils/task.h"
 
 #ifndef _MSC_VER 
 #include <stdint.h>
@@ -38,6 +40,7 @@ static bool cheatsResetJit = false;
 void CHEATS::clear()
 {
 	this->_list.resize(0);
+	this->_programs.resize(0);
 	this->_currentGet = 0;
 }
 
@@ -170,7 +173,125 @@ bool CHEATS::DirectWrite(const size_t newValueLength, const int targetProc, cons
 	return false;
 }
 
-bool CHEATS::ARparser(const CHEATS_LIST &theList)
+// Code types that are looked at even while the execution status is false. The IFs
+// have to push onto the status stack so that their D0 terminators pair up correctly.
+static bool ARcodeRunsWhenSkipping(const u32 type)
+{
+	return (type >= 0x03 && type <= 0x0A) || (type == 0xD0) || (type == 0xD1) || (type == 0xD2) || (type == 0xC5);
+}
+
+void CHEATS::ARcompile(const CHEATS_LIST &theList, CHEATS_AR_PROGRAM &outProgram)
+{
+	const u32 num = theList.num;
+
+	outProgram.source.assign(&theList.code[0][0], &theList.code[0][0] + (num * 2));
+	outProgram.ops.resize(num);
+	outProgram.payload.resize(0);
+
+	for (u32 i = 0; i < num; i++)
+	{
+		CHEATS_AR_OP &op = outProgram.ops[i];
+		const u32 hi = theList.code[i][0];
+		const u32 lo = theList.code[i][1];
+
+		//parse codes into types by kodewerx standards
+		op.type = hi >> 28;
+		//these two are broken down into subtypes
+		if (op.type == 0x0C || op.type == 0x0D)
+			op.type = hi >> 24;
+
+		op.x = hi & 0x0FFFFFFF;
+		op.y = lo;
+		op.z = 0;
+		op.next = i + 1;
+		op.payload = 0;
+		op.payloadWords = 0;
+		op.payloadBytes = 0;
+
+		switch (op.type)
+		{
+			case 0x01:
+			case 0x07:
+			case 0x08:
+			case 0x09:
+			case 0x0A:
+				op.y = lo & 0xFFFF;
+				//the 16-bit conditionals only ever use the inverted mask
+				op.z = ~(lo >> 16) & 0xFFFF;
+				break;
+
+			case 0x02:
+				op.y = lo & 0xFF;
+				break;
+
+			case 0xDF:
+				op.x = hi;
+				break;
+
+			case 0x0E:
+			{
+				//the parameter bytes follow the code in the list, and are gathered here exactly the
+				//way the copy loop used to walk them, including where it leaves the code pointer
+				u32 row = i;
+				u32 t = 0;
+				u32 b = 0;
+				u32 y = lo;
+
+				if (y == 0)
+					break; //nothing to copy, so just move on to the next code
+
+				op.payload = (u32)outProgram.payload.size();
+
+				row++; //skip over the current code
+				while (y >= 4)
+				{
+					if (row == num) break; //if we erroneously went off the end, bail
+					outProgram.payload.push_back(theList.code[row][t]);
+					op.payloadWords++;
+					if (t == 1) row++;
+					t ^= 1;
+					y -= 4;
+				}
+				while (y > 0)
+				{
+					if (row == num) break; //if we erroneously went off the end, bail
+					outProgram.payload.push_back((theList.code[row][t] >> b) & 0xFF);
+					op.payloadBytes++;
+					y -= 1;
+					b += 4;
+				}
+
+				//the copy loop may have gone one too far
+				if (t == 0)
+					row--;
+
+				op.next = row + 1;
+				break;
+			}
+
+			default:
+				break;
+		}
+	}
+
+	//resolve where execution resumes when a code is skipped, so that a false condition jumps
+	//straight over the block it guards instead of stepping through it one code at a time
+	for (u32 i = num; i-- > 0; )
+	{
+		CHEATS_AR_OP &op = outProgram.ops[i];
+		u32 target = i + 1;
+
+		if (op.type == 0x0E)
+			target += (op.y + 7) / 8; //a skipped patch code also skips its parameter bytes
+
+		while ( (target < num) && !ARcodeRunsWhenSkipping(outProgram.ops[target].type) )
+			target = outProgram.ops[target].skip;
+
+		op.skip = (target < num) ? target : num;
+	}
+}
+
+bool CHEATS::ARexecute(const CHEATS_AR_PROGRAM &theProgram)
 {
 	//primary organizational source (seems to be referenced by cheaters the most) - http://doc.kodewerx.org/hacking_nds.html
 	//secondary clarification and details (for programmers) - http://problemkaputt.de/gbatek.htm#dscartcheatactionreplayds
@@ -184,10 +305,10 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 
 	bool v154 = true; //on advice of power users, v154 is so old, we can assume all cheats use it
 	bool vEmulator = true;
-	bool needsJitReset = false;
+	bool didWriteCode = false;
 
 	struct {
-		//LSB is 
+		//LSB is
 		u32 status;
 
 		struct {
@@ -199,7 +320,7 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 
 			//loop iterations goal (runs rpt+1 times generally)
 			u32 iterations;
-		
+
 			//target of loop
 			u32 top;
 		} loop;
@@ -217,19 +338,17 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 
 	CHEATLOG("-----------------------------------\n");
 
-	for (u32 i = 0; i < theList.num; i++)
-	{
-		bool shouldResetJit = false;
-		const u32 hi = theList.code[i][0];
-		const u32 lo = theList.code[i][1];
+	const u32 num = (u32)theProgram.ops.size();
+	u32 i = 0;
 
-		CHEATLOG("executing [%02d] %08X %08X (ofs=%08X)\n",i, hi,lo, st.offset);
+	while (i < num)
+	{
+		bool shouldWriteCode = false;
+		const CHEATS_AR_OP &op = theProgram.ops[i];
+		const u32 type = op.type;
+		u32 next = op.next;
 
-		//parse codes into types by kodewerx standards
-		u32 type = theList.code[i][0] >> 28;
-		//these two are broken down into subtypes
-		if(type == 0x0C || type == 0x0D)
-			type = theList.code[i][0] >> 24;
+		CHEATLOG("executing [%02d] %08X %08X (ofs=%08X)\n",i, theProgram.source[i*2],theProgram.source[i*2+1], st.offset);
 
 		//process current execution status:
 		u32 statusSkip = st.status & 1;
@@ -244,20 +363,11 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 		}
 		if(type == 0xD0 || type == 0xD1 || type == 0xD2) {}
 		else if(type == 0xC5) {}
-		else if(type == 0x0E)
+		else if(statusSkip)
 		{
-			if (statusSkip) {
-				CHEATLOG(" (skip multiple lines!)\n");
-				i += (lo + 7) / 8;
-				continue;
-			}
-		}
-		else
-		{
-			if(statusSkip) {
-				CHEATLOG(" (skip!)\n");
-				continue;
-			}
+			CHEATLOG(" (skip to [%02d])\n", op.skip);
+			i = op.skip;
+			continue;
 		}
 
 		u32 operand,x,y,z,addr;
@@ -272,30 +382,24 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			//32-bit (Constant RAM Writes)
 			//0XXXXXXX YYYYYYYY
 			//Writes word YYYYYYYY to [XXXXXXX+offset].
-			x = hi & 0x0FFFFFFF;
-			y = lo;
-			addr = x + st.offset;
-			shouldResetJit = CHEATS::DirectWrite<4>(st.proc, addr, y);
+			addr = op.x + st.offset;
+			shouldWriteCode = CHEATS::DirectWrite<4>(st.proc, addr, op.y);
 			break;
-		
+
 		case 0x01:
 			//16-bit (Constant RAM Writes)
 			//1XXXXXXX 0000YYYY
 			//Writes halfword YYYY to [XXXXXXX+offset].
-			x = hi & 0x0FFFFFFF;
-			y = lo & 0xFFFF;
-			addr = x + st.offset;
-			shouldResetJit = CHEATS::DirectWrite<2>(st.proc, addr, y);
+			addr = op.x + st.offset;
+			shouldWriteCode = CHEATS::DirectWrite<2>(st.proc, addr, op.y);
 			break;
 
 		case 0x02:
 			//8-bit (Constant RAM Writes)
 			//2XXXXXXX 000000YY
 			//Writes byte YY to [XXXXXXX+offset].
-			x = hi & 0x0FFFFFFF;
-			y = lo & 0xFF;
-			addr = x + st.offset;
-			shouldResetJit = CHEATS::DirectWrite<1>(st.proc, addr, y);
+			addr = op.x + st.offset;
+			shouldWriteCode = CHEATS::DirectWrite<1>(st.proc, addr, op.y);
 			break;
 
 		case 0x03:
@@ -303,11 +407,10 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			//3XXXXXXX YYYYYYYY
 			//Checks if YYYYYYYY > (word at [XXXXXXX])
 			//If not, the code(s) following this one are not executed (ie. execution status is set to false) until a code type D0 or D2 is encountered, or until the end of the code list is reached.
-			x = hi & 0x0FFFFFFF;
-			y = lo;
+			x = op.x;
 			if(v154) if(x == 0) x = st.offset;
 			operand = _MMU_read32(st.proc,MMU_AT_DEBUG,x);
-			if(y > operand) st.status &= ~1;
+			if(op.y > operand) st.status &= ~1;
 			break;
 
 		case 0x04:
@@ -315,11 +418,10 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			//4XXXXXXX YYYYYYYY
 			//Checks if YYYYYYYY < (word at [XXXXXXX])
 			//If not, the code(s) following this one are not executed (ie. execution status is set to false) until a code type D0 or D2 is encountered, or until the end of the code list is reached.
-			x = hi & 0x0FFFFFFF;
-			y = lo;
+			x = op.x;
 			if(v154) if(x == 0) x = st.offset;
 			operand = _MMU_read32(st.proc,MMU_AT_DEBUG,x);
-			if(y < operand) st.status &= ~1;
+			if(op.y < operand) st.status &= ~1;
 			break;
 
 		case 0x05:
@@ -327,11 +429,10 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			//5XXXXXXX YYYYYYYY
 			//Checks if YYYYYYYY == (word at [XXXXXXX])
 			//If not, the code(s) following this one are not executed (ie. execution status is set to false) until a code type D0 or D2 is encountered, or until the end of the code list is reached.
-			x = hi & 0x0FFFFFFF;
-			y = lo;
+			x = op.x;
 			if(v154) if(x == 0) x = st.offset;
 			operand = _MMU_read32(st.proc,MMU_AT_DEBUG,x);
-			if(y == operand) st.status &= ~1;
+			if(op.y == operand) st.status &= ~1;
 			break;
 
 		case 0x06:
@@ -339,11 +440,10 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			//6XXXXXXX YYYYYYYY
 			//Checks if YYYYYYYY != (word at [XXXXXXX])
 			//If not, the code(s) following this one are not executed (ie. execution status is set to false) until a code type D0 or D2 is encountered, or until the end of the code list is reached.
-			x = hi & 0x0FFFFFFF;
-			y = lo;
+			x = op.x;
 			if(v154) if(x == 0) x = st.offset;
 			operand = _MMU_read32(st.proc,MMU_AT_DEBUG,x);
-			if(y != operand) st.status &= ~1;
+			if(op.y != operand) st.status &= ~1;
 			break;
 
 		case 0x07:
@@ -351,12 +451,10 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			//7XXXXXXX ZZZZYYYY
 			//Checks if (YYYY) > (not (ZZZZ) & halfword at [XXXX]).
 			//If not, the code(s) following this one are not executed (ie. execution status is set to false) until a code type D0 or D2 is encountered, or until the end of the code list is reached.
-			x = hi & 0x0FFFFFFF;
-			y = lo&0xFFFF;
-			z = lo>>16;
+			x = op.x;
 			if(v154) if(x == 0) x = st.offset;
 			operand = _MMU_read16(st.proc,MMU_AT_DEBUG,x);
-			if(y > (u16)( (~z) & operand) ) st.status &= ~1;
+			if(op.y > (op.z & operand) ) st.status &= ~1;
 			break;
 
 		case 0x08:
@@ -364,12 +462,10 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			//8XXXXXXX ZZZZYYYY
 			//Checks if (YYYY) < (not (ZZZZ) & halfword at [XXXX]).
 			//If not, the code(s) following this one are not executed (ie. execution status is set to false) until a code type D0 or D2 is encountered, or until the end of the code list is reached.
-			x = hi & 0x0FFFFFFF;
-			y = lo&0xFFFF;
-			z = lo>>16;
+			x = op.x;
 			if(v154) if(x == 0) x = st.offset;
 			operand = _MMU_read16(st.proc,MMU_AT_DEBUG,x);
-			if(y < (u16)( (~z) & operand) ) st.status &= ~1;
+			if(op.y < (op.z & operand) ) st.status &= ~1;
 			break;
 
 		case 0x09:
@@ -377,12 +473,10 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			//9XXXXXXX ZZZZYYYY
 			//Checks if (YYYY) == (not (ZZZZ) & halfword at [XXXX]).
 			//If not, the code(s) following this one are not executed (ie. execution status is set to false) until a code type D0 or D2 is encountered, or until the end of the code list is reached.
-			x = hi & 0x0FFFFFFF;
-			y = lo&0xFFFF;
-			z = lo>>16;
+			x = op.x;
 			if(v154) if(x == 0) x = st.offset;
 			operand = _MMU_read16(st.proc,MMU_AT_DEBUG,x);
-			if(y == (u16)( (~z) & operand) ) st.status &= ~1;
+			if(op.y == (op.z & operand) ) st.status &= ~1;
 			break;
 
 		case 0x0A:
@@ -390,12 +484,10 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			//AXXXXXXX ZZZZYYYY
 			//Checks if (YYYY) != (not (ZZZZ) & halfword at [XXXX]).
 			//If not, the code(s) following this one are not executed (ie. execution status is set to false) until a code type D0 or D2 is encountered, or until the end of the code list is reached.
-			x = hi & 0x0FFFFFFF;
-			y = lo&0xFFFF;
-			z = lo>>16;
+			x = op.x;
 			if(v154) if(x == 0) x = st.offset;
 			operand = _MMU_read16(st.proc,MMU_AT_DEBUG,x);
-			if(y != (u16)( (~z) & operand) ) st.status &= ~1;
+			if(op.y != (op.z & operand) ) st.status &= ~1;
 			break;
 
 		case 0x0B:
@@ -403,20 +495,18 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			//BXXXXXXX 00000000
 			//Loads the 32-bit value into the 'offset'.
 			//Offset = word at [0XXXXXXX + offset].
-			x = hi & 0x0FFFFFFF;
-			addr = x + st.offset;
+			addr = op.x + st.offset;
 			st.offset = _MMU_read32(st.proc,MMU_AT_DEBUG,addr);
 			break;
 
 		case 0xC0:
 			//(Loop Code)
-			//C0000000 YYYYYYYY 
+			//C0000000 YYYYYYYY
 			//This sets the 'Dx repeat value' to YYYYYYYY and saves the 'Dx nextcode to be executed' and the 'Dx execution status'. Repeat will be executed when a D1/D2 code is encountered.
 			//When repeat is executed, the AR reloads the 'next code to be executed' and the 'execution status' from the Dx registers.
 			//<gbatek> FOR loopcount=0 to YYYYYYYY  ;execute Y+1 times
-			y = lo;
 			st.loop.idx = 0; //<gbatek> any FOR statement does forcefully terminate any prior loop
-			st.loop.iterations = y;
+			st.loop.iterations = op.y;
 			st.loop.top = i; //current instruction is saved as top for branching back up
 			//<gbatek> FOR does backup the current IF condidition flags, and NEXT does restore these flags
 			st.loop.status = st.status;
@@ -425,7 +515,7 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 		case 0xC4:
 			//Rewrite Code (v1.54 only) (trainer toolkit codes)
 			//<gbatek> offset = address of the C4000000 code
-			//it seems this lets us rewrite the code at runtime. /his will be very difficult to emulate. 
+			//it seems this lets us rewrite the code at runtime. /his will be very difficult to emulate.
 			//But it would be possible: we could copy whenever it's activated and allow that to be rewritten
 			//we would try to select a special sentinel pointer which couldn't be confused for a useful address
 			if(!v154) break;
@@ -442,20 +532,19 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 
 		case 0xC6:
 			//Store Offset  (trainer toolkit codes)
-			//<gbatek> C6000000 XXXXXXXX   [XXXXXXXX]=offset  
+			//<gbatek> C6000000 XXXXXXXX   [XXXXXXXX]=offset
 			if(!v154) break;
-			x = lo;
-			shouldResetJit = CHEATS::DirectWrite<4>(st.proc, x, st.offset);
+			shouldWriteCode = CHEATS::DirectWrite<4>(st.proc, op.y, st.offset);
 			break;
 
 		case 0xD0:
 			//Terminator (Special Codes)
 			//D0000000 00000000
 			//Loads the previous execution status. If none exists, the execution status stays at 'execute codes'
-			
+
 			//wild guess as to fine details of how this is implemented
 			st.status >>= 1;
-			//"If none exists, the execution status stays at 'execute codes'." 
+			//"If none exists, the execution status stays at 'execute codes'."
 			//0 will be shifted in, so execution will always proceed
 			//in other words, a stack underflow results in the original state of execution
 
@@ -463,28 +552,28 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 
 		case 0xD1:
 			//Loop execute variant (Special Codes)
-			//D1000000 00000000 
+			//D1000000 00000000
 			//Executes the next block of codes 'n' times (specified by the 0x0C codetype), but doesn't clear the Dx register upon completion.
 			//<gbatek> FOR does backup the current IF condidition flags, and NEXT does restore these flags
 			st.status = st.loop.status;
 			if(st.loop.idx < st.loop.iterations)
 			{
 				st.loop.idx++;
-				i = st.loop.top;
+				next = st.loop.top + 1;
 			}
 			break;
 
 		case 0xD2:
 			//Loop Execute Variant/ Full Terminator (Special Codes)
-			//D2000000 00000000 
+			//D2000000 00000000
 			//Executes the next block of codes 'n' times (specified by the 0x0C codetype), and clears all temporary data. (i.e. execution status, offsets, code C settings, etc.)
-			//This code can also be used as a full terminator, giving the same effects to any block of code. 
+			//This code can also be used as a full terminator, giving the same effects to any block of code.
 			//<gbatek> FOR does backup the current IF condidition flags, and NEXT does restore these flags
 			st.status = st.loop.status;
 			if(st.loop.idx < st.loop.iterations)
 			{
 				st.loop.idx++;
-				i = st.loop.top;
+				next = st.loop.top + 1;
 			}
 			else
 			{
@@ -494,110 +583,100 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 			}
 			break;
 
-		case 0xD3: 
+		case 0xD3:
 			//Set offset (Offset Codes)
 			//D3000000 XXXXXXXX
 			//Sets the offset value to XXXXXXXX.
-			x = lo;
-			st.offset = x;
+			st.offset = op.y;
 			break;
 
 		case 0xD4:
 			//Add Value (Data Register Codes)
-			//D4000000 XXXXXXXX 
+			//D4000000 XXXXXXXX
 			//Adds 'XXXXXXXX' to the data register used by codetypes 0xD6 - 0xDB.
 			//<gbatek> datareg = datareg + XXXXXXXX
-			x = lo;
-			st.data += x;
+			st.data += op.y;
 			break;
 
 		case 0xD5:
 			//Set Value (Data Register Codes)
-			//D5000000 XXXXXXXX 
+			//D5000000 XXXXXXXX
 			//Set 'XXXXXXXX' to the data register used by code types 0xD6 - 0xD8.
-			x = lo;
-			st.data = x;
+			st.data = op.y;
 			break;
 
 		case 0xD6:
 			//32-Bit Incrementive Write (Data Register Codes)
-			//D6000000 XXXXXXXX 
+			//D6000000 XXXXXXXX
 			//Writes the 'Dx data' word to [XXXXXXXX+offset], and increments the offset by 4.
 			//<gbatek> word[XXXXXXXX+offset]=datareg, offset=offset+4
-			x = lo;
-			addr = x + st.offset;
-			shouldResetJit = CHEATS::DirectWrite<4>(st.proc, addr, st.data);
+			addr = op.y + st.offset;
+			shouldWriteCode = CHEATS::DirectWrite<4>(st.proc, addr, st.data);
 			st.offset += 4;
 			break;
 
 		case 0xD7:
 			//16-Bit Incrementive Write (Data Register Codes)
-			//D7000000 XXXXXXXX 
+			//D7000000 XXXXXXXX
 			//Writes the 'Dx data' halfword to [XXXXXXXX+offset], and increments the offset by 2.
 			//<gbatek> half[XXXXXXXX+offset]=datareg, offset=offset+2
-			x = lo;
-			addr = x + st.offset;
-			shouldResetJit = CHEATS::DirectWrite<2>(st.proc, addr, st.data);
+			addr = op.y + st.offset;
+			shouldWriteCode = CHEATS::DirectWrite<2>(st.proc, addr, st.data);
 			st.offset += 2;
 			break;
 
 		case 0xD8:
 			//8-Bit Incrementive Write (Data Register Codes)
-			//D8000000 XXXXXXXX 
+			//D8000000 XXXXXXXX
 			//Writes the 'Dx data' byte to [XXXXXXXX+offset], and increments the offset by 1.
 			//<gbatek> byte[XXXXXXXX+offset]=datareg, offset=offset+1
-			x = lo;
-			addr = x + st.offset;
-			shouldResetJit = CHEATS::DirectWrite<1>(st.proc, addr, st.data);
+			addr = op.y + st.offset;
+			shouldWriteCode = CHEATS::DirectWrite<1>(st.proc, addr, st.data);
 			st.offset += 1;
 			break;
 
 		case 0xD9:
 			//32-Bit Load (Data Register Codes)
-			//D9000000 XXXXXXXX 
+			//D9000000 XXXXXXXX
 			//Loads the word at [XXXXXXXX+offset] and stores it in the'Dx data register'.
-			x = lo;
-			addr = x + st.offset;
+			addr = op.y + st.offset;
 			st.data = _MMU_read32(st.proc,MMU_AT_DEBUG,addr);
 			break;
 
 		case 0xDA:
 			//16-Bit Load (Data Register Codes)
-			//DA000000 XXXXXXXX 
+			//DA000000 XXXXXXXX
 			//Loads the halfword at [XXXXXXXX+offset] and stores it in the'Dx data register'.
-			x = lo;
-			addr = x + st.offset;
+			addr = op.y + st.offset;
 			st.data = _MMU_read16(st.proc,MMU_AT_DEBUG,addr);
 			break;
 
 		case 0xDB:
 			//8-Bit Load (Data Register Codes)
-			//DB000000 XXXXXXXX 
+			//DB000000 XXXXXXXX
 			//Loads the byte at [XXXXXXXX+offset] and stores it in the'Dx data register'.
-			//This is a bugged code type. Check 'AR Hack #0' for the fix. 
-			x = lo;
-			addr = x + st.offset;
+			//This is a bugged code type. Check 'AR Hack #0' for the fix.
+			addr = op.y + st.offset;
 			st.data = _MMU_read08(st.proc,MMU_AT_DEBUG,addr);
 			//<gbatek> Before v1.54, the DB000000 code did accidently set offset=offset+XXXXXXX after execution of the code
 			if(!v154)
 				st.offset = addr;
 			break;
 
-		case 0xDC: 
+		case 0xDC:
 			//Set offset (Offset Codes)
 			//DC000000 XXXXXXXX
 			//Adds an offset to the current offset. (Dual Offset)
-			x = lo;
-			st.offset += x;
+			st.offset += op.y;
 			break;
 
 		case 0xDF:
 			if(vEmulator)
 			{
-				if(hi == 0xDFFFFFFF) {
-					if(lo == 0x99999999)
+				if(op.x == 0xDFFFFFFF) {
+					if(op.y == 0x99999999)
 						st.proc = ARMCPU_ARM9;
-					else if(lo == 0x77777777)
+					else if(op.y == 0x77777777)
 						st.proc = ARMCPU_ARM7;
 				}
 			}
@@ -605,88 +684,78 @@ bool CHEATS::ARparser(const CHEATS_LIST &theList)
 
 		case 0x0E:
 			//Patch Code (Miscellaneous Memory Manipulation Codes)
-			//EXXXXXXX YYYYYYYY 
+			//EXXXXXXX YYYYYYYY
 			//Copies YYYYYYYY bytes from (current code location + 8) to [XXXXXXXX + offset].
 			//<gbatek> Copy YYYYYYYY parameter bytes to [XXXXXXXX+offset...]
 			//<gbatek> For the COPY commands, addresses should be aligned by four (all data is copied with ldr/str, except, on odd lengths, the last 1..3 bytes do use ldrb/strb).
-			//attempting to emulate logic the way they may have implemented it, just in case
-			x = hi & 0x0FFFFFFF;
-			y = lo;
-			addr = x + st.offset;
+			//the parameter bytes were gathered by ARcompile(), which also worked out where the next code is
+			addr = op.x + st.offset;
 
 			{
-				u32 t = 0;
-				u32 b = 0;
-				
-				if(y>0) i++; //skip over the current code
-				while(y>=4)
+				const u32 *payload = &theProgram.payload[op.payload];
+
+				for (u32 w = 0; w < op.payloadWords; w++)
 				{
-					if (i == theList.num) break; //if we erroneously went off the end, bail
-					u32 tmp = theList.code[i][t];
-					if (t == 1) i++;
-					t ^= 1;
-					shouldResetJit = CHEATS::DirectWrite<4>(st.proc, addr, tmp);
+					shouldWriteCode = CHEATS::DirectWrite<4>(st.proc, addr, *payload++) || shouldWriteCode;
 					addr += 4;
-					y -= 4;
 				}
-				while(y>0)
+				for (u32 b = 0; b < op.payloadBytes; b++)
 				{
-					if (i == theList.num) break; //if we erroneously went off the end, bail
-					u32 tmp = theList.code[i][t]>>b;
-					shouldResetJit = CHEATS::DirectWrite<1>(st.proc, addr, tmp);
+					shouldWriteCode = CHEATS::DirectWrite<1>(st.proc, addr, *payload++) || shouldWriteCode;
 					addr += 1;
-					y -= 1;
-					b += 4;
 				}
-
-				//the main loop will increment to the next cheat, but the loop above may have gone one too far
-				if(t==0)
-					i--;
 			}
 			break;
 
 		case 0x0F:
 			//Memory Copy Code (Miscellaneous Memory Manipulation Codes)
-			//FXXXXXXX YYYYYYYY 
+			//FXXXXXXX YYYYYYYY
 			//<gbatek> Copy YYYYYYYY bytes from [offset..] to [XXXXXXX...]
 			//<gbatek> For the COPY commands, addresses should be aligned by four (all data is copied with ldr/str, except, on odd lengths, the last 1..3 bytes do use ldrb/strb).
 			//attempting to emulate logic the way they may have implemented it, just in case
-			x = hi & 0x0FFFFFFF;
-			y = lo;
+			y = op.y;
 			addr = st.offset;
-			operand = x; //mis-use of this variable to store dst
+			z = op.x; //dst
 			while(y>=4)
 			{
-				if (i == theList.num) break; //if we erroneously went off the end, bail
 				u32 tmp = _MMU_read32(st.proc,MMU_AT_DEBUG,addr);
-				shouldResetJit = CHEATS::DirectWrite<4>(st.proc, operand, tmp);
+				shouldWriteCode = CHEATS::DirectWrite<4>(st.proc, z, tmp) || shouldWriteCode;
 				addr += 4;
-				operand += 4;
+				z += 4;
 				y -= 4;
 			}
 			while(y>0)
 			{
-				if (i == theList.num) break; //if we erroneously went off the end, bail
 				u8 tmp = _MMU_read08(st.proc,MMU_AT_DEBUG,addr);
-				shouldResetJit = CHEATS::DirectWrite<1>(st.proc, operand, tmp);
+				shouldWriteCode = CHEATS::DirectWrite<1>(st.proc, z, tmp) || shouldWriteCode;
 				addr += 1;
-				operand += 1;
+				z += 1;
 				y -= 1;
 			}
 			break;
 
 		default:
-			printf("AR: ERROR unknown command %08X %08X\n", hi, lo);
+			printf("AR: ERROR unknown command %08X %08X\n", theProgram.source[i*2], theProgram.source[i*2+1]);
 			break;
 		}
-		
-		if (shouldResetJit)
+
+		if (shouldWriteCode)
 		{
-			needsJitReset = true;
+			didWriteCode = true;
 		}
+
+		i = next;
 	}
-	
-	return needsJitReset;
+
+	return didWriteCode;
+}
+
+bool CHEATS::ARparser(const CHEATS_LIST &theList)
+{
+	CHEATS_AR_PROGRAM program;
+	CHEATS::ARcompile(theList, program);
+
+	return CHEATS::ARexecute(program);
 }
 
 size_t CHEATS::add_AR_Direct(const CHEATS_LIST &srcCheat)
@@ -1156,15 +1225,18 @@ bool CHEATS::load()
 
 bool CHEATS::process(int targetType) const
 {
-	bool needsJitReset = false;
+	bool didWriteCode = false;
 	
 	if (CommonSettings.cheatsDisable || (this->_list.size() == 0))
-		return needsJitReset;
+		return didWriteCode;
 	
 	size_t num = this->_list.size();
+	if (this->_programs.size() < num)
+		this->_programs.resize(num);
+	
 	for (size_t i = 0; i < num; i++)
 	{
-		bool shouldResetJit = false;
+		bool shouldWriteCode = false;
 		
 		if (this->_list[i].enabled == 0)
 			continue;
@@ -1178,12 +1250,20 @@ bool CHEATS::process(int targetType) const
 		{
 			case CHEAT_TYPE_INTERNAL:
 				//INFO("list at 0x0|%07X value %i (size %i)\n",list[i].code[0], list[i].lo[0], list[i].size);
-				shouldResetJit = CHEATS::DirectWrite(this->_list[i].size + 1, ARMCPU_ARM9, this->_list[i].code[0][0], this->_list[i].code[0][1]);
+				shouldWriteCode = CHEATS::DirectWrite(this->_list[i].size + 1, ARMCPU_ARM9, this->_list[i].code[0][0], this->_list[i].code[0][1]);
 				break;
 				
 			case CHEAT_TYPE_AR:
-				shouldResetJit = CHEATS::ARparser(this->_list[i]);
+			{
+				// Items can be edited in place through getItemPtrAtIndex(), so the compiled
+				// program is checked against the codes it was built from before it is reused.
+				CHEATS_AR_PROGRAM &program = this->_programs[i];
+				if (!program.isCompiledFrom(this->_list[i]))
+					CHEATS::ARcompile(this->_list[i], program);
+				
+				shouldWriteCode = CHEATS::ARexecute(program);
 				break;
+			}
 				
 			case CHEAT_TYPE_CODEBREAKER:
 				break;
@@ -1192,18 +1272,15 @@ bool CHEATS::process(int targetType) const
 				continue;
 		}
 		
-		if (shouldResetJit)
+		if (shouldWriteCode)
 		{
-			needsJitReset = true;
+			didWriteCode = true;
 		}
 	}
 	
-	if (needsJitReset)
-	{
-		CHEATS::JitNeedsReset();
-	}
-	
-	return needsJitReset;
+	// No JIT reset is requested here. Cheat writes go through the regular MMU write path,
+	// which already discards the compiled blocks covering the written addresses.
+	return didWriteCode;
 }
 
 void CHEATS::JitNeedsReset()
@@ -1327,6 +1404,334 @@ bool CHEATS::XXCodeFromString(const char *codeString, CHEATS_LIST &outCheatItem)
 }
 
 // ========================================== search
+
+// A search keeps one bit per byte of main RAM in _statMem. A candidate of <size> bytes at
+// address i owns the bits of its bytes, and they are always all set or all clear, so a pass
+// only has to AND the bitmap with the outcome of the comparison, expanded the same way. For
+// 1, 2 and 4 byte values, that expanded outcome is exactly what a vector compare followed by
+// a byte movemask yields.
+//
+// RAM is split between up to CHEATSEARCH_MAX_WORKERS threads, in slices that keep whole
+// bitmap bytes and whole 3 byte values together.
+#define CHEATSEARCH_MAX_WORKERS 4
+#define CHEATSEARCH_SLICE_ALIGN 192
+
+enum CheatSearchCompare
+{
+	CheatSearchCompare_Greater = 0,	// than the snapshot
+	CheatSearchCompare_Less    = 1,
+	CheatSearchCompare_Equal   = 2,
+	CheatSearchCompare_Differ  = 3,
+	CheatSearchCompare_Value   = 4,	// equal to a given value
+	CheatSearchCompare_None    = 5	// nothing passes
+};
+
+struct CHEATSEARCH_JOB
+{
+	u8 *cur;
+	u8 *ref;
+	u8 *stat;
+	u32 begin;
+	u32 end;
+	u32 ramSize;
+	u32 size;
+	u32 comp;
+	u32 val;
+	u32 bits;		// bitmap bits still set in [begin,end) after the pass
+};
+
+static FORCEINLINE u32 cheatsearch_popcount(u32 v)
+{
+	v = v - ((v >> 1) & 0x55555555);
+	v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+	return (((v + (v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+template<int COMP> static FORCEINLINE bool cheatsearch_compare(u32 cur, u32 ref)
+{
+	switch (COMP)
+	{
+		case CheatSearchCompare_Greater: return cur > ref;
+		case CheatSearchCompare_Less:    return cur < ref;
+		case CheatSearchCompare_Differ:  return cur != ref;
+		default:                         return cur == ref;
+	}
+}
+
+template<int SIZE> static FORCEINLINE u32 cheatsearch_read(u8 *mem, u32 i)
+{
+	switch (SIZE)
+	{
+		case 1: return T1ReadByte(mem, i);
+		case 2: return T1ReadWord(mem, i);
+		case 3: return (u32)mem[i] | ((u32)mem[i+1] << 8) | ((u32)mem[i+2] << 16);
+		default: return T1ReadLong(mem, i);
+	}
+}
+
+// Handles one bitmap byte at a time, and skips those without candidates.
+template<int SIZE, int COMP> static u32 cheatsearch_scan(CHEATSEARCH_JOB &job, u32 i)
+{
+	u32 bits = 0;
+
+	for (; i < job.end; i += 8)
+	{
+		const u8 stat = job.stat[i >> 3];
+		if (stat == 0)
+			continue;
+
+		u8 pass = 0;
+		for (u32 e = 0; e < 8; e += SIZE)
+		{
+			if (!(stat & (1 << e)))
+				continue;
+			const u32 ref = (COMP == CheatSearchCompare_Value) ? job.val : cheatsearch_read<SIZE>(job.ref, i + e);
+			if (cheatsearch_compare<COMP>(cheatsearch_read<SIZE>(job.cur, i + e), ref))
+				pass |= ((1 << SIZE) - 1) << e;
+		}
+
+		job.stat[i >> 3] = stat & pass;
+		bits += cheatsearch_popcount(stat & pass);
+	}
+
+	return bits;
+}
+
+// 3 byte values don't line up with the bitmap bytes. They only own the bits of their
+// bytes that fall in the bitmap byte of their first one.
+template<int COMP> static u32 cheatsearch_scan24(CHEATSEARCH_JOB &job)
+{
+	u32 amount = 0;
+
+	for (u32 i = job.begin; i < job.end; i += 3)
+	{
+		const u32 addr = (i >> 3);
+		const u32 offs = (i % 8);
+		if (!(job.stat[addr] & (0x7 << offs)))
+			continue;
+
+		if (i + 3 <= job.ramSize)
+		{
+			const u32 ref = (COMP == CheatSearchCompare_Value) ? job.val : cheatsearch_read<3>(job.ref, i);
+			if (cheatsearch_compare<COMP>(cheatsearch_read<3>(job.cur, i), ref))
+			{
+				job.stat[addr] |= (0x7 << offs);
+				amount++;
+				continue;
+			}
+		}
+		job.stat[addr] &= ~(0x7 << offs);
+	}
+
+	return amount * 3;
+}
+
+#if defined(ENABLE_AVX2) || defined(ENABLE_SIMD_DISPATCH)
+SIMD_TARGET_BEGIN_AVX2
+
+template<int SIZE> static FORCEINLINE v256u8 cheatsearch_set1_AVX2(u32 val)
+{
+	switch (SIZE)
+	{
+		case 1: return _mm256_set1_epi8((s8)val);
+		case 2: return _mm256_set1_epi16((s16)val);
+		default: return _mm256_set1_epi32((s32)val);
+	}
+}
+
+template<int SIZE> static FORCEINLINE v256u8 cheatsearch_cmpeq_AVX2(const v256u8 &a, const v256u8 &b)
+{
+	switch (SIZE)
+	{
+		case 1: return _mm256_cmpeq_epi8(a, b);
+		case 2: return _mm256_cmpeq_epi16(a, b);
+		default: return _mm256_cmpeq_epi32(a, b);
+	}
+}
+
+// unsigned a > b, by flipping the sign bits for the signed compare
+template<int SIZE> static FORCEINLINE v256u8 cheatsearch_cmpgt_AVX2(const v256u8 &a, const v256u8 &b)
+{
+	const v256u8 bias = cheatsearch_set1_AVX2<SIZE>(1U << (SIZE*8 - 1));
+	const v256u8 sa = _mm256_xor_si256(a, bias);
+	const v256u8 sb = _mm256_xor_si256(b, bias);
+	switch (SIZE)
+	{
+		case 1: return _mm256_cmpgt_epi8(sa, sb);
+		case 2: return _mm256_cmpgt_epi16(sa, sb);
+		default: return _mm256_cmpgt_epi32(sa, sb);
+	}
+}
+
+template<int SIZE, int COMP> static u32 cheatsearch_scan_AVX2(CHEATSEARCH_JOB &job)
+{
+	const v256u8 val = cheatsearch_set1_AVX2<SIZE>(job.val);
+	u32 bits = 0;
+	u32 i = job.begin;
+
+	for (; i + 32 <= job.end; i += 32)
+	{
+		u32 *stat = (u32 *)(job.stat + (i >> 3));
+		if (*stat == 0)
+			continue;
+
+		const v256u8 cur = _mm256_loadu_si256((v256u8 *)(job.cur + i));
+		const v256u8 ref = (COMP == CheatSearchCompare_Value) ? val : _mm256_loadu_si256((v256u8 *)(job.ref + i));
+		u32 pass;
+		switch (COMP)
+		{
+			case CheatSearchCompare_Greater: pass = (u32)_mm256_movemask_epi8(cheatsearch_cmpgt_AVX2<SIZE>(cur, ref)); break;
+			case CheatSearchCompare_Less:    pass = (u32)_mm256_movemask_epi8(cheatsearch_cmpgt_AVX2<SIZE>(ref, cur)); break;
+			case CheatSearchCompare_Differ:  pass = ~(u32)_mm256_movemask_epi8(cheatsearch_cmpeq_AVX2<SIZE>(cur, ref)); break;
+			default:                         pass = (u32)_mm256_movemask_epi8(cheatsearch_cmpeq_AVX2<SIZE>(cur, ref)); break;
+		}
+
+		*stat &= pass;
+		bits += cheatsearch_popcount(*stat);
+	}
+
+	return bits + cheatsearch_scan<SIZE, COMP>(job, i);
+}
+
+SIMD_TARGET_END
+#endif
+
+#if defined(ENABLE_SSE2) && !defined(ENABLE_AVX2)
+
+template<int SIZE> static FORCEINLINE v128u8 cheatsearch_set1_SSE2(u32 val)
+{
+	switch (SIZE)
+	{
+		case 1: return _mm_set1_epi8((s8)val);
+		case 2: return _mm_set1_epi16((s16)val);
+		default: return _mm_set1_epi32((s32)val);
+	}
+}
+
+template<int SIZE> static FORCEINLINE v128u8 cheatsearch_cmpeq_SSE2(const v128u8 &a, const v128u8 &b)
+{
+	switch (SIZE)
+	{
+		case 1: return _mm_cmpeq_epi8(a, b);
+		case 2: return _mm_cmpeq_epi16(a, b);
+		default: return _mm_cmpeq_epi32(a, b);
+	}
+}
+
+template<int SIZE> static FORCEINLINE v128u8 cheatsearch_cmpgt_SSE2(const v128u8 &a, const v128u8 &b)
+{
+	const v128u8 bias = cheatsearch_set1_SSE2<SIZE>(1U << (SIZE*8 - 1));
+	const v128u8 sa = _mm_xor_si128(a, bias);
+	const v128u8 sb = _mm_xor_si128(b, bias);
+	switch (SIZE)
+	{
+		case 1: return _mm_cmpgt_epi8(sa, sb);
+		case 2: return _mm_cmpgt_epi16(sa, sb);
+		default: return _mm_cmpgt_epi32(sa, sb);
+	}
+}
+
+template<int SIZE, int COMP> static u32 cheatsearch_scan_SSE2(CHEATSEARCH_JOB &job)
+{
+	const v128u8 val = cheatsearch_set1_SSE2<SIZE>(job.val);
+	u32 bits = 0;
+	u32 i = job.begin;
+
+	for (; i + 16 <= job.end; i += 16)
+	{
+		u16 *stat = (u16 *)(job.stat + (i >> 3));
+		if (*stat == 0)
+			continue;
+
+		const v128u8 cur = _mm_loadu_si128((v128u8 *)(job.cur + i));
+		const v128u8 ref = (COMP == CheatSearchCompare_Value) ? val : _mm_loadu_si128((v128u8 *)(job.ref + i));
+		u32 pass;
+		switch (COMP)
+		{
+			case CheatSearchCompare_Greater: pass = (u32)_mm_movemask_epi8(cheatsearch_cmpgt_SSE2<SIZE>(cur, ref)); break;
+			case CheatSearchCompare_Less:    pass = (u32)_mm_movemask_epi8(cheatsearch_cmpgt_SSE2<SIZE>(ref, cur)); break;
+			case CheatSearchCompare_Differ:  pass = ~(u32)_mm_movemask_epi8(cheatsearch_cmpeq_SSE2<SIZE>(cur, ref)); break;
+			default:                         pass = (u32)_mm_movemask_epi8(cheatsearch_cmpeq_SSE2<SIZE>(cur, ref)); break;
+		}
+
+		*stat &= (u16)pass;
+		bits += cheatsearch_popcount(*stat);
+	}
+
+	return bits + cheatsearch_scan<SIZE, COMP>(job, i);
+}
+
+#endif
+
+template<int SIZE, int COMP> static u32 cheatsearch_run(CHEATSEARCH_JOB &job)
+{
+	if (SIZE == 3)
+		return cheatsearch_scan24<COMP>(job);
+
+#if defined(ENABLE_AVX2)
+	return cheatsearch_scan_AVX2<SIZE, COMP>(job);
+#elif defined(ENABLE_SIMD_DISPATCH)
+	if (CPU_GetSIMDLevel() >= CPUSIMDLevel_AVX2)
+		return cheatsearch_scan_AVX2<SIZE, COMP>(job);
+	return cheatsearch_scan_SSE2<SIZE, COMP>(job);
+#elif defined(ENABLE_SSE2)
+	return cheatsearch_scan_SSE2<SIZE, COMP>(job);
+#else
+	return cheatsearch_scan<SIZE, COMP>(job, job.begin);
+#endif
+}
+
+template<int SIZE> static u32 cheatsearch_run(CHEATSEARCH_JOB &job)
+{
+	switch (job.comp)
+	{
+		case CheatSearchCompare_Greater: return cheatsearch_run<SIZE, CheatSearchCompare_Greater>(job);
+		case CheatSearchCompare_Less:    return cheatsearch_run<SIZE, CheatSearchCompare_Less>(job);
+		case CheatSearchCompare_Equal:   return cheatsearch_run<SIZE, CheatSearchCompare_Equal>(job);
+		case CheatSearchCompare_Differ:  return cheatsearch_run<SIZE, CheatSearchCompare_Differ>(job);
+		default:                         return cheatsearch_run<SIZE, CheatSearchCompare_Value>(job);
+	}
+}
+
+static void* cheatsearch_job_proc(void *param)
+{
+	CHEATSEARCH_JOB &job = *(CHEATSEARCH_JOB *)param;
+
+	switch (job.size)
+	{
+		case 0: job.bits = cheatsearch_run<1>(job); break;
+		case 1: job.bits = cheatsearch_run<2>(job); break;
+		case 2: job.bits = cheatsearch_run<3>(job); break;
+		default: job.bits = cheatsearch_run<4>(job); break;
+	}
+	return NULL;
+}
+
+static Task *cheatSearchWorkers = NULL;
+static int cheatSearchWorkerCount = 0;
+
+static int cheatsearch_workers()
+{
+	const int want = std::max(1, std::min(CommonSettings.num_cores, CHEATSEARCH_MAX_WORKERS));
+	if (want != cheatSearchWorkerCount)
+	{
+		for (int i = 0; i < cheatSearchWorkerCount - 1; i++)
+			cheatSearchWorkers[i].shutdown();
+		delete[] cheatSearchWorkers;
+		cheatSearchWorkers = NULL;
+		cheatSearchWorkerCount = want;
+
+		//the calling thread takes the first slice
+		if (want > 1)
+		{
+			cheatSearchWorkers = new Task[want - 1];
+			for (int i = 0; i < want - 1; i++)
+				cheatSearchWorkers[i].start(false, 0, "cheat search");
+		}
+	}
+	return want;
+}
+
 bool CHEATSEARCH::start(u8 type, u8 size, u8 sign)
 {
 	bool didStartSearch = false;
@@ -1339,12 +1744,15 @@ bool CHEATSEARCH::start(u8 type, u8 size, u8 sign)
 		return didStartSearch;
 	}
 
-	this->_statMem = new u8 [ ( 4 * 1024 * 1024 ) / 8 ];
-	memset(this->_statMem, 0xFF, ( 4 * 1024 * 1024 ) / 8);
+	// main RAM is 4MB on retail units, 8MB on debug consoles and 16MB on the DSi
+	this->_ramSize = _MMU_MAIN_MEM_MASK + 1;
+
+	this->_statMem = new u8 [ this->_ramSize / 8 ];
+	memset(this->_statMem, 0xFF, this->_ramSize / 8);
 
-	// comparative search type (need 8Mb RAM !!! (4+4))
-	this->_mem = new u8 [ ( 4 * 1024 * 1024 ) ];
-	memcpy(this->_mem, MMU.MMU_MEM[0][0x20], ( 4 * 1024 * 1024 ) );
+	// comparative search type (needs twice the RAM size)
+	this->_mem = new u8 [ this->_ramSize ];
+	memcpy(this->_mem, MMU.MMU_MEM[0][0x20], this->_ramSize );
 
 	this->_type = type;
 	this->_size = size;
@@ -1376,202 +1784,61 @@ void CHEATSEARCH::close()
 	//INFO("Cheat search system is closed\n");
 }
 
-u32 CHEATSEARCH::search(u32 val)
+u32 CHEATSEARCH::_search(u32 comp, u32 val)
 {
-	this->_amount = 0;
+	const u32 elementSize = this->_size + 1;
 
-	switch (this->_size)
+	// nothing can pass, so the candidates are simply dropped
+	if ( (comp == CheatSearchCompare_None) || ((comp == CheatSearchCompare_Value) && (elementSize < 4) && (val >> (elementSize * 8))) )
 	{
-		case 0:		// 1 byte
-			for (u32 i = 0; i < (4 * 1024 * 1024); i++)
-			{
-				u32	addr = (i >> 3);
-				u32	offs = (i % 8);
-				if (this->_statMem[addr] & (1<<offs))
-				{
-					if ( T1ReadByte(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) == val )
-					{
-						this->_statMem[addr] |= (1<<offs);
-						this->_amount++;
-						continue;
-					}
-					this->_statMem[addr] &= ~(1<<offs);
-				}
-			}
-		break;
+		memset(this->_statMem, 0, this->_ramSize / 8);
+		this->_amount = 0;
+		return this->_amount;
+	}
 
-		case 1:		// 2 bytes
-			for (u32 i = 0; i < (4 * 1024 * 1024); i+=2)
-			{
-				u32	addr = (i >> 3);
-				u32	offs = (i % 8);
-				if (this->_statMem[addr] & (3<<offs))
-				{
-					if ( T1ReadWord(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) == val )
-					{
-						this->_statMem[addr] |= (3<<offs);
-						this->_amount++;
-						continue;
-					}
-					this->_statMem[addr] &= ~(3<<offs);
-				}
-			}
-		break;
+	const int workers = cheatsearch_workers();
+	const u32 slice = (this->_ramSize / workers) / CHEATSEARCH_SLICE_ALIGN * CHEATSEARCH_SLICE_ALIGN;
+	CHEATSEARCH_JOB jobs[CHEATSEARCH_MAX_WORKERS];
 
-		case 2:		// 3 bytes
-			for (u32 i = 0; i < (4 * 1024 * 1024); i+=3)
-			{
-				u32	addr = (i >> 3);
-				u32	offs = (i % 8);
-				if (this->_statMem[addr] & (0x7<<offs))
-				{
-					if ( (T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) & 0x00FFFFFF) == val )
-					{
-						this->_statMem[addr] |= (0x7<<offs);
-						this->_amount++;
-						continue;
-					}
-					this->_statMem[addr] &= ~(0x7<<offs);
-				}
-			}
-		break;
+	for (int i = 0; i < workers; i++)
+	{
+		CHEATSEARCH_JOB &job = jobs[i];
+		job.cur = MMU.MMU_MEM[ARMCPU_ARM9][0x20];
+		job.ref = this->_mem;
+		job.stat = this->_statMem;
+		job.begin = slice * i;
+		job.end = (i == workers - 1) ? this->_ramSize : slice * (i + 1);
+		job.ramSize = this->_ramSize;
+		job.size = this->_size;
+		job.comp = comp;
+		job.val = val;
+		job.bits = 0;
 
-		case 3:		// 4 bytes
-			for (u32 i = 0; i < (4 * 1024 * 1024); i+=4)
-			{
-				u32	addr = (i >> 3);
-				u32	offs = (i % 8);
-				if (this->_statMem[addr] & (0xF<<offs))
-				{
-					if ( T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) == val )
-					{
-						this->_statMem[addr] |= (0xF<<offs);
-						this->_amount++;
-						continue;
-					}
-					this->_statMem[addr] &= ~(0xF<<offs);
-				}
-			}
-		break;
+		if (i > 0)
+			cheatSearchWorkers[i - 1].execute(cheatsearch_job_proc, &job);
+	}
+
+	cheatsearch_job_proc(&jobs[0]);
+	u32 bits = jobs[0].bits;
+	for (int i = 1; i < workers; i++)
+	{
+		cheatSearchWorkers[i - 1].finish();
+		bits += jobs[i].bits;
 	}
 
+	this->_amount = bits / elementSize;
 	return this->_amount;
 }
 
-u32 CHEATSEARCH::search(u8 comp)
+u32 CHEATSEARCH::search(u32 val)
 {
-	bool didComparePass = false;
-
-	this->_amount = 0;
-	
-	switch (this->_size)
-	{
-		case 0:		// 1 byte
-			for (u32 i = 0; i < (4 * 1024 * 1024); i++)
-			{
-				u32	addr = (i >> 3);
-				u32	offs = (i % 8);
-				if (this->_statMem[addr] & (1<<offs))
-				{
-					switch (comp)
-					{
-						case 0: didComparePass = (T1ReadByte(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) > T1ReadByte(this->_mem, i)); break;
-						case 1: didComparePass = (T1ReadByte(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) < T1ReadByte(this->_mem, i)); break;
-						case 2: didComparePass = (T1ReadByte(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) == T1ReadByte(this->_mem, i)); break;
-						case 3: didComparePass = (T1ReadByte(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) != T1ReadByte(this->_mem, i)); break;
-						default: didComparePass = false; break;
-					}
-					if (didComparePass)
-					{
-						this->_statMem[addr] |= (1<<offs);
-						this->_amount++;
-						continue;
-					}
-					this->_statMem[addr] &= ~(1<<offs);
-				}
-			}
-		break;
-
-		case 1:		// 2 bytes
-			for (u32 i = 0; i < (4 * 1024 * 1024); i+=2)
-			{
-				u32	addr = (i >> 3);
-				u32	offs = (i % 8);
-				if (this->_statMem[addr] & (3<<offs))
-				{
-					switch (comp)
-					{
-						case 0: didComparePass = (T1ReadWord(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) > T1ReadWord(this->_mem, i)); break;
-						case 1: didComparePass = (T1ReadWord(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) < T1ReadWord(this->_mem, i)); break;
-						case 2: didComparePass = (T1ReadWord(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) == T1ReadWord(this->_mem, i)); break;
-						case 3: didComparePass = (T1ReadWord(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) != T1ReadWord(this->_mem, i)); break;
-						default: didComparePass = false; break;
-					}
-					if (didComparePass)
-					{
-						this->_statMem[addr] |= (3<<offs);
-						this->_amount++;
-						continue;
-					}
-					this->_statMem[addr] &= ~(3<<offs);
-				}
-			}
-		break;
-
-		case 2:		// 3 bytes
-			for (u32 i = 0; i < (4 * 1024 * 1024); i+=3)
-			{
-				u32	addr = (i >> 3);
-				u32	offs = (i % 8);
-				if (this->_statMem[addr] & (7<<offs))
-				{
-					switch (comp)
-					{
-						case 0: didComparePass = ((T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) & 0x00FFFFFF) > (T1ReadLong(this->_mem, i) & 0x00FFFFFF) ); break;
-						case 1: didComparePass = ((T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) & 0x00FFFFFF) < (T1ReadLong(this->_mem, i) & 0x00FFFFFF) ); break;
-						case 2: didComparePass = ((T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) & 0x00FFFFFF) == (T1ReadLong(this->_mem, i) & 0x00FFFFFF) ); break;
-						case 3: didComparePass = ((T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) & 0x00FFFFFF) != (T1ReadLong(this->_mem, i) & 0x00FFFFFF) ); break;
-						default: didComparePass = false; break;
-					}
-					if (didComparePass)
-					{
-						this->_statMem[addr] |= (7<<offs);
-						this->_amount++;
-						continue;
-					}
-					this->_statMem[addr] &= ~(7<<offs);
-				}
-			}
-		break;
-
-		case 3:		// 4 bytes
-			for (u32 i = 0; i < (4 * 1024 * 1024); i+=4)
-			{
-				u32	addr = (i >> 3);
-				u32	offs = (i % 8);
-				if (this->_statMem[addr] & (0xF<<offs))
-				{
-					switch (comp)
-					{
-						case 0: didComparePass = (T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) > T1ReadLong(this->_mem, i)); break;
-						case 1: didComparePass = (T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) < T1ReadLong(this->_mem, i)); break;
-						case 2: didComparePass = (T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) == T1ReadLong(this->_mem, i)); break;
-						case 3: didComparePass = (T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) != T1ReadLong(this->_mem, i)); break;
-						default: didComparePass = false; break;
-					}
-					if (didComparePass)
-					{
-						this->_statMem[addr] |= (0xF<<offs);
-						this->_amount++;
-						continue;
-					}
-					this->_statMem[addr] &= ~(0xF<<offs);
-				}
-			}
-		break;
-	}
+	return this->_search(CheatSearchCompare_Value, val);
+}
 
-	memcpy(this->_mem, MMU.MMU_MEM[0][0x20], ( 4 * 1024 * 1024 ) );
+u32 CHEATSEARCH::search(u8 comp)
+{
+	this->_search((comp < CheatSearchCompare_Value) ? comp : (u32)CheatSearchCompare_None, 0);
+	memcpy(this->_mem, MMU.MMU_MEM[0][0x20], this->_ramSize );
 
 	return this->_amount;
 }
@@ -1594,7 +1861,7 @@ bool CHEATSEARCH::getList(u32 *address, u32 *curVal)
 		case 3: stepMem = 0xF; break;
 	}
 
-	for (u32 i = this->_lastRecord; i < (4 * 1024 * 1024); i+=step)
+	for (u32 i = this->_lastRecord; i < this->_ramSize; i+=step)
 	{
 		u32	addr = (i >> 3);
 		u32	offs = (i % 8);
@@ -1607,7 +1874,7 @@ bool CHEATSEARCH::getList(u32 *address, u32 *curVal)
 			{
 				case 0: *curVal = (u32)T1ReadByte(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i); break;
 				case 1: *curVal = (u32)T1ReadWord(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i); break;
-				case 2: *curVal = (u32)T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i) & 0x00FFFFFF; break;
+				case 2: *curVal = cheatsearch_read<3>(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i); break;
 				case 3: *curVal = (u32)T1ReadLong(MMU.MMU_MEM[ARMCPU_ARM9][0x20], i); break;
 				default: break;
 			}
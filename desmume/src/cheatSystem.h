@@ -73,10 +73,39 @@ struct CHEATS_LIST
 	u8		size;
 };
 
+// One Action Replay code, decoded ahead of time so that the per-frame pass does not
+// have to pick the code apart again.
+struct CHEATS_AR_OP
+{
+	u32 type;				// code type, with the C and D types broken down into subtypes
+	u32 x;					// address field, or the whole high word for the DF codes
+	u32 y;					// value field, already masked down to the code's width
+	u32 z;					// inverted mask of the 16-bit conditionals
+	u32 next;				// code to execute next
+	u32 skip;				// code to resume at while the execution status is false
+	u32 payload;			// first parameter word or byte of an E code in CHEATS_AR_PROGRAM::payload
+	u32 payloadWords;
+	u32 payloadBytes;
+};
+
+struct CHEATS_AR_PROGRAM
+{
+	std::vector<u32> source;			// the code list this program was compiled from
+	std::vector<CHEATS_AR_OP> ops;		// one op per code, so loop targets are code indices
+	std::vector<u32> payload;
+	
+	bool isCompiledFrom(const CHEATS_LIST &theList) const
+	{
+		return (this->source.size() == (size_t)theList.num * 2) &&
+		       ((theList.num == 0) || (memcmp(&this->source[0], theList.code, theList.num * sizeof(theList.code[0])) == 0));
+	}
+};
+
 class CHEATS
 {
 private:
 	std::vector<CHEATS_LIST> _list;
+	mutable std::vector<CHEATS_AR_PROGRAM> _programs;
 	u8					_filename[MAX_PATH];
 	size_t				_currentGet;
 
@@ -141,6 +170,8 @@ public:
 	template<size_t LENGTH> static bool DirectWrite(const int targetProc, const u32 targetAddress, u32 newValue);
 	static bool DirectWrite(const size_t newValueLength, const int targetProc, const u32 targetAddress, u32 newValue);
 	
+	static void ARcompile(const CHEATS_LIST &cheat, CHEATS_AR_PROGRAM &outProgram);
+	static bool ARexecute(const CHEATS_AR_PROGRAM &program);
 	static bool ARparser(const CHEATS_LIST &cheat);
 	
 	static void StringFromXXCode(const CHEATS_LIST &srcCheatItem, char *outCStringBuffer);
@@ -155,14 +186,17 @@ private:
 	u8	*_mem;
 	u32	_amount;
 	u32	_lastRecord;
+	u32	_ramSize;
 
 	u32	_type;
 	u32	_size;
 	u32	_sign;
 
+	u32 _search(u32 comp, u32 val);
+
 public:
 	CHEATSEARCH()
-			: _statMem(0), _mem(0), _amount(0), _lastRecord(0), _type(0), _size(0), _sign(0) 
+			: _statMem(0), _mem(0), _amount(0), _lastRecord(0), _ramSize(0), _type(0), _size(0), _sign(0) 
 	{}
 	~CHEATSEARCH() { this->close(); }
 	bool start(u8 type, u8 size, u8 sign);
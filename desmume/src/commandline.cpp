@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include "commandline.h"
 #include "types.h"
+#include "common.h"
 #include "movie.h"
 #include "rtc.h"
 #include "slot1.h"
@@ -65,7 +66,11 @@ CommandLine::CommandLine()
 #ifdef HAVE_JIT
 , _cpu_mode(-1)
 , _jit_size(-1)
+, _jit_fastmem(-1)
 #endif
+, _arm7_thread(-1)
+, _arm7_thread_skew(-1)
+, _idle_loop_skip(-1)
 , _console_type(NULL)
 , _advanscene_import(NULL)
 , load_slot(-1)
@@ -139,12 +144,23 @@ ENDL
 #ifdef HAVE_JIT
 " --jit-enable               Formerly --cpu-mode; default OFF" ENDL
 " --jit-size N               JIT block size 1-100; 1:accurate 100:fast (default)" ENDL
+" --jit-fastmem              Let JIT code access RAM directly (Linux x86_64 only)" ENDL
 #endif
 " --advanced-timing          Use advanced bus-level timing; default ON" ENDL
 " --rigorous-timing          Use more realistic component timings; default OFF" ENDL
 " --gamehacks                Use game-specific hacks; default ON" ENDL
 " --spu-advanced             Enable advanced SPU capture functions (reverb)" ENDL
 " --backupmem-db             Use DB for autodetecting backup memory type" ENDL
+" --arm7-thread              Run the ARM7 on its own thread (interpreter only;" ENDL
+"                            not deterministic, so movies may desync)" ENDL
+" --arm7-thread-skew N       Cycles the threaded cores may drift apart; default 2000" ENDL
+" --idle-loop-skip           Skip ahead when a CPU spins in a polling loop" ENDL
+" --savestate-codec [ZLIB|CHUNKED|FAST]" ENDL
+"                            Savestate compression; default ZLIB, which older versions can load" ENDL
+" --simd-level [BASELINE|AVX2|AVX512]" ENDL
+"                            Highest SIMD code path to use; default is the best" ENDL
+"                            one that the CPU supports. The 2D compositor always" ENDL
+"                            uses the level it was built for" ENDL
 ENDL
 "Arguments affecting the emulated requipment:" ENDL
 " --console-type [FAT|LITE|IQUE|DEBUG|DSI]" ENDL
@@ -204,6 +220,9 @@ ENDL
 #define OPT_FRAMESKIP 83
 #define OPT_SCALE 84
 #define OPT_JIT_SIZE 100
+#define OPT_ARM7_THREAD_SKEW 110
+#define OPT_SAVESTATE_CODEC 111
+#define OPT_SIMD_LEVEL 112
 
 #define OPT_CONSOLE_TYPE 200
 #define OPT_ARM9 201
@@ -242,6 +261,8 @@ bool CommandLine::parse(int argc,char **argv)
 	srand((unsigned)time(nullptr));
 
 	std::string _render3d;
+	std::string _savestate_codec;
+	std::string _simd_level;
 
 	int opt_help = 0;
 	int option_index = 0;
@@ -279,12 +300,18 @@ bool CommandLine::parse(int argc,char **argv)
 			#ifdef HAVE_JIT
 				{ "jit-enable", no_argument, &_cpu_mode, 1},
 				{ "jit-size", required_argument, NULL, OPT_JIT_SIZE },
+				{ "jit-fastmem", no_argument, &_jit_fastmem, 1},
 			#endif
 			{ "rigorous-timing", no_argument, &_rigorous_timing, 1},
 			{ "advanced-timing", no_argument, &_advanced_timing, 1},
 			{ "gamehacks", no_argument, &_gamehacks, 1},
 			{ "spu-advanced", no_argument, &_spu_advanced, 1},
 			{ "backupmem-db", no_argument, &autodetect_method, 1},
+			{ "arm7-thread", no_argument, &_arm7_thread, 1},
+			{ "arm7-thread-skew", required_argument, NULL, OPT_ARM7_THREAD_SKEW},
+			{ "idle-loop-skip", no_argument, &_idle_loop_skip, 1},
+			{ "savestate-codec", required_argument, NULL, OPT_SAVESTATE_CODEC},
+			{ "simd-level", required_argument, NULL, OPT_SIMD_LEVEL},
 
 			//system equipment
 			{ "console-type", required_argument, NULL, OPT_CONSOLE_TYPE },
@@ -357,6 +384,9 @@ bool CommandLine::parse(int argc,char **argv)
 		#ifdef HAVE_JIT
 		case OPT_JIT_SIZE: _jit_size = atoi(optarg); break;
 		#endif
+		case OPT_ARM7_THREAD_SKEW: _arm7_thread_skew = atoi(optarg); break;
+		case OPT_SAVESTATE_CODEC: _savestate_codec = optarg; break;
+		case OPT_SIMD_LEVEL: _simd_level = optarg; break;
 
 		//system equipment
 		case OPT_CONSOLE_TYPE: console_type = optarg; break;
@@ -406,6 +436,24 @@ bool CommandLine::parse(int argc,char **argv)
 	if(_rigorous_timing) CommonSettings.rigorous_timing = true;
 	if(_advanced_timing != -1) CommonSettings.advanced_timing = _advanced_timing==1;
 	if(_gamehacks != -1) CommonSettings.gamehacks.en = _gamehacks==1;
+	if(_arm7_thread != -1) CommonSettings.arm7_thread = (_arm7_thread==1);
+	if(_arm7_thread_skew > 0) CommonSettings.arm7_thread_skew = _arm7_thread_skew;
+	if(_idle_loop_skip != -1) CommonSettings.idle_loop_skip = (_idle_loop_skip==1);
+
+	_savestate_codec = strtoupper(_savestate_codec);
+	if(_savestate_codec == "ZLIB") CommonSettings.savestate_codec = TCommonSettings::SavestateCodec_Zlib;
+	else if(_savestate_codec == "CHUNKED") CommonSettings.savestate_codec = TCommonSettings::SavestateCodec_ZlibChunked;
+	else if(_savestate_codec == "FAST") CommonSettings.savestate_codec = TCommonSettings::SavestateCodec_Fast;
+
+	if(_simd_level != "")
+	{
+		CPUSIMDLevel simdLevel;
+		std::transform(_simd_level.begin(), _simd_level.end(), _simd_level.begin(), ::tolower);
+		if(!CPU_ParseSIMDLevel(_simd_level.c_str(), simdLevel))
+			printerror("Invalid SIMD level [BASELINE|AVX2|AVX512]. Ignoring command line setting.\n");
+		else if(!CPU_ForceSIMDLevel(simdLevel))
+			printerror("This CPU doesn't support the %s SIMD level; using %s.\n", _simd_level.c_str(), CPU_GetSIMDLevelName(CPU_GetSIMDLevel()));
+	}
 
 #ifdef HAVE_JIT
 	if(_cpu_mode != -1) CommonSettings.use_jit = (_cpu_mode==1);
@@ -416,6 +464,7 @@ bool CommandLine::parse(int argc,char **argv)
 		else
 			CommonSettings.jit_max_block_size = _jit_size;
 	}
+	if(_jit_fastmem != -1) CommonSettings.jit_fastmem = (_jit_fastmem==1);
 #endif
 
 	//process console type
@@ -109,7 +109,11 @@ private:
 #ifdef HAVE_JIT
 	int _cpu_mode;
 	int _jit_size;
+	int _jit_fastmem;
 #endif
+	int _arm7_thread;
+	int _arm7_thread_skew;
+	int _idle_loop_skip;
 	char* _slot1;
 	char *_slot1_fat_dir;
 	char* _console_type;
@@ -30,6 +30,12 @@
 #include <stdlib.h>
 #include <map>
 
+#if defined(ENABLE_SIMD_DISPATCH) && defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(ENABLE_SIMD_DISPATCH)
+#include <cpuid.h>
+#endif
+
 static std::map<void *, void *> _alignedPtrList; // Key: Aligned pointer / Value: Original pointer
 
 // ===============================================================================
@@ -71,6 +77,172 @@ msgBoxInterface msgBoxFake = {
 
 msgBoxInterface *msgbox = &msgBoxFake;
 
+// ===============================================================================
+// CPU features
+// ===============================================================================
+#if defined(ENABLE_SIMD_DISPATCH)
+
+static void _CPU_GetCPUID(u32 leaf, u32 subleaf, u32 *regs)
+{
+#if defined(_MSC_VER)
+	__cpuidex((int *)regs, (int)leaf, (int)subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static u64 _CPU_GetXCR0()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	u32 lo, hi;
+	__asm__ __volatile__ ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((u64)hi << 32) | lo;
+#endif
+}
+
+static CPUSIMDLevel _CPU_DetectSIMDLevel()
+{
+	u32 regs[4];
+	
+	_CPU_GetCPUID(0, 0, regs);
+	const u32 maxLeaf = regs[0];
+	if (maxLeaf < 7)
+	{
+		return CPUSIMDLevel_Baseline;
+	}
+	
+	// The OS must save the wider registers on a context switch, or else the
+	// instructions that use them can't be used even if the CPU has them.
+	_CPU_GetCPUID(1, 0, regs);
+	const bool hasOSXSAVE = (regs[2] & (1 << 27)) != 0;
+	const bool hasAVX     = (regs[2] & (1 << 28)) != 0;
+	if (!hasOSXSAVE || !hasAVX)
+	{
+		return CPUSIMDLevel_Baseline;
+	}
+	
+	const u64 xcr0 = _CPU_GetXCR0();
+	const bool osSavesYMM = (xcr0 & 0x06) == 0x06;
+	const bool osSavesZMM = (xcr0 & 0xE6) == 0xE6;
+	
+	_CPU_GetCPUID(7, 0, regs);
+	const bool hasAVX2     = (regs[1] & (1 <<  5)) != 0;
+	const bool hasAVX512F  = (regs[1] & (1 << 16)) != 0;
+	const bool hasAVX512DQ = (regs[1] & (1 << 17)) != 0;
+	const bool hasAVX512CD = (regs[1] & (1 << 28)) != 0;
+	const bool hasAVX512BW = (regs[1] & (1 << 30)) != 0;
+	
+	if (osSavesZMM && hasAVX2 && hasAVX512F && hasAVX512CD && hasAVX512BW && hasAVX512DQ)
+	{
+		return CPUSIMDLevel_AVX512;
+	}
+	
+	if (osSavesYMM && hasAVX2)
+	{
+		return CPUSIMDLevel_AVX2;
+	}
+	
+	return CPUSIMDLevel_Baseline;
+}
+
+#else
+
+static CPUSIMDLevel _CPU_DetectSIMDLevel()
+{
+#if defined(ENABLE_AVX512_1)
+	return CPUSIMDLevel_AVX512;
+#elif defined(ENABLE_AVX2)
+	return CPUSIMDLevel_AVX2;
+#else
+	return CPUSIMDLevel_Baseline;
+#endif
+}
+
+#endif // ENABLE_SIMD_DISPATCH
+
+static CPUSIMDLevel _CPU_GetInitialSIMDLevel()
+{
+	CPUSIMDLevel level = CPU_GetDetectedSIMDLevel();
+	CPUSIMDLevel forcedLevel;
+	
+	const char *forcedLevelName = getenv("DESMUME_SIMD_LEVEL");
+	if ( (forcedLevelName != NULL) && CPU_ParseSIMDLevel(forcedLevelName, forcedLevel) && (forcedLevel < level) )
+	{
+		level = forcedLevel;
+	}
+	
+	return level;
+}
+
+static CPUSIMDLevel& _CPU_SIMDLevel()
+{
+	static CPUSIMDLevel level = _CPU_GetInitialSIMDLevel();
+	return level;
+}
+
+CPUSIMDLevel CPU_GetDetectedSIMDLevel()
+{
+	static const CPUSIMDLevel detectedLevel = _CPU_DetectSIMDLevel();
+	return detectedLevel;
+}
+
+CPUSIMDLevel CPU_GetSIMDLevel()
+{
+	return _CPU_SIMDLevel();
+}
+
+bool CPU_ForceSIMDLevel(CPUSIMDLevel level)
+{
+	const CPUSIMDLevel detectedLevel = CPU_GetDetectedSIMDLevel();
+	if (level > detectedLevel)
+	{
+		_CPU_SIMDLevel() = detectedLevel;
+		return false;
+	}
+	
+	_CPU_SIMDLevel() = level;
+	return true;
+}
+
+const char* CPU_GetSIMDLevelName(CPUSIMDLevel level)
+{
+	switch (level)
+	{
+		case CPUSIMDLevel_AVX2:
+			return "avx2";
+			
+		case CPUSIMDLevel_AVX512:
+			return "avx512";
+			
+		default:
+			return "baseline";
+	}
+}
+
+bool CPU_ParseSIMDLevel(const char *name, CPUSIMDLevel &outLevel)
+{
+	if ( !strcmp(name, "baseline") || !strcmp(name, "sse2") )
+	{
+		outLevel = CPUSIMDLevel_Baseline;
+	}
+	else if (!strcmp(name, "avx2"))
+	{
+		outLevel = CPUSIMDLevel_AVX2;
+	}
+	else if (!strcmp(name, "avx512"))
+	{
+		outLevel = CPUSIMDLevel_AVX512;
+	}
+	else
+	{
+		return false;
+	}
+	
+	return true;
+}
+
 void* malloc_aligned(size_t length, size_t alignment)
 {
 	const uintptr_t ptrOffset = alignment; // This value must be a power of 2, or this function will fail.
@@ -44,6 +44,31 @@ extern msgBoxInterface *msgbox;
 // ===============================================================================
 //
 
+// ===============================================================================
+// CPU features
+// ===============================================================================
+
+// The SIMD code paths that can be picked at runtime, in increasing order. Baseline is
+// whatever instruction set the build itself targets (SSE2 on x86-64).
+enum CPUSIMDLevel
+{
+	CPUSIMDLevel_Baseline	= 0,
+	CPUSIMDLevel_AVX2		= 1,
+	CPUSIMDLevel_AVX512		= 2		// AVX-512 Tier-1 (F, CD, BW, DQ)
+};
+
+CPUSIMDLevel CPU_GetDetectedSIMDLevel();		// Highest level that the CPU and the OS support.
+CPUSIMDLevel CPU_GetSIMDLevel();				// Level that the emulator uses.
+
+// Caps the level that the emulator uses, for testing the lower code paths. The level
+// can also be capped with the DESMUME_SIMD_LEVEL environment variable. Subsystems pick
+// their code path when they are created, so call this before NDS_Init(). Returns false
+// if the CPU doesn't support the requested level, in which case the detected level is used.
+bool CPU_ForceSIMDLevel(CPUSIMDLevel level);
+
+const char* CPU_GetSIMDLevelName(CPUSIMDLevel level);
+bool CPU_ParseSIMDLevel(const char *name, CPUSIMDLevel &outLevel);
+
 void* malloc_aligned(size_t length, size_t alignment);
 void* malloc_aligned16(size_t length);
 void* malloc_aligned32(size_t length);
@@ -1549,8 +1549,6 @@ void ClientCheatManager::DirectWriteInternalCheat(uint32_t targetAddress, uint32
 
 void ClientCheatManager::ApplyPendingInternalCheatWrites()
 {
-	bool needsJitReset = false;
-	
 	const size_t writeListSize = this->_pendingInternalCheatWriteList.size();
 	if (writeListSize == 0)
 	{
@@ -1561,20 +1559,10 @@ void ClientCheatManager::ApplyPendingInternalCheatWrites()
 	{
 		const InternalCheatParam cheatWrite = this->_pendingInternalCheatWriteList[i];
 		
-		const bool shouldResetJit = CHEATS::DirectWrite(cheatWrite.valueLength, ARMCPU_ARM9, cheatWrite.address, cheatWrite.value);
-		if (shouldResetJit)
-		{
-			needsJitReset = true;
-		}
+		CHEATS::DirectWrite(cheatWrite.valueLength, ARMCPU_ARM9, cheatWrite.address, cheatWrite.value);
 	}
 	
 	this->_pendingInternalCheatWriteList.clear();
-	
-	if (needsJitReset)
-	{
-		CHEATS::JitNeedsReset();
-		CHEATS::ResetJitIfNeeded();
-	}
 }
 
 #pragma mark -
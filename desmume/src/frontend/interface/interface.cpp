@@ -158,6 +158,49 @@ EXPORTED void desmume_cycle(BOOL with_joystick)
     SPU_Emulate_user();
 }
 
+EXPORTED const DesmumeBatchResult *desmume_cycle_batch(const DesmumeFrameInput *input, int frames, BOOL render_all, BOOL capture_audio)
+{
+    static DesmumeBatchResult result;
+
+    if (capture_audio)
+        SPU_CaptureStart();
+
+    for (int i = 0; i < frames; i++)
+    {
+        if (input)
+        {
+            update_keypad(input[i].keys);
+            if (input[i].touch)
+                NDS_setTouchPos(input[i].touch_x, input[i].touch_y);
+            else
+                NDS_releaseTouch();
+        }
+        if (!render_all && i < frames - 2)
+            NDS_SkipNextFrame();
+
+        NDS_beginProcessingInput();
+        {
+            FCEUMOV_AddInputState();
+        }
+        NDS_endProcessingInput();
+
+        NDS_exec<false>();
+        if (!capture_audio)
+            SPU_Emulate_user();
+    }
+
+    size_t sampleCount = 0;
+    result.audio = NULL;
+    if (capture_audio)
+    {
+        SPU_CaptureStop();
+        result.audio = SPU_CaptureGetSamples(sampleCount);
+    }
+    result.audio_samples = (int)sampleCount;
+    result.screens = desmume_draw_raw();
+    return &result;
+}
+
 EXPORTED int desmume_sdl_get_ticks()
 {
     return SDL_GetTicks();
@@ -287,6 +330,60 @@ EXPORTED char* desmume_savestate_slot_date(int index)
     return savestates[index].date;
 }
 
+EXPORTED BOOL desmume_savestate_save_base(const char *file_name)
+{
+    return savestate_save_base(file_name);
+}
+
+EXPORTED BOOL desmume_savestate_save_delta(const char *file_name)
+{
+    return savestate_save_delta(file_name);
+}
+
+EXPORTED int desmume_savestate_load_delta(const char *base_file_name, const char *delta_file_name)
+{
+    switch (savestate_load_delta(base_file_name, delta_file_name))
+    {
+        case SAVESTATE_DELTA_OK: return DESMUME_SAVESTATE_DELTA_OK;
+        case SAVESTATE_DELTA_WRONG_BASE: return DESMUME_SAVESTATE_DELTA_WRONG_BASE;
+        default: return DESMUME_SAVESTATE_DELTA_FAILED;
+    }
+}
+
+EXPORTED void desmume_rewind_enable(int buffer_size_mb, int interval)
+{
+    if (buffer_size_mb <= 0 || buffer_size_mb > DESMUME_REWIND_MAX_MB || interval <= 0)
+        return;
+    rewind_enable((u32)((u64)buffer_size_mb * 1024 * 1024), interval);
+}
+
+EXPORTED void desmume_rewind_disable()
+{
+    rewind_disable();
+}
+
+EXPORTED BOOL desmume_rewind_enabled()
+{
+    return rewind_is_enabled();
+}
+
+EXPORTED BOOL desmume_rewind_step_back()
+{
+    return rewind_step_back();
+}
+
+EXPORTED BOOL desmume_rewind_step_forward()
+{
+    return rewind_step_forward();
+}
+
+EXPORTED int desmume_rewind_available()
+{
+    REWIND_STATS stats;
+    rewind_get_stats(&stats);
+    return stats.stepsBack;
+}
+
 EXPORTED BOOL desmume_gpu_get_layer_main_enable_state(int layer_index)
 {
     return GPU->GetEngineMain()->GetLayerEnableState(layer_index);
@@ -611,7 +708,6 @@ EXPORTED int desmume_movie_get_length()
 
 EXPORTED char *desmume_movie_get_name()
 {
-    extern char curMovieFilename[512];
     return curMovieFilename;
 }
 
@@ -664,11 +760,43 @@ EXPORTED void desmume_movie_record_from_date(const char *save_file_name, const c
 EXPORTED void desmume_movie_replay()
 {
     if (movieMode != MOVIEMODE_INACTIVE) {
-        extern char curMovieFilename[512];
-        desmume_movie_play(curMovieFilename);
+        FCEUI_LoadMovie(curMovieFilename, true, false, 0);
     }
 }
 EXPORTED void desmume_movie_stop()
 {
     FCEUI_StopMovie();
 }
+
+EXPORTED BOOL desmume_movie_seek(int frame)
+{
+    if (!desmume_movie_is_playing() && !desmume_movie_is_finished())
+        return FALSE;
+    if (frame < 0 || frame > currMovieData.getNumRecords())
+        return FALSE;
+
+    if (FCEUI_MovieSeekKeyframe(frame) < 0) {
+        std::string fileName = curMovieFilename;
+        if (FCEUI_LoadMovie(fileName.c_str(), movie_readonly, false, 0) != NULL)
+            return FALSE;
+    }
+
+    while (currFrameCounter < frame && movieMode == MOVIEMODE_PLAY) {
+        NDS_SkipNextFrame();
+
+        NDS_beginProcessingInput();
+        {
+            FCEUMOV_AddInputState();
+        }
+        NDS_endProcessingInput();
+
+        NDS_exec<false>();
+    }
+
+    return currFrameCounter == frame;
+}
+
+EXPORTED void desmume_movie_set_keyframe_interval(int frames)
+{
+    FCEUI_SetMovieKeyframeInterval(frames);
+}
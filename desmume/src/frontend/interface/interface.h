@@ -66,6 +66,28 @@ struct SimpleDate {
     int millisecond;
 };
 
+// Input for one frame of desmume_cycle_batch. Keys are laid out like desmume_input_keypad_update.
+struct DesmumeFrameInput {
+    u16 keys;
+    u16 touch_x;
+    u16 touch_y;
+    u8 touch;
+};
+
+// Output of desmume_cycle_batch. The pointers belong to the core and stay valid until
+// the next batch or cycle.
+struct DesmumeBatchResult {
+    // Both screens after the last frame, laid out like desmume_draw_raw, backlight applied.
+    const u16 *screens;
+    // Interleaved stereo samples of all frames of the batch, or NULL if audio wasn't captured.
+    const s16 *audio;
+    int audio_samples;
+};
+
+// There is one emulator per process. The core keeps its state in globals (MMU, the ARM
+// cores, GPU, SPU, gfx3d, the JIT and CommonSettings), so these calls have no instance
+// handle, and they must all come from the same thread. Running several emulators needs
+// several processes until that state moves behind a context.
 EXPORTED int desmume_init(void);
 EXPORTED void desmume_free(void);
 
@@ -79,6 +101,12 @@ EXPORTED void desmume_reset(void);
 EXPORTED BOOL desmume_running(void);
 EXPORTED void desmume_skip_next_frame(void);
 EXPORTED void desmume_cycle(BOOL with_joystick);
+// Runs <frames> frames, taking the input of frame i from input[i] (or keeping the
+// current input if <input> is NULL). Unless <render_all>, frames whose picture would
+// never be seen are skipped by the GPU; the last two frames of a batch are always
+// drawn since the 2D engines finish a frame one frame after the 3D. If
+// <capture_audio>, the audio of the batch is handed back instead of being played.
+EXPORTED const DesmumeBatchResult *desmume_cycle_batch(const DesmumeFrameInput *input, int frames, BOOL render_all, BOOL capture_audio);
 
 EXPORTED int desmume_sdl_get_ticks();
 
@@ -106,6 +134,26 @@ EXPORTED void desmume_savestate_slot_save(int index);
 EXPORTED BOOL desmume_savestate_slot_exists(int index);
 EXPORTED char* desmume_savestate_slot_date(int index);
 
+// Incremental savestates: a base, then deltas holding only the RAM written since it.
+// desmume_savestate_load_delta returns one of the DESMUME_SAVESTATE_DELTA_* codes.
+#define DESMUME_SAVESTATE_DELTA_OK 0
+#define DESMUME_SAVESTATE_DELTA_FAILED 1
+#define DESMUME_SAVESTATE_DELTA_WRONG_BASE 2
+EXPORTED BOOL desmume_savestate_save_base(const char *file_name);
+EXPORTED BOOL desmume_savestate_save_delta(const char *file_name);
+EXPORTED int desmume_savestate_load_delta(const char *base_file_name, const char *delta_file_name);
+
+// Rewind: keeps a snapshot every <interval> frames in <buffer_size_mb> of memory.
+// Sizes outside 1..DESMUME_REWIND_MAX_MB, or an interval below 1, are ignored.
+#define DESMUME_REWIND_MAX_MB 2048
+EXPORTED void desmume_rewind_enable(int buffer_size_mb, int interval);
+EXPORTED void desmume_rewind_disable();
+EXPORTED BOOL desmume_rewind_enabled();
+EXPORTED BOOL desmume_rewind_step_back();
+EXPORTED BOOL desmume_rewind_step_forward();
+// Number of steps back currently possible.
+EXPORTED int desmume_rewind_available();
+
 EXPORTED BOOL desmume_gpu_get_layer_main_enable_state(int layer_index);
 EXPORTED BOOL desmume_gpu_get_layer_sub_enable_state(int layer_index);
 EXPORTED void desmume_gpu_set_layer_main_enable_state(int layer_index, BOOL the_state);
@@ -174,6 +222,10 @@ EXPORTED void desmume_movie_record(const char *save_file_name, const char *autho
 EXPORTED void desmume_movie_record_from_date(const char *save_file_name, const char *author_name, START_FROM start_from, const char* sram_file_name, SimpleDate date);
 EXPORTED void desmume_movie_replay();
 EXPORTED void desmume_movie_stop();
+// Plays the movie to the start of <frame> without rendering. Movies in the binary .dsmb format
+// start from their nearest keyframe; others are replayed from the beginning to go backwards.
+EXPORTED BOOL desmume_movie_seek(int frame);
+EXPORTED void desmume_movie_set_keyframe_interval(int frames);
 
 };
 
@@ -0,0 +1,442 @@
+/* cheat_search.cpp - this file is part of DeSmuME
+ *
+ * Copyright (C) 2026 DeSmuME Team
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Runs cheat searches over main RAM and checks the candidates against a plain model that
+ * compares every value one at a time, for 4, 8 and 16MB of RAM, each value size, each
+ * compare mode, at every SIMD level the CPU has and with one and several worker threads.
+ * 3 byte values get a few extra checks, since they don't line up with the bitmap bytes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "../NDSSystem.h"
+#include "../SPU.h"
+#include "../MMU.h"
+#include "../render3D.h"
+#include "../cheatSystem.h"
+#include "../common.h"
+
+volatile bool execute = false;
+
+SoundInterface_struct *SNDCoreList[] = {
+  &SNDDummy,
+  NULL
+};
+
+GPU3DInterface *core3DList[] = {
+  &gpu3DNull,
+  NULL
+};
+
+/* compare modes of CHEATSEARCH::search(u8) */
+enum
+{
+  COMPARE_GREATER = 0,
+  COMPARE_LESS = 1,
+  COMPARE_EQUAL = 2,
+  COMPARE_DIFFER = 3,
+  COMPARE_VALUE = 4
+};
+
+struct SearchPass
+{
+  int comp;
+  u32 val;
+};
+
+/* Each chain of passes starts with one that leaves few enough candidates to list quickly. */
+static const SearchPass chainGreater[] = { { COMPARE_DIFFER, 0 }, { COMPARE_GREATER, 0 }, { -1, 0 } };
+static const SearchPass chainLess[] = { { COMPARE_DIFFER, 0 }, { COMPARE_LESS, 0 }, { -1, 0 } };
+static const SearchPass chainEqual[] = { { COMPARE_DIFFER, 0 }, { COMPARE_EQUAL, 0 }, { COMPARE_DIFFER, 0 }, { -1, 0 } };
+static const SearchPass chainValue[] = { { COMPARE_VALUE, 0x80 }, { COMPARE_EQUAL, 0 }, { COMPARE_VALUE, 0x80 }, { -1, 0 } };
+static const SearchPass chainTooBig[] = { { COMPARE_VALUE, 0x1000000 }, { -1, 0 } };
+
+static const SearchPass *chains[] = { chainGreater, chainLess, chainEqual, chainValue, chainTooBig };
+#define CHAIN_COUNT ((int)(sizeof(chains) / sizeof(chains[0])))
+
+struct RamConfig
+{
+  const char *name;
+  bool debugConsole;
+  bool dsi;
+};
+
+static const RamConfig ramConfigs[] = {
+  { "4MB", false, false },
+  { "8MB", true, false },
+  { "16MB", false, true },
+};
+
+static u32 seed;
+
+static u32
+next_random ()
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+/* Few distinct byte values, so that equal values are common, and some on either side of
+ * the sign bit, since the search compares unsigned. */
+static const u8 randomBytes[8] = { 0x00, 0x01, 0x7F, 0x80, 0xFE, 0xFF, 0x00, 0xFF };
+
+static void
+fill_ram (u32 ramSize)
+{
+  for (u32 i = 0; i < ramSize; i += 8)
+    {
+      const u32 r = next_random();
+      for (u32 b = 0; b < 8; b++)
+        MMU.MAIN_MEM[i + b] = randomBytes[(r >> (b * 3)) & 7];
+    }
+}
+
+/* changes about one byte in 16 */
+static void
+mutate_ram (u32 ramSize)
+{
+  for (u32 n = ramSize / 16; n > 0; n--)
+    {
+      const u32 r = next_random();
+      MMU.MAIN_MEM[(r ^ (next_random() << 8)) & (ramSize - 1)] = randomBytes[r & 7];
+    }
+}
+
+static u32
+read_value (const u8 *mem, u32 i, u32 size)
+{
+  u32 val = 0;
+  for (u32 b = 0; b < size; b++)
+    val |= (u32)mem[i + b] << (b * 8);
+  return val;
+}
+
+static bool
+compare_value (int comp, u32 cur, u32 ref)
+{
+  switch (comp)
+    {
+    case COMPARE_GREATER: return cur > ref;
+    case COMPARE_LESS: return cur < ref;
+    case COMPARE_DIFFER: return cur != ref;
+    default: return cur == ref;
+    }
+}
+
+/* One bool per value of <size> bytes, the way a search would be written without a bitmap.
+ * A value that runs past the end of RAM never passes. */
+class SearchModel
+{
+public:
+  SearchModel (u32 ramSize, u32 size)
+    : _ramSize(ramSize), _size(size), _alive((ramSize + size - 1) / size, true), _ref(MMU.MAIN_MEM, MMU.MAIN_MEM + ramSize)
+  {}
+
+  void
+  search (int comp, u32 val)
+  {
+    const bool tooBig = (comp == COMPARE_VALUE) && (_size < 4) && (val >> (_size * 8));
+
+    for (size_t e = 0; e < _alive.size(); e++)
+      {
+        const u32 i = e * _size;
+        if (!_alive[e])
+          continue;
+        if (tooBig || i + _size > _ramSize)
+          {
+            _alive[e] = false;
+            continue;
+          }
+
+        const u32 ref = (comp == COMPARE_VALUE) ? val : read_value(&_ref[0], i, _size);
+        _alive[e] = compare_value(comp, read_value(MMU.MAIN_MEM, i, _size), ref);
+      }
+
+    if (comp != COMPARE_VALUE)
+      _ref.assign(MMU.MAIN_MEM, MMU.MAIN_MEM + _ramSize);
+  }
+
+  void
+  list (std::vector<u32> &out) const
+  {
+    for (size_t e = 0; e < _alive.size(); e++)
+      {
+        if (!_alive[e])
+          continue;
+        const u32 i = e * _size;
+        out.push_back(i);
+        out.push_back(read_value(MMU.MAIN_MEM, i, _size));
+      }
+  }
+
+private:
+  u32 _ramSize;
+  u32 _size;
+  std::vector<u8> _alive;
+  std::vector<u8> _ref;
+};
+
+static void
+list_candidates (CHEATSEARCH &search, std::vector<u32> &out)
+{
+  u32 address, val;
+  search.getListReset();
+  while (search.getList(&address, &val))
+    {
+      out.push_back(address);
+      out.push_back(val);
+    }
+}
+
+static bool
+check_candidates (const char *name, int pass, CHEATSEARCH &search, u32 amount, const std::vector<u32> &expected)
+{
+  std::vector<u32> actual;
+  list_candidates(search, actual);
+
+  if (amount != expected.size() / 2 || search.getAmount() != amount)
+    {
+      printf("%s: pass %d found %u values, expected %u\n", name, pass, amount, (u32)(expected.size() / 2));
+      return false;
+    }
+
+  for (size_t i = 0; i < expected.size() && i < actual.size(); i += 2)
+    {
+      if (expected[i] != actual[i] || expected[i + 1] != actual[i + 1])
+        {
+          printf("%s: pass %d lists %08X = %X, expected %08X = %X\n", name, pass,
+                 actual[i], actual[i + 1], expected[i], expected[i + 1]);
+          return false;
+        }
+    }
+
+  if (expected.size() != actual.size())
+    {
+      printf("%s: pass %d lists %u values, expected %u\n", name, pass,
+             (u32)(actual.size() / 2), (u32)(expected.size() / 2));
+      return false;
+    }
+
+  return true;
+}
+
+/* The RAM contents are generated again from <chainSeed> for every run of a chain, so the
+ * model only has to go through them once. */
+static void
+run_model (u32 chainSeed, u32 ramSize, u32 size, const SearchPass *chain, std::vector< std::vector<u32> > &lists)
+{
+  seed = chainSeed;
+  fill_ram(ramSize);
+  SearchModel model(ramSize, size);
+
+  for (int pass = 0; chain[pass].comp >= 0; pass++)
+    {
+      if (chain[pass].comp != COMPARE_VALUE)
+        mutate_ram(ramSize);
+
+      model.search(chain[pass].comp, chain[pass].val);
+      lists.push_back(std::vector<u32>());
+      model.list(lists.back());
+    }
+}
+
+static bool
+run_chain (const char *name, u32 chainSeed, u32 ramSize, u32 size, const SearchPass *chain,
+           const std::vector< std::vector<u32> > &lists)
+{
+  seed = chainSeed;
+  fill_ram(ramSize);
+
+  CHEATSEARCH search;
+  if (!search.start(1, size - 1, 0))
+    {
+      printf("%s: couldn't start a search\n", name);
+      return false;
+    }
+
+  bool ok = true;
+
+  for (int pass = 0; chain[pass].comp >= 0 && ok; pass++)
+    {
+      if (chain[pass].comp != COMPARE_VALUE)
+        mutate_ram(ramSize);
+
+      u32 amount;
+      if (chain[pass].comp == COMPARE_VALUE)
+        amount = search.search(chain[pass].val);
+      else
+        amount = search.search((u8)chain[pass].comp);
+
+      ok = check_candidates(name, pass, search, amount, lists[pass]);
+    }
+
+  search.close();
+  return ok;
+}
+
+/* A 3 byte value starting at 6 owns the top two bits of bitmap byte 0 and nothing of byte
+ * 1, and one that only partly fits at the end of RAM must never show up. */
+static bool
+check_24bit_edges (const char *name, u32 ramSize)
+{
+  const u32 lastWhole = (ramSize - 3) / 3 * 3;
+  bool ok = true;
+
+  memset(MMU.MAIN_MEM, 0, ramSize);
+  T1WriteLong(MMU.MAIN_MEM, 6, 0xABCDEF);
+  MMU.MAIN_MEM[lastWhole + 0] = 0xEF;
+  MMU.MAIN_MEM[lastWhole + 1] = 0xCD;
+  MMU.MAIN_MEM[lastWhole + 2] = 0xAB;
+
+  CHEATSEARCH search;
+  search.start(0, 2, 0);
+  u32 address = 0, val = 0;
+
+  if (search.search((u32)0xABCDEF) != 2)
+    {
+      printf("%s: 3 byte value search found %u values, expected 2\n", name, search.getAmount());
+      ok = false;
+    }
+  search.getListReset();
+  if (!search.getList(&address, &val) || address != 6 || val != 0xABCDEF)
+    {
+      printf("%s: 3 byte value at 6 listed as %08X = %X\n", name, address, val);
+      ok = false;
+    }
+  if (!search.getList(&address, &val) || address != lastWhole || val != 0xABCDEF)
+    {
+      printf("%s: last 3 byte value listed as %08X = %X, expected %08X\n", name, address, val, lastWhole);
+      ok = false;
+    }
+  search.close();
+
+  /* the candidate at 6 going away must not take the one at 9 with it */
+  search.start(1, 2, 0);
+  MMU.MAIN_MEM[8] = 0x12;
+  search.search((u8)COMPARE_EQUAL);
+  search.getListReset();
+  u32 first[3] = { 0, 0, 0 };
+  for (int i = 0; i < 3 && search.getList(&address, &val); i++)
+    first[i] = address;
+  if (first[0] != 0 || first[1] != 3 || first[2] != 9)
+    {
+      printf("%s: 3 byte candidates start %08X %08X %08X, expected 0 3 9\n", name, first[0], first[1], first[2]);
+      ok = false;
+    }
+
+  /* whatever lies past the end of RAM, the partial value there is never listed */
+  u32 last = 0;
+  search.getListReset();
+  while (search.getList(&address, &val))
+    last = address;
+  if (last != lastWhole)
+    {
+      printf("%s: last 3 byte candidate is %08X, expected %08X\n", name, last, lastWhole);
+      ok = false;
+    }
+  search.close();
+
+  return ok;
+}
+
+int main(int argc, char ** argv) {
+  CommonSettings.num_cores = 1;
+  if (NDS_Init() != 0)
+    {
+      fprintf(stderr, "Couldn't initialize the emulator\n");
+      return EXIT_FAILURE;
+    }
+
+  static const CPUSIMDLevel levels[] = { CPUSIMDLevel_Baseline, CPUSIMDLevel_AVX2 };
+  static const int workerCounts[] = { 1, 4 };
+  const CPUSIMDLevel startLevel = CPU_GetSIMDLevel();
+  int failures = 0;
+  int runs = 0;
+
+  for (size_t r = 0; r < sizeof(ramConfigs) / sizeof(ramConfigs[0]); r++)
+    {
+      SetupMMU(ramConfigs[r].debugConsole, ramConfigs[r].dsi);
+      const u32 ramSize = _MMU_MAIN_MEM_MASK + 1;
+
+      for (u32 size = 1; size <= 4; size++)
+        for (int c = 0; c < CHAIN_COUNT; c++)
+          {
+            const u32 chainSeed = 0x43484541 + c * 7 + size;
+            std::vector< std::vector<u32> > lists;
+            run_model(chainSeed, ramSize, size, chains[c], lists);
+
+            for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++)
+              {
+                if (!CPU_ForceSIMDLevel(levels[l]))
+                  continue;
+
+                for (size_t w = 0; w < sizeof(workerCounts) / sizeof(workerCounts[0]); w++)
+                  {
+                    CommonSettings.num_cores = workerCounts[w];
+
+                    char name[128];
+                    snprintf(name, sizeof(name), "%s, %s, %d thread%s, %u byte values, search %d",
+                             ramConfigs[r].name, CPU_GetSIMDLevelName(levels[l]), workerCounts[w],
+                             (workerCounts[w] > 1) ? "s" : "", size, c);
+
+                    const bool ok = run_chain(name, chainSeed, ramSize, size, chains[c], lists);
+                    printf("%s: %s\n", name, ok ? "ok" : "FAILED");
+                    runs++;
+                    if (!ok)
+                      failures++;
+                  }
+              }
+          }
+
+      for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++)
+        {
+          if (!CPU_ForceSIMDLevel(levels[l]))
+            continue;
+
+          for (size_t w = 0; w < sizeof(workerCounts) / sizeof(workerCounts[0]); w++)
+            {
+              CommonSettings.num_cores = workerCounts[w];
+
+              char name[128];
+              snprintf(name, sizeof(name), "%s, %s, %d thread%s, 3 byte edges",
+                       ramConfigs[r].name, CPU_GetSIMDLevelName(levels[l]), workerCounts[w],
+                       (workerCounts[w] > 1) ? "s" : "");
+              const bool ok = check_24bit_edges(name, ramSize);
+              printf("%s: %s\n", name, ok ? "ok" : "FAILED");
+              runs++;
+              if (!ok)
+                failures++;
+            }
+        }
+    }
+
+  CPU_ForceSIMDLevel(startLevel);
+  SetupMMU(false, false);
+  CommonSettings.num_cores = 1;
+  NDS_DeInit();
+
+  printf("%d of %d cheat searches matched the model\n", runs - failures, runs);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,532 @@
+/* rasterizer.cpp - this file is part of DeSmuME
+ *
+ * Copyright (C) 2026 DeSmuME Team
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Draws the same scenes of random screen space polygons with the plain SoftRasterizer,
+ * which shades every fragment through RasterizerUnit::_pixel(), and with each SIMD
+ * rasterizer the build and the CPU have, whose span functions depth test, interpolate,
+ * sample and shade whole spans at once. The color buffer and every fragment attribute
+ * buffer must come out the same. The scenes cover the polygon modes, direct color and
+ * translucent textures with each wrap mode, alpha test and blending, W-buffering, the
+ * depth equal test, shadow polygons, fog and edge marking.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "../NDSSystem.h"
+#include "../SPU.h"
+#include "../MMU.h"
+#include "../GPU.h"
+#include "../gfx3d.h"
+#include "../render3D.h"
+#include "../rasterize.h"
+#include "../texcache.h"
+#include "../common.h"
+
+volatile bool execute = false;
+
+SoundInterface_struct *SNDCoreList[] = {
+  &SNDDummy,
+  NULL
+};
+
+GPU3DInterface *core3DList[] = {
+  &gpu3DNull,
+  NULL
+};
+
+/* Where the test keeps its textures and palettes, as offsets into the LCDC VRAM. */
+#define TEXTURE_DIRECT_ADDR  0x0000
+#define TEXTURE_A3I5_ADDR    0x1000
+#define TEXTURE_A5I3_ADDR    0x1800
+#define TEXTURE_SIZE         0x2000
+#define PALETTE_ADDR         0x80000
+#define PALETTE_SIZE         0x40
+
+/* All test textures are 32x32 texels, so that texture coordinates run off them often. */
+#define TEXTURE_SIZE_SHIFT   2
+
+#define POLYS_PER_SCENE      120
+#define FRAMES_PER_SCENE     4
+
+enum SceneFlags
+{
+  SCENE_TEXTURED    = 1 << 0,
+  SCENE_TRANSLUCENT = 1 << 1,
+  SCENE_TOON        = 1 << 2,
+  SCENE_HIGHLIGHT   = 1 << 3,
+  SCENE_ALPHA_TEST  = 1 << 4,
+  SCENE_W_DEPTH     = 1 << 5,
+  SCENE_DEPTH_EQUAL = 1 << 6,
+  SCENE_SHADOW      = 1 << 7,
+  SCENE_FOG         = 1 << 8,
+  SCENE_EDGE_MARK   = 1 << 9,
+};
+
+struct Scene
+{
+  const char *name;
+  int flags;
+};
+
+static const Scene scenes[] = {
+  { "flat", 0 },
+  { "textured", SCENE_TEXTURED },
+  { "toon", SCENE_TEXTURED | SCENE_TOON },
+  { "highlight", SCENE_TEXTURED | SCENE_HIGHLIGHT },
+  { "translucent", SCENE_TEXTURED | SCENE_TRANSLUCENT },
+  { "alpha test", SCENE_TEXTURED | SCENE_TRANSLUCENT | SCENE_ALPHA_TEST },
+  { "w-buffer", SCENE_TEXTURED | SCENE_TRANSLUCENT | SCENE_W_DEPTH },
+  { "depth equal", SCENE_TEXTURED | SCENE_DEPTH_EQUAL },
+  { "depth equal w-buffer", SCENE_TEXTURED | SCENE_TRANSLUCENT | SCENE_DEPTH_EQUAL | SCENE_W_DEPTH },
+  { "shadow", SCENE_TEXTURED | SCENE_TRANSLUCENT | SCENE_SHADOW },
+  { "fog and edge marking", SCENE_TEXTURED | SCENE_TRANSLUCENT | SCENE_FOG | SCENE_EDGE_MARK },
+};
+#define SCENE_COUNT ((int)(sizeof(scenes) / sizeof(scenes[0])))
+
+enum RasterizerKind
+{
+  RASTERIZER_PLAIN,
+  RASTERIZER_SSE2,
+  RASTERIZER_AVX2,
+  RASTERIZER_COUNT
+};
+
+static const char *rasterizerNames[RASTERIZER_COUNT] = { "plain", "SSE2", "AVX2" };
+
+struct RenderResult
+{
+  std::vector<u32> color;
+  std::vector<u32> depth;
+  std::vector<u8> opaquePolyID;
+  std::vector<u8> translucentPolyID;
+  std::vector<u8> stencil;
+  std::vector<u8> isFogged;
+  std::vector<u8> isTranslucentPoly;
+  std::vector<u8> polyFacing;
+};
+
+static u32 seed;
+
+static u32
+next_random ()
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+static s32
+random_range (s32 low, s32 high)
+{
+  return low + (s32)(next_random() % (u32)(high - low + 1));
+}
+
+/* Fills the textures and their palette with random texels, and points the texture and
+ * palette slots at them. Direct color texels are transparent when bit 15 is clear, and the
+ * A3I5 and A5I3 texels carry their own alpha, so all three give the alpha test something
+ * to do. */
+static void
+fill_textures ()
+{
+  for (size_t i = 0; i < TEXTURE_SIZE; i++)
+    MMU.ARM9_LCD[i] = (u8)next_random();
+
+  for (size_t i = 0; i < PALETTE_SIZE; i++)
+    MMU.ARM9_LCD[PALETTE_ADDR + i] = (u8)next_random();
+
+  for (size_t i = 0; i < 4; i++)
+    MMU.texInfo.textureSlotAddr[i] = MMU.ARM9_LCD + (i * 0x20000);
+
+  for (size_t i = 0; i < 6; i++)
+    MMU.texInfo.texPalSlot[i] = MMU.ARM9_LCD + PALETTE_ADDR + (i * 0x4000);
+
+  /* the VRAM was written behind the texture cache's back */
+  texCache.Reset();
+}
+
+static void
+make_state (const Scene &scene, GFX3D_State &state)
+{
+  memset(&state, 0, sizeof(state));
+
+  state.DISP3DCNT.EnableTexMapping = (scene.flags & SCENE_TEXTURED) ? 1 : 0;
+  state.DISP3DCNT.PolygonShading = (scene.flags & SCENE_HIGHLIGHT) ? PolygonShadingMode_Highlight : PolygonShadingMode_Toon;
+  state.DISP3DCNT.EnableAlphaTest = (scene.flags & SCENE_ALPHA_TEST) ? 1 : 0;
+  state.DISP3DCNT.EnableAlphaBlending = (scene.flags & SCENE_TRANSLUCENT) ? 1 : 0;
+  state.DISP3DCNT.EnableEdgeMarking = (scene.flags & SCENE_EDGE_MARK) ? 1 : 0;
+  state.DISP3DCNT.EnableFog = (scene.flags & SCENE_FOG) ? 1 : 0;
+  state.SWAP_BUFFERS.DepthMode = (scene.flags & SCENE_W_DEPTH) ? 1 : 0;
+
+  state.alphaTestRef = (u8)random_range(0, 31);
+  state.fogShift = (u8)random_range(0, 10);
+  state.fogColor = next_random() & 0x001F7FFF;
+  state.fogOffset = (u16)(next_random() & 0x7FFF);
+
+  /* opaque clear color, polygon ID 0x3F, and fog on the background */
+  state.clearColor = (next_random() & 0x7FFF) | (31 << 16) | (0x3F << 24) | 0x8000;
+  state.clearDepth = 0x00FFFFFF;
+
+  for (size_t i = 0; i < 8; i++)
+    state.edgeMarkColorTable[i] = (u16)(next_random() & 0x7FFF);
+
+  for (size_t i = 0; i < 32; i++)
+    {
+      state.fogDensityTable[i] = (u8)random_range(0, 127);
+      state.toonTable16[i] = (u16)(next_random() & 0x7FFF);
+    }
+}
+
+static void
+make_texture (const Scene &scene, POLY &poly)
+{
+  poly.texParam.value = 0;
+  poly.texPalette = 0;
+
+  if (!(scene.flags & SCENE_TEXTURED) || random_range(0, 3) == 0)
+    return;
+
+  switch (random_range(0, (scene.flags & SCENE_TRANSLUCENT) ? 2 : 0))
+    {
+    case 0:
+      poly.texParam.PackedFormat = TEXMODE_16BPP;
+      poly.texParam.VRAMOffset = TEXTURE_DIRECT_ADDR >> 3;
+      break;
+    case 1:
+      poly.texParam.PackedFormat = TEXMODE_A3I5;
+      poly.texParam.VRAMOffset = TEXTURE_A3I5_ADDR >> 3;
+      break;
+    default:
+      poly.texParam.PackedFormat = TEXMODE_A5I3;
+      poly.texParam.VRAMOffset = TEXTURE_A5I3_ADDR >> 3;
+      break;
+    }
+
+  poly.texParam.SizeShiftS = TEXTURE_SIZE_SHIFT;
+  poly.texParam.SizeShiftT = TEXTURE_SIZE_SHIFT;
+  poly.texParam.RepeatS_Enable = random_range(0, 1);
+  poly.texParam.RepeatT_Enable = random_range(0, 1);
+  poly.texParam.MirroredRepeatS_Enable = random_range(0, 1);
+  poly.texParam.MirroredRepeatT_Enable = random_range(0, 1);
+}
+
+static void
+make_attribute (const Scene &scene, POLY &poly)
+{
+  poly.attribute.value = 0;
+  poly.attribute.FrontSurface = 1;
+  poly.attribute.BackSurface = 1;
+  poly.attribute.PolygonID = random_range(0, 63);
+  poly.attribute.Fog_Enable = random_range(0, 1);
+  poly.attribute.TranslucentDepthWrite_Enable = random_range(0, 1);
+
+  if (scene.flags & (SCENE_TOON | SCENE_HIGHLIGHT))
+    poly.attribute.Mode = random_range(0, 3) ? POLYGON_MODE_TOONHIGHLIGHT : POLYGON_MODE_MODULATE;
+  else
+    poly.attribute.Mode = random_range(0, 1) ? POLYGON_MODE_DECAL : POLYGON_MODE_MODULATE;
+
+  /* shadow masks have polygon ID 0, and the shadows themselves any other ID */
+  if ((scene.flags & SCENE_SHADOW) && random_range(0, 2) == 0)
+    {
+      poly.attribute.Mode = POLYGON_MODE_SHADOW;
+      poly.attribute.PolygonID = random_range(0, 1) ? 0 : random_range(1, 63);
+    }
+
+  if ((scene.flags & SCENE_TRANSLUCENT) && random_range(0, 1))
+    poly.attribute.Alpha = random_range(1, 30);
+  else
+    poly.attribute.Alpha = 31;
+}
+
+/* Makes a triangle or a convex quad somewhere on the screen, with random winding, so that
+ * some come out back facing. Most are wide enough to have whole spans on their lines, and
+ * their edges land on odd pixels so that the spans end at odd places. */
+static void
+make_vertices (CPoly &cPoly)
+{
+  const s32 width = random_range(1, 4) == 1 ? random_range(2, 24) : random_range(24, 250);
+  const s32 height = random_range(4, 120);
+  const s32 left = random_range(0, GPU_FRAMEBUFFER_NATIVE_WIDTH - width);
+  const s32 top = random_range(0, GPU_FRAMEBUFFER_NATIVE_HEIGHT - height);
+  const size_t count = random_range(0, 1) ? 4 : 3;
+
+  s32 x[4];
+  s32 y[4];
+
+  x[0] = left + random_range(0, width / 3);             y[0] = top;
+  x[1] = left + width;                                  y[1] = top + random_range(0, height / 3);
+  x[2] = left + width - random_range(0, width / 3);     y[2] = top + height;
+  x[3] = left;                                          y[3] = top + height - random_range(0, height / 3);
+
+  if (count == 3)
+    {
+      x[2] = x[3];
+      y[2] = y[3];
+    }
+
+  const bool reverse = (random_range(0, 1) != 0);
+
+  cPoly.type = (count == 4) ? POLYGON_TYPE_QUAD : POLYGON_TYPE_TRIANGLE;
+
+  for (size_t i = 0; i < count; i++)
+    {
+      NDSVertex &vtx = cPoly.vtx[reverse ? (count - 1 - i) : i];
+
+      vtx.position.x = (x[i] << 16) | (random_range(0, 0xFFFF) & ((x[i] < GPU_FRAMEBUFFER_NATIVE_WIDTH) ? 0xFFFF : 0));
+      vtx.position.y = (y[i] << 16) | (random_range(0, 0xFFFF) & ((y[i] < GPU_FRAMEBUFFER_NATIVE_HEIGHT) ? 0xFFFF : 0));
+      vtx.position.z = (s32)(next_random() << 7) & 0x7FFFFFFF;
+      vtx.position.w = random_range(0x200, 0x8000);
+      vtx.texCoord.s = random_range(-64 * 16, 96 * 16);
+      vtx.texCoord.t = random_range(-64 * 16, 96 * 16);
+      vtx.color.r = (u8)random_range(0, 63);
+      vtx.color.g = (u8)random_range(0, 63);
+      vtx.color.b = (u8)random_range(0, 63);
+      vtx.color.a = 0;
+    }
+
+  /* the same facing test that gfx3d does after clipping */
+  const NDSVertex *vtx = cPoly.vtx;
+  s64 facing = 0;
+
+  for (size_t i = 0; i < count; i++)
+    {
+      const size_t j = (i + 1) % count;
+      facing += ((s64)vtx[j].position.y + (s64)vtx[i].position.y) * ((s64)vtx[j].position.x - (s64)vtx[i].position.x);
+    }
+
+  cPoly.isPolyBackFacing = (facing < 0);
+}
+
+/* Fills the geometry list with a new scene, opaque polygons first as gfx3d sorts them. With
+ * the depth equal test, some polygons are drawn a second time at the same depth. */
+static void
+make_scene (const Scene &scene, GFX3D_GeometryList &gList)
+{
+  std::vector<CPoly> opaque;
+  std::vector<CPoly> translucent;
+
+  gList.rawPolyCount = 0;
+
+  while (gList.rawPolyCount < POLYS_PER_SCENE)
+    {
+      const u16 index = (u16)gList.rawPolyCount++;
+      POLY &poly = gList.rawPolyList[index];
+
+      memset(&poly, 0, sizeof(poly));
+      poly.vtxFormat = GFX3D_QUADS;
+      make_attribute(scene, poly);
+      make_texture(scene, poly);
+
+      CPoly cPoly;
+      memset(&cPoly, 0, sizeof(cPoly));
+      cPoly.index = index;
+      make_vertices(cPoly);
+      poly.type = cPoly.type;
+
+      (GFX3D_IsPolyTranslucent(poly) ? translucent : opaque).push_back(cPoly);
+
+      if ((scene.flags & SCENE_DEPTH_EQUAL) && random_range(0, 1) && gList.rawPolyCount < POLYS_PER_SCENE)
+        {
+          const u16 equalIndex = (u16)gList.rawPolyCount++;
+          POLY &equalPoly = gList.rawPolyList[equalIndex];
+
+          equalPoly = poly;
+          equalPoly.attribute.DepthEqualTest_Enable = 1;
+          equalPoly.attribute.PolygonID = random_range(0, 63);
+          make_texture(scene, equalPoly);
+
+          cPoly.index = equalIndex;
+          for (size_t i = 0; i < (size_t)cPoly.type; i++)
+            {
+              cPoly.vtx[i].color.r = (u8)random_range(0, 63);
+              cPoly.vtx[i].texCoord.s = random_range(-64 * 16, 96 * 16);
+            }
+
+          (GFX3D_IsPolyTranslucent(equalPoly) ? translucent : opaque).push_back(cPoly);
+        }
+    }
+
+  gList.clippedPolyOpaqueCount = opaque.size();
+  gList.clippedPolyCount = 0;
+
+  for (size_t i = 0; i < opaque.size(); i++)
+    gList.clippedPolyList[gList.clippedPolyCount++] = opaque[i];
+
+  for (size_t i = 0; i < translucent.size(); i++)
+    gList.clippedPolyList[gList.clippedPolyCount++] = translucent[i];
+}
+
+static SoftRasterizerRenderer *
+create_rasterizer (RasterizerKind kind)
+{
+  switch (kind)
+    {
+    case RASTERIZER_PLAIN:
+      return new SoftRasterizerRenderer;
+
+    case RASTERIZER_SSE2:
+#if defined(ENABLE_SSE2) && !defined(ENABLE_AVX2)
+      return new SoftRasterizerRenderer_SSE2;
+#else
+      return NULL;
+#endif
+
+    case RASTERIZER_AVX2:
+#if defined(ENABLE_AVX2) || defined(ENABLE_SIMD_DISPATCH)
+      if (CPU_GetDetectedSIMDLevel() >= CPUSIMDLevel_AVX2)
+        return new SoftRasterizerRenderer_AVX2;
+#endif
+      return NULL;
+
+    default:
+      return NULL;
+    }
+}
+
+template <typename T>
+static void
+copy_buffer (std::vector<T> &dst, const T *src, size_t count)
+{
+  dst.assign(src, src + count);
+}
+
+static void
+render (SoftRasterizerRenderer *rasterizer, const GFX3D_State &state, const GFX3D_GeometryList &gList, RenderResult &result)
+{
+  const size_t pixCount = GPU_FRAMEBUFFER_NATIVE_WIDTH * GPU_FRAMEBUFFER_NATIVE_HEIGHT;
+
+  rasterizer->ApplyRenderingSettings(state);
+  rasterizer->Render(state, gList);
+  rasterizer->RenderFinish();
+
+  /* every rasterizer draws into the main engine's 3D framebuffer, so it is copied out */
+  const Color4u8 *color = rasterizer->GetFramebuffer();
+  result.color.resize(pixCount);
+  for (size_t i = 0; i < pixCount; i++)
+    result.color[i] = color[i].value;
+
+  const FragmentAttributesBuffer &attributes = *rasterizer->_framebufferAttributes;
+  copy_buffer(result.depth, attributes.depth, pixCount);
+  copy_buffer(result.opaquePolyID, attributes.opaquePolyID, pixCount);
+  copy_buffer(result.translucentPolyID, attributes.translucentPolyID, pixCount);
+  copy_buffer(result.stencil, attributes.stencil, pixCount);
+  copy_buffer(result.isFogged, attributes.isFogged, pixCount);
+  copy_buffer(result.isTranslucentPoly, attributes.isTranslucentPoly, pixCount);
+  copy_buffer(result.polyFacing, attributes.polyFacing, pixCount);
+}
+
+template <typename T>
+static bool
+compare (const char *name, const char *what, const std::vector<T> &expected, const std::vector<T> &actual)
+{
+  for (size_t i = 0; i < expected.size(); i++)
+    {
+      if (expected[i] != actual[i])
+        {
+          printf("%s: %s differs first at %d,%d: 0x%X, expected 0x%X\n", name, what,
+                 (int)(i % GPU_FRAMEBUFFER_NATIVE_WIDTH), (int)(i / GPU_FRAMEBUFFER_NATIVE_WIDTH),
+                 (unsigned)actual[i], (unsigned)expected[i]);
+          return false;
+        }
+    }
+
+  return true;
+}
+
+int main(int argc, char ** argv) {
+  CommonSettings.num_cores = 1;
+  if (NDS_Init() != 0)
+    {
+      fprintf(stderr, "Couldn't initialize the emulator\n");
+      return EXIT_FAILURE;
+    }
+
+  /* the sampling hack skips the span functions, so they would have nothing to check */
+  CommonSettings.GFX3D_TXTHack = false;
+  CommonSettings.GFX3D_Texture = true;
+  CommonSettings.GFX3D_Fog = true;
+  CommonSettings.GFX3D_EdgeMark = true;
+
+  GFX3D_State *state = new GFX3D_State;
+  GFX3D_GeometryList *gList = new GFX3D_GeometryList;
+  SoftRasterizerRenderer *rasterizers[RASTERIZER_COUNT];
+
+  for (int kind = 0; kind < RASTERIZER_COUNT; kind++)
+    {
+      rasterizers[kind] = create_rasterizer((RasterizerKind)kind);
+      if (rasterizers[kind] != NULL)
+        rasterizers[kind]->SetFramebufferSize(GPU_FRAMEBUFFER_NATIVE_WIDTH, GPU_FRAMEBUFFER_NATIVE_HEIGHT);
+    }
+
+  int failures = 0;
+  int runs = 0;
+
+  for (int s = 0; s < SCENE_COUNT; s++)
+    for (int frame = 0; frame < FRAMES_PER_SCENE; frame++)
+      {
+        seed = (u32)(s * 97 + frame);
+        fill_textures();
+        make_state(scenes[s], *state);
+        make_scene(scenes[s], *gList);
+
+        RenderResult expected;
+        render(rasterizers[RASTERIZER_PLAIN], *state, *gList, expected);
+
+        for (int kind = RASTERIZER_PLAIN + 1; kind < RASTERIZER_COUNT; kind++)
+          {
+            if (rasterizers[kind] == NULL)
+              continue;
+
+            RenderResult actual;
+            render(rasterizers[kind], *state, *gList, actual);
+            runs++;
+
+            char name[128];
+            snprintf(name, sizeof(name), "%s, frame %d, %s", scenes[s].name, frame, rasterizerNames[kind]);
+
+            bool same = true;
+            same = compare(name, "color", expected.color, actual.color) && same;
+            same = compare(name, "depth", expected.depth, actual.depth) && same;
+            same = compare(name, "opaque polygon ID", expected.opaquePolyID, actual.opaquePolyID) && same;
+            same = compare(name, "translucent polygon ID", expected.translucentPolyID, actual.translucentPolyID) && same;
+            same = compare(name, "stencil", expected.stencil, actual.stencil) && same;
+            same = compare(name, "fog flag", expected.isFogged, actual.isFogged) && same;
+            same = compare(name, "translucent flag", expected.isTranslucentPoly, actual.isTranslucentPoly) && same;
+            same = compare(name, "polygon facing", expected.polyFacing, actual.polyFacing) && same;
+            printf("%s: %s\n", name, same ? "ok" : "FAILED");
+
+            if (!same)
+              failures++;
+          }
+      }
+
+  for (int kind = 0; kind < RASTERIZER_COUNT; kind++)
+    delete rasterizers[kind];
+
+  delete gList;
+  delete state;
+  NDS_DeInit();
+
+  printf("%d of %d SIMD rasterizer runs matched the plain rasterizer\n", runs - failures, runs);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
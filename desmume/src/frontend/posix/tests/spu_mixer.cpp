@@ -0,0 +1,369 @@
+/* spu_mixer.cpp - this file is part of DeSmuME
+ *
+ * Copyright (C) 2026 DeSmuME Team
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Plays the same register writes through the SPU mixer twice, once with channels mixed a
+ * block at a time and once a sample at a time, and checks that the mixed output, the
+ * channel state and the captured RAM come out the same. The block mixer is run at every
+ * SIMD level the CPU has, for each interpolation mode, with and without the advanced mixer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "../NDSSystem.h"
+#include "../SPU.h"
+#include "../MMU.h"
+#include "../render3D.h"
+#include "../common.h"
+
+volatile bool execute = false;
+
+SoundInterface_struct *SNDCoreList[] = {
+  &SNDDummy,
+  NULL
+};
+
+GPU3DInterface *core3DList[] = {
+  &gpu3DNull,
+  NULL
+};
+
+/* Where the test keeps its sounds and capture buffers, as seen from the ARM7. */
+#define SAMPLE_BASE   0x02100000
+#define PCM8_ADDR     (SAMPLE_BASE + 0x0000)
+#define PCM16_ADDR    (SAMPLE_BASE + 0x1000)
+#define ADPCM_ADDR    (SAMPLE_BASE + 0x3000)
+#define CAPBUF0_ADDR  (SAMPLE_BASE + 0x4000)
+#define CAPBUF1_ADDR  (SAMPLE_BASE + 0x4800)
+#define SAMPLE_SIZE   0x5000
+
+#define MIX_BUFFER_SIZE 2048
+
+/* Number of samples mixed by each call, picked to start and end blocks at odd places. */
+static const int mixLengths[] = { 1, 2, 3, 64, 63, 65, 200, 3, 1000, 17, 512, 1, 129, 735 };
+#define MIX_STEPS ((int)(sizeof(mixLengths) / sizeof(mixLengths[0])))
+
+enum Scenario
+{
+  SCENARIO_CHANNELS,
+  SCENARIO_ROUTING,
+  SCENARIO_CAPTURE,
+  SCENARIO_COUNT
+};
+
+static const char *scenarioNames[SCENARIO_COUNT] = { "channels", "routing", "capture" };
+static const char *modeNames[] = { "none", "linear", "cosine", "catmull-rom" };
+
+struct MixResult
+{
+  std::vector<s16> outbuf;
+  std::vector<s32> sndbuf;
+  std::vector<s32> channels;
+  std::vector<u8> capture;
+  s32 lastdata;
+};
+
+static u32 seed;
+
+static u32
+next_random ()
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+static void
+fill_samples ()
+{
+  seed = 0x5350554D;
+  u8 *ram = MMU.MAIN_MEM + (SAMPLE_BASE & 0xFFFFFF);
+
+  /* Noisy waves with some full scale peaks, so that clamping gets exercised too. */
+  for (u32 i = 0; i < SAMPLE_SIZE; i++)
+    ram[i] = (u8)next_random();
+  for (u32 i = 0; i < 0x1000; i += 97)
+    T1WriteWord(ram, (PCM16_ADDR - SAMPLE_BASE) + i * 2, (i & 0x100) ? 0x7FFF : 0x8000);
+
+  /* ADPCM header: initial sample and step index. */
+  T1WriteWord(ram, ADPCM_ADDR - SAMPLE_BASE, 0x0123);
+  T1WriteWord(ram, ADPCM_ADDR - SAMPLE_BASE + 2, 20);
+}
+
+static void
+write_channel (SPU_struct *spu, int ch, u32 cnt, u32 addr, u16 timer, u16 loopstart, u32 length)
+{
+  const u32 base = 0x400 + ch * 16;
+  spu->WriteLong(base + 0x4, addr);
+  spu->WriteLong(base + 0x8, timer | (loopstart << 16));
+  spu->WriteLong(base + 0xC, length);
+  spu->WriteLong(base + 0x0, cnt);
+}
+
+/* SOUNDxCNT: volume, divider, pan, PSG duty, repeat mode (1 loop, 2 one-shot), format, start */
+static u32
+channel_cnt (u32 vol, u32 div, u32 pan, u32 duty, u32 repeat, u32 format)
+{
+  return vol | (div << 8) | (pan << 16) | (duty << 24) | (repeat << 27) | (format << 29) | 0x80000000;
+}
+
+static void
+start_channels (SPU_struct *spu)
+{
+  /* Looping and one-shot samples of each format, at rates below and above the output rate.
+   * The short one-shot sounds stop in the middle of a block. */
+  write_channel(spu, 0, channel_cnt(127, 0, 64, 0, 1, 0), PCM8_ADDR, 0xFC00, 4, 200);
+  write_channel(spu, 1, channel_cnt(100, 1, 20, 0, 1, 1), PCM16_ADDR, 0xFE00, 16, 400);
+  write_channel(spu, 2, channel_cnt(90, 0, 100, 0, 1, 2), ADPCM_ADDR, 0xFF00, 1, 300);
+  write_channel(spu, 3, channel_cnt(127, 2, 127, 0, 2, 1), PCM16_ADDR + 0x100, 0xFFC0, 0, 60);
+  write_channel(spu, 4, channel_cnt(64, 0, 0, 0, 2, 0), PCM8_ADDR + 0x40, 0xFF00, 0, 5);
+  write_channel(spu, 5, channel_cnt(127, 3, 40, 0, 2, 2), ADPCM_ADDR, 0xFE80, 1, 40);
+  write_channel(spu, 6, channel_cnt(80, 0, 90, 0, 1, 1), PCM16_ADDR + 0x800, 0xF000, 2, 30);
+  write_channel(spu, 7, channel_cnt(127, 0, 64, 0, 0, 0), PCM8_ADDR + 0x400, 0xFF80, 0, 400);
+
+  /* PSG square waves and noise. */
+  write_channel(spu, 8, channel_cnt(60, 0, 10, 0, 0, 3), 0, 0xFFA0, 0, 0);
+  write_channel(spu, 9, channel_cnt(70, 1, 64, 3, 0, 3), 0, 0xF800, 0, 0);
+  write_channel(spu, 10, channel_cnt(50, 0, 120, 7, 0, 3), 0, 0xFE00, 0, 0);
+  write_channel(spu, 11, channel_cnt(127, 2, 64, 5, 0, 3), 0, 0xFFF0, 0, 0);
+  write_channel(spu, 14, channel_cnt(40, 0, 30, 0, 0, 3), 0, 0xFF00, 0, 0);
+  write_channel(spu, 15, channel_cnt(127, 0, 100, 0, 0, 3), 0, 0xC000, 0, 0);
+}
+
+static void
+start_scenario (SPU_struct *spu, Scenario scenario)
+{
+  for (int i = 0; i < 16; i++)
+    CommonSettings.spu_muteChannels[i] = false;
+  CommonSettings.spu_captureMuted = false;
+
+  spu->WriteWord(0x500, 0x8000 | 110);
+  start_channels(spu);
+
+  switch (scenario)
+    {
+    case SCENARIO_CHANNELS:
+      break;
+
+    case SCENARIO_ROUTING:
+      /* Left from ch1, right from ch1+ch3, both bypassing the mixer, some channels muted. */
+      spu->WriteWord(0x500, 0x8000 | 127 | (1 << 8) | (3 << 10) | (1 << 12) | (1 << 13));
+      CommonSettings.spu_muteChannels[4] = true;
+      CommonSettings.spu_muteChannels[9] = true;
+      CommonSettings.spu_captureMuted = true;
+      break;
+
+    case SCENARIO_CAPTURE:
+      /* Channel 1 plays back what capture 0 records from the mixer, like the reverb games set
+       * up, and capture 1 records ch2+ch3 in 8 bits. */
+      write_channel(spu, 1, channel_cnt(127, 0, 64, 0, 1, 1), CAPBUF0_ADDR, 0xFE00, 0, 0x100);
+      spu->WriteLong(0x510, CAPBUF0_ADDR);
+      spu->WriteWord(0x514, 0x100);
+      spu->WriteLong(0x518, CAPBUF1_ADDR);
+      spu->WriteWord(0x51C, 0x40);
+      spu->WriteByte(0x508, 0x80);
+      spu->WriteByte(0x509, 0x80 | 0x08 | 0x02 | 0x01);
+      break;
+
+    default:
+      break;
+    }
+}
+
+/* Register writes made between two mixing calls, so that channels and capture start and
+ * stop in the middle of a run. */
+static void
+step_scenario (SPU_struct *spu, Scenario scenario, int step)
+{
+  switch (step)
+    {
+    case 3:
+      /* restart a one-shot sound that has stopped by now */
+      spu->WriteByte(0x443, 0);
+      write_channel(spu, 4, channel_cnt(100, 0, 64, 0, 2, 1), PCM16_ADDR + 0x200, 0xFF40, 0, 9);
+      break;
+    case 5:
+      spu->WriteByte(0x423, 0);
+      spu->WriteWord(0x408, 0xFE40);
+      break;
+    case 8:
+      if (scenario == SCENARIO_ROUTING)
+        spu->WriteWord(0x500, 0x8000 | 127 | (2 << 8) | (0 << 10) | (1 << 13));
+      if (scenario == SCENARIO_CAPTURE)
+        spu->WriteByte(0x509, 0);
+      break;
+    case 10:
+      if (scenario == SCENARIO_CAPTURE)
+        spu->WriteByte(0x508, 0);
+      spu->WriteByte(0x463, 0);
+      break;
+    case 12:
+      if (scenario == SCENARIO_CAPTURE)
+        spu->WriteByte(0x508, 0x80 | 0x08);
+      break;
+    }
+}
+
+static void
+save_channels (const SPU_struct *spu, std::vector<s32> &out)
+{
+  for (int i = 0; i < 16; i++)
+    {
+      const channel_struct &chan = spu->channels[i];
+      out.push_back(chan.status);
+      out.push_back(chan.sampcntInt);
+      out.push_back((s32)chan.sampcntFrac);
+      out.push_back(chan.pcm16bOffs);
+      for (int j = 0; j < SPUINTERPOLATION_TAPS; j++)
+        out.push_back(chan.pcm16b[j]);
+      out.push_back(chan.index);
+      out.push_back(chan.loop_pcm16b);
+      out.push_back(chan.loop_index);
+      out.push_back(chan.x);
+    }
+
+  /* the capture counters are only set up once a capture starts */
+  for (int i = 0; i < 2; i++)
+    {
+      const SPU_struct::REGS::CAP::Runtime &runtime = spu->regs.cap[i].runtime;
+      out.push_back(runtime.running);
+      out.push_back(runtime.running ? runtime.curdad : 0);
+      out.push_back(runtime.running ? runtime.sampcntInt : 0);
+    }
+}
+
+static void
+run_mixer (Scenario scenario, MixResult &result)
+{
+  SPU_struct *spu = new SPU_struct(MIX_BUFFER_SIZE);
+  SPU_struct *savedCore = SPU_core;
+  SPU_core = spu;
+
+  start_scenario(spu, scenario);
+
+  for (int step = 0; step < MIX_STEPS; step++)
+    {
+      step_scenario(spu, scenario, step);
+
+      const int length = mixLengths[step];
+      SPU_MixAudio(true, spu, length);
+      result.outbuf.insert(result.outbuf.end(), spu->outbuf, spu->outbuf + length * 2);
+      result.sndbuf.insert(result.sndbuf.end(), spu->sndbuf, spu->sndbuf + length * 2);
+      save_channels(spu, result.channels);
+    }
+
+  result.lastdata = spu->lastdata;
+  result.capture.assign(MMU.MAIN_MEM + (CAPBUF0_ADDR & 0xFFFFFF), MMU.MAIN_MEM + (CAPBUF0_ADDR & 0xFFFFFF) + 0x1000);
+
+  SPU_core = savedCore;
+  delete spu;
+}
+
+template<typename T> static bool
+compare (const char *name, const char *what, const std::vector<T> &expected, const std::vector<T> &actual)
+{
+  if (expected.size() != actual.size())
+    {
+      printf("%s: %s has %d values, expected %d\n", name, what, (int)actual.size(), (int)expected.size());
+      return false;
+    }
+
+  for (size_t i = 0; i < expected.size(); i++)
+    {
+      if (expected[i] != actual[i])
+        {
+          printf("%s: %s differs first at %d: %d, expected %d\n", name, what, (int)i, (int)actual[i], (int)expected[i]);
+          return false;
+        }
+    }
+
+  return true;
+}
+
+int main(int argc, char ** argv) {
+  CommonSettings.num_cores = 1;
+  if (NDS_Init() != 0)
+    {
+      fprintf(stderr, "Couldn't initialize the emulator\n");
+      return EXIT_FAILURE;
+    }
+
+  /* the mixer only converts to 16 bits while the speakers are on */
+  T1WriteWord(MMU.ARM7_REG, 0x304, 1);
+
+  static const CPUSIMDLevel levels[] = { CPUSIMDLevel_Baseline, CPUSIMDLevel_AVX2 };
+  const CPUSIMDLevel startLevel = CPU_GetSIMDLevel();
+  int failures = 0;
+  int runs = 0;
+
+  for (int advanced = 0; advanced < 2; advanced++)
+    for (int mode = SPUInterpolation_None; mode <= SPUInterpolation_CatmullRom; mode++)
+      for (int scenario = 0; scenario < SCENARIO_COUNT; scenario++)
+        {
+          CommonSettings.spu_advanced = (advanced != 0);
+          CommonSettings.spuInterpolationMode = mode;
+
+          fill_samples();
+          SPU_SetBlockMixing(false);
+          MixResult expected;
+          run_mixer((Scenario)scenario, expected);
+          SPU_SetBlockMixing(true);
+
+          for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++)
+            {
+              if (!CPU_ForceSIMDLevel(levels[l]))
+                continue;
+
+              fill_samples();
+              MixResult actual;
+              run_mixer((Scenario)scenario, actual);
+              runs++;
+
+              char name[128];
+              snprintf(name, sizeof(name), "%s mixer, %s interpolation, %s, %s",
+                       advanced ? "advanced" : "plain", modeNames[mode], scenarioNames[scenario],
+                       CPU_GetSIMDLevelName(levels[l]));
+
+              bool same = true;
+              same = compare(name, "outbuf", expected.outbuf, actual.outbuf) && same;
+              same = compare(name, "sndbuf", expected.sndbuf, actual.sndbuf) && same;
+              same = compare(name, "channel state", expected.channels, actual.channels) && same;
+              same = compare(name, "captured RAM", expected.capture, actual.capture) && same;
+              if (expected.lastdata != actual.lastdata)
+                {
+                  printf("%s: lastdata is %d, expected %d\n", name, actual.lastdata, expected.lastdata);
+                  same = false;
+                }
+              printf("%s: %s\n", name, same ? "ok" : "FAILED");
+
+              if (!same)
+                failures++;
+            }
+        }
+
+  CPU_ForceSIMDLevel(startLevel);
+  NDS_DeInit();
+
+  printf("%d of %d mixer runs matched the per-sample mixer\n", runs - failures, runs);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
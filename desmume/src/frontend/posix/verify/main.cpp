@@ -0,0 +1,452 @@
+/* main.cpp - this file is part of DeSmuME
+ *
+ * Copyright (C) 2006-2026 DeSmuME Team
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * desmume-verify plays movies headless and as fast as possible, and logs a hash of the
+ * screens, the audio and main RAM every few frames. Each movie runs in a process of its
+ * own, since the emulator core is a single global machine, and as many of them run at
+ * once as there are cores. Two logs can then be compared to find the first frame where
+ * a build stopped behaving like the one the reference log came from.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <zlib.h>
+
+#include <string>
+#include <vector>
+
+#include "../NDSSystem.h"
+#include "../driver.h"
+#include "../GPU.h"
+#include "../SPU.h"
+#include "../MMU.h"
+#include "../movie.h"
+#include "../render3D.h"
+#include "../rasterize.h"
+#include "../emufile.h"
+
+volatile bool execute = false;
+
+SoundInterface_struct *SNDCoreList[] = {
+  &SNDDummy,
+  NULL
+};
+
+GPU3DInterface *core3DList[] = {
+  &gpu3DNull,
+  &gpu3DRasterize,
+  NULL
+};
+
+//little endian 4-byte cookie
+static const u32 kDSVL = 0x4C565344;
+
+#define VERIFY_LOG_VERSION 1
+
+/* One checkpoint of the log, taken at the end of <frame>. The audio hash covers the
+ * samples mixed since the previous checkpoint. */
+struct VerifyEntry
+{
+  u32 frame;
+  u32 video;
+  u32 audio;
+  u32 ram;
+};
+
+struct VerifyLog
+{
+  u32 interval;
+  std::vector<VerifyEntry> entries;
+};
+
+struct VerifyOptions
+{
+  std::string rom;
+  std::string logDir;
+  std::string referenceDir;
+  int interval;
+  int jobs;
+  int engine3D;
+  bool audio;
+};
+
+static std::string
+log_name_for (const std::string &movie)
+{
+  std::string name = movie;
+  size_t slash = name.find_last_of('/');
+  if (slash != std::string::npos)
+    name = name.substr(slash + 1);
+  size_t dot = name.find_last_of('.');
+  if (dot != std::string::npos)
+    name = name.substr(0, dot);
+
+  return name + ".vlog";
+}
+
+static std::string
+log_path_for (const std::string &dir, const std::string &name, const std::string &movie)
+{
+  if (dir != "")
+    return dir + "/" + name;
+
+  size_t slash = movie.find_last_of('/');
+  if (slash == std::string::npos)
+    return name;
+  return movie.substr(0, slash + 1) + name;
+}
+
+static bool
+read_log (const std::string &fileName, VerifyLog &log)
+{
+  EMUFILE_FILE fp(fileName, "rb");
+  if (!fp.is_open())
+    {
+      fprintf(stderr, "Can't open %s\n", fileName.c_str());
+      return false;
+    }
+
+  u32 cookie, version;
+  if (fp.read_32LE(cookie) != 1 || cookie != kDSVL ||
+      fp.read_32LE(version) != 1 || version != VERIFY_LOG_VERSION ||
+      fp.read_32LE(log.interval) != 1)
+    {
+      fprintf(stderr, "%s is not a verification log\n", fileName.c_str());
+      return false;
+    }
+
+  log.entries.clear();
+  VerifyEntry entry;
+  while (fp.read_32LE(entry.frame) == 1 && fp.read_32LE(entry.video) == 1 &&
+         fp.read_32LE(entry.audio) == 1 && fp.read_32LE(entry.ram) == 1)
+    log.entries.push_back(entry);
+
+  return true;
+}
+
+/* Reports the first checkpoint the two logs both have but disagree on. Logs taken at
+ * different intervals are compared on the frames they have in common. Returns 0 when
+ * they match, 1 when they diverge and 2 when a log can't be read. */
+static int
+compare_logs (const std::string &nameA, const std::string &nameB)
+{
+  VerifyLog a, b;
+  if (!read_log(nameA, a) || !read_log(nameB, b))
+    return 2;
+
+  size_t i = 0, j = 0, common = 0;
+  while (i < a.entries.size() && j < b.entries.size())
+    {
+      const VerifyEntry &ea = a.entries[i];
+      const VerifyEntry &eb = b.entries[j];
+      if (ea.frame < eb.frame) { i++; continue; }
+      if (eb.frame < ea.frame) { j++; continue; }
+
+      if (ea.video != eb.video || ea.audio != eb.audio || ea.ram != eb.ram)
+        {
+          printf("%s and %s diverge at frame %u:%s%s%s\n", nameA.c_str(), nameB.c_str(), ea.frame,
+                 (ea.video != eb.video) ? " video" : "",
+                 (ea.audio != eb.audio) ? " audio" : "",
+                 (ea.ram != eb.ram) ? " ram" : "");
+          return 1;
+        }
+
+      common++;
+      i++;
+      j++;
+    }
+
+  const u32 lastA = a.entries.empty() ? 0 : a.entries.back().frame;
+  const u32 lastB = b.entries.empty() ? 0 : b.entries.back().frame;
+  if (lastA != lastB)
+    {
+      printf("%s and %s match for %u checkpoints, but end at frames %u and %u\n",
+             nameA.c_str(), nameB.c_str(), (u32)common, lastA, lastB);
+      return 1;
+    }
+
+  printf("%s and %s match (%u checkpoints)\n", nameA.c_str(), nameB.c_str(), (u32)common);
+  return 0;
+}
+
+static void
+take_checkpoint (EMUFILE &fp, u32 frame, bool audio)
+{
+  const NDSDisplayInfo &displayInfo = GPU->GetDisplayInfo();
+  const size_t screenBytes = GPU_FRAMEBUFFER_NATIVE_WIDTH * GPU_FRAMEBUFFER_NATIVE_HEIGHT * sizeof(u16);
+
+  VerifyEntry entry;
+  entry.frame = frame;
+  entry.video = crc32(0, (const Bytef *)displayInfo.masterNativeBuffer16, screenBytes * 2);
+  entry.audio = 0;
+  entry.ram = crc32(0, MMU.MAIN_MEM, _MMU_MAIN_MEM_MASK + 1);
+
+  if (audio)
+    {
+      size_t sampleCount = 0;
+      const s16 *samples = SPU_CaptureGetSamples(sampleCount);
+      entry.audio = crc32(0, (const Bytef *)samples, sampleCount * 2 * sizeof(s16));
+      SPU_CaptureStart();
+    }
+
+  fp.write_32LE(entry.frame);
+  fp.write_32LE(entry.video);
+  fp.write_32LE(entry.audio);
+  fp.write_32LE(entry.ram);
+}
+
+static bool
+is_checkpoint (const VerifyOptions &opt, int frame, int frames)
+{
+  return ((frame + 1) % opt.interval) == 0 || (frame + 1) == frames;
+}
+
+/* Plays one movie to its end and writes its log. Runs in a child process. */
+static int
+verify_movie (const VerifyOptions &opt, const std::string &movie)
+{
+  const std::string name = log_name_for(movie);
+  const std::string logPath = log_path_for(opt.logDir, name, movie);
+
+  //the runs already share the machine's cores between them
+  CommonSettings.num_cores = 1;
+
+  NDS_Init();
+  driver = new BaseDriver();
+  SPU_ChangeSoundCore(SNDCORE_DUMMY, 735 * 4);
+  if (!GPU->Change3DRendererByID(opt.engine3D))
+    GPU->Change3DRendererByID(RENDERID_SOFTRASTERIZER);
+
+  if (NDS_LoadROM(opt.rom.c_str()) < 0)
+    {
+      fprintf(stderr, "%s: error while loading %s\n", movie.c_str(), opt.rom.c_str());
+      return 2;
+    }
+  execute = true;
+
+  const char *error = FCEUI_LoadMovie(movie.c_str(), true, false, -1);
+  if (error != NULL)
+    {
+      fprintf(stderr, "%s: %s\n", movie.c_str(), error);
+      return 2;
+    }
+
+  EMUFILE_FILE fp(logPath, "wb");
+  if (!fp.is_open())
+    {
+      fprintf(stderr, "%s: can't write %s\n", movie.c_str(), logPath.c_str());
+      return 2;
+    }
+  fp.write_32LE(kDSVL);
+  fp.write_32LE(VERIFY_LOG_VERSION);
+  fp.write_32LE(opt.interval);
+
+  if (opt.audio)
+    SPU_CaptureStart();
+
+  const int frames = currMovieData.getNumRecords();
+  while (movieMode == MOVIEMODE_PLAY)
+    {
+      const int frame = currFrameCounter;
+      const bool checkpoint = is_checkpoint(opt, frame, frames);
+
+      //only checkpoints need the screens. a skip request holds back the 2D engines one
+      //frame later than the 3D one, so stop asking two frames ahead of each checkpoint
+      if (!checkpoint && !is_checkpoint(opt, frame + 1, frames))
+        NDS_SkipNextFrame();
+
+      NDS_beginProcessingInput();
+      FCEUMOV_AddInputState();
+      NDS_endProcessingInput();
+
+      if (movieMode != MOVIEMODE_PLAY)
+        break;
+
+      NDS_exec<false>();
+
+      if (checkpoint)
+        take_checkpoint(fp, frame, opt.audio);
+    }
+
+  fp.fflush();
+  SPU_CaptureStop();
+  NDS_DeInit();
+
+  printf("%s: %d frames, log written to %s\n", movie.c_str(), frames, logPath.c_str());
+
+  if (opt.referenceDir != "")
+    return compare_logs(log_path_for(opt.referenceDir, name, movie), logPath);
+
+  return 0;
+}
+
+static void
+usage (const char *prog)
+{
+  printf("Usage: %s [OPTIONS] --rom ROM MOVIE...\n"
+         "       %s --compare LOG_A LOG_B\n"
+         "\n"
+         "Plays each movie headless and logs hashes of the screens, audio and main RAM.\n"
+         "\n"
+         "  --rom ROM             ROM the movies were recorded with\n"
+         "  --interval N          take a checkpoint every N frames (default 1)\n"
+         "  --jobs N              movies to play at once (default: one per core)\n"
+         "  --log-dir DIR         write the logs to DIR (default: next to each movie)\n"
+         "  --reference DIR       compare each log with the one of the same name in DIR\n"
+         "  --no-audio            don't mix or hash audio\n"
+         "  --3d-engine N         0 = 3d disabled, 1 = internal rasterizer (default)\n"
+         "  --compare A B         report the first frame where logs A and B diverge\n",
+         prog, prog);
+}
+
+int main(int argc, char ** argv) {
+  VerifyOptions opt;
+  opt.interval = 1;
+  opt.jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  opt.engine3D = RENDERID_SOFTRASTERIZER;
+  opt.audio = true;
+
+  enum {
+    OPT_ROM = 1000, OPT_INTERVAL, OPT_JOBS, OPT_LOG_DIR, OPT_REFERENCE,
+    OPT_NO_AUDIO, OPT_3D_ENGINE, OPT_COMPARE, OPT_HELP
+  };
+  static const struct option longOptions[] = {
+    { "rom", required_argument, NULL, OPT_ROM },
+    { "interval", required_argument, NULL, OPT_INTERVAL },
+    { "jobs", required_argument, NULL, OPT_JOBS },
+    { "log-dir", required_argument, NULL, OPT_LOG_DIR },
+    { "reference", required_argument, NULL, OPT_REFERENCE },
+    { "no-audio", no_argument, NULL, OPT_NO_AUDIO },
+    { "3d-engine", required_argument, NULL, OPT_3D_ENGINE },
+    { "compare", no_argument, NULL, OPT_COMPARE },
+    { "help", no_argument, NULL, OPT_HELP },
+    { NULL, 0, NULL, 0 }
+  };
+
+  bool compare = false;
+  int c;
+  while ((c = getopt_long(argc, argv, "", longOptions, NULL)) != -1)
+    {
+      switch (c)
+        {
+        case OPT_ROM: opt.rom = optarg; break;
+        case OPT_INTERVAL: opt.interval = atoi(optarg); break;
+        case OPT_JOBS: opt.jobs = atoi(optarg); break;
+        case OPT_LOG_DIR: opt.logDir = optarg; break;
+        case OPT_REFERENCE: opt.referenceDir = optarg; break;
+        case OPT_NO_AUDIO: opt.audio = false; break;
+        case OPT_3D_ENGINE: opt.engine3D = atoi(optarg); break;
+        case OPT_COMPARE: compare = true; break;
+        case OPT_HELP: usage(argv[0]); return 0;
+        default: usage(argv[0]); return 2;
+        }
+    }
+
+  std::vector<std::string> files;
+  for (int i = optind; i < argc; i++)
+    files.push_back(argv[i]);
+
+  if (compare)
+    {
+      if (files.size() != 2)
+        {
+          usage(argv[0]);
+          return 2;
+        }
+      return compare_logs(files[0], files[1]);
+    }
+
+  if (opt.rom == "" || files.empty() || opt.interval < 1 ||
+      (opt.engine3D != 0 && opt.engine3D != 1))
+    {
+      usage(argv[0]);
+      return 2;
+    }
+  if (opt.jobs < 1)
+    opt.jobs = 1;
+
+  /* run the movies in child processes, at most <jobs> at a time */
+  std::vector<pid_t> running;
+  std::vector<std::string> runningMovie;
+  size_t next = 0;
+  int failed = 0, diverged = 0;
+
+  while (next < files.size() || !running.empty())
+    {
+      if (next < files.size() && (int)running.size() < opt.jobs)
+        {
+          fflush(stdout);
+          pid_t pid = fork();
+          if (pid == 0)
+            {
+              const int result = verify_movie(opt, files[next]);
+              fflush(stdout);
+              _exit(result);
+            }
+          if (pid < 0)
+            {
+              perror("fork");
+              failed++;
+            }
+          else
+            {
+              running.push_back(pid);
+              runningMovie.push_back(files[next]);
+            }
+          next++;
+          continue;
+        }
+
+      int status = 0;
+      pid_t pid = wait(&status);
+      if (pid < 0)
+        break;
+
+      for (size_t i = 0; i < running.size(); i++)
+        {
+          if (running[i] != pid)
+            continue;
+
+          if (!WIFEXITED(status) || WEXITSTATUS(status) == 2)
+            {
+              fprintf(stderr, "%s: verification failed\n", runningMovie[i].c_str());
+              failed++;
+            }
+          else if (WEXITSTATUS(status) == 1)
+            diverged++;
+
+          running.erase(running.begin() + i);
+          runningMovie.erase(runningMovie.begin() + i);
+          break;
+        }
+    }
+
+  printf("%u movies: %d diverged, %d failed\n", (u32)files.size(), diverged, failed);
+
+  if (failed)
+    return 2;
+  return diverged ? 1 : 0;
+}
@@ -1890,6 +1890,8 @@ DEFINE_LUA_FUNCTION(vram_writeword, "address,value")
 	int address = luaL_checkinteger(L,1);
 	u16 value = (u16)(luaL_checkinteger(L,2) & 0xFFFF);
 	T1WriteWord(MMU.ARM9_LCD,address,value);
+	MMU_MarkDirty(MMU.ARM9_LCD + address);
+	MMU_VRAMTouchRange(MMU.ARM9_LCD + address, 2);
 	return 0;
 }
 DEFINE_LUA_FUNCTION(memory_writedword, "address,value")
@@ -21,6 +21,14 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
+
+#ifdef HOST_WINDOWS
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include "common.h"
 #include "armcpu.h"
@@ -33,6 +41,7 @@
 #include "utils/advanscene.h"
 #include "utils/xstring.h"
 #include "emufile.h"
+#include "utils/task.h"
 
 //#define _DONT_SAVE_BACKUP
 //#define _MCLOG
@@ -88,6 +97,83 @@ static const u32 saveSizes[] = {512,			// 4k
 								0xFFFFFFFF};
 static const u32 saveSizes_count = ARRAY_SIZE(saveSizes);
 
+//while a game runs, its save file is kept in memory. writes only mark the image dirty;
+//it is written back in the background a little later, into a temporary file which then
+//replaces the .dsv once it is flushed to disk, so that a crash or power loss in the middle
+//of a write leaves the previous save intact.
+#define BACKUP_WRITEBACK_DELAY 60 //frames from the first unsaved write until the image is written back
+
+class EMUFILE_BACKUP : public EMUFILE_MEMORY
+{
+public:
+	EMUFILE_BACKUP() : dirty(false) {}
+
+	bool dirty;
+
+	virtual size_t fwrite(const void *ptr, size_t bytes)
+	{
+		dirty = true;
+		return EMUFILE_MEMORY::fwrite(ptr, bytes);
+	}
+
+	virtual void truncate(s32 length)
+	{
+		dirty = true;
+		EMUFILE_MEMORY::truncate(length);
+	}
+};
+
+static Task *backupWriteTask = NULL;
+static std::atomic<bool> backupWriteBusy(false);
+//the file being written by the task; only touched while it is idle
+static std::string backupWriteName;
+static std::vector<u8> backupWriteData;
+
+static void* backup_write_proc(void *)
+{
+	const std::string tmp = backupWriteName + ".tmp";
+	FILE *fp = fopen(tmp.c_str(), "wb");
+	bool ok = (fp != NULL);
+	if (ok && !backupWriteData.empty())
+		ok = (fwrite(&backupWriteData[0], backupWriteData.size(), 1, fp) == 1);
+	//the data has to reach the disk before the rename does, or a power loss could
+	//leave the .dsv pointing at a file that was never written
+	ok = ok && (fflush(fp) == 0);
+#ifdef HOST_WINDOWS
+	ok = ok && (_commit(_fileno(fp)) == 0);
+#else
+	ok = ok && (fsync(fileno(fp)) == 0);
+#endif
+	if (fp != NULL)
+		ok = (fclose(fp) == 0) && ok;
+
+#ifdef HOST_WINDOWS
+	ok = ok && MoveFileExA(tmp.c_str(), backupWriteName.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+	ok = ok && (rename(tmp.c_str(), backupWriteName.c_str()) == 0);
+	if (ok)
+	{
+		//make the rename itself durable
+		const size_t slash = backupWriteName.find_last_of('/');
+		const std::string dir = (slash == std::string::npos) ? std::string(".") : backupWriteName.substr(0, slash + 1);
+		int dirfd = open(dir.c_str(), O_RDONLY);
+		if (dirfd != -1)
+		{
+			fsync(dirfd);
+			close(dirfd);
+		}
+	}
+#endif
+	if (!ok)
+	{
+		printf("BackupDevice: Could not write the save file %s\n", backupWriteName.c_str());
+		remove(tmp.c_str());
+	}
+
+	backupWriteBusy = false;
+	return NULL;
+}
+
 //the lookup table from user save types to save parameters
 const SAVE_TYPE save_types[] = {
 	{"Autodetect",		MC_TYPE_AUTODETECT,	1, 0},
@@ -214,6 +300,8 @@ bool BackupDevice::load_state(EMUFILE &is)
 BackupDevice::BackupDevice()
 {
 	_fpMC = NULL;
+	_image = NULL;
+	_dirtyFrames = 0;
 	_fsize = 0;
 	_addr_size = 0;
 
@@ -326,13 +414,24 @@ BackupDevice::BackupDevice()
 		}
 	}
 
-	_fpMC = new EMUFILE_FILE(_fileName, fexists?"rb+" : "wb+");
-	const bool fileCanReadWrite = (_fpMC->get_fp() != NULL);
-	if (!fileCanReadWrite)
 	{
-		delete _fpMC;
-		_fpMC = new EMUFILE_MEMORY();
-		printf("BackupDevice: WARNING! Failed to get read/write access to the save file! Will operate in RAM instead.\n");
+		EMUFILE_FILE fpFile(_fileName, fexists?"rb+" : "wb+");
+		const bool fileCanReadWrite = (fpFile.get_fp() != NULL);
+		if (fileCanReadWrite)
+		{
+			_image = new EMUFILE_BACKUP();
+			std::vector<u8> data(fpFile.size());
+			if (!data.empty() && fpFile.fread(&data[0], data.size()) == data.size())
+				_image->fwrite(&data[0], data.size());
+			_image->fseek(0, SEEK_SET);
+			_image->dirty = false;
+			_fpMC = _image;
+		}
+		else
+		{
+			_fpMC = new EMUFILE_MEMORY();
+			printf("BackupDevice: WARNING! Failed to get read/write access to the save file! Will operate in RAM instead.\n");
+		}
 	}
 	
 	if (!_fpMC->fail())
@@ -409,8 +508,10 @@ BackupDevice::BackupDevice()
 
 BackupDevice::~BackupDevice()
 {
+	writeBack(true);
 	delete this->_fpMC;
 	this->_fpMC = NULL;
+	this->_image = NULL;
 }
 
 int BackupDevice::readFooter()
@@ -562,7 +663,44 @@ void BackupDevice::seek(u32 pos)
 
 void BackupDevice::flushBackup()
 {
-	this->_fpMC->fflush();
+	writeBack(false);
+}
+
+//hands a copy of the image to the write-back task, then with <wait> waits until it is on disk
+void BackupDevice::writeBack(bool wait)
+{
+	if (this->_image != NULL && this->_image->dirty)
+	{
+		if (backupWriteTask == NULL)
+		{
+			backupWriteTask = new Task();
+			backupWriteTask->start(false, 0, "backup write");
+		}
+		backupWriteTask->finish();
+
+		backupWriteName = this->_fileName;
+		backupWriteData.assign(this->_image->buf(), this->_image->buf() + this->_image->size());
+		this->_image->dirty = false;
+		this->_dirtyFrames = 0;
+
+		backupWriteBusy = true;
+		backupWriteTask->execute(backup_write_proc, NULL);
+	}
+
+	if (wait && backupWriteTask != NULL)
+		backupWriteTask->finish();
+}
+
+void BackupDevice::frameEnd()
+{
+	if (this->_image == NULL || !this->_image->dirty)
+		return;
+	if (++this->_dirtyFrames < BACKUP_WRITEBACK_DELAY)
+		return;
+	//try again next frame rather than stall the emulation
+	if (backupWriteBusy)
+		return;
+	writeBack(false);
 }
 
 bool BackupDevice::saveBuffer(u8 *data, u32 size, bool willRewind, bool willTruncate)
@@ -630,9 +768,10 @@ void BackupDevice::reset()
 
 void BackupDevice::close_rom()
 {
-	this->_fpMC->fflush();
+	writeBack(true);
 	delete this->_fpMC;
 	this->_fpMC = NULL;
+	this->_image = NULL;
 }
 
 //todo - this function is horrible. it's only needed due to our big disorganization between save types and sizes.
@@ -1659,8 +1798,10 @@ bool BackupDevice::import_dsv(const char *filename)
 
 bool BackupDevice::load_movie(EMUFILE *is)
 {
+	writeBack(true);
 	delete this->_fpMC;
 	this->_fpMC = is;
+	this->_image = NULL;
 	
 	int ok = readFooter();
 	// TODO - in case we ever change the format again (and we should probably entirely rewrite this if we do) we'd need to detect the old versions
@@ -1682,8 +1823,10 @@ bool BackupDevice::load_movie(EMUFILE *is)
 
 void BackupDevice::load_movie_blank()
 {
+	writeBack(true);
 	delete this->_fpMC;
 	this->_fpMC = new EMUFILE_MEMORY();
+	this->_image = NULL;
 
 	this->_state = DETECTING;
 	this->_fsize = 0;
@@ -49,6 +49,7 @@
 #define MC_SIZE_512MBITS                0x4000000
 
 class EMUFILE;
+class EMUFILE_BACKUP;
 
 struct BackupDeviceFileInfo
 {
@@ -104,7 +105,10 @@ public:
 
 	void seek(u32 pos);
 
+	//starts writing the save file back if it changed
 	void flushBackup();
+	//called at the end of each frame, to write the save file back some time after the game wrote to it
+	void frameEnd();
 	
 	u8 searchFileSaveType(u32 size);
 
@@ -164,6 +168,8 @@ public:
 
 private:
 	EMUFILE *_fpMC;
+	EMUFILE_BACKUP *_image; //_fpMC while it holds the save file of _fileName
+	u32 _dirtyFrames;
 	std::string _fileName;
 	u32	_fsize;
 	BackupDeviceFileInfo _info;
@@ -200,6 +206,7 @@ private:
 
 	void checkReset();
 	void detect();
+	void writeBack(bool wait);
 };
 
 
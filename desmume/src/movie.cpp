@@ -77,6 +77,312 @@ int currRerecordCount;
 bool movie_reset_command = false;
 //--------------
 
+//----binary movie container (.dsmb)
+//a preamble (cookie, version, rerecord count, header size), the .dsm text header,
+//then chunks of [tag, payload size, first frame, data]. a keyframe is either a full savestate,
+//or a delta holding the RAM pages dirtied since the full keyframe it names, which keeps long
+//movies from growing by a whole savestate every interval. EMUFILE offsets are ints, so the
+//file is never grown past MOVIE_BINARY_MAX_SIZE
+
+//little endian 4-byte cookies
+static const u32 kDSMB = 0x424D5344;
+static const u32 kFRMS = 0x534D5246;
+static const u32 kKEYF = 0x4659454B;
+static const u32 kKEYD = 0x4459454B;
+
+#define MOVIE_BINARY_VERSION 1
+#define MOVIE_BINARY_RERECORD_OFFSET 8
+#define MOVIE_BINARY_BLOCK_FRAMES 60 //records are written out in blocks of this many frames
+#define MOVIE_BINARY_MAX_SIZE 0x7FFFFFFF
+#define MOVIE_KEYFRAME_MAX_DELTAS 15 //a full keyframe follows this many deltas, since deltas grow as more RAM gets dirtied
+
+struct MOVIE_CHUNK
+{
+	int frame;		// first record of a block, or the frame a keyframe was taken at
+	int count;		// records in a block, 0 for a keyframe
+	int base;		// for a delta keyframe, the frame of the full keyframe it applies to; -1 otherwise
+	s32 offset;		// file offset of the chunk's tag
+	s32 size;		// payload size, including the frame field
+};
+
+static bool movieBinary = false;
+static std::vector<MOVIE_CHUNK> movieChunks;
+static int movieBinaryFlushed = 0;	// records that are already in the file
+static s32 movieBinaryEnd = 0;		// end of the last complete chunk
+static int movieKeyframeInterval = MOVIE_KEYFRAME_INTERVAL_DEFAULT;
+static bool movieKeyframeIO = false;	// keyframes are savestates without the movie in them
+static int movieKeyframeBase = -1;	// the full keyframe the next delta applies to; -1 to write a full one
+static int movieKeyframeDeltas = 0;	// deltas written against movieKeyframeBase
+static SAVESTATE_DELTA_CONTEXT movieKeyframeContext; // holds movieKeyframeBase's RAM, apart from the frontend's deltas
+static bool movieBinaryFull = false;	// the file reached MOVIE_BINARY_MAX_SIZE
+
+static bool IsBinaryMovieName(const char *fname)
+{
+	const char *ext = strrchr(fname, '.');
+	if (ext == NULL || strlen(ext + 1) != strlen(MOVIE_BINARY_EXTENSION))
+		return false;
+
+	for (size_t i = 0; ext[i + 1] != '\0'; i++)
+		if (tolower(ext[i + 1]) != MOVIE_BINARY_EXTENSION[i])
+			return false;
+
+	return true;
+}
+
+static void BinaryMovieBegin(EMUFILE &fp)
+{
+	std::vector<u8> header;
+	EMUFILE_MEMORY ms(&header);
+	currMovieData.dumpHeader(ms, false);
+
+	fp.write_32LE(kDSMB);
+	fp.write_32LE(MOVIE_BINARY_VERSION);
+	fp.write_32LE(currMovieData.rerecordCount);
+	fp.write_32LE((u32)header.size());
+	if (header.size() != 0)
+		fp.fwrite(&header[0], header.size());
+	fp.fflush();
+
+	movieChunks.clear();
+	movieBinaryFlushed = 0;
+	movieBinaryEnd = fp.ftell();
+	movieKeyframeBase = -1;
+	movieBinaryFull = false;
+}
+
+//whether a chunk with <payload> bytes still fits in the file
+static bool BinaryMovieHasRoom(s64 payload)
+{
+	if ((s64)movieBinaryEnd + 8 + payload <= MOVIE_BINARY_MAX_SIZE)
+		return true;
+
+	if (!movieBinaryFull)
+		printf("Movie file reached its size limit; the rest of the recording isn't saved\n");
+	movieBinaryFull = true;
+	return false;
+}
+
+//appends the records that aren't in the file yet
+static void BinaryMovieFlush()
+{
+	if (!movieBinary || !osRecordingMovie)
+		return;
+
+	const int count = (int)currMovieData.records.size() - movieBinaryFlushed;
+	if (count <= 0)
+		return;
+
+	if (!BinaryMovieHasRoom(4 + (s64)count * MOVIE_BINARY_RECORD_SIZE))
+		return;
+
+	MOVIE_CHUNK chunk;
+	chunk.frame = movieBinaryFlushed;
+	chunk.count = count;
+	chunk.base = -1;
+	chunk.offset = movieBinaryEnd;
+	chunk.size = 4 + count * MOVIE_BINARY_RECORD_SIZE;
+
+	EMUFILE &fp = *osRecordingMovie;
+	fp.write_32LE(kFRMS);
+	fp.write_32LE(chunk.size);
+	fp.write_32LE(chunk.frame);
+	for (int i = 0; i < count; i++)
+		currMovieData.records[movieBinaryFlushed + i].dumpFixed(fp);
+	fp.fflush();
+
+	movieChunks.push_back(chunk);
+	movieBinaryFlushed += count;
+	movieBinaryEnd = fp.ftell();
+}
+
+static bool BinaryMovieHasKeyframe(int frame)
+{
+	for (size_t i = 0; i < movieChunks.size(); i++)
+		if (movieChunks[i].count == 0 && movieChunks[i].frame == frame)
+			return true;
+
+	return false;
+}
+
+static void BinaryMovieWriteKeyframe(int frame)
+{
+	if (!osRecordingMovie)
+		return;
+
+	BinaryMovieFlush();
+
+	//deltas compare the RAM with a copy of the base's, so they stay valid across savestate loads
+	const bool delta = movieKeyframeBase >= 0 && movieKeyframeDeltas < MOVIE_KEYFRAME_MAX_DELTAS;
+
+	std::vector<u8> state;
+	EMUFILE_MEMORY ms(&state);
+	movieKeyframeIO = true;
+	bool success = delta ? savestate_save_delta(ms, movieKeyframeContext, Z_DEFAULT_COMPRESSION) : savestate_save_base(ms, movieKeyframeContext);
+	movieKeyframeIO = false;
+	if (!success || state.size() == 0)
+		return;
+
+	MOVIE_CHUNK chunk;
+	chunk.frame = frame;
+	chunk.count = 0;
+	chunk.base = delta ? movieKeyframeBase : -1;
+	chunk.offset = movieBinaryEnd;
+	chunk.size = (delta ? 8 : 4) + (s32)state.size();
+	if (!BinaryMovieHasRoom(chunk.size))
+		return;
+
+	EMUFILE &fp = *osRecordingMovie;
+	fp.write_32LE(delta ? kKEYD : kKEYF);
+	fp.write_32LE(chunk.size);
+	fp.write_32LE(chunk.frame);
+	if (delta)
+		fp.write_32LE(chunk.base);
+	fp.fwrite(&state[0], state.size());
+	fp.fflush();
+
+	if (delta)
+		movieKeyframeDeltas++;
+	else
+	{
+		movieKeyframeBase = frame;
+		movieKeyframeDeltas = 0;
+	}
+
+	movieChunks.push_back(chunk);
+	movieBinaryEnd = fp.ftell();
+}
+
+//reads the header and the records, and indexes the keyframes without reading them
+static bool LoadBinaryMovie(MovieData &movieData, EMUFILE &fp)
+{
+	u32 cookie, version, rerecordCount, headerSize;
+	if (fp.read_32LE(cookie) != 1 || cookie != kDSMB) return false;
+	if (fp.read_32LE(version) != 1 || version != MOVIE_BINARY_VERSION) return false;
+	if (fp.read_32LE(rerecordCount) != 1) return false;
+	if (fp.read_32LE(headerSize) != 1) return false;
+
+	if (!LoadFM2(movieData, fp, headerSize, false))
+		return false;
+	movieData.rerecordCount = rerecordCount;
+	movieData.records.clear();
+
+	movieChunks.clear();
+	movieBinaryEnd = fp.ftell();
+
+	const s32 end = fp.size();
+	if (end < 0)
+		return false;
+	std::vector<u8> block;
+	while (movieBinaryEnd + 12 <= end)
+	{
+		MOVIE_CHUNK chunk;
+		u32 tag, size, frame;
+		chunk.offset = movieBinaryEnd;
+		fp.fseek(chunk.offset, SEEK_SET);
+		fp.read_32LE(tag);
+		fp.read_32LE(size);
+		fp.read_32LE(frame);
+
+		//a chunk that runs past the end was cut off while it was being written
+		if (size < 4 || (s64)chunk.offset + 8 + size > end)
+			break;
+
+		chunk.frame = (int)frame;
+		chunk.size = (s32)size;
+		chunk.count = 0;
+		chunk.base = -1;
+
+		if (tag == kFRMS)
+		{
+			if (chunk.frame != (int)movieData.records.size())
+				break;
+
+			chunk.count = (chunk.size - 4) / MOVIE_BINARY_RECORD_SIZE;
+			block.resize(chunk.count * MOVIE_BINARY_RECORD_SIZE);
+			if (block.size() != 0 && fp.fread(&block[0], block.size()) != block.size())
+				break;
+
+			EMUFILE_MEMORY ms(&block);
+			movieData.records.resize(chunk.frame + chunk.count);
+			for (int i = 0; i < chunk.count; i++)
+				movieData.records[chunk.frame + i].parseFixed(ms);
+		}
+		else if (tag == kKEYD)
+		{
+			u32 base;
+			if (size < 8 || fp.read_32LE(base) != 1)
+				break;
+			chunk.base = (int)base;
+		}
+		else if (tag != kKEYF)
+		{
+			movieBinaryEnd = chunk.offset + 8 + chunk.size;
+			continue; //unknown chunk, skip it
+		}
+
+		movieChunks.push_back(chunk);
+		movieBinaryEnd = chunk.offset + 8 + chunk.size;
+	}
+
+	movieBinaryFlushed = (int)movieData.records.size();
+	return true;
+}
+
+//reopens the movie file for recording after a rerecord. the file keeps its first <keepFrames>
+//records and the keyframes up to there; everything after is cut off and rewritten from currMovieData
+static void BinaryMovieReopen(int keepFrames)
+{
+	s32 cut = movieBinaryEnd;
+	size_t keep = 0;
+	for (; keep < movieChunks.size(); keep++)
+	{
+		const MOVIE_CHUNK &chunk = movieChunks[keep];
+		if ( (chunk.count != 0) ? (chunk.frame + chunk.count > keepFrames) : (chunk.frame > keepFrames) )
+		{
+			cut = chunk.offset;
+			break;
+		}
+	}
+	movieChunks.resize(keep);
+	movieKeyframeBase = -1;
+	movieBinaryFull = false;
+
+	movieBinaryFlushed = 0;
+	for (size_t i = 0; i < movieChunks.size(); i++)
+		if (movieChunks[i].count != 0)
+			movieBinaryFlushed = movieChunks[i].frame + movieChunks[i].count;
+
+	EMUFILE_FILE *fp = new EMUFILE_FILE(curMovieFilename, "r+b");
+	if (!fp->is_open())
+	{
+		delete fp;
+		return;
+	}
+
+	fp->truncate(cut);
+	fp->fseek(MOVIE_BINARY_RERECORD_OFFSET, SEEK_SET);
+	fp->write_32LE(currMovieData.rerecordCount);
+	fp->fseek(0, SEEK_END);
+
+	osRecordingMovie = fp;
+	movieBinaryEnd = cut;
+	BinaryMovieFlush();
+}
+
+//the number of leading records that <oldMovie> and <newMovie> have in common
+static int BinaryMovieCommonFrames(MovieData &oldMovie, MovieData &newMovie)
+{
+	if (oldMovie.guid != newMovie.guid)
+		return 0;
+
+	const int length = std::min(oldMovie.getNumRecords(), newMovie.getNumRecords());
+	for (int i = 0; i < length; i++)
+		if (!oldMovie.records[i].Compare(newMovie.records[i]))
+			return i;
+
+	return length;
+}
+
 
 void MovieData::clearRecordRange(int start, int len)
 {
@@ -355,6 +661,25 @@ void MovieData::installValue(std::string& key, std::string& val)
 int MovieData::dump(EMUFILE &fp, bool binary)
 {
 	int start = fp.ftell();
+	dumpHeader(fp, binary);
+
+	if (binary)
+	{
+		//put one | to start the binary dump
+		fp.fputc('|');
+		for (int i = 0; i < (int)records.size(); i++)
+			records[i].dumpBinary(fp);
+	}
+	else
+		for (int i = 0; i < (int)records.size(); i++)
+			records[i].dump(fp);
+
+	int end = fp.ftell();
+	return end-start;
+}
+
+void MovieData::dumpHeader(EMUFILE &fp, bool binary)
+{
 	fp.fprintf("version %d\n", version);
 	fp.fprintf("emuVersion %d\n", emuVersion);
 	fp.fprintf("rerecordCount %d\n", rerecordCount);
@@ -415,20 +740,6 @@ int MovieData::dump(EMUFILE &fp, bool binary)
 			fp.fprintf("%s %s\n",tmp, BytesToString(&micSamples[i][0],micSamples[i].size()).c_str());
 		}
 	}
-
-	if (binary)
-	{
-		//put one | to start the binary dump
-		fp.fputc('|');
-		for (int i = 0; i < (int)records.size(); i++)
-			records[i].dumpBinary(fp);
-	}
-	else
-		for (int i = 0; i < (int)records.size(); i++)
-			records[i].dump(fp);
-
-	int end = fp.ftell();
-	return end-start;
 }
 
 std::string readUntilWhitespace(EMUFILE &fp)
@@ -553,6 +864,7 @@ static void closeRecordingMovie()
 {
 	if(osRecordingMovie)
 	{
+		BinaryMovieFlush();
 		delete osRecordingMovie;
 		osRecordingMovie = 0;
 	}
@@ -593,6 +905,82 @@ void FCEUI_StopMovie()
 
 	curMovieFilename[0] = 0;
 	freshMovie = false;
+	movieBinary = false;
+	movieChunks.clear();
+	movieKeyframeBase = -1;
+}
+
+//reads the savestate held by a keyframe chunk
+static bool BinaryMovieReadKeyframe(EMUFILE &fp, const MOVIE_CHUNK &chunk, std::vector<u8> &state)
+{
+	const int header = (chunk.base >= 0) ? 8 : 4;
+	if (chunk.size <= header)
+		return false;
+	state.resize(chunk.size - header);
+	fp.fseek(chunk.offset + 8 + header, SEEK_SET);
+	return fp.fread(&state[0], state.size()) == state.size();
+}
+
+void FCEUI_SetMovieKeyframeInterval(int frames)
+{
+	movieKeyframeInterval = std::max(frames, 0);
+}
+
+int FCEUI_MovieSeekKeyframe(int frame)
+{
+	if (movieMode != MOVIEMODE_PLAY && movieMode != MOVIEMODE_FINISHED)
+		return -1;
+
+	const MOVIE_CHUNK *keyframe = NULL;
+	for (size_t i = 0; i < movieChunks.size(); i++)
+	{
+		const MOVIE_CHUNK &chunk = movieChunks[i];
+		if (chunk.count == 0 && chunk.frame <= frame && chunk.frame <= currMovieData.getNumRecords())
+		{
+			if (keyframe == NULL || chunk.frame > keyframe->frame)
+				keyframe = &chunk;
+		}
+	}
+
+	//playing on from where we are is cheaper when the target is ahead and no keyframe is closer
+	if (frame >= currFrameCounter && (keyframe == NULL || keyframe->frame <= currFrameCounter))
+		return currFrameCounter;
+
+	if (keyframe == NULL)
+		return -1;
+
+	const MOVIE_CHUNK *base = NULL;
+	if (keyframe->base >= 0)
+	{
+		for (size_t i = 0; i < movieChunks.size() && base == NULL; i++)
+			if (movieChunks[i].count == 0 && movieChunks[i].base < 0 && movieChunks[i].frame == keyframe->base)
+				base = &movieChunks[i];
+		if (base == NULL)
+			return -1;
+	}
+
+	std::vector<u8> state, baseState;
+	EMUFILE_FILE fp(curMovieFilename, "rb");
+	if (!fp.is_open())
+		return -1;
+	if (!BinaryMovieReadKeyframe(fp, *keyframe, state))
+		return -1;
+	if (base != NULL && !BinaryMovieReadKeyframe(fp, *base, baseState))
+		return -1;
+
+	//the movie stays as it is, and so do the emulation settings it brought along
+	EMUFILE_MEMORY ms(&state);
+	EMUFILE_MEMORY baseMs(&baseState);
+	movieKeyframeIO = true;
+	firstReset = true;
+	bool success = (base != NULL) ? (savestate_load_delta(baseMs, ms, movieKeyframeContext) == SAVESTATE_DELTA_OK) : savestate_load(ms);
+	firstReset = false;
+	movieKeyframeIO = false;
+	if (!success)
+		return -1;
+
+	movieMode = MOVIEMODE_PLAY;
+	return currFrameCounter;
 }
 
 static void LoadSettingsFromMovie(MovieData movieData)
@@ -681,7 +1069,14 @@ const char* _CDECL_ FCEUI_LoadMovie(const char *fname, bool _read_only, bool tas
 	
 	bool loadedfm2 = false;
 	EMUFILE *fp = new EMUFILE_FILE(fname, "rb");
-	loadedfm2 = LoadFM2(currMovieData, *fp, INT_MAX, false);
+	u32 cookie = 0;
+	fp->read_32LE(cookie);
+	fp->fseek(0, SEEK_SET);
+	movieBinary = (cookie == kDSMB);
+	if (movieBinary)
+		loadedfm2 = LoadBinaryMovie(currMovieData, *fp);
+	else
+		loadedfm2 = LoadFM2(currMovieData, *fp, INT_MAX, false);
 	delete fp;
 
 	if(!loadedfm2)
@@ -806,6 +1201,7 @@ void FCEUI_SaveMovie(const char *fname, std::wstring author, START_FROM startFro
 	FCEUI_StopMovie();
 
 	openRecordingMovie(fname);
+	movieBinary = IsBinaryMovieName(fname);
 
 	currFrameCounter = 0;
 	//LagCounterReset();
@@ -848,7 +1244,10 @@ void FCEUI_SaveMovie(const char *fname, std::wstring author, START_FROM startFro
 	}
 
 	//we are going to go ahead and dump the header. from now on we will only be appending frames
-	currMovieData.dump(*osRecordingMovie, false);
+	if (movieBinary)
+		BinaryMovieBegin(*osRecordingMovie);
+	else
+		currMovieData.dump(*osRecordingMovie, false);
 
 	currFrameCounter=0;
 	lagframecounter=0;
@@ -933,8 +1332,25 @@ void FCEUI_SaveMovie(const char *fname, std::wstring author, START_FROM startFro
 		 //assert(nds.touchX == input.touch.touchX && nds.touchY == input.touch.touchY);
 		 //assert((mr.touch.x << 4) == nds.touchX && (mr.touch.y << 4) == nds.touchY);
 
-		 mr.dump(*osRecordingMovie);
-		 currMovieData.records.push_back(mr);
+		 if (movieBinary)
+		 {
+			 //a keyframe holds the state at the start of its frame, before that frame's input
+			 const int frame = (int)currMovieData.records.size();
+			 if (movieKeyframeInterval > 0 && frame > 0 && frame == currFrameCounter &&
+				 (frame % movieKeyframeInterval) == 0 && !BinaryMovieHasKeyframe(frame))
+			 {
+				 BinaryMovieWriteKeyframe(frame);
+			 }
+
+			 currMovieData.records.push_back(mr);
+			 if ((int)currMovieData.records.size() - movieBinaryFlushed >= MOVIE_BINARY_BLOCK_FRAMES)
+				 BinaryMovieFlush();
+		 }
+		 else
+		 {
+			 mr.dump(*osRecordingMovie);
+			 currMovieData.records.push_back(mr);
+		 }
 
 		 // it's apparently un-threadsafe to do this here
 		 // (causes crazy flickering in other OSD elements, at least)
@@ -972,7 +1388,7 @@ void mov_savestate(EMUFILE &fp)
 	//if(movieMode == MOVIEMODE_RECORD || movieMode == MOVIEMODE_PLAY)
 	//	return currMovieData.dump(os, true);
 	//else return 0;
-	if(movieMode != MOVIEMODE_INACTIVE)
+	if(movieMode != MOVIEMODE_INACTIVE && !movieKeyframeIO)
 	{
 		fp.write_32LE(kMOVI);
 		currMovieData.dump(fp, true);
@@ -1021,6 +1437,9 @@ bool mov_loadstate(EMUFILE &fp, int size)
 	if (fp.read_32LE(cookie) != 1) return false;
 	if (cookie == kNOMO)
 	{
+		//a movie keyframe, which leaves the movie alone
+		if(movieKeyframeIO)
+			return true;
 		if(movieMode == MOVIEMODE_RECORD || movieMode == MOVIEMODE_PLAY)
 			FinishPlayback();
 		return true;
@@ -1126,6 +1545,11 @@ bool mov_loadstate(EMUFILE &fp, int size)
 			#endif
 		}
 
+		//records the movie file can keep if this turns into a rerecord
+		int keepFrames = 0;
+		if(movieBinary && !movie_readonly)
+			keepFrames = BinaryMovieCommonFrames(currMovieData, tempMovieData);
+
 		closeRecordingMovie();
 
 		if(!movie_readonly)
@@ -1178,15 +1602,28 @@ bool mov_loadstate(EMUFILE &fp, int size)
 			currMovieData.rerecordCount = currRerecordCount;
 			currMovieData.truncateAt(currFrameCounter);
 
-			openRecordingMovie(curMovieFilename);
-			if(!osRecordingMovie)
+			if(movieBinary)
 			{
-			   driver->SetLineColor(255, 0, 0);
-			   driver->AddLine("Can't save movie file!");
+				//only what follows the last common frame gets rewritten
+				BinaryMovieReopen(std::min(keepFrames, currFrameCounter));
+				if(!osRecordingMovie)
+				{
+				   driver->SetLineColor(255, 0, 0);
+				   driver->AddLine("Can't save movie file!");
+				}
+			}
+			else
+			{
+				openRecordingMovie(curMovieFilename);
+				if(!osRecordingMovie)
+				{
+				   driver->SetLineColor(255, 0, 0);
+				   driver->AddLine("Can't save movie file!");
+				}
+
+				//printf("DUMPING MOVIE: %d FRAMES\n",currMovieData.records.size());
+				currMovieData.dump(*osRecordingMovie, false);
 			}
-
-			//printf("DUMPING MOVIE: %d FRAMES\n",currMovieData.records.size());
-			currMovieData.dump(*osRecordingMovie, false);
 			movieMode = MOVIEMODE_RECORD;
 		}
 	}
@@ -1252,6 +1689,29 @@ void MovieRecord::dumpBinary(EMUFILE &fp)
 	fp.write_u8(this->touch.touch);
 }
 
+void MovieRecord::parseFixed(EMUFILE &fp)
+{
+	u8 reserved;
+	fp.read_u8(this->commands);
+	fp.read_16LE(this->pad);
+	fp.read_u8(this->touch.x);
+	fp.read_u8(this->touch.y);
+	fp.read_u8(this->touch.touch);
+	fp.read_u8(this->touch.micsample);
+	fp.read_u8(reserved);
+}
+
+void MovieRecord::dumpFixed(EMUFILE &fp) const
+{
+	fp.write_u8(this->commands);
+	fp.write_16LE(this->pad);
+	fp.write_u8(this->touch.x);
+	fp.write_u8(this->touch.y);
+	fp.write_u8(this->touch.touch);
+	fp.write_u8(this->touch.micsample);
+	fp.write_u8(0);
+}
+
 void LoadFM2_binarychunk(MovieData &movieData, EMUFILE &fp, int size)
 {
 	int recordsize = 1; //1 for the command
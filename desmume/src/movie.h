@@ -130,6 +130,9 @@ public:
 	void dumpBinary(EMUFILE &fp);
 	void parsePad(EMUFILE &fp, u16 &outPad);
 	void dumpPad(EMUFILE &fp, u16 inPad);
+	//fixed-size records of the .dsmb container, see MOVIE_BINARY_RECORD_SIZE
+	void parseFixed(EMUFILE &fp);
+	void dumpFixed(EMUFILE &fp) const;
 	
 	static const char mnemonics[13];
 
@@ -212,6 +215,7 @@ public:
 	void truncateAt(int frame);
 	void installValue(std::string& key, std::string& val);
 	int dump(EMUFILE &fp, bool binary);
+	void dumpHeader(EMUFILE &fp, bool binary);
 	void clearRecordRange(int start, int len);
 	void insertEmpty(int at, int frames);
 	
@@ -251,11 +255,21 @@ private:
 	std::map<std::string, ivm> installValueMap;
 };
 
+// Binary movie container, used for movies whose file name ends in .dsmb. It holds the same
+// header as a .dsm, followed by tagged chunks: blocks of fixed-size input records, appended
+// as the movie is recorded, and keyframe savestates taken every <interval> frames. Opening
+// one reads the records and skips over the keyframes, so any frame can be reached by
+// loading the nearest keyframe and replaying less than one interval of input.
+#define MOVIE_BINARY_EXTENSION "dsmb"
+#define MOVIE_BINARY_RECORD_SIZE 8
+#define MOVIE_KEYFRAME_INTERVAL_DEFAULT 600
+
 extern int currFrameCounter;
 extern EMOVIEMODE movieMode;		//adelikat: main needs this for frame counter display
 extern MovieData currMovieData;		//adelikat: main needs this for frame counter display
 
 extern bool movie_reset_command;
+extern char curMovieFilename[512];
 
 bool FCEUI_MovieGetInfo(EMUFILE &fp, MOVIE_INFO &info, bool skipFrameCount);
 void FCEUI_SaveMovie(const char *fname, std::wstring author, START_FROM startFrom, std::string sramfname, const DateTime &rtcstart);
@@ -263,6 +277,11 @@ const char* _CDECL_ FCEUI_LoadMovie(const char *fname, bool _read_only, bool tas
 void UnloadMovieEmulationSettings();
 bool AreMovieEmulationSettingsActive();
 void FCEUI_StopMovie();
+void FCEUI_SetMovieKeyframeInterval(int frames); // 0 stops taking keyframes
+// Gets playback to the best starting point for reaching <frame>: the nearest keyframe at or before
+// it, unless playback is already there or closer. Returns the frame playback continues from, or -1
+// if <frame> is behind playback and there is no keyframe to go back to.
+int FCEUI_MovieSeekKeyframe(int frame);
 void FCEUMOV_AddInputState();
 void FCEUMOV_HandlePlayback();
 void FCEUMOV_HandleRecording();
@@ -568,6 +568,868 @@ FORCEINLINE float RasterizerUnit<RENDERER>::_round_s(const float val)
 	}
 }
 
+// The floating-point interpolant values of one fragment in a span, kept until the span's
+// depth test has decided whether the fragment needs its perspective divides at all. These
+// are only used by the fragment sampling hack.
+struct SoftRasterizerSpanFragment
+{
+	float invWFloat;
+	Vector2f32 texCoordFloat;
+	Color3f32 vtxColorFloat;
+};
+
+// Fills in the interpolants and depths of up to SOFTRASTERIZER_SPAN_LENGTH fragments of a span.
+static void SoftRasterizer_SpanInterpolate(SoftRasterizerSpanInterpolants &interpolated, const SoftRasterizerSpanInterpolants &interpolated_dx, const size_t length, const bool isWDepth, SoftRasterizerSpan &span)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		if (isWDepth)
+		{
+			// not sure about the w-buffer depth value: this value was chosen to make the skybox, castle window decals, and water level render correctly in SM64
+			span.depth[i] = (u32)((1LL << W_PRECISION) / interpolated.invW);
+		}
+		else
+		{
+			// When using Z-depth, be sure to test against the following test cases:
+			// - "Dragon Quest IV: Chapters of the Chosen" - Overworld map
+			// - "Advance Wars: Days of Ruin" - Campaign map / In-game unit drawing on map
+			// - "Etrian Odyssey III: The Drowned City" - Main menu, when the cityscape transitions between day and night
+			// - "Super Monkey Ball: Touch & Roll" - 3D rendered horizon
+			// - "Pokemon Diamond/Pearl" - Main map mode
+			//
+			// TODO: Hack - Drop the LSB so that the overworld map in Dragon Quest IV shows up correctly.
+			span.depth[i] = (u32)(interpolated.z / (1LL << (Z_EXTRAPRECISION + 7))) & 0xFFFFFFFE;
+		}
+		
+		span.invW[i] = interpolated.invW;
+		span.s[i] = interpolated.s;
+		span.t[i] = interpolated.t;
+		span.color[0][i] = interpolated.color[0];
+		span.color[1][i] = interpolated.color[1];
+		span.color[2][i] = interpolated.color[2];
+		
+		interpolated.invW += interpolated_dx.invW;
+		interpolated.z += interpolated_dx.z;
+		interpolated.s += interpolated_dx.s;
+		interpolated.t += interpolated_dx.t;
+		interpolated.color[0] += interpolated_dx.color[0];
+		interpolated.color[1] += interpolated_dx.color[1];
+		interpolated.color[2] += interpolated_dx.color[2];
+	}
+}
+
+// Runs the perspective divides of fragment <i> of a span.
+static FORCEINLINE void SoftRasterizer_FragmentPerspective(SoftRasterizerSpan &span, const size_t i, const s64 texScalingFactor, const u8 alpha)
+{
+	const s64 invW = span.invW[i];
+	
+	span.vtxColor[i].r = max<u8>( 0x00, (u8)min<s64>(0x3F, span.color[0][i] / invW) );
+	span.vtxColor[i].g = max<u8>( 0x00, (u8)min<s64>(0x3F, span.color[1][i] / invW) );
+	span.vtxColor[i].b = max<u8>( 0x00, (u8)min<s64>(0x3F, span.color[2][i] / invW) );
+	span.vtxColor[i].a = alpha;
+	
+	span.texCoordS[i] = (s32)(span.s[i] * texScalingFactor / invW);
+	span.texCoordT[i] = (s32)(span.t[i] * texScalingFactor / invW);
+}
+
+// Depth tests up to SOFTRASTERIZER_SPAN_LENGTH fragments of a span, and returns a mask
+// with bit N set for each fragment N that passes.
+static u32 SoftRasterizer_SpanDepthTest(const u32 *__restrict srcDepth, const u32 *__restrict dstDepth, const u8 *__restrict dstPolyFacing, const Color4u8 *__restrict dstColor, const size_t length, const bool isEqualTest, const bool isFrontFacing)
+{
+	u32 passMask = 0;
+	
+	for (size_t i = 0; i < length; i++)
+	{
+		bool depthPass;
+		
+		if (isEqualTest)
+		{
+			// The EQUAL depth test is used if the polygon requests it. Note that the NDS doesn't perform
+			// a true EQUAL test -- there is a set tolerance to it that makes it easier for pixels to
+			// pass the depth test.
+			const u32 minDepth = (u32)max<s32>(0x00000000, (s32)dstDepth[i] - DEPTH_EQUALS_TEST_TOLERANCE);
+			const u32 maxDepth = min<u32>(0x00FFFFFF, dstDepth[i] + DEPTH_EQUALS_TEST_TOLERANCE);
+			
+			depthPass = (srcDepth[i] >= minDepth) && (srcDepth[i] <= maxDepth);
+		}
+		else if ( (isFrontFacing && (dstPolyFacing[i] == PolyFacing_Back)) && (dstColor[i].a == 0x1F) )
+		{
+			// The LEQUAL test is used in the special case where an incoming front-facing polygon's pixel
+			// is to be drawn on top of a back-facing polygon's opaque pixel.
+			//
+			// Test case: The Customize status screen in Sands of Destruction requires this type of depth
+			// test in order to correctly show the animating characters.
+			depthPass = (srcDepth[i] <= dstDepth[i]);
+		}
+		else
+		{
+			// The LESS depth test is the default type of depth test for all other conditions.
+			depthPass = (srcDepth[i] < dstDepth[i]);
+		}
+		
+		passMask |= (depthPass) ? (1 << i) : 0;
+	}
+	
+	return passMask;
+}
+
+#if defined(ENABLE_SSE2)
+
+// The SIMD span functions do the s64 perspective divides in double precision. When both
+// operands lie within +/-2^51, they convert to doubles exactly, and truncating the rounded
+// double quotient always gives the same result as the integer division does. Lanes with
+// operands outside this range, or with a zero divisor, are left to the scalar code.
+static FORCEINLINE v128u32 SoftRasterizer_OutOfDivideRange_SSE2(const v128u32 &val)
+{
+	return _mm_srli_epi64( _mm_add_epi64(val, _mm_set_epi32(0x00080000, 0, 0x00080000, 0)), 52 );
+}
+
+// Converts s64 lanes within +/-2^51 to doubles. Adding the bits of 1.5*2^52 places the value
+// in the mantissa of a double with a fixed exponent, and subtracting 1.5*2^52 leaves the value.
+static FORCEINLINE __m128d SoftRasterizer_ConvertS64ToF64_SSE2(const v128u32 &val)
+{
+	const v128u32 magic = _mm_set_epi32(0x43380000, 0, 0x43380000, 0);
+	return _mm_sub_pd( _mm_castsi128_pd(_mm_add_epi64(val, magic)), _mm_castsi128_pd(magic) );
+}
+
+// Returns the low 32 bits of each integral double lane within +/-2^51, in the low 32 bits
+// of its 64-bit lane. This is the reverse of SoftRasterizer_ConvertS64ToF64_SSE2().
+static FORCEINLINE v128u32 SoftRasterizer_ConvertF64ToS32_SSE2(const __m128d &val)
+{
+	return _mm_castpd_si128( _mm_add_pd(val, _mm_set1_pd(6755399441055744.0)) );
+}
+
+static FORCEINLINE __m128d SoftRasterizer_DivideTruncate_SSE2(const __m128d &numerator, const __m128d &denominator)
+{
+	const __m128d quotient = _mm_div_pd(numerator, denominator);
+	const __m128d magic = _mm_set1_pd(6755399441055744.0);
+	const __m128d absMask = _mm_castsi128_pd( _mm_set_epi32(0x7FFFFFFF, -1, 0x7FFFFFFF, -1) );
+	
+	// SSE2 has no truncating round, so round the magnitude to the nearest integer, step back
+	// down if that rounded up, and then put the sign back.
+	const __m128d absQuotient = _mm_and_pd(quotient, absMask);
+	__m128d result = _mm_sub_pd( _mm_add_pd(absQuotient, magic), magic );
+	result = _mm_sub_pd( result, _mm_and_pd(_mm_cmpgt_pd(result, absQuotient), _mm_set1_pd(1.0)) );
+	
+	return _mm_or_pd( result, _mm_andnot_pd(absMask, quotient) );
+}
+
+// The color functions below work on two Color4u8 at a time, widened to 16 bits per channel.
+
+static FORCEINLINE v128u16 SoftRasterizer_Select_SSE2(const v128u16 &mask, const v128u16 &a, const v128u16 &b)
+{
+	return _mm_or_si128( _mm_and_si128(mask, a), _mm_andnot_si128(mask, b) );
+}
+
+// Same as modulate_table[a][b].
+static FORCEINLINE v128u16 SoftRasterizer_Modulate_SSE2(const v128u16 &a, const v128u16 &b)
+{
+	const v128u16 one = _mm_set1_epi16(1);
+	return _mm_srli_epi16( _mm_sub_epi16(_mm_mullo_epi16(_mm_add_epi16(a, one), _mm_add_epi16(b, one)), one), 6 );
+}
+
+// Converts the alpha channel to 6 bits, the same as GFX3D_5TO6_LOOKUP().
+static FORCEINLINE v128u16 SoftRasterizer_Alpha5To6_SSE2(const v128u16 &color)
+{
+	const v128u16 alphaMask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+	const v128u16 alpha = _mm_and_si128(color, alphaMask);
+	const v128u16 alpha6 = _mm_andnot_si128( _mm_cmpeq_epi16(alpha, _mm_setzero_si128()), _mm_add_epi16(_mm_add_epi16(alpha, alpha), _mm_set1_epi16(1)) );
+	
+	return SoftRasterizer_Select_SSE2(alphaMask, alpha6, color);
+}
+
+// Same as RasterizerUnit::_shade() for polygons that aren't shadow polygons.
+static FORCEINLINE v128u16 SoftRasterizer_Shade_SSE2(const SoftRasterizerSpanShader &shader, const v128u16 &vtxColor, const v128u16 &texColor, const v128u16 &toonColor)
+{
+	const v128u16 alphaMask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+	
+	switch (shader.polygonMode)
+	{
+		case POLYGON_MODE_MODULATE:
+		{
+			const v128u16 outColor = SoftRasterizer_Modulate_SSE2( SoftRasterizer_Alpha5To6_SSE2(texColor), SoftRasterizer_Alpha5To6_SSE2(vtxColor) );
+			return SoftRasterizer_Select_SSE2(alphaMask, _mm_srli_epi16(outColor, 1), outColor);
+		}
+			
+		case POLYGON_MODE_DECAL:
+		{
+			if (!shader.isSamplingEnabled)
+			{
+				return vtxColor;
+			}
+			
+			const v128u16 texAlpha = _mm_shufflehi_epi16( _mm_shufflelo_epi16(texColor, 0xFF), 0xFF );
+			const v128u16 outColor = _mm_srli_epi16( _mm_add_epi16(_mm_mullo_epi16(texColor, texAlpha), _mm_mullo_epi16(vtxColor, _mm_sub_epi16(_mm_set1_epi16(31), texAlpha))), 5 );
+			return SoftRasterizer_Select_SSE2(alphaMask, vtxColor, outColor);
+		}
+			
+		case POLYGON_MODE_TOONHIGHLIGHT:
+		{
+			if (shader.isHighlightShading)
+			{
+				const v128u16 vtxRed = _mm_shufflehi_epi16( _mm_shufflelo_epi16(vtxColor, 0x00), 0x00 );
+				const v128u16 outColor = SoftRasterizer_Modulate_SSE2( SoftRasterizer_Alpha5To6_SSE2(texColor), SoftRasterizer_Select_SSE2(alphaMask, SoftRasterizer_Alpha5To6_SSE2(vtxColor), vtxRed) );
+				return SoftRasterizer_Select_SSE2( alphaMask, _mm_srli_epi16(outColor, 1), _mm_min_epi16(_mm_add_epi16(outColor, toonColor), _mm_set1_epi16(0x3F)) );
+			}
+			
+			const v128u16 outColor = SoftRasterizer_Modulate_SSE2( SoftRasterizer_Alpha5To6_SSE2(texColor), SoftRasterizer_Select_SSE2(alphaMask, SoftRasterizer_Alpha5To6_SSE2(vtxColor), toonColor) );
+			return SoftRasterizer_Select_SSE2(alphaMask, _mm_srli_epi16(outColor, 1), outColor);
+		}
+			
+		default:
+			return vtxColor;
+	}
+}
+
+// Same as the blending branch of alphaBlend().
+static FORCEINLINE v128u16 SoftRasterizer_AlphaBlend_SSE2(const v128u16 &src, const v128u16 &dst)
+{
+	const v128u16 alphaMask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+	const v128u16 alpha = _mm_add_epi16( _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, 0xFF), 0xFF), _mm_set1_epi16(1) );
+	const v128u16 invAlpha = _mm_sub_epi16(_mm_set1_epi16(32), alpha);
+	const v128u16 outColor = _mm_srli_epi16( _mm_add_epi16(_mm_mullo_epi16(src, alpha), _mm_mullo_epi16(dst, invAlpha)), 5 );
+	
+	return SoftRasterizer_Select_SSE2(alphaMask, _mm_max_epi16(src, dst), outColor);
+}
+
+// This is RasterizerUnit::_pixel() for a whole span of a polygon that isn't a shadow polygon,
+// four fragments at a time. The AVX2 renderer uses it as well, since the 16-bit channel math
+// gains little from the wider vectors.
+static void SoftRasterizer_SpanShade_SSE2(const SoftRasterizerSpanShader &shader, const SoftRasterizerSpan &span, const u32 passMask, const size_t fragmentIndex)
+{
+	const FragmentAttributesBuffer &dstAttributes = *shader.dstAttributes;
+	Color4u8 *dstColor = shader.dstColor + fragmentIndex;
+	u32 *dstDepth = dstAttributes.depth + fragmentIndex;
+	
+	const v128u32 zero = _mm_setzero_si128();
+	const v128u32 laneBits = _mm_set_epi32(8, 4, 2, 1);
+	const v128u32 polyID = _mm_set1_epi32(shader.polygonID);
+	const bool isToonHighlight = (shader.polygonMode == POLYGON_MODE_TOONHIGHLIGHT);
+	
+	v128u32 isOpaqueLanes[SOFTRASTERIZER_SPAN_LENGTH / 4];
+	v128u32 isTranslucentLanes[SOFTRASTERIZER_SPAN_LENGTH / 4];
+	
+	for (size_t i = 0; i < SOFTRASTERIZER_SPAN_LENGTH; i+=(sizeof(v128u32)/sizeof(u32)))
+	{
+		const v128u32 vtxColor = _mm_load_si128((v128u32 *)(span.vtxColor + i));
+		const v128u32 texColor = (shader.isSamplingEnabled) ? _mm_load_si128((v128u32 *)(span.texColor + i)) : _mm_set1_epi32(0x1F3F3F3F);
+		v128u32 toonColor = zero;
+		
+		if (isToonHighlight)
+		{
+			toonColor = _mm_set_epi32(shader.toonColorLUT[span.vtxColor[i+3].r >> 1].value,
+			                          shader.toonColorLUT[span.vtxColor[i+2].r >> 1].value,
+			                          shader.toonColorLUT[span.vtxColor[i+1].r >> 1].value,
+			                          shader.toonColorLUT[span.vtxColor[i+0].r >> 1].value);
+		}
+		
+		const v128u32 srcColor = _mm_packus_epi16( SoftRasterizer_Shade_SSE2(shader, _mm_unpacklo_epi8(vtxColor, zero), _mm_unpacklo_epi8(texColor, zero), _mm_unpacklo_epi8(toonColor, zero)),
+		                                           SoftRasterizer_Shade_SSE2(shader, _mm_unpackhi_epi8(vtxColor, zero), _mm_unpackhi_epi8(texColor, zero), _mm_unpackhi_epi8(toonColor, zero)) );
+		const v128u32 srcAlpha = _mm_srli_epi32(srcColor, 24);
+		
+		// handle alpha test
+		const v128u32 isPassing = _mm_cmpeq_epi32( _mm_and_si128(_mm_set1_epi32(passMask >> i), laneBits), laneBits );
+		v128u32 isDrawn = _mm_andnot_si128(_mm_cmpeq_epi32(srcAlpha, zero), isPassing);
+		
+		if (shader.isAlphaTestEnabled)
+		{
+			isDrawn = _mm_andnot_si128(_mm_cmplt_epi32(srcAlpha, _mm_set1_epi32(shader.alphaTestRef)), isDrawn);
+		}
+		
+		// dont overwrite pixels on translucent polys with the same polyids
+		v128u32 dstTranslucentPolyID = _mm_cvtsi32_si128( *(s32 *)(dstAttributes.translucentPolyID + fragmentIndex + i) );
+		dstTranslucentPolyID = _mm_unpacklo_epi8(dstTranslucentPolyID, zero);
+		dstTranslucentPolyID = _mm_unpacklo_epi16(dstTranslucentPolyID, zero);
+		
+		const v128u32 isOpaque = _mm_and_si128( isDrawn, _mm_cmpeq_epi32(srcAlpha, _mm_set1_epi32(0x1F)) );
+		const v128u32 isTranslucent = _mm_andnot_si128( _mm_or_si128(isOpaque, _mm_cmpeq_epi32(dstTranslucentPolyID, polyID)), isDrawn );
+		
+		// alpha blending and write color
+		const v128u32 oldDstColor = _mm_loadu_si128((v128u32 *)(dstColor + i));
+		v128u32 newDstColor = SoftRasterizer_Select_SSE2(_mm_or_si128(isOpaque, isTranslucent), srcColor, oldDstColor);
+		
+		if (shader.isAlphaBlendingEnabled)
+		{
+			const v128u32 isBlended = _mm_andnot_si128( _mm_cmpeq_epi32(_mm_srli_epi32(oldDstColor, 24), zero), isTranslucent );
+			const v128u32 blendedColor = _mm_packus_epi16( SoftRasterizer_AlphaBlend_SSE2(_mm_unpacklo_epi8(srcColor, zero), _mm_unpacklo_epi8(oldDstColor, zero)),
+			                                               SoftRasterizer_AlphaBlend_SSE2(_mm_unpackhi_epi8(srcColor, zero), _mm_unpackhi_epi8(oldDstColor, zero)) );
+			newDstColor = SoftRasterizer_Select_SSE2(isBlended, blendedColor, newDstColor);
+		}
+		
+		_mm_storeu_si128((v128u32 *)(dstColor + i), newDstColor);
+		
+		//depth writing
+		const v128u32 isDepthWritten = (shader.isTranslucentDepthWriteEnabled) ? _mm_or_si128(isOpaque, isTranslucent) : isOpaque;
+		const v128u32 oldDstDepth = _mm_loadu_si128((v128u32 *)(dstDepth + i));
+		_mm_storeu_si128( (v128u32 *)(dstDepth + i), SoftRasterizer_Select_SSE2(isDepthWritten, _mm_load_si128((v128u32 *)(span.depth + i)), oldDstDepth) );
+		
+		isOpaqueLanes[i/4] = isOpaque;
+		isTranslucentLanes[i/4] = isTranslucent;
+	}
+	
+	// Narrow the lane masks down to one byte per fragment for the attribute buffers.
+	const v128u8 isOpaque = _mm_packs_epi16( _mm_packs_epi32(isOpaqueLanes[0], isOpaqueLanes[1]), _mm_packs_epi32(isOpaqueLanes[2], isOpaqueLanes[3]) );
+	const v128u8 isTranslucent = _mm_packs_epi16( _mm_packs_epi32(isTranslucentLanes[0], isTranslucentLanes[1]), _mm_packs_epi32(isTranslucentLanes[2], isTranslucentLanes[3]) );
+	const v128u8 isWritten = _mm_or_si128(isOpaque, isTranslucent);
+	
+	if (_mm_movemask_epi8(isWritten) == 0)
+	{
+		return;
+	}
+	
+	const v128u8 polyID8 = _mm_set1_epi8(shader.polygonID);
+	u8 *dstOpaquePolyID = dstAttributes.opaquePolyID + fragmentIndex;
+	u8 *dstTranslucentPolyID = dstAttributes.translucentPolyID + fragmentIndex;
+	u8 *dstIsFogged = dstAttributes.isFogged + fragmentIndex;
+	u8 *dstIsTranslucentPoly = dstAttributes.isTranslucentPoly + fragmentIndex;
+	u8 *dstPolyFacing = dstAttributes.polyFacing + fragmentIndex;
+	
+	_mm_storeu_si128( (v128u8 *)dstOpaquePolyID, SoftRasterizer_Select_SSE2(isOpaque, polyID8, _mm_loadu_si128((v128u8 *)dstOpaquePolyID)) );
+	_mm_storeu_si128( (v128u8 *)dstTranslucentPolyID, SoftRasterizer_Select_SSE2(isTranslucent, polyID8, _mm_loadu_si128((v128u8 *)dstTranslucentPolyID)) );
+	_mm_storeu_si128( (v128u8 *)dstIsTranslucentPoly, SoftRasterizer_Select_SSE2(isOpaque, _mm_set1_epi8((shader.isPolyTranslucent) ? 1 : 0), _mm_loadu_si128((v128u8 *)dstIsTranslucentPoly)) );
+	_mm_storeu_si128( (v128u8 *)dstPolyFacing, SoftRasterizer_Select_SSE2(isWritten, _mm_set1_epi8((shader.isFrontFacing) ? PolyFacing_Front : PolyFacing_Back), _mm_loadu_si128((v128u8 *)dstPolyFacing)) );
+	
+	// Opaque fragments take the polygon's fog flag, while translucent fragments stay fogged
+	// only if both they and the polygon are.
+	const v128u8 oldIsFogged = _mm_loadu_si128((v128u8 *)dstIsFogged);
+	const v128u8 translucentIsFogged = (shader.isFogEnabled) ? _mm_andnot_si128(_mm_cmpeq_epi8(oldIsFogged, zero), _mm_set1_epi8(1)) : zero;
+	v128u8 newIsFogged = SoftRasterizer_Select_SSE2(isTranslucent, translucentIsFogged, oldIsFogged);
+	newIsFogged = SoftRasterizer_Select_SSE2(isOpaque, _mm_set1_epi8((shader.isFogEnabled) ? 1 : 0), newIsFogged);
+	_mm_storeu_si128((v128u8 *)dstIsFogged, newIsFogged);
+}
+
+#endif
+
+#if defined(ENABLE_AVX2) || defined(ENABLE_SIMD_DISPATCH)
+SIMD_TARGET_BEGIN_AVX2
+
+static u32 SoftRasterizer_SpanDepthTest_AVX2(const u32 *__restrict srcDepth, const u32 *__restrict dstDepth, const u8 *__restrict dstPolyFacing, const Color4u8 *__restrict dstColor, const size_t length, const bool isEqualTest, const bool isFrontFacing)
+{
+	if (length < SOFTRASTERIZER_SPAN_LENGTH)
+	{
+		return SoftRasterizer_SpanDepthTest(srcDepth, dstDepth, dstPolyFacing, dstColor, length, isEqualTest, isFrontFacing);
+	}
+	
+	u32 passMask = 0;
+	
+	for (size_t i = 0; i < SOFTRASTERIZER_SPAN_LENGTH; i+=(sizeof(v256u32)/sizeof(u32)))
+	{
+		const v256u32 src = _mm256_loadu_si256((v256u32 *)(srcDepth + i));
+		const v256u32 dst = _mm256_loadu_si256((v256u32 *)(dstDepth + i));
+		v256u32 depthPass;
+		
+		if (isEqualTest)
+		{
+			const v256u32 minDepth = _mm256_max_epi32( _mm256_sub_epi32(dst, _mm256_set1_epi32(DEPTH_EQUALS_TEST_TOLERANCE)), _mm256_setzero_si256() );
+			const v256u32 maxDepth = _mm256_min_epu32( _mm256_add_epi32(dst, _mm256_set1_epi32(DEPTH_EQUALS_TEST_TOLERANCE)), _mm256_set1_epi32(0x00FFFFFF) );
+			
+			depthPass = _mm256_and_si256( _mm256_cmpeq_epi32(_mm256_max_epu32(src, minDepth), src),
+			                              _mm256_cmpeq_epi32(_mm256_min_epu32(src, maxDepth), src) );
+		}
+		else
+		{
+			const v256u32 isEqual = _mm256_cmpeq_epi32(src, dst);
+			depthPass = _mm256_andnot_si256( isEqual, _mm256_cmpeq_epi32(_mm256_min_epu32(src, dst), src) );
+			
+			if (isFrontFacing)
+			{
+				const v256u32 facing = _mm256_cvtepu8_epi32( _mm_loadl_epi64((v128u8 *)(dstPolyFacing + i)) );
+				const v256u32 alpha = _mm256_srli_epi32( _mm256_loadu_si256((v256u32 *)(dstColor + i)), 24 );
+				const v256u32 useLEqual = _mm256_and_si256( _mm256_cmpeq_epi32(facing, _mm256_set1_epi32(PolyFacing_Back)),
+				                                            _mm256_cmpeq_epi32(alpha, _mm256_set1_epi32(0x1F)) );
+				
+				depthPass = _mm256_or_si256( depthPass, _mm256_and_si256(useLEqual, isEqual) );
+			}
+		}
+		
+		passMask |= (u32)_mm256_movemask_ps(_mm256_castsi256_ps(depthPass)) << i;
+	}
+	
+	return passMask;
+}
+
+
+static FORCEINLINE void SoftRasterizer_InterpolateLanes_AVX2(const s64 start, const s64 dx, s64 *__restrict outLanes)
+{
+	CACHE_ALIGN const s64 step[4] = { dx * 4, dx * 4, dx * 4, dx * 4 };
+	outLanes[0] = start;
+	outLanes[1] = start + dx;
+	outLanes[2] = start + (dx * 2);
+	outLanes[3] = start + (dx * 3);
+	
+	v256u32 lanes = _mm256_load_si256((v256u32 *)outLanes);
+	const v256u32 laneStep = _mm256_load_si256((v256u32 *)step);
+	
+	for (size_t i = 4; i < SOFTRASTERIZER_SPAN_LENGTH; i+=4)
+	{
+		lanes = _mm256_add_epi64(lanes, laneStep);
+		_mm256_store_si256((v256u32 *)(outLanes + i), lanes);
+	}
+}
+
+// These work the same as their SSE2 counterparts, such as SoftRasterizer_OutOfDivideRange_SSE2().
+static FORCEINLINE v256u32 SoftRasterizer_OutOfDivideRange_AVX2(const v256u32 &val)
+{
+	return _mm256_srli_epi64( _mm256_add_epi64(val, _mm256_set_epi32(0x00080000, 0, 0x00080000, 0, 0x00080000, 0, 0x00080000, 0)), 52 );
+}
+
+static FORCEINLINE __m256d SoftRasterizer_ConvertS64ToF64_AVX2(const v256u32 &val)
+{
+	const v256u32 magic = _mm256_set_epi32(0x43380000, 0, 0x43380000, 0, 0x43380000, 0, 0x43380000, 0);
+	return _mm256_sub_pd( _mm256_castsi256_pd(_mm256_add_epi64(val, magic)), _mm256_castsi256_pd(magic) );
+}
+
+// Also packs the low 32 bits of the four lanes together into a 128-bit vector.
+static FORCEINLINE v128u32 SoftRasterizer_ConvertF64ToS32_AVX2(const __m256d &val)
+{
+	const v256u32 bits = _mm256_castpd_si256( _mm256_add_pd(val, _mm256_set1_pd(6755399441055744.0)) );
+	return _mm256_castsi256_si128( _mm256_permutevar8x32_epi32(bits, _mm256_set_epi32(7, 5, 3, 1, 6, 4, 2, 0)) );
+}
+
+static FORCEINLINE __m256d SoftRasterizer_DivideTruncate_AVX2(const __m256d &numerator, const __m256d &denominator)
+{
+	return _mm256_round_pd( _mm256_div_pd(numerator, denominator), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC );
+}
+
+static FORCEINLINE bool SoftRasterizer_IsDivideExact_AVX2(const v256u32 &divisor, const v256u32 &numeratorRange)
+{
+	const v256u32 zero = _mm256_setzero_si256();
+	const v256u32 outOfRange = _mm256_or_si256( _mm256_or_si256(SoftRasterizer_OutOfDivideRange_AVX2(divisor), numeratorRange), _mm256_cmpeq_epi64(divisor, zero) );
+	return (_mm256_testz_si256(outOfRange, outOfRange) != 0);
+}
+
+static void SoftRasterizer_SpanInterpolate_AVX2(SoftRasterizerSpanInterpolants &interpolated, const SoftRasterizerSpanInterpolants &interpolated_dx, const size_t length, const bool isWDepth, SoftRasterizerSpan &span)
+{
+	if (length < SOFTRASTERIZER_SPAN_LENGTH)
+	{
+		SoftRasterizer_SpanInterpolate(interpolated, interpolated_dx, length, isWDepth, span);
+		return;
+	}
+	
+	CACHE_ALIGN s64 z[SOFTRASTERIZER_SPAN_LENGTH];
+	
+	SoftRasterizer_InterpolateLanes_AVX2(interpolated.invW, interpolated_dx.invW, span.invW);
+	SoftRasterizer_InterpolateLanes_AVX2(interpolated.z, interpolated_dx.z, z);
+	SoftRasterizer_InterpolateLanes_AVX2(interpolated.s, interpolated_dx.s, span.s);
+	SoftRasterizer_InterpolateLanes_AVX2(interpolated.t, interpolated_dx.t, span.t);
+	SoftRasterizer_InterpolateLanes_AVX2(interpolated.color[0], interpolated_dx.color[0], span.color[0]);
+	SoftRasterizer_InterpolateLanes_AVX2(interpolated.color[1], interpolated_dx.color[1], span.color[1]);
+	SoftRasterizer_InterpolateLanes_AVX2(interpolated.color[2], interpolated_dx.color[2], span.color[2]);
+	
+	if (isWDepth)
+	{
+		const __m256d depthNumerator = _mm256_set1_pd( (double)(1LL << W_PRECISION) );
+		
+		for (size_t i = 0; i < SOFTRASTERIZER_SPAN_LENGTH; i+=4)
+		{
+			const v256u32 invW = _mm256_load_si256((v256u32 *)(span.invW + i));
+			
+			if (!SoftRasterizer_IsDivideExact_AVX2(invW, _mm256_setzero_si256()))
+			{
+				for (size_t j = i; j < i+4; j++)
+				{
+					span.depth[j] = (u32)((1LL << W_PRECISION) / span.invW[j]);
+				}
+				continue;
+			}
+			
+			_mm_store_si128( (v128u32 *)(span.depth + i), SoftRasterizer_ConvertF64ToS32_AVX2(SoftRasterizer_DivideTruncate_AVX2(depthNumerator, SoftRasterizer_ConvertS64ToF64_AVX2(invW))) );
+		}
+	}
+	else
+	{
+		const s32 depthRoundingBias = (1 << (Z_EXTRAPRECISION + 7)) - 1;
+		const v256u32 packLow = _mm256_set_epi32(7, 5, 3, 1, 6, 4, 2, 0);
+		
+		for (size_t i = 0; i < SOFTRASTERIZER_SPAN_LENGTH; i+=4)
+		{
+			// The integer division rounds toward zero, so bias negative values before shifting.
+			const v256u32 zLanes = _mm256_load_si256((v256u32 *)(z + i));
+			const v256u32 zSign = _mm256_cmpgt_epi64(_mm256_setzero_si256(), zLanes);
+			v256u32 depth = _mm256_add_epi64( zLanes, _mm256_and_si256(zSign, _mm256_set_epi32(0, depthRoundingBias, 0, depthRoundingBias, 0, depthRoundingBias, 0, depthRoundingBias)) );
+			depth = _mm256_srli_epi64(depth, Z_EXTRAPRECISION + 7);
+			depth = _mm256_permutevar8x32_epi32(depth, packLow);
+			
+			_mm_store_si128( (v128u32 *)(span.depth + i), _mm_and_si128(_mm256_castsi256_si128(depth), _mm_set1_epi32((s32)0xFFFFFFFE)) );
+		}
+	}
+	
+	interpolated.invW += interpolated_dx.invW * SOFTRASTERIZER_SPAN_LENGTH;
+	interpolated.z += interpolated_dx.z * SOFTRASTERIZER_SPAN_LENGTH;
+	interpolated.s += interpolated_dx.s * SOFTRASTERIZER_SPAN_LENGTH;
+	interpolated.t += interpolated_dx.t * SOFTRASTERIZER_SPAN_LENGTH;
+	interpolated.color[0] += interpolated_dx.color[0] * SOFTRASTERIZER_SPAN_LENGTH;
+	interpolated.color[1] += interpolated_dx.color[1] * SOFTRASTERIZER_SPAN_LENGTH;
+	interpolated.color[2] += interpolated_dx.color[2] * SOFTRASTERIZER_SPAN_LENGTH;
+}
+
+static void SoftRasterizer_SpanPerspective_AVX2(SoftRasterizerSpan &span, const u32 texScalingShift, const u8 alpha, const u32 passMask)
+{
+	const v128u32 texScalingShiftVec = _mm_cvtsi32_si128(texScalingShift);
+	const v128u32 byteMask = _mm_set1_epi32(0x000000FF);
+	const v128u32 laneBits = _mm_set_epi32(8, 4, 2, 1);
+	const __m256d colorMax = _mm256_set1_pd(63.0);
+	
+	for (size_t i = 0; i < SOFTRASTERIZER_SPAN_LENGTH; i+=4)
+	{
+		const u32 quadMask = (passMask >> i) & 0xF;
+		
+		if (quadMask == 0)
+		{
+			_mm_store_si128((v128u32 *)(span.vtxColor + i), _mm_setzero_si128());
+			_mm_store_si128((v128u32 *)(span.texCoordS + i), _mm_setzero_si128());
+			_mm_store_si128((v128u32 *)(span.texCoordT + i), _mm_setzero_si128());
+			continue;
+		}
+		
+		const v256u32 invW = _mm256_load_si256((v256u32 *)(span.invW + i));
+		const v256u32 r = _mm256_load_si256((v256u32 *)(span.color[0] + i));
+		const v256u32 g = _mm256_load_si256((v256u32 *)(span.color[1] + i));
+		const v256u32 b = _mm256_load_si256((v256u32 *)(span.color[2] + i));
+		const v256u32 s = _mm256_sll_epi64(_mm256_load_si256((v256u32 *)(span.s + i)), texScalingShiftVec);
+		const v256u32 t = _mm256_sll_epi64(_mm256_load_si256((v256u32 *)(span.t + i)), texScalingShiftVec);
+		
+		const v256u32 numeratorRange = _mm256_or_si256( _mm256_or_si256(SoftRasterizer_OutOfDivideRange_AVX2(r), SoftRasterizer_OutOfDivideRange_AVX2(g)),
+		                                                _mm256_or_si256(SoftRasterizer_OutOfDivideRange_AVX2(b), _mm256_or_si256(SoftRasterizer_OutOfDivideRange_AVX2(s), SoftRasterizer_OutOfDivideRange_AVX2(t))) );
+		
+		if (!SoftRasterizer_IsDivideExact_AVX2(invW, numeratorRange))
+		{
+			for (size_t j = i; j < i+4; j++)
+			{
+				if ( (passMask & (1 << j)) != 0 )
+				{
+					SoftRasterizer_FragmentPerspective(span, j, 1LL << texScalingShift, alpha);
+				}
+				else
+				{
+					span.vtxColor[j].value = 0;
+					span.texCoordS[j] = 0;
+					span.texCoordT[j] = 0;
+				}
+			}
+			continue;
+		}
+		
+		const __m256d invWf = SoftRasterizer_ConvertS64ToF64_AVX2(invW);
+		const v128u32 rq = SoftRasterizer_ConvertF64ToS32_AVX2( _mm256_min_pd(SoftRasterizer_DivideTruncate_AVX2(SoftRasterizer_ConvertS64ToF64_AVX2(r), invWf), colorMax) );
+		const v128u32 gq = SoftRasterizer_ConvertF64ToS32_AVX2( _mm256_min_pd(SoftRasterizer_DivideTruncate_AVX2(SoftRasterizer_ConvertS64ToF64_AVX2(g), invWf), colorMax) );
+		const v128u32 bq = SoftRasterizer_ConvertF64ToS32_AVX2( _mm256_min_pd(SoftRasterizer_DivideTruncate_AVX2(SoftRasterizer_ConvertS64ToF64_AVX2(b), invWf), colorMax) );
+		const v128u32 sq = SoftRasterizer_ConvertF64ToS32_AVX2( SoftRasterizer_DivideTruncate_AVX2(SoftRasterizer_ConvertS64ToF64_AVX2(s), invWf) );
+		const v128u32 tq = SoftRasterizer_ConvertF64ToS32_AVX2( SoftRasterizer_DivideTruncate_AVX2(SoftRasterizer_ConvertS64ToF64_AVX2(t), invWf) );
+		
+		v128u32 vtxColor = _mm_or_si128( _mm_and_si128(rq, byteMask), _mm_slli_epi32(_mm_and_si128(gq, byteMask), 8) );
+		vtxColor = _mm_or_si128( vtxColor, _mm_or_si128(_mm_slli_epi32(_mm_and_si128(bq, byteMask), 16), _mm_set1_epi32((u32)alpha << 24)) );
+		
+		// Zero out the fragments that didn't pass.
+		const v128u32 keepMask = _mm_cmpeq_epi32( _mm_and_si128(_mm_set1_epi32(quadMask), laneBits), laneBits );
+		_mm_store_si128( (v128u32 *)(span.vtxColor + i), _mm_and_si128(vtxColor, keepMask) );
+		_mm_store_si128( (v128u32 *)(span.texCoordS + i), _mm_and_si128(sq, keepMask) );
+		_mm_store_si128( (v128u32 *)(span.texCoordT + i), _mm_and_si128(tq, keepMask) );
+	}
+}
+
+static FORCEINLINE v256u32 SoftRasterizer_SampleWrap_AVX2(const v256u32 &coord, const s32 size, const s32 sizeMask, const bool isRepeat, const bool isFlip)
+{
+	if (isFlip)
+	{
+		const v256u32 mirrorSize = _mm256_set1_epi32((size << 1) - 1);
+		const v256u32 val = _mm256_and_si256(coord, mirrorSize);
+		const v256u32 isMirrored = _mm256_cmpgt_epi32(val, _mm256_set1_epi32(size - 1));
+		return _mm256_blendv_epi8( val, _mm256_sub_epi32(mirrorSize, val), isMirrored );
+	}
+	else if (isRepeat)
+	{
+		return _mm256_and_si256(coord, _mm256_set1_epi32(sizeMask));
+	}
+	
+	return _mm256_min_epi32( _mm256_max_epi32(coord, _mm256_setzero_si256()), _mm256_set1_epi32(sizeMask) );
+}
+
+static void SoftRasterizer_SpanSample_AVX2(const SoftRasterizerSpanSampler &sampler, SoftRasterizerSpan &span)
+{
+	const bool isRepeatS = (sampler.wrapMode & 0x1) != 0;
+	const bool isRepeatT = (sampler.wrapMode & 0x2) != 0;
+	const bool isFlipS = isRepeatS && ((sampler.wrapMode & 0x4) != 0);
+	const bool isFlipT = isRepeatT && ((sampler.wrapMode & 0x8) != 0);
+	const v128u32 widthShift = _mm_cvtsi32_si128(sampler.widthShift);
+	
+	for (size_t i = 0; i < SOFTRASTERIZER_SPAN_LENGTH; i+=(sizeof(v256u32)/sizeof(u32)))
+	{
+		const v256u32 u = SoftRasterizer_SampleWrap_AVX2(_mm256_load_si256((v256u32 *)(span.texCoordS + i)), sampler.width, sampler.widthMask, isRepeatS, isFlipS);
+		const v256u32 v = SoftRasterizer_SampleWrap_AVX2(_mm256_load_si256((v256u32 *)(span.texCoordT + i)), sampler.height, sampler.heightMask, isRepeatT, isFlipT);
+		const v256u32 texelIndex = _mm256_add_epi32(_mm256_sll_epi32(v, widthShift), u);
+		
+		_mm256_store_si256( (v256u32 *)(span.texColor + i), _mm256_i32gather_epi32((const int *)sampler.data, texelIndex, sizeof(u32)) );
+	}
+}
+
+SIMD_TARGET_END
+#endif
+
+#if defined(ENABLE_SSE2) && !defined(ENABLE_AVX2)
+
+static u32 SoftRasterizer_SpanDepthTest_SSE2(const u32 *__restrict srcDepth, const u32 *__restrict dstDepth, const u8 *__restrict dstPolyFacing, const Color4u8 *__restrict dstColor, const size_t length, const bool isEqualTest, const bool isFrontFacing)
+{
+	if (length < SOFTRASTERIZER_SPAN_LENGTH)
+	{
+		return SoftRasterizer_SpanDepthTest(srcDepth, dstDepth, dstPolyFacing, dstColor, length, isEqualTest, isFrontFacing);
+	}
+	
+	// SSE2 only has signed 32-bit compares, so flip the sign bits to compare unsigned values.
+	const v128u32 signFlip = _mm_set1_epi32((s32)0x80000000);
+	u32 passMask = 0;
+	
+	for (size_t i = 0; i < SOFTRASTERIZER_SPAN_LENGTH; i+=(sizeof(v128u32)/sizeof(u32)))
+	{
+		const v128u32 src = _mm_loadu_si128((v128u32 *)(srcDepth + i));
+		const v128u32 dst = _mm_loadu_si128((v128u32 *)(dstDepth + i));
+		const v128u32 srcFlipped = _mm_xor_si128(src, signFlip);
+		v128u32 depthPass;
+		
+		if (isEqualTest)
+		{
+			v128u32 minDepth = _mm_sub_epi32(dst, _mm_set1_epi32(DEPTH_EQUALS_TEST_TOLERANCE));
+			minDepth = _mm_andnot_si128(_mm_srai_epi32(minDepth, 31), minDepth);
+			
+			const v128u32 maxDepthLimit = _mm_set1_epi32(0x00FFFFFF);
+			v128u32 maxDepth = _mm_add_epi32(dst, _mm_set1_epi32(DEPTH_EQUALS_TEST_TOLERANCE));
+			const v128u32 isBelowLimit = _mm_cmplt_epi32( _mm_xor_si128(maxDepth, signFlip), _mm_xor_si128(maxDepthLimit, signFlip) );
+			maxDepth = _mm_or_si128( _mm_and_si128(isBelowLimit, maxDepth), _mm_andnot_si128(isBelowLimit, maxDepthLimit) );
+			
+			const v128u32 depthFail = _mm_or_si128( _mm_cmplt_epi32(srcFlipped, _mm_xor_si128(minDepth, signFlip)),
+			                                        _mm_cmpgt_epi32(srcFlipped, _mm_xor_si128(maxDepth, signFlip)) );
+			depthPass = _mm_xor_si128(depthFail, _mm_set1_epi32(-1));
+		}
+		else
+		{
+			const v128u32 dstFlipped = _mm_xor_si128(dst, signFlip);
+			depthPass = _mm_cmplt_epi32(srcFlipped, dstFlipped);
+			
+			if (isFrontFacing)
+			{
+				v128u32 facing = _mm_cvtsi32_si128( *(s32 *)(dstPolyFacing + i) );
+				facing = _mm_unpacklo_epi8(facing, _mm_setzero_si128());
+				facing = _mm_unpacklo_epi16(facing, _mm_setzero_si128());
+				
+				const v128u32 alpha = _mm_srli_epi32( _mm_loadu_si128((v128u32 *)(dstColor + i)), 24 );
+				const v128u32 useLEqual = _mm_and_si128( _mm_cmpeq_epi32(facing, _mm_set1_epi32(PolyFacing_Back)),
+				                                         _mm_cmpeq_epi32(alpha, _mm_set1_epi32(0x1F)) );
+				
+				depthPass = _mm_or_si128( depthPass, _mm_and_si128(useLEqual, _mm_cmpeq_epi32(src, dst)) );
+			}
+		}
+		
+		passMask |= (u32)_mm_movemask_ps(_mm_castsi128_ps(depthPass)) << i;
+	}
+	
+	return passMask;
+}
+
+
+// Fills a whole span of <outLanes> with start, start+dx, start+2*dx and so on. This is exactly
+// what stepping the interpolant one fragment at a time gives.
+static FORCEINLINE void SoftRasterizer_InterpolateLanes_SSE2(const s64 start, const s64 dx, s64 *__restrict outLanes)
+{
+	CACHE_ALIGN const s64 step[2] = { dx * 2, dx * 2 };
+	outLanes[0] = start;
+	outLanes[1] = start + dx;
+	
+	v128u32 lanes = _mm_load_si128((v128u32 *)outLanes);
+	const v128u32 laneStep = _mm_load_si128((v128u32 *)step);
+	
+	for (size_t i = 2; i < SOFTRASTERIZER_SPAN_LENGTH; i+=2)
+	{
+		lanes = _mm_add_epi64(lanes, laneStep);
+		_mm_store_si128((v128u32 *)(outLanes + i), lanes);
+	}
+}
+
+// Returns true if both s64 lanes of <divisor> are nonzero and, along with every lane of
+// <numeratorRange>, within the range of SoftRasterizer_OutOfDivideRange_SSE2().
+static FORCEINLINE bool SoftRasterizer_IsDivideExact_SSE2(const v128u32 &divisor, const v128u32 &numeratorRange)
+{
+	const v128u32 zero = _mm_setzero_si128();
+	v128u32 isZero = _mm_cmpeq_epi32(divisor, zero);
+	isZero = _mm_and_si128(isZero, _mm_shuffle_epi32(isZero, 0xB1));
+	
+	const v128u32 outOfRange = _mm_or_si128( _mm_or_si128(SoftRasterizer_OutOfDivideRange_SSE2(divisor), numeratorRange), isZero );
+	return (_mm_movemask_epi8(_mm_cmpeq_epi32(outOfRange, zero)) == 0xFFFF);
+}
+
+static void SoftRasterizer_SpanInterpolate_SSE2(SoftRasterizerSpanInterpolants &interpolated, const SoftRasterizerSpanInterpolants &interpolated_dx, const size_t length, const bool isWDepth, SoftRasterizerSpan &span)
+{
+	if (length < SOFTRASTERIZER_SPAN_LENGTH)
+	{
+		SoftRasterizer_SpanInterpolate(interpolated, interpolated_dx, length, isWDepth, span);
+		return;
+	}
+	
+	CACHE_ALIGN s64 z[SOFTRASTERIZER_SPAN_LENGTH];
+	
+	SoftRasterizer_InterpolateLanes_SSE2(interpolated.invW, interpolated_dx.invW, span.invW);
+	SoftRasterizer_InterpolateLanes_SSE2(interpolated.z, interpolated_dx.z, z);
+	SoftRasterizer_InterpolateLanes_SSE2(interpolated.s, interpolated_dx.s, span.s);
+	SoftRasterizer_InterpolateLanes_SSE2(interpolated.t, interpolated_dx.t, span.t);
+	SoftRasterizer_InterpolateLanes_SSE2(interpolated.color[0], interpolated_dx.color[0], span.color[0]);
+	SoftRasterizer_InterpolateLanes_SSE2(interpolated.color[1], interpolated_dx.color[1], span.color[1]);
+	SoftRasterizer_InterpolateLanes_SSE2(interpolated.color[2], interpolated_dx.color[2], span.color[2]);
+	
+	if (isWDepth)
+	{
+		const __m128d depthNumerator = _mm_set1_pd( (double)(1LL << W_PRECISION) );
+		
+		for (size_t i = 0; i < SOFTRASTERIZER_SPAN_LENGTH; i+=2)
+		{
+			const v128u32 invW = _mm_load_si128((v128u32 *)(span.invW + i));
+			
+			if (!SoftRasterizer_IsDivideExact_SSE2(invW, _mm_setzero_si128()))
+			{
+				span.depth[i+0] = (u32)((1LL << W_PRECISION) / span.invW[i+0]);
+				span.depth[i+1] = (u32)((1LL << W_PRECISION) / span.invW[i+1]);
+				continue;
+			}
+			
+			const v128u32 depth = SoftRasterizer_ConvertF64ToS32_SSE2( SoftRasterizer_DivideTruncate_SSE2(depthNumerator, SoftRasterizer_ConvertS64ToF64_SSE2(invW)) );
+			_mm_storel_epi64( (v128u32 *)(span.depth + i), _mm_shuffle_epi32(depth, 0xD8) );
+		}
+	}
+	else
+	{
+		const s32 depthRoundingBias = (1 << (Z_EXTRAPRECISION + 7)) - 1;
+		
+		for (size_t i = 0; i < SOFTRASTERIZER_SPAN_LENGTH; i+=2)
+		{
+			// The integer division rounds toward zero, so bias negative values before shifting.
+			const v128u32 zLanes = _mm_load_si128((v128u32 *)(z + i));
+			const v128u32 zSign = _mm_shuffle_epi32( _mm_srai_epi32(zLanes, 31), 0xF5 );
+			v128u32 depth = _mm_add_epi64( zLanes, _mm_and_si128(zSign, _mm_set_epi32(0, depthRoundingBias, 0, depthRoundingBias)) );
+			depth = _mm_srli_epi64(depth, Z_EXTRAPRECISION + 7);
+			depth = _mm_and_si128(depth, _mm_set1_epi32((s32)0xFFFFFFFE));
+			
+			_mm_storel_epi64( (v128u32 *)(span.depth + i), _mm_shuffle_epi32(depth, 0xD8) );
+		}
+	}
+	
+	interpolated.invW += interpolated_dx.invW * SOFTRASTERIZER_SPAN_LENGTH;
+	interpolated.z += interpolated_dx.z * SOFTRASTERIZER_SPAN_LENGTH;
+	interpolated.s += interpolated_dx.s * SOFTRASTERIZER_SPAN_LENGTH;
+	interpolated.t += interpolated_dx.t * SOFTRASTERIZER_SPAN_LENGTH;
+	interpolated.color[0] += interpolated_dx.color[0] * SOFTRASTERIZER_SPAN_LENGTH;
+	interpolated.color[1] += interpolated_dx.color[1] * SOFTRASTERIZER_SPAN_LENGTH;
+	interpolated.color[2] += interpolated_dx.color[2] * SOFTRASTERIZER_SPAN_LENGTH;
+}
+
+static void SoftRasterizer_SpanPerspective_SSE2(SoftRasterizerSpan &span, const u32 texScalingShift, const u8 alpha, const u32 passMask)
+{
+	const v128u32 zero = _mm_setzero_si128();
+	const v128u32 texScalingShiftVec = _mm_cvtsi32_si128(texScalingShift);
+	const v128u32 colorAlpha = _mm_set1_epi32((u32)alpha << 24);
+	const v128u32 byteMask = _mm_set1_epi32(0x000000FF);
+	const __m128d colorMax = _mm_set1_pd(63.0);
+	
+	for (size_t i = 0; i < SOFTRASTERIZER_SPAN_LENGTH; i+=2)
+	{
+		const u32 pairMask = (passMask >> i) & 0x3;
+		
+		if (pairMask == 0)
+		{
+			_mm_storel_epi64((v128u32 *)(span.vtxColor + i), zero);
+			_mm_storel_epi64((v128u32 *)(span.texCoordS + i), zero);
+			_mm_storel_epi64((v128u32 *)(span.texCoordT + i), zero);
+			continue;
+		}
+		
+		const v128u32 invW = _mm_load_si128((v128u32 *)(span.invW + i));
+		const v128u32 r = _mm_load_si128((v128u32 *)(span.color[0] + i));
+		const v128u32 g = _mm_load_si128((v128u32 *)(span.color[1] + i));
+		const v128u32 b = _mm_load_si128((v128u32 *)(span.color[2] + i));
+		const v128u32 s = _mm_sll_epi64(_mm_load_si128((v128u32 *)(span.s + i)), texScalingShiftVec);
+		const v128u32 t = _mm_sll_epi64(_mm_load_si128((v128u32 *)(span.t + i)), texScalingShiftVec);
+		
+		const v128u32 numeratorRange = _mm_or_si128( _mm_or_si128(SoftRasterizer_OutOfDivideRange_SSE2(r), SoftRasterizer_OutOfDivideRange_SSE2(g)),
+		                                             _mm_or_si128(SoftRasterizer_OutOfDivideRange_SSE2(b), _mm_or_si128(SoftRasterizer_OutOfDivideRange_SSE2(s), SoftRasterizer_OutOfDivideRange_SSE2(t))) );
+		
+		if (!SoftRasterizer_IsDivideExact_SSE2(invW, numeratorRange))
+		{
+			for (size_t j = i; j < i+2; j++)
+			{
+				if ( (passMask & (1 << j)) != 0 )
+				{
+					SoftRasterizer_FragmentPerspective(span, j, 1LL << texScalingShift, alpha);
+				}
+				else
+				{
+					span.vtxColor[j].value = 0;
+					span.texCoordS[j] = 0;
+					span.texCoordT[j] = 0;
+				}
+			}
+			continue;
+		}
+		
+		const __m128d invWf = SoftRasterizer_ConvertS64ToF64_SSE2(invW);
+		const v128u32 rq = SoftRasterizer_ConvertF64ToS32_SSE2( _mm_min_pd(SoftRasterizer_DivideTruncate_SSE2(SoftRasterizer_ConvertS64ToF64_SSE2(r), invWf), colorMax) );
+		const v128u32 gq = SoftRasterizer_ConvertF64ToS32_SSE2( _mm_min_pd(SoftRasterizer_DivideTruncate_SSE2(SoftRasterizer_ConvertS64ToF64_SSE2(g), invWf), colorMax) );
+		const v128u32 bq = SoftRasterizer_ConvertF64ToS32_SSE2( _mm_min_pd(SoftRasterizer_DivideTruncate_SSE2(SoftRasterizer_ConvertS64ToF64_SSE2(b), invWf), colorMax) );
+		const v128u32 sq = SoftRasterizer_ConvertF64ToS32_SSE2( SoftRasterizer_DivideTruncate_SSE2(SoftRasterizer_ConvertS64ToF64_SSE2(s), invWf) );
+		const v128u32 tq = SoftRasterizer_ConvertF64ToS32_SSE2( SoftRasterizer_DivideTruncate_SSE2(SoftRasterizer_ConvertS64ToF64_SSE2(t), invWf) );
+		
+		v128u32 vtxColor = _mm_or_si128( _mm_and_si128(rq, byteMask), _mm_slli_epi32(_mm_and_si128(gq, byteMask), 8) );
+		vtxColor = _mm_or_si128( vtxColor, _mm_or_si128(_mm_slli_epi32(_mm_and_si128(bq, byteMask), 16), colorAlpha) );
+		
+		// Zero out the fragment that didn't pass, if any.
+		const v128u32 keepMask = _mm_set_epi32(0, (pairMask & 0x2) ? -1 : 0, 0, (pairMask & 0x1) ? -1 : 0);
+		_mm_storel_epi64( (v128u32 *)(span.vtxColor + i), _mm_shuffle_epi32(_mm_and_si128(vtxColor, keepMask), 0xD8) );
+		_mm_storel_epi64( (v128u32 *)(span.texCoordS + i), _mm_shuffle_epi32(_mm_and_si128(sq, keepMask), 0xD8) );
+		_mm_storel_epi64( (v128u32 *)(span.texCoordT + i), _mm_shuffle_epi32(_mm_and_si128(tq, keepMask), 0xD8) );
+	}
+}
+
+// Same as SoftRasterizerTexture::GetRenderSamplerCoordinates() for a single axis.
+static FORCEINLINE v128u32 SoftRasterizer_SampleWrap_SSE2(const v128u32 &coord, const s32 size, const s32 sizeMask, const bool isRepeat, const bool isFlip)
+{
+	if (isFlip)
+	{
+		const v128u32 mirrorSize = _mm_set1_epi32((size << 1) - 1);
+		const v128u32 val = _mm_and_si128(coord, mirrorSize);
+		const v128u32 isMirrored = _mm_cmpgt_epi32(val, _mm_set1_epi32(size - 1));
+		return SoftRasterizer_Select_SSE2( isMirrored, _mm_sub_epi32(mirrorSize, val), val );
+	}
+	else if (isRepeat)
+	{
+		return _mm_and_si128(coord, _mm_set1_epi32(sizeMask));
+	}
+	
+	const v128u32 sizeMaskVec = _mm_set1_epi32(sizeMask);
+	const v128u32 val = _mm_andnot_si128(_mm_srai_epi32(coord, 31), coord);
+	return SoftRasterizer_Select_SSE2( _mm_cmpgt_epi32(val, sizeMaskVec), sizeMaskVec, val );
+}
+
+static void SoftRasterizer_SpanSample_SSE2(const SoftRasterizerSpanSampler &sampler, SoftRasterizerSpan &span)
+{
+	const bool isRepeatS = (sampler.wrapMode & 0x1) != 0;
+	const bool isRepeatT = (sampler.wrapMode & 0x2) != 0;
+	const bool isFlipS = isRepeatS && ((sampler.wrapMode & 0x4) != 0);
+	const bool isFlipT = isRepeatT && ((sampler.wrapMode & 0x8) != 0);
+	const v128u32 widthShift = _mm_cvtsi32_si128(sampler.widthShift);
+	CACHE_ALIGN u32 texelIndex[SOFTRASTERIZER_SPAN_LENGTH];
+	
+	for (size_t i = 0; i < SOFTRASTERIZER_SPAN_LENGTH; i+=(sizeof(v128u32)/sizeof(u32)))
+	{
+		const v128u32 u = SoftRasterizer_SampleWrap_SSE2(_mm_load_si128((v128u32 *)(span.texCoordS + i)), sampler.width, sampler.widthMask, isRepeatS, isFlipS);
+		const v128u32 v = SoftRasterizer_SampleWrap_SSE2(_mm_load_si128((v128u32 *)(span.texCoordT + i)), sampler.height, sampler.heightMask, isRepeatT, isFlipT);
+		_mm_store_si128( (v128u32 *)(texelIndex + i), _mm_add_epi32(_mm_sll_epi32(v, widthShift), u) );
+	}
+	
+	// SSE2 has no gather, so the texels themselves are still loaded one at a time.
+	for (size_t i = 0; i < SOFTRASTERIZER_SPAN_LENGTH; i++)
+	{
+		span.texColor[i].value = sampler.data[texelIndex[i]];
+	}
+}
+
+#endif
+
 template<bool RENDERER> template<bool ISSHADOWPOLYGON>
 FORCEINLINE void RasterizerUnit<RENDERER>::_shade(const PolygonMode polygonMode, const Color4u8 vtxColor, const Vector2s32 &texCoord, Color4u8 &outColor)
 {
@@ -669,53 +1531,6 @@ FORCEINLINE void RasterizerUnit<RENDERER>::_pixel(const POLYGON_ATTR polyAttr, c
 	u8 &dstAttributeIsTranslucentPoly	= this->_softRender->_framebufferAttributes->isTranslucentPoly[fragmentIndex];
 	u8 &dstAttributePolyFacing			= this->_softRender->_framebufferAttributes->polyFacing[fragmentIndex];
 	
-	// run the depth test
-	bool depthFail = false;
-	
-	if (polyAttr.DepthEqualTest_Enable)
-	{
-		// The EQUAL depth test is used if the polygon requests it. Note that the NDS doesn't perform
-		// a true EQUAL test -- there is a set tolerance to it that makes it easier for pixels to
-		// pass the depth test.
-		const u32 minDepth = (u32)max<s32>(0x00000000, (s32)dstAttributeDepth - DEPTH_EQUALS_TEST_TOLERANCE);
-		const u32 maxDepth = min<u32>(0x00FFFFFF, dstAttributeDepth + DEPTH_EQUALS_TEST_TOLERANCE);
-		
-		if (depth < minDepth || depth > maxDepth)
-		{
-			depthFail = true;
-		}
-	}
-	else if ( (ISFRONTFACING && (dstAttributePolyFacing == PolyFacing_Back)) && (dstColor.a == 0x1F) )
-	{
-		// The LEQUAL test is used in the special case where an incoming front-facing polygon's pixel
-		// is to be drawn on top of a back-facing polygon's opaque pixel.
-		//
-		// Test case: The Customize status screen in Sands of Destruction requires this type of depth
-		// test in order to correctly show the animating characters.
-		if (depth > dstAttributeDepth)
-		{
-			depthFail = true;
-		}
-	}
-	else
-	{
-		// The LESS depth test is the default type of depth test for all other conditions.
-		if (depth >= dstAttributeDepth)
-		{
-			depthFail = true;
-		}
-	}
-
-	if (depthFail)
-	{
-		//shadow mask polygons set stencil bit here
-		if (ISSHADOWPOLYGON && polyAttr.PolygonID == 0)
-		{
-			dstAttributeStencil = 1;
-		}
-		return;
-	}
-	
 	//handle shadow polys
 	if (ISSHADOWPOLYGON)
 	{
@@ -825,20 +1640,14 @@ FORCEINLINE void RasterizerUnit<RENDERER>::_drawscanline(const POLYGON_ATTR poly
 	}
 
 	//these are the starting values, taken from the left edge
-	s64 invWInterpolated = pLeft.invW.curr;
-	s64 zInterpolated = pLeft.z.curr;
-	
-	CACHE_ALIGN Vector2s64 texCoordInterpolated = {
-		pLeft.s.curr,
-		pLeft.t.curr
-	};
-	
-	CACHE_ALIGN Color4s64 vtxColorInterpolated = {
-		pLeft.color[0].curr,
-		pLeft.color[1].curr,
-		pLeft.color[2].curr,
-		polyAttr.Alpha
-	};
+	SoftRasterizerSpanInterpolants interpolated;
+	interpolated.invW = pLeft.invW.curr;
+	interpolated.z = pLeft.z.curr;
+	interpolated.s = pLeft.s.curr;
+	interpolated.t = pLeft.t.curr;
+	interpolated.color[0] = pLeft.color[0].curr;
+	interpolated.color[1] = pLeft.color[1].curr;
+	interpolated.color[2] = pLeft.color[2].curr;
 	
 	float invWFloatInterpolated = pLeft.invWFloat.curr;
 	float zFloatInterpolated = pLeft.zFloat.curr;
@@ -848,30 +1657,23 @@ FORCEINLINE void RasterizerUnit<RENDERER>::_drawscanline(const POLYGON_ATTR poly
 		pLeft.tFloat.curr
 	};
 	
-	CACHE_ALIGN Color4f32 vtxColorFloatInterpolated = {
+	CACHE_ALIGN Color3f32 vtxColorFloatInterpolated = {
 		pLeft.colorFloat[0].curr,
 		pLeft.colorFloat[1].curr,
-		pLeft.colorFloat[2].curr,
-		(float)polyAttr.Alpha / 31.0f
+		pLeft.colorFloat[2].curr
 	};
 	
 	//our dx values are taken from the steps up until the right edge
 	const s64 rasterWidth_dx = rasterWidth;
 	
-	const s64 invWInterpolated_dx = (pRight.invW.curr - invWInterpolated) / rasterWidth_dx;
-	const s64 zInterpolated_dx = (pRight.z.curr - zInterpolated) / rasterWidth_dx;
-	
-	const CACHE_ALIGN Vector2s64 texCoordInterpolated_dx = {
-		(pRight.s.curr - texCoordInterpolated.s) / rasterWidth_dx,
-		(pRight.t.curr - texCoordInterpolated.t) / rasterWidth_dx
-	};
-	
-	const CACHE_ALIGN Color4s64 vtxColorInterpolated_dx = {
-		(pRight.color[0].curr - vtxColorInterpolated.r) / rasterWidth_dx,
-		(pRight.color[1].curr - vtxColorInterpolated.g) / rasterWidth_dx,
-		(pRight.color[2].curr - vtxColorInterpolated.b) / rasterWidth_dx,
-		0 / rasterWidth_dx
-	};
+	SoftRasterizerSpanInterpolants interpolated_dx;
+	interpolated_dx.invW = (pRight.invW.curr - interpolated.invW) / rasterWidth_dx;
+	interpolated_dx.z = (pRight.z.curr - interpolated.z) / rasterWidth_dx;
+	interpolated_dx.s = (pRight.s.curr - interpolated.s) / rasterWidth_dx;
+	interpolated_dx.t = (pRight.t.curr - interpolated.t) / rasterWidth_dx;
+	interpolated_dx.color[0] = (pRight.color[0].curr - interpolated.color[0]) / rasterWidth_dx;
+	interpolated_dx.color[1] = (pRight.color[1].curr - interpolated.color[1]) / rasterWidth_dx;
+	interpolated_dx.color[2] = (pRight.color[2].curr - interpolated.color[2]) / rasterWidth_dx;
 	
 	const float invWFloatInterpolated_dx = (pRight.invWFloat.curr - invWFloatInterpolated) / (float)rasterWidth_dx;
 	const float zFloatInterpolated_dx = (pRight.zFloat.curr - zFloatInterpolated) / (float)rasterWidth_dx;
@@ -881,11 +1683,10 @@ FORCEINLINE void RasterizerUnit<RENDERER>::_drawscanline(const POLYGON_ATTR poly
 		(pRight.tFloat.curr - texCoordFloatInterpolated.t) / rasterWidth_dx
 	};
 	
-	const CACHE_ALIGN Color4f32 vtxColorFloatInterpolated_dx = {
+	const CACHE_ALIGN Color3f32 vtxColorFloatInterpolated_dx = {
 		(pRight.colorFloat[0].curr - vtxColorFloatInterpolated.r) / (float)rasterWidth_dx,
 		(pRight.colorFloat[1].curr - vtxColorFloatInterpolated.g) / (float)rasterWidth_dx,
-		(pRight.colorFloat[2].curr - vtxColorFloatInterpolated.b) / (float)rasterWidth_dx,
-		0.0f / (float)rasterWidth_dx
+		(pRight.colorFloat[2].curr - vtxColorFloatInterpolated.b) / (float)rasterWidth_dx
 	};
 
 	//CONSIDER: in case some other math is wrong (shouldve been clipped OK), we might go out of bounds here.
@@ -908,16 +1709,13 @@ FORCEINLINE void RasterizerUnit<RENDERER>::_drawscanline(const POLYGON_ATTR poly
 			return;
 		}
 		
-		invWInterpolated += invWInterpolated_dx * -x;
-		zInterpolated += zInterpolated_dx * -x;
-		
-		texCoordInterpolated.s += texCoordInterpolated_dx.s * -x;
-		texCoordInterpolated.t += texCoordInterpolated_dx.t * -x;
-		
-		vtxColorInterpolated.r += vtxColorInterpolated_dx.r * -x;
-		vtxColorInterpolated.g += vtxColorInterpolated_dx.g * -x;
-		vtxColorInterpolated.b += vtxColorInterpolated_dx.b * -x;
-		vtxColorInterpolated.a += vtxColorInterpolated_dx.a * -x;
+		interpolated.invW += interpolated_dx.invW * -x;
+		interpolated.z += interpolated_dx.z * -x;
+		interpolated.s += interpolated_dx.s * -x;
+		interpolated.t += interpolated_dx.t * -x;
+		interpolated.color[0] += interpolated_dx.color[0] * -x;
+		interpolated.color[1] += interpolated_dx.color[1] * -x;
+		interpolated.color[2] += interpolated_dx.color[2] * -x;
 		
 		invWFloatInterpolated += invWFloatInterpolated_dx * (float)-x;
 		zFloatInterpolated += zFloatInterpolated_dx * (float)-x;
@@ -927,7 +1725,6 @@ FORCEINLINE void RasterizerUnit<RENDERER>::_drawscanline(const POLYGON_ATTR poly
 		vtxColorFloatInterpolated.r += vtxColorFloatInterpolated_dx.r * (float)-x;
 		vtxColorFloatInterpolated.g += vtxColorFloatInterpolated_dx.g * (float)-x;
 		vtxColorFloatInterpolated.b += vtxColorFloatInterpolated_dx.b * (float)-x;
-		vtxColorFloatInterpolated.a += vtxColorFloatInterpolated_dx.a * (float)-x;
 		
 		adr += -x;
 		rasterWidth -= -x;
@@ -947,91 +1744,165 @@ FORCEINLINE void RasterizerUnit<RENDERER>::_drawscanline(const POLYGON_ATTR poly
 	}
 	
 	const s64 texScalingFactor = (s64)this->_currentTexture->GetScalingFactor();
+	const u32 texScalingShift = (texScalingFactor == 4) ? 2 : ((texScalingFactor == 2) ? 1 : 0);
+	
+	const bool isWDepth = (this->_softRender->currentRenderState->SWAP_BUFFERS.DepthMode != 0);
+	const bool enableFragmentSamplingHack = this->_softRender->_enableFragmentSamplingHack;
+	const FragmentAttributesBuffer &dstAttributes = *this->_softRender->_framebufferAttributes;
 	
-	u32 depth;
-	Color4u8 vtxColor;
-	Vector2s32 texCoord;
+	// Whole spans of polygons that aren't shadow polygons are shaded and written by the renderer's
+	// span functions where it has them. Everything else goes through _pixel() one fragment at a time.
+	const bool willShadeSpans = !ISSHADOWPOLYGON && !enableFragmentSamplingHack && (this->_softRender->_spanShade != NULL);
+	SoftRasterizerSpanShader spanShader;
+	SoftRasterizerSpanSampler spanSampler;
 	
-	while (rasterWidth-- > 0)
+	if (willShadeSpans)
 	{
-		if (this->_softRender->currentRenderState->SWAP_BUFFERS.DepthMode)
+		const GFX3D_State &renderState = *this->_softRender->currentRenderState;
+		
+		spanShader.dstColor = dstColor;
+		spanShader.dstAttributes = this->_softRender->_framebufferAttributes;
+		spanShader.toonColorLUT = this->_softRender->toonColor32LUT;
+		spanShader.polygonMode = polyAttr.Mode;
+		spanShader.polygonID = polyAttr.PolygonID;
+		spanShader.alphaTestRef = renderState.alphaTestRef;
+		spanShader.isSamplingEnabled = this->_currentTexture->IsSamplingEnabled();
+		spanShader.isHighlightShading = (renderState.DISP3DCNT.PolygonShading == PolygonShadingMode_Highlight);
+		spanShader.isAlphaTestEnabled = (renderState.DISP3DCNT.EnableAlphaTest != 0);
+		spanShader.isAlphaBlendingEnabled = (renderState.DISP3DCNT.EnableAlphaBlending != 0);
+		spanShader.isPolyTranslucent = isPolyTranslucent;
+		spanShader.isFogEnabled = (polyAttr.Fog_Enable != 0);
+		spanShader.isTranslucentDepthWriteEnabled = (polyAttr.TranslucentDepthWrite_Enable != 0);
+		spanShader.isFrontFacing = ISFRONTFACING;
+		
+		if (spanShader.isSamplingEnabled)
 		{
-			// not sure about the w-buffer depth value: this value was chosen to make the skybox, castle window decals, and water level render correctly in SM64
-			depth = (u32)((1LL << W_PRECISION) / invWInterpolated);
+			this->_currentTexture->GetRenderSampler(this->_textureWrapMode, spanSampler);
 		}
-		else
+	}
+	
+	CACHE_ALIGN SoftRasterizerSpan span;
+	CACHE_ALIGN SoftRasterizerSpanFragment spanFragment[SOFTRASTERIZER_SPAN_LENGTH];
+	
+	// The scanline is drawn in spans. Each span first steps the interpolants and computes the
+	// fragment depths, then depth tests the whole span at once, and then only spends the
+	// perspective divides and shading on the fragments that passed.
+	while (rasterWidth > 0)
+	{
+		const size_t spanLength = min<s32>(rasterWidth, SOFTRASTERIZER_SPAN_LENGTH);
+		
+		this->_softRender->_spanInterpolate(interpolated, interpolated_dx, spanLength, isWDepth, span);
+		
+		if (enableFragmentSamplingHack)
 		{
-			// When using Z-depth, be sure to test against the following test cases:
-			// - "Dragon Quest IV: Chapters of the Chosen" - Overworld map
-			// - "Advance Wars: Days of Ruin" - Campaign map / In-game unit drawing on map
-			// - "Etrian Odyssey III: The Drowned City" - Main menu, when the cityscape transitions between day and night
-			// - "Super Monkey Ball: Touch & Roll" - 3D rendered horizon
-			// - "Pokemon Diamond/Pearl" - Main map mode
-			
-			if (this->_softRender->_enableFragmentSamplingHack)
+			for (size_t i = 0; i < spanLength; i++)
 			{
-				depth = (u32)((s32)this->_round_s(zFloatInterpolated * (float)0x00FFFFFF));
+				if (!isWDepth)
+				{
+					// TODO: Hack - Drop the LSB so that the overworld map in Dragon Quest IV shows up correctly.
+					span.depth[i] = (u32)((s32)this->_round_s(zFloatInterpolated * (float)0x00FFFFFF)) & 0xFFFFFFFE;
+				}
+				
+				SoftRasterizerSpanFragment &fragment = spanFragment[i];
+				fragment.invWFloat = invWFloatInterpolated;
+				fragment.texCoordFloat = texCoordFloatInterpolated;
+				fragment.vtxColorFloat = vtxColorFloatInterpolated;
+				
+				invWFloatInterpolated += invWFloatInterpolated_dx;
+				zFloatInterpolated += zFloatInterpolated_dx;
+				texCoordFloatInterpolated.s += texCoordFloatInterpolated_dx.s;
+				texCoordFloatInterpolated.t += texCoordFloatInterpolated_dx.t;
+				
+				vtxColorFloatInterpolated.r += vtxColorFloatInterpolated_dx.r;
+				vtxColorFloatInterpolated.g += vtxColorFloatInterpolated_dx.g;
+				vtxColorFloatInterpolated.b += vtxColorFloatInterpolated_dx.b;
 			}
-			else
+		}
+		
+		u32 passMask = this->_softRender->_spanDepthTest(span.depth,
+		                                                 dstAttributes.depth + adr,
+		                                                 dstAttributes.polyFacing + adr,
+		                                                 dstColor + adr,
+		                                                 spanLength,
+		                                                 (polyAttr.DepthEqualTest_Enable != 0),
+		                                                 ISFRONTFACING);
+		
+		if (ISSHADOWPOLYGON && (polyAttr.PolygonID == 0))
+		{
+			// shadow mask polygons only affect the stencil buffer, and then only when they fail depth test
+			for (size_t i = 0; i < spanLength; i++)
 			{
-				depth = (u32)(zInterpolated / (1LL << (Z_EXTRAPRECISION + 7)));
+				if ( (passMask & (1 << i)) == 0 )
+				{
+					dstAttributes.stencil[adr + i] = 1;
+				}
 			}
 			
-			// TODO: Hack - Drop the LSB so that the overworld map in Dragon Quest IV shows up correctly.
-			depth &= 0xFFFFFFFE;
+			passMask = 0;
 		}
 		
-		if (this->_softRender->_enableFragmentSamplingHack)
+		if (willShadeSpans && (spanLength == SOFTRASTERIZER_SPAN_LENGTH))
 		{
-			vtxColor.r = max<u8>( 0x00, (u8)min<float>(63.0f, vtxColorFloatInterpolated.r / invWFloatInterpolated) );
-			vtxColor.g = max<u8>( 0x00, (u8)min<float>(63.0f, vtxColorFloatInterpolated.g / invWFloatInterpolated) );
-			vtxColor.b = max<u8>( 0x00, (u8)min<float>(63.0f, vtxColorFloatInterpolated.b / invWFloatInterpolated) );
-			vtxColor.a = vtxColorInterpolated.a;
-			
-			texCoord.s = (s32)(texCoordFloatInterpolated.s * (float)texScalingFactor / invWFloatInterpolated);
-			texCoord.t = (s32)(texCoordFloatInterpolated.t * (float)texScalingFactor / invWFloatInterpolated);
+			if (passMask != 0)
+			{
+				this->_softRender->_spanPerspective(span, texScalingShift, polyAttr.Alpha, passMask);
+				
+				if (spanShader.isSamplingEnabled)
+				{
+					this->_softRender->_spanSample(spanSampler, span);
+				}
+				
+				this->_softRender->_spanShade(spanShader, span, passMask, adr);
+			}
 		}
 		else
 		{
-			vtxColor.r = max<u8>( 0x00, (u8)min<s64>(0x3F, vtxColorInterpolated.r / invWInterpolated) );
-			vtxColor.g = max<u8>( 0x00, (u8)min<s64>(0x3F, vtxColorInterpolated.g / invWInterpolated) );
-			vtxColor.b = max<u8>( 0x00, (u8)min<s64>(0x3F, vtxColorInterpolated.b / invWInterpolated) );
-			vtxColor.a = vtxColorInterpolated.a;
-			
-			texCoord.s = (s32)(texCoordInterpolated.s * texScalingFactor / invWInterpolated);
-			texCoord.t = (s32)(texCoordInterpolated.t * texScalingFactor / invWInterpolated);
+			for (size_t i = 0; (i < spanLength) && (passMask != 0); i++)
+			{
+				if ( (passMask & (1 << i)) == 0 )
+				{
+					continue;
+				}
+				
+				passMask &= ~(1 << i);
+				
+				Color4u8 vtxColor;
+				Vector2s32 texCoord;
+				
+				if (enableFragmentSamplingHack)
+				{
+					const SoftRasterizerSpanFragment &fragment = spanFragment[i];
+					
+					vtxColor.r = max<u8>( 0x00, (u8)min<float>(63.0f, fragment.vtxColorFloat.r / fragment.invWFloat) );
+					vtxColor.g = max<u8>( 0x00, (u8)min<float>(63.0f, fragment.vtxColorFloat.g / fragment.invWFloat) );
+					vtxColor.b = max<u8>( 0x00, (u8)min<float>(63.0f, fragment.vtxColorFloat.b / fragment.invWFloat) );
+					vtxColor.a = polyAttr.Alpha;
+					
+					texCoord.s = (s32)(fragment.texCoordFloat.s * (float)texScalingFactor / fragment.invWFloat);
+					texCoord.t = (s32)(fragment.texCoordFloat.t * (float)texScalingFactor / fragment.invWFloat);
+				}
+				else
+				{
+					SoftRasterizer_FragmentPerspective(span, i, texScalingFactor, polyAttr.Alpha);
+					
+					vtxColor = span.vtxColor[i];
+					texCoord.s = span.texCoordS[i];
+					texCoord.t = span.texCoordT[i];
+				}
+				
+				this->_pixel<ISFRONTFACING, ISSHADOWPOLYGON>(polyAttr,
+				                                             isPolyTranslucent,
+				                                             span.depth[i],
+				                                             vtxColor,
+				                                             texCoord,
+				                                             adr + i,
+				                                             dstColor[adr + i]);
+			}
 		}
 		
-		this->_pixel<ISFRONTFACING, ISSHADOWPOLYGON>(polyAttr,
-													 isPolyTranslucent,
-		                                             depth,
-		                                             vtxColor,
-		                                             texCoord,
-		                                             adr,
-		                                             dstColor[adr]);
-		adr++;
-		x++;
-		
-		invWInterpolated += invWInterpolated_dx;
-		zInterpolated += zInterpolated_dx;
-		
-		texCoordInterpolated.s += texCoordInterpolated_dx.s;
-		texCoordInterpolated.t += texCoordInterpolated_dx.t;
-		
-		vtxColorInterpolated.r += vtxColorInterpolated_dx.r;
-		vtxColorInterpolated.g += vtxColorInterpolated_dx.g;
-		vtxColorInterpolated.b += vtxColorInterpolated_dx.b;
-		vtxColorInterpolated.a += vtxColorInterpolated_dx.a;
-		
-		invWFloatInterpolated += invWFloatInterpolated_dx;
-		zFloatInterpolated += zFloatInterpolated_dx;
-		texCoordFloatInterpolated.s += texCoordFloatInterpolated_dx.s;
-		texCoordFloatInterpolated.t += texCoordFloatInterpolated_dx.t;
-		
-		vtxColorFloatInterpolated.r += vtxColorFloatInterpolated_dx.r;
-		vtxColorFloatInterpolated.g += vtxColorFloatInterpolated_dx.g;
-		vtxColorFloatInterpolated.b += vtxColorFloatInterpolated_dx.b;
-		vtxColorFloatInterpolated.a += vtxColorFloatInterpolated_dx.a;
+		adr += spanLength;
+		x += (s32)spanLength;
+		rasterWidth -= (s32)spanLength;
 	}
 }
 
@@ -1288,11 +2159,11 @@ void RasterizerUnit<RENDERER>::SetRenderer(SoftRasterizerRenderer *theRenderer)
 	this->_softRender = theRenderer;
 }
 
+//renders the clipped polys listed in polyIndexList, or all of them in order if it is NULL
 template<bool RENDERER> template <bool SLI, bool USELINEHACK>
-FORCEINLINE void RasterizerUnit<RENDERER>::Render()
+void RasterizerUnit<RENDERER>::_RenderPolygonList(const u32 *polyIndexList, const size_t polyCount)
 {
-	const size_t clippedPolyCount = this->_softRender->GetClippedPolyCount();
-	if (clippedPolyCount == 0)
+	if (polyCount == 0)
 	{
 		return;
 	}
@@ -1303,18 +2174,20 @@ FORCEINLINE void RasterizerUnit<RENDERER>::Render()
 	
 	const SoftRasterizerPrecalculation *softRastPrecalc = this->_softRender->GetPrecalculationList();
 	
+	const size_t firstIndex = (polyIndexList != NULL) ? polyIndexList[0] : 0;
 	const POLY *rawPolyList = this->_softRender->GetRawPolyList();
-	const CPoly &firstClippedPoly = this->_softRender->GetClippedPolyByIndex(0);
+	const CPoly &firstClippedPoly = this->_softRender->GetClippedPolyByIndex(firstIndex);
 	const POLY &firstPoly = rawPolyList[firstClippedPoly.index];
 	POLYGON_ATTR polyAttr = firstPoly.attribute;
 	TEXIMAGE_PARAM lastTexParams = firstPoly.texParam;
 	u32 lastTexPalette = firstPoly.texPalette;
 	
-	this->_SetupTexture(firstPoly, 0);
+	this->_SetupTexture(firstPoly, firstIndex);
 
 	//iterate over polys
-	for (size_t i = 0; i < clippedPolyCount; i++)
+	for (size_t listIndex = 0; listIndex < polyCount; listIndex++)
 	{
+		const size_t i = (polyIndexList != NULL) ? polyIndexList[listIndex] : listIndex;
 		if (!RENDERER) _debug_thisPoly = (i == this->_softRender->_debug_drawClippedUserPoly);
 		
 		const CPoly &clippedPoly = this->_softRender->GetClippedPolyByIndex(i);
@@ -1397,6 +2270,24 @@ FORCEINLINE void RasterizerUnit<RENDERER>::Render()
 	}
 }
 
+template<bool RENDERER> template <bool SLI, bool USELINEHACK>
+FORCEINLINE void RasterizerUnit<RENDERER>::Render()
+{
+	this->_RenderPolygonList<SLI, USELINEHACK>(NULL, this->_softRender->GetClippedPolyCount());
+}
+
+template<bool RENDERER> template <bool USELINEHACK>
+void RasterizerUnit<RENDERER>::RenderTiles()
+{
+	const u32 *binList = this->_softRender->GetTileBinList();
+	
+	for (const SoftRasterizerTile *tile = this->_softRender->GetNextTile(); tile != NULL; tile = this->_softRender->GetNextTile())
+	{
+		this->SetSLI(tile->startLine, tile->endLine, false);
+		this->_RenderPolygonList<true, USELINEHACK>(binList + tile->binStart, tile->binCount);
+	}
+}
+
 template <bool USELINEHACK>
 void* _HACK_Viewer_ExecUnit(void *arg)
 {
@@ -1415,6 +2306,15 @@ void* SoftRasterizer_RunRasterizerUnit(void *arg)
 	return 0;
 }
 
+template <bool USELINEHACK>
+void* SoftRasterizer_RunRasterizerUnitTiles(void *arg)
+{
+	RasterizerUnit<true> *unit = (RasterizerUnit<true> *)arg;
+	unit->RenderTiles<USELINEHACK>();
+	
+	return 0;
+}
+
 static void* SoftRasterizer_RunGetAndLoadAllTextures(void *arg)
 {
 	SoftRasterizerRenderer *softRender = (SoftRasterizerRenderer *)arg;
@@ -1427,6 +2327,7 @@ static void* SoftRasterizer_RunRasterizerPrecalculate(void *arg)
 {
 	SoftRasterizerRenderer *softRender = (SoftRasterizerRenderer *)arg;
 	softRender->RasterizerPrecalculate();
+	softRender->RasterizerBinPolygons();
 	
 	return NULL;
 }
@@ -1459,6 +2360,13 @@ static Render3D* SoftRasterizerRendererCreate()
 {
 #if defined(ENABLE_AVX2)
 	return new SoftRasterizerRenderer_AVX2;
+#elif defined(ENABLE_SIMD_DISPATCH)
+	if (CPU_GetSIMDLevel() >= CPUSIMDLevel_AVX2)
+	{
+		return new SoftRasterizerRenderer_AVX2;
+	}
+	
+	return new SoftRasterizerRenderer_SSE2;
 #elif defined(ENABLE_SSE2)
 	return new SoftRasterizerRenderer_SSE2;
 #elif defined(ENABLE_NEON_A64)
@@ -1476,6 +2384,8 @@ static void SoftRasterizerRendererDestroy()
 	{
 #if defined(ENABLE_AVX2)
 		SoftRasterizerRenderer_AVX2 *oldRenderer = (SoftRasterizerRenderer_AVX2 *)CurrentRenderer;
+#elif defined(ENABLE_SIMD_DISPATCH)
+		SoftRasterizerRenderer *oldRenderer = (SoftRasterizerRenderer *)CurrentRenderer;
 #elif defined(ENABLE_SSE2)
 		SoftRasterizerRenderer_SSE2 *oldRenderer = (SoftRasterizerRenderer_SSE2 *)CurrentRenderer;
 #elif defined(ENABLE_NEON_A64)
@@ -1669,6 +2579,17 @@ FORCEINLINE void SoftRasterizerTexture::GetRenderSamplerCoordinates(const u8 wra
 	}
 }
 
+void SoftRasterizerTexture::GetRenderSampler(const u8 wrapMode, SoftRasterizerSpanSampler &outSampler) const
+{
+	outSampler.data = this->_renderData;
+	outSampler.width = this->_renderWidth;
+	outSampler.height = this->_renderHeight;
+	outSampler.widthMask = this->_renderWidthMask;
+	outSampler.heightMask = this->_renderHeightMask;
+	outSampler.widthShift = this->_renderWidthShift;
+	outSampler.wrapMode = wrapMode;
+}
+
 void SoftRasterizerTexture::SetUseDeposterize(bool willDeposterize)
 {
 	this->_useDeposterize = willDeposterize;
@@ -1771,6 +2692,10 @@ SoftRasterizerRenderer::SoftRasterizerRenderer()
 	
 	_task = NULL;
 	
+	_tileCount = 0;
+	_tileLines = 0;
+	_tileQueueNext = 0;
+	
 	_debug_drawClippedUserPoly = 0;
 	
 	_renderGeometryNeedsFinish = false;
@@ -1779,6 +2704,11 @@ SoftRasterizerRenderer::SoftRasterizerRenderer()
 	_enableHighPrecisionColorInterpolation = CommonSettings.GFX3D_HighResolutionInterpolateColor;
 	_enableLineHack = CommonSettings.GFX3D_LineHack;
 	_enableFragmentSamplingHack = CommonSettings.GFX3D_TXTHack;
+	_spanDepthTest = &SoftRasterizer_SpanDepthTest;
+	_spanInterpolate = &SoftRasterizer_SpanInterpolate;
+	_spanPerspective = NULL;
+	_spanSample = NULL;
+	_spanShade = NULL;
 	
 	_HACK_viewer_rasterizerUnit.SetSLI(0, (u32)_framebufferHeight, false);
 	
@@ -1837,7 +2767,6 @@ SoftRasterizerRenderer::SoftRasterizerRenderer()
 			_threadClearParam[i].startPixel = i * _customPixelsPerThread;
 			_threadClearParam[i].endPixel = (i < _threadCount - 1) ? (i + 1) * _customPixelsPerThread : _framebufferPixCount;
 			
-			_rasterizerUnit[i].SetSLI((u32)_threadPostprocessParam[i].startLine, (u32)_threadPostprocessParam[i].endLine, false);
 			_rasterizerUnit[i].SetRenderer(this);
 			
 			char name[16];
@@ -1850,6 +2779,8 @@ SoftRasterizerRenderer::SoftRasterizerRenderer()
 			_task[i].start(false, 0, name);
 #endif
 		}
+		
+		_UpdateTiles(_framebufferHeight);
 	}
 	
 	__InitTables();
@@ -1994,6 +2925,136 @@ void SoftRasterizerRenderer::RasterizerPrecalculate()
 	}
 }
 
+void SoftRasterizerRenderer::_UpdateTiles(const size_t h)
+{
+	this->_tileLines = ((h * SOFTRASTERIZER_TILE_NATIVE_LINES) + GPU_FRAMEBUFFER_NATIVE_HEIGHT - 1) / GPU_FRAMEBUFFER_NATIVE_HEIGHT;
+	if (this->_tileLines == 0)
+	{
+		this->_tileLines = 1;
+	}
+	
+	this->_tileCount = (h + this->_tileLines - 1) / this->_tileLines;
+	
+	for (size_t t = 0; t < this->_tileCount; t++)
+	{
+		this->_tile[t].startLine = (u32)(t * this->_tileLines);
+		this->_tile[t].endLine = (u32)min<size_t>((t + 1) * this->_tileLines, h);
+		this->_tile[t].binStart = 0;
+		this->_tile[t].binCount = 0;
+	}
+	
+	this->_tileQueueNext = (s32)this->_tileCount;
+}
+
+bool SoftRasterizerRenderer::_GetPolygonTileRange(const size_t polyIndex, size_t &firstTile, size_t &lastTile) const
+{
+	// Every line that the polygon's edges step over lies between its highest and lowest
+	// vertex, including the lowest one for horizontal line polygons.
+	const SoftRasterizerPrecalculation *polyPrecalc = &this->_precalc[polyIndex * MAX_CLIPPED_VERTS];
+	const size_t vertCount = (size_t)this->_clippedPolyList[polyIndex].type;
+	s64 yMin = polyPrecalc[0].positionCeil.y;
+	s64 yMax = polyPrecalc[0].positionCeil.y;
+	
+	for (size_t j = 1; j < vertCount; j++)
+	{
+		yMin = min<s64>(yMin, polyPrecalc[j].positionCeil.y);
+		yMax = max<s64>(yMax, polyPrecalc[j].positionCeil.y);
+	}
+	
+	if ( (yMax < 0) || (yMin >= (s64)this->_framebufferHeight) )
+	{
+		return false;
+	}
+	
+	firstTile = (size_t)max<s64>(yMin, 0) / this->_tileLines;
+	lastTile = (size_t)min<s64>(yMax, (s64)this->_framebufferHeight - 1) / this->_tileLines;
+	return true;
+}
+
+void SoftRasterizerRenderer::RasterizerBinPolygons()
+{
+	// Each tile gets the polygons that touch it, in the same order as the clipped polygon list.
+	// Since no pixel belongs to more than one tile, rendering the tiles in any order gives the
+	// same result as rendering the whole list at once.
+	size_t firstTile;
+	size_t lastTile;
+	size_t binTotal = 0;
+	
+	for (size_t t = 0; t < this->_tileCount; t++)
+	{
+		this->_tile[t].binCount = 0;
+	}
+	
+	for (size_t i = 0; i < this->_clippedPolyCount; i++)
+	{
+		if (this->_GetPolygonTileRange(i, firstTile, lastTile))
+		{
+			for (size_t t = firstTile; t <= lastTile; t++)
+			{
+				this->_tile[t].binCount++;
+			}
+			
+			binTotal += lastTile - firstTile + 1;
+		}
+	}
+	
+	if (this->_tileBinList.size() < binTotal)
+	{
+		this->_tileBinList.resize(binTotal);
+	}
+	
+	for (size_t t = 0, binStart = 0; t < this->_tileCount; t++)
+	{
+		this->_tile[t].binStart = binStart;
+		binStart += this->_tile[t].binCount;
+		this->_tile[t].binCount = 0;
+	}
+	
+	for (size_t i = 0; i < this->_clippedPolyCount; i++)
+	{
+		if (this->_GetPolygonTileRange(i, firstTile, lastTile))
+		{
+			for (size_t t = firstTile; t <= lastTile; t++)
+			{
+				SoftRasterizerTile &tile = this->_tile[t];
+				this->_tileBinList[tile.binStart + tile.binCount] = (u32)i;
+				tile.binCount++;
+			}
+		}
+	}
+	
+	// Hand out the busiest tiles first, so that the threads finish at about the same time
+	// instead of one of them picking up a heavy tile at the very end.
+	for (size_t t = 0; t < this->_tileCount; t++)
+	{
+		size_t q = t;
+		for (; (q > 0) && (this->_tile[this->_tileQueue[q-1]].binCount < this->_tile[t].binCount); q--)
+		{
+			this->_tileQueue[q] = this->_tileQueue[q-1];
+		}
+		
+		this->_tileQueue[q] = (u32)t;
+	}
+	
+	this->_tileQueueNext = 0;
+}
+
+const SoftRasterizerTile* SoftRasterizerRenderer::GetNextTile()
+{
+	const s32 queueIndex = atomic_inc_barrier32(&this->_tileQueueNext) - 1;
+	if (queueIndex >= (s32)this->_tileCount)
+	{
+		return NULL;
+	}
+	
+	return &this->_tile[this->_tileQueue[queueIndex]];
+}
+
+const u32* SoftRasterizerRenderer::GetTileBinList() const
+{
+	return (this->_tileBinList.empty()) ? NULL : &this->_tileBinList[0];
+}
+
 Render3DError SoftRasterizerRenderer::ApplyRenderingSettings(const GFX3D_State &renderState)
 {
 	this->_enableHighPrecisionColorInterpolation = CommonSettings.GFX3D_HighResolutionInterpolateColor;
@@ -2062,14 +3123,14 @@ Render3DError SoftRasterizerRenderer::RenderGeometry()
 		{
 			for (size_t i = 0; i < this->_threadCount; i++)
 			{
-				this->_task[i].execute(&SoftRasterizer_RunRasterizerUnit<true>, &this->_rasterizerUnit[i]);
+				this->_task[i].execute(&SoftRasterizer_RunRasterizerUnitTiles<true>, &this->_rasterizerUnit[i]);
 			}
 		}
 		else
 		{
 			for (size_t i = 0; i < this->_threadCount; i++)
 			{
-				this->_task[i].execute(&SoftRasterizer_RunRasterizerUnit<false>, &this->_rasterizerUnit[i]);
+				this->_task[i].execute(&SoftRasterizer_RunRasterizerUnitTiles<false>, &this->_rasterizerUnit[i]);
 			}
 		}
 		
@@ -2497,9 +3558,9 @@ Render3DError SoftRasterizerRenderer::SetFramebufferSize(size_t w, size_t h)
 			
 			this->_threadClearParam[i].startPixel = i * this->_customPixelsPerThread;
 			this->_threadClearParam[i].endPixel = (i < this->_threadCount - 1) ? (i + 1) * this->_customPixelsPerThread : pixCount;
-			
-			this->_rasterizerUnit[i].SetSLI((u32)this->_threadPostprocessParam[i].startLine, (u32)this->_threadPostprocessParam[i].endLine, false);
 		}
+		
+		this->_UpdateTiles(h);
 	}
 	
 	return RENDER3DERROR_NOERR;
@@ -2510,6 +3571,9 @@ Render3DError SoftRasterizerRenderer::SetFramebufferSize(size_t w, size_t h)
 template <size_t SIMDBYTES>
 SoftRasterizer_SIMD<SIMDBYTES>::SoftRasterizer_SIMD()
 {
+	// With runtime SIMD dispatch, the base class may have been sized for a narrower vector.
+	_framebufferSIMDPixCount = _framebufferPixCount - (_framebufferPixCount % SIMDBYTES);
+	
 	if (_threadCount == 0)
 	{
 		_threadClearParam[0].renderer = this;
@@ -2569,12 +3633,14 @@ Render3DError SoftRasterizer_SIMD<SIMDBYTES>::ClearUsingValues(const Color4u8 &c
 template <size_t SIMDBYTES>
 Render3DError SoftRasterizer_SIMD<SIMDBYTES>::SetFramebufferSize(size_t w, size_t h)
 {
-	Render3DError error = Render3D_SIMD<SIMDBYTES>::SetFramebufferSize(w, h);
+	Render3DError error = Render3D::SetFramebufferSize(w, h);
 	if (error != RENDER3DERROR_NOERR)
 	{
 		return RENDER3DERROR_NOERR;
 	}
 	
+	this->_framebufferSIMDPixCount = this->_framebufferPixCount - (this->_framebufferPixCount % SIMDBYTES);
+	
 	delete this->_framebufferAttributes;
 	this->_framebufferAttributes = new FragmentAttributesBuffer(w * h);
 	
@@ -2607,9 +3673,9 @@ Render3DError SoftRasterizer_SIMD<SIMDBYTES>::SetFramebufferSize(size_t w, size_
 			
 			this->_threadClearParam[i].startPixel = i * pixelsPerThread;
 			this->_threadClearParam[i].endPixel = (i < this->_threadCount - 1) ? (i + 1) * pixelsPerThread : pixCount;
-			
-			this->_rasterizerUnit[i].SetSLI(this->_threadPostprocessParam[i].startLine, this->_threadPostprocessParam[i].endLine, false);
 		}
+		
+		this->_UpdateTiles(h);
 	}
 	
 	return RENDER3DERROR_NOERR;
@@ -2617,7 +3683,17 @@ Render3DError SoftRasterizer_SIMD<SIMDBYTES>::SetFramebufferSize(size_t w, size_
 
 #endif // defined(ENABLE_AVX) || defined(ENABLE_SSE2) || defined(ENABLE_NEON_A64) || defined(ENABLE_ALTIVEC)
 
-#if defined(ENABLE_AVX2)
+#if defined(ENABLE_AVX2) || defined(ENABLE_SIMD_DISPATCH)
+SIMD_TARGET_BEGIN_AVX2
+
+SoftRasterizerRenderer_AVX2::SoftRasterizerRenderer_AVX2()
+{
+	_spanDepthTest = &SoftRasterizer_SpanDepthTest_AVX2;
+	_spanInterpolate = &SoftRasterizer_SpanInterpolate_AVX2;
+	_spanPerspective = &SoftRasterizer_SpanPerspective_AVX2;
+	_spanSample = &SoftRasterizer_SpanSample_AVX2;
+	_spanShade = &SoftRasterizer_SpanShade_SSE2;
+}
 
 void SoftRasterizerRenderer_AVX2::LoadClearValues(const Color4u8 &clearColor6665, const FragmentAttributes &clearAttributes)
 {
@@ -2654,7 +3730,19 @@ void SoftRasterizerRenderer_AVX2::ClearUsingValues_Execute(const size_t startPix
 	}
 }
 
-#elif defined(ENABLE_SSE2)
+SIMD_TARGET_END
+#endif
+
+#if defined(ENABLE_SSE2) && !defined(ENABLE_AVX2)
+
+SoftRasterizerRenderer_SSE2::SoftRasterizerRenderer_SSE2()
+{
+	_spanDepthTest = &SoftRasterizer_SpanDepthTest_SSE2;
+	_spanInterpolate = &SoftRasterizer_SpanInterpolate_SSE2;
+	_spanPerspective = &SoftRasterizer_SpanPerspective_SSE2;
+	_spanSample = &SoftRasterizer_SpanSample_SSE2;
+	_spanShade = &SoftRasterizer_SpanShade_SSE2;
+}
 
 void SoftRasterizerRenderer_SSE2::LoadClearValues(const Color4u8 &clearColor6665, const FragmentAttributes &clearAttributes)
 {
@@ -18,12 +18,103 @@
 #ifndef _RASTERIZE_H_
 #define _RASTERIZE_H_
 
+#include <vector>
+
 #include "render3D.h"
 #include "gfx3d.h"
 
 
 #define SOFTRASTERIZER_MAX_THREADS 32
 
+// When multithreaded, the polygons are sorted into tiles of whole framebuffer lines, and
+// the rasterizer threads take tiles from a shared queue until there are none left. Tiles
+// are this many lines tall at the native resolution, and scale with the framebuffer height.
+#define SOFTRASTERIZER_TILE_NATIVE_LINES 4
+#define SOFTRASTERIZER_MAX_TILES (GPU_FRAMEBUFFER_NATIVE_HEIGHT / SOFTRASTERIZER_TILE_NATIVE_LINES)
+
+// Scanlines are drawn in spans of this many fragments. The depth test runs on a whole span
+// at once, and only the fragments that pass it get their perspective divides and shading.
+#define SOFTRASTERIZER_SPAN_LENGTH 16
+
+// The integer interpolants of a scanline, either at one fragment or as the step from one
+// fragment to the next.
+struct SoftRasterizerSpanInterpolants
+{
+	s64 invW;
+	s64 z;
+	s64 s;
+	s64 t;
+	s64 color[3];
+};
+
+// The fragments of one span. Each value is kept in its own array so that the span functions
+// can work on several fragments at once.
+struct SoftRasterizerSpan
+{
+	CACHE_ALIGN s64 invW[SOFTRASTERIZER_SPAN_LENGTH];
+	CACHE_ALIGN s64 s[SOFTRASTERIZER_SPAN_LENGTH];
+	CACHE_ALIGN s64 t[SOFTRASTERIZER_SPAN_LENGTH];
+	CACHE_ALIGN s64 color[3][SOFTRASTERIZER_SPAN_LENGTH];
+	CACHE_ALIGN u32 depth[SOFTRASTERIZER_SPAN_LENGTH];
+	
+	// Results of the perspective divides and of texture sampling
+	CACHE_ALIGN Color4u8 vtxColor[SOFTRASTERIZER_SPAN_LENGTH];
+	CACHE_ALIGN s32 texCoordS[SOFTRASTERIZER_SPAN_LENGTH];
+	CACHE_ALIGN s32 texCoordT[SOFTRASTERIZER_SPAN_LENGTH];
+	CACHE_ALIGN Color4u8 texColor[SOFTRASTERIZER_SPAN_LENGTH];
+};
+
+// Everything needed to sample the current texture, as given by SoftRasterizerTexture::GetRenderSampler().
+struct SoftRasterizerSpanSampler
+{
+	const u32 *data;
+	s32 width;
+	s32 height;
+	s32 widthMask;
+	s32 heightMask;
+	u32 widthShift;
+	u8 wrapMode;
+};
+
+// The polygon and framebuffer state that shading and writing a span's fragments depends on.
+struct SoftRasterizerSpanShader
+{
+	Color4u8 *dstColor;
+	FragmentAttributesBuffer *dstAttributes;
+	const Color4u8 *toonColorLUT;
+	
+	u8 polygonMode;
+	u8 polygonID;
+	u8 alphaTestRef;
+	bool isSamplingEnabled;
+	bool isHighlightShading;
+	bool isAlphaTestEnabled;
+	bool isAlphaBlendingEnabled;
+	bool isPolyTranslucent;
+	bool isFogEnabled;
+	bool isTranslucentDepthWriteEnabled;
+	bool isFrontFacing;
+};
+
+// Depth tests <length> fragments (at most SOFTRASTERIZER_SPAN_LENGTH) against the framebuffer,
+// returning a mask with bit N set for each fragment N that passes.
+typedef u32 (*SoftRasterizerSpanDepthTestFunc)(const u32 *__restrict srcDepth, const u32 *__restrict dstDepth, const u8 *__restrict dstPolyFacing, const Color4u8 *__restrict dstColor, const size_t length, const bool isEqualTest, const bool isFrontFacing);
+
+// Fills in the interpolants and the integer depth of <length> fragments starting at <interpolated>,
+// then steps <interpolated> past them.
+typedef void (*SoftRasterizerSpanInterpolateFunc)(SoftRasterizerSpanInterpolants &interpolated, const SoftRasterizerSpanInterpolants &interpolated_dx, const size_t length, const bool isWDepth, SoftRasterizerSpan &span);
+
+// Runs the perspective divides of the fragments in <passMask> of a whole span, giving their vertex
+// colors and texture coordinates. All other fragments are given zeroes.
+typedef void (*SoftRasterizerSpanPerspectiveFunc)(SoftRasterizerSpan &span, const u32 texScalingShift, const u8 alpha, const u32 passMask);
+
+// Samples the texture at the texture coordinates of every fragment of a whole span.
+typedef void (*SoftRasterizerSpanSampleFunc)(const SoftRasterizerSpanSampler &sampler, SoftRasterizerSpan &span);
+
+// Shades the fragments in <passMask> of a whole span, and then alpha tests, blends and writes them
+// to the framebuffer starting at <fragmentIndex>. Shadow polygons aren't handled here.
+typedef void (*SoftRasterizerSpanShadeFunc)(const SoftRasterizerSpanShader &shader, const SoftRasterizerSpan &span, const u32 passMask, const size_t fragmentIndex);
+
 extern GPU3DInterface gpu3DRasterize;
 
 class Task;
@@ -66,6 +157,14 @@ struct SoftRasterizerPostProcessParams
 	bool fogAlphaOnly;
 };
 
+struct SoftRasterizerTile
+{
+	u32 startLine;
+	u32 endLine;
+	size_t binStart; // Index of this tile's first polygon in the bin list
+	size_t binCount; // Number of polygons that touch this tile
+};
+
 class SoftRasterizerTexture : public Render3DTexture
 {
 private:
@@ -106,6 +205,7 @@ public:
 	u32 GetRenderWidthShift() const;
 	
 	void GetRenderSamplerCoordinates(const u8 wrapMode, Vector2s32 &sampleCoordInOut) const;
+	void GetRenderSampler(const u8 wrapMode, SoftRasterizerSpanSampler &outSampler) const;
 	
 	void SetUseDeposterize(bool willDeposterize);
 	void SetScalingFactor(size_t scalingFactor);
@@ -137,11 +237,13 @@ protected:
 	template<int TYPE> FORCEINLINE void _rot_verts();
 	template<bool ISFRONTFACING, int TYPE> void _sort_verts();
 	template<bool SLI, bool ISFRONTFACING, bool ISSHADOWPOLYGON, bool USELINEHACK> void _shape_engine(const POLYGON_ATTR polyAttr, const bool isPolyTranslucent, Color4u8 *dstColor, const size_t framebufferWidth, const size_t framebufferHeight, int type);
+	template<bool SLI, bool USELINEHACK> void _RenderPolygonList(const u32 *polyIndexList, const size_t polyCount);
 	
 public:
 	void SetSLI(u32 startLine, u32 endLine, bool debug);
 	void SetRenderer(SoftRasterizerRenderer *theRenderer);
 	template<bool SLI, bool USELINEHACK> FORCEINLINE void Render();
+	template<bool USELINEHACK> void RenderTiles();
 };
 
 #if defined(ENABLE_AVX2)
@@ -175,6 +277,13 @@ protected:
 	
 	SoftRasterizerPrecalculation *_precalc;
 	
+	SoftRasterizerTile _tile[SOFTRASTERIZER_MAX_TILES];
+	size_t _tileCount;
+	size_t _tileLines;
+	u32 _tileQueue[SOFTRASTERIZER_MAX_TILES]; // Tile indices, with the most heavily loaded tiles first
+	volatile s32 _tileQueueNext;
+	std::vector<u32> _tileBinList; // Clipped polygon indices of each tile in turn, in drawing order
+	
 	u8 _fogTable[32768];
 	Color4u8 _edgeMarkTable[8];
 	bool _edgeMarkDisabled[8];
@@ -187,6 +296,8 @@ protected:
 	// SoftRasterizer-specific methods
 	void _UpdateEdgeMarkColorTable(const u16 *edgeMarkColorTable);
 	void _UpdateFogTable(const u8 *fogDensityTable);
+	void _UpdateTiles(const size_t h);
+	bool _GetPolygonTileRange(const size_t polyIndex, size_t &firstTile, size_t &lastTile) const;
 	
 	// Base rendering methods
 	virtual Render3DError BeginRender(const GFX3D_State &renderState, const GFX3D_GeometryList &renderGList);
@@ -203,6 +314,13 @@ public:
 	GFX3D_State *currentRenderState;
 	
 	bool _enableFragmentSamplingHack;
+	SoftRasterizerSpanDepthTestFunc _spanDepthTest;
+	SoftRasterizerSpanInterpolateFunc _spanInterpolate;
+	
+	// Only set by the SIMD renderers. Without them, every fragment goes through RasterizerUnit::_pixel().
+	SoftRasterizerSpanPerspectiveFunc _spanPerspective;
+	SoftRasterizerSpanSampleFunc _spanSample;
+	SoftRasterizerSpanShadeFunc _spanShade;
 	
 	SoftRasterizerRenderer();
 	virtual ~SoftRasterizerRenderer();
@@ -211,6 +329,9 @@ public:
 	
 	void GetAndLoadAllTextures();
 	void RasterizerPrecalculate();
+	void RasterizerBinPolygons();
+	const SoftRasterizerTile* GetNextTile();
+	const u32* GetTileBinList() const;
 	Render3DError RenderEdgeMarkingAndFog(const SoftRasterizerPostProcessParams &param);
 	
 	SoftRasterizerTexture* GetLoadedTextureFromPolygon(const POLY &thePoly, bool enableTexturing);
@@ -239,7 +360,9 @@ public:
 	virtual Render3DError SetFramebufferSize(size_t w, size_t h);
 };
 
-#if defined(ENABLE_AVX2)
+// A build with runtime SIMD dispatch carries both the SSE2 and the AVX2 rasterizers, and
+// SoftRasterizerRendererCreate() picks one for the running CPU.
+#if defined(ENABLE_AVX2) || defined(ENABLE_SIMD_DISPATCH)
 class SoftRasterizerRenderer_AVX2 : public SoftRasterizer_SIMD<32>
 {
 protected:
@@ -255,10 +378,13 @@ protected:
 	virtual void LoadClearValues(const Color4u8 &clearColor6665, const FragmentAttributes &clearAttributes);
 	
 public:
+	SoftRasterizerRenderer_AVX2();
+	
 	virtual void ClearUsingValues_Execute(const size_t startPixel, const size_t endPixel);
 };
+#endif
 
-#elif defined(ENABLE_SSE2)
+#if defined(ENABLE_SSE2) && !defined(ENABLE_AVX2)
 class SoftRasterizerRenderer_SSE2 : public SoftRasterizer_SIMD<16>
 {
 protected:
@@ -274,6 +400,8 @@ protected:
 	virtual void LoadClearValues(const Color4u8 &clearColor6665, const FragmentAttributes &clearAttributes);
 	
 public:
+	SoftRasterizerRenderer_SSE2();
+	
 	virtual void ClearUsingValues_Execute(const size_t startPixel, const size_t endPixel);
 };
 
@@ -28,6 +28,8 @@
 #include <sys/stat.h>
 #include <time.h>
 #include <fstream>
+#include <deque>
+#include <atomic>
 
 #include "common.h"
 #include "armcpu.h"
@@ -54,6 +56,7 @@
 #include "wifi.h"
 
 #include "path.h"
+#include "utils/task.h"
 
 #ifdef HOST_WINDOWS
 #include "frontend/windows/main.h"
@@ -76,6 +79,8 @@ savestates_t savestates[NB_STATES];
 
 #define SAVESTATE_VERSION       12
 static const char* magic = "DeSmuME SState\0";
+static const char* deltaMagic = "DeSmuME SDelta\0";
+static const char* chunkMagic = "DeSmuME SChunk\0";
 
 //a savestate chunk loader can set this if it wants to permit a silent failure (for compatibility)
 static bool SAV_silent_fail_flag;
@@ -386,6 +391,34 @@ SFORMAT reserveChunks[] = {
 	{ 0 }
 };
 
+struct SAVESTATE_PAGED_MEM
+{
+	u8 *ptr;
+	u32 size;
+};
+
+//the RAM that incremental savestate deltas store by dirty page instead of in full.
+//the sizes match what SF_MEM and SF_MMU save, and the order is part of the delta format.
+static const SAVESTATE_PAGED_MEM pagedMem[] = {
+	{ MMU.ARM9_ITCM,  sizeof(MMU.ARM9_ITCM) },
+	{ MMU.ARM9_DTCM,  sizeof(MMU.ARM9_DTCM) },
+	{ MMU.MAIN_MEM,   0x800000 },
+	{ MMU.ARM9_VMEM,  sizeof(MMU.ARM9_VMEM) },
+	{ MMU.ARM9_OAM,   sizeof(MMU.ARM9_OAM) },
+	{ MMU.ARM9_LCD,   0xA4000 },
+	{ MMU.ARM7_BIOS,  sizeof(MMU.ARM7_BIOS) },
+	{ MMU.ARM7_ERAM,  sizeof(MMU.ARM7_ERAM) },
+	{ MMU.ARM7_WIRAM, sizeof(MMU.ARM7_WIRAM) },
+	{ MMU.SWIRAM,     sizeof(MMU.SWIRAM) },
+};
+
+//identifies the base that the dirty pages are being tracked against
+static u32 deltaBaseLen = 0;
+static u32 deltaBaseAdler = 0;
+
+//the pages a delta being written stores: MMU_dirty's, or those found by a delta context
+static const u8 *deltaDirtyPages = NULL;
+
 #ifdef MSB_FIRST
 /* endian-flips count bytes.  count should be even and nonzero. */
 static INLINE void FlipByteOrder(u8 *src, u32 count)
@@ -602,6 +635,86 @@ static bool mmu_loadstate(EMUFILE &is, int size)
 	return ok;
 }
 
+//writes the tracked RAM that was dirtied since the base, merging runs of dirty pages
+static void paged_savestate(EMUFILE &os)
+{
+	const u8 *mmuBase = (const u8 *)&MMU;
+	const u32 countPos = os.ftell();
+	u32 count = 0;
+	os.write_32LE(count);
+
+	for (u32 page = 0; page < MMU_DIRTY_PAGES; page++)
+	{
+		if (!deltaDirtyPages[page])
+			continue;
+		u32 end = page + 1;
+		while (end < MMU_DIRTY_PAGES && deltaDirtyPages[end])
+			end++;
+
+		const u8 *lo = mmuBase + ((size_t)page << MMU_DIRTY_PAGE_SHIFT);
+		const u8 *hi = mmuBase + ((size_t)end << MMU_DIRTY_PAGE_SHIFT);
+		for (u32 i = 0; i < ARRAY_SIZE(pagedMem); i++)
+		{
+			const u8 *from = std::max(lo, (const u8 *)pagedMem[i].ptr);
+			const u8 *to = std::min(hi, (const u8 *)pagedMem[i].ptr + pagedMem[i].size);
+			if (from >= to)
+				continue;
+			os.write_32LE(i);
+			os.write_32LE((u32)(from - pagedMem[i].ptr));
+			os.write_32LE((u32)(to - from));
+			os.fwrite(from, to - from);
+			count++;
+		}
+		page = end;
+	}
+
+	const u32 endPos = os.ftell();
+	os.fseek(countPos, SEEK_SET);
+	os.write_32LE(count);
+	os.fseek(endPos, SEEK_SET);
+}
+
+static bool paged_loadstate(EMUFILE &is, int size)
+{
+	u32 count;
+	if (is.read_32LE(count) != 1) return false;
+
+	for (u32 n = 0; n < count; n++)
+	{
+		u32 i, ofs, len;
+		if (is.read_32LE(i) != 1) return false;
+		if (is.read_32LE(ofs) != 1) return false;
+		if (is.read_32LE(len) != 1) return false;
+		if (i >= ARRAY_SIZE(pagedMem) || ofs > pagedMem[i].size || len > pagedMem[i].size - ofs)
+			return false;
+
+		is.fread(pagedMem[i].ptr + ofs, len);
+		if (is.fail()) return false;
+
+		//so that the next delta against this base still carries these pages
+		MMU_MarkDirtyRange(pagedMem[i].ptr + ofs, len);
+	}
+	return true;
+}
+
+//<sf> without the entries that pagedMem covers
+static std::vector<SFORMAT> unpaged(const SFORMAT *sf)
+{
+	std::vector<SFORMAT> ret;
+	for (; sf->v; sf++)
+	{
+		bool paged = false;
+		for (u32 i = 0; i < ARRAY_SIZE(pagedMem); i++)
+			if ((u8 *)sf->v >= pagedMem[i].ptr && (u8 *)sf->v < pagedMem[i].ptr + pagedMem[i].size)
+				paged = true;
+		if (!paged)
+			ret.push_back(*sf);
+	}
+	const SFORMAT end = { 0 };
+	ret.push_back(end);
+	return ret;
+}
+
 static void cp15_savestate(EMUFILE &os)
 {
 	//version
@@ -1040,21 +1153,317 @@ static void savestate_WriteChunk(EMUFILE &os, int type, void (*saveproc)(EMUFILE
 */
 }
 
-static void writechunks(EMUFILE &os);
+static void writechunks(EMUFILE &os, bool delta = false);
 
-bool savestate_save(EMUFILE &outstream, int compressionLevel)
+static u32 savestate_adler(const u8 *buf, u32 len)
+{
+	return (u32)adler32(adler32(0, NULL, 0), buf, len);
+}
+
+//=========================== chunked savestates
+
+//A chunked savestate has the usual header with its own magic and the codec where the compressed
+//length would be, followed by blocks of {u32 raw length, u32 stored length, stored bytes}, where
+//a block stored at its raw length wasn't compressed. The blocks are independent, so they are
+//compressed on worker threads and written out in order as each one completes.
+
+#define SAVESTATE_BLOCK_SIZE (256*1024)
+#define SAVESTATE_MAX_WORKERS 8
+
+//---- fast codec: byte oriented LZ77 in the style of LZ4.
+//a sequence is a token (literal count<<4 | match length-4), the literal count's extra bytes,
+//the literals, a u16 LE match offset and the match length's extra bytes. the last sequence
+//has only literals.
+
+#define SAVESTATE_LZ_HASH_BITS 14
+#define SAVESTATE_LZ_MIN_MATCH 4
+
+static FORCEINLINE u32 savestate_lz_read32(const u8 *p)
+{
+	u32 v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static FORCEINLINE u32 savestate_lz_hash(u32 v)
+{
+	return (v * 2654435761U) >> (32 - SAVESTATE_LZ_HASH_BITS);
+}
+
+static void savestate_lz_putlen(std::vector<u8> &out, u32 len)
+{
+	for (; len >= 255; len -= 255)
+		out.push_back(255);
+	out.push_back((u8)len);
+}
+
+static void savestate_lz_sequence(std::vector<u8> &out, const u8 *lit, u32 litLen, u32 offset, u32 matchLen)
+{
+	const u32 m = matchLen ? matchLen - SAVESTATE_LZ_MIN_MATCH : 0;
+	out.push_back((u8)((std::min(litLen, 15U) << 4) | std::min(m, 15U)));
+	if (litLen >= 15)
+		savestate_lz_putlen(out, litLen - 15);
+	out.insert(out.end(), lit, lit + litLen);
+	if (matchLen == 0)
+		return;
+	out.push_back((u8)offset);
+	out.push_back((u8)(offset >> 8));
+	if (m >= 15)
+		savestate_lz_putlen(out, m - 15);
+}
+
+static void savestate_lz_compress(const u8 *src, u32 len, std::vector<u8> &out)
+{
+	std::vector<u32> table(1 << SAVESTATE_LZ_HASH_BITS, 0);
+	out.clear();
+	out.reserve(len + len / 255 + 16);
+
+	u32 pos = 1, anchor = 0;
+	while (pos + SAVESTATE_LZ_MIN_MATCH <= len)
+	{
+		const u32 seq = savestate_lz_read32(src + pos);
+		u32 &slot = table[savestate_lz_hash(seq)];
+		const u32 cand = slot;
+		slot = pos;
+
+		if (pos - cand > 0xFFFF || savestate_lz_read32(src + cand) != seq)
+		{
+			//step faster through data that doesn't compress
+			pos += 1 + ((pos - anchor) >> 6);
+			continue;
+		}
+
+		u32 matchLen = SAVESTATE_LZ_MIN_MATCH;
+		while (pos + matchLen + 8 <= len)
+		{
+			u64 a, b;
+			memcpy(&a, src + cand + matchLen, 8);
+			memcpy(&b, src + pos + matchLen, 8);
+			if (a != b) break;
+			matchLen += 8;
+		}
+		while (pos + matchLen < len && src[cand + matchLen] == src[pos + matchLen])
+			matchLen++;
+
+		savestate_lz_sequence(out, src + anchor, pos - anchor, pos - cand, matchLen);
+		pos += matchLen;
+		anchor = pos;
+	}
+
+	savestate_lz_sequence(out, src + anchor, len - anchor, 0, 0);
+}
+
+static bool savestate_lz_getlen(const u8 *&src, const u8 *end, u32 &len)
+{
+	u8 b;
+	do
+	{
+		if (src >= end) return false;
+		b = *src++;
+		len += b;
+	} while (b == 255);
+	return true;
+}
+
+static bool savestate_lz_decompress(const u8 *src, u32 srcLen, u8 *dst, u32 dstLen)
+{
+	const u8 *end = src + srcLen;
+	u32 op = 0;
+	while (src < end)
+	{
+		const u8 token = *src++;
+		u32 litLen = token >> 4;
+		if (litLen == 15 && !savestate_lz_getlen(src, end, litLen)) return false;
+		if (litLen > (u32)(end - src) || litLen > dstLen - op) return false;
+		memcpy(dst + op, src, litLen);
+		src += litLen;
+		op += litLen;
+		if (src == end)
+			break;
+
+		if (end - src < 2) return false;
+		const u32 offset = src[0] | (src[1] << 8);
+		src += 2;
+		u32 matchLen = token & 15;
+		if (matchLen == 15 && !savestate_lz_getlen(src, end, matchLen)) return false;
+		matchLen += SAVESTATE_LZ_MIN_MATCH;
+		if (offset == 0 || offset > op || matchLen > dstLen - op) return false;
+
+		//matches may overlap the bytes they produce, which is how runs are coded
+		if (offset == 1)
+			memset(dst + op, dst[op - 1], matchLen);
+		else
+			for (u32 i = 0; i < matchLen; i++)
+				dst[op + i] = dst[op - offset + i];
+		op += matchLen;
+	}
+	return op == dstLen;
+}
+
+//---- blocks
+
+struct SAVESTATE_BLOCK
+{
+	const u8 *src;
+	u32 len;
+	int codec;
+	int compressionLevel;
+	std::vector<u8> out; //empty if the block is stored as it is
+};
+
+static void* savestate_compress_block(void *param)
+{
+	SAVESTATE_BLOCK &block = *(SAVESTATE_BLOCK *)param;
+	block.out.clear();
+
+	if (block.codec == TCommonSettings::SavestateCodec_Fast)
+		savestate_lz_compress(block.src, block.len, block.out);
+#ifdef HAVE_LIBZ
+	else
+	{
+		uLongf comprlen = compressBound(block.len);
+		block.out.resize(comprlen);
+		if (compress2(&block.out[0], &comprlen, block.src, block.len, block.compressionLevel) == Z_OK)
+			block.out.resize(comprlen);
+		else
+			block.out.clear();
+	}
+#endif
+
+	if (block.out.size() >= block.len)
+		block.out.clear();
+	return NULL;
+}
+
+static bool savestate_decompress_block(int codec, const u8 *src, u32 srcLen, u8 *dst, u32 dstLen)
+{
+	if (codec == TCommonSettings::SavestateCodec_Fast)
+		return savestate_lz_decompress(src, srcLen, dst, dstLen);
+#ifdef HAVE_LIBZ
+	uLongf uncomprlen = dstLen;
+	return uncompress(dst, &uncomprlen, src, srcLen) == Z_OK && uncomprlen == dstLen;
+#else
+	return false;
+#endif
+}
+
+static Task *savestateWorkers = NULL;
+static int savestateWorkerCount = 0;
+
+void savestate_shutdown_workers()
+{
+	//with a single worker, blocks are compressed inline and there are no threads
+	for (int i = 0; savestateWorkers != NULL && i < savestateWorkerCount; i++)
+		savestateWorkers[i].shutdown();
+	delete[] savestateWorkers;
+	savestateWorkers = NULL;
+	savestateWorkerCount = 0;
+}
+
+//returns how many blocks can be in flight; with one, they are compressed on the calling thread
+static int savestate_workers()
+{
+	const int want = std::max(1, std::min(CommonSettings.num_cores, SAVESTATE_MAX_WORKERS));
+	if (want != savestateWorkerCount)
+	{
+		savestate_shutdown_workers();
+		savestateWorkerCount = want;
+
+		if (want > 1)
+		{
+			savestateWorkers = new Task[want];
+			for (int i = 0; i < want; i++)
+				savestateWorkers[i].start(false, 0, "savestate compression");
+		}
+	}
+	return want;
+}
+
+static void savestate_start_block(SAVESTATE_BLOCK &block, u32 index, const u8 *data, u32 len, int codec, int compressionLevel)
+{
+	block.src = data + index * SAVESTATE_BLOCK_SIZE;
+	block.len = std::min((u32)SAVESTATE_BLOCK_SIZE, len - index * SAVESTATE_BLOCK_SIZE);
+	block.codec = codec;
+	block.compressionLevel = compressionLevel;
+	if (savestateWorkerCount > 1)
+		savestateWorkers[index % savestateWorkerCount].execute(savestate_compress_block, &block);
+	else
+		savestate_compress_block(&block);
+}
+
+static bool savestate_save_chunked(EMUFILE &outstream, int codec, int compressionLevel, u32 *dataLen, u32 *dataAdler)
+{
+	EMUFILE_MEMORY ms;
+	writechunks(ms);
+	const u32 len = ms.ftell();
+	const u8 *data = ms.buf();
+
+	if (dataAdler)
+	{
+		*dataLen = len;
+		*dataAdler = savestate_adler(data, len);
+	}
+
+	outstream.fwrite(chunkMagic,16);
+	outstream.write_32LE(SAVESTATE_VERSION);
+	outstream.write_32LE(EMU_DESMUME_VERSION_NUMERIC()); //desmume version
+	outstream.write_32LE(len); //uncompressed length, without the header
+	outstream.write_32LE(codec);
+
+	const u32 count = (len + SAVESTATE_BLOCK_SIZE - 1) / SAVESTATE_BLOCK_SIZE;
+	const u32 workers = (u32)savestate_workers();
+	const u32 slots = std::max(1U, std::min(count, workers));
+	std::vector<SAVESTATE_BLOCK> blocks(slots);
+
+	//block i is compressed in slot i%slots, which takes block i+slots once block i is written
+	u32 next = 0;
+	for (; next < std::min(count, slots); next++)
+		savestate_start_block(blocks[next], next, data, len, codec, compressionLevel);
+
+	for (u32 i = 0; i < count; i++)
+	{
+		if (workers > 1)
+			savestateWorkers[i % workers].finish();
+
+		const SAVESTATE_BLOCK &block = blocks[i % slots];
+		const bool stored = block.out.empty();
+		outstream.write_32LE(block.len);
+		outstream.write_32LE(stored ? block.len : (u32)block.out.size());
+		if (stored)
+			outstream.fwrite(block.src, block.len);
+		else
+			outstream.fwrite(&block.out[0], block.out.size());
+
+		if (next < count)
+		{
+			savestate_start_block(blocks[next % slots], next, data, len, codec, compressionLevel);
+			next++;
+		}
+	}
+
+	return !outstream.fail();
+}
+
+//a base for incremental savestates gets its data checksummed, so it always goes through memory
+static bool savestate_save(EMUFILE &outstream, int compressionLevel, u32 *dataLen, u32 *dataAdler)
 {
 #ifdef HAVE_JIT 
 	arm_jit_sync();
 #endif
+	int codec = CommonSettings.savestate_codec;
 	#ifndef HAVE_LIBZ
-	compressionLevel = Z_NO_COMPRESSION;
+	if (codec != TCommonSettings::SavestateCodec_Fast)
+		compressionLevel = Z_NO_COMPRESSION;
 	#endif
 
+	if (compressionLevel != Z_NO_COMPRESSION && codec != TCommonSettings::SavestateCodec_Zlib)
+		return savestate_save_chunked(outstream, codec, compressionLevel, dataLen, dataAdler);
+
+	const bool direct = (compressionLevel == Z_NO_COMPRESSION) && !dataAdler;
 	EMUFILE_MEMORY ms;
-	EMUFILE &os = (compressionLevel != Z_NO_COMPRESSION) ? (EMUFILE &)ms : (EMUFILE &)outstream;
+	EMUFILE &os = direct ? (EMUFILE &)outstream : (EMUFILE &)ms;
 	
-	if (compressionLevel == Z_NO_COMPRESSION)
+	if (direct)
 	{
 		os.fseek(32,SEEK_SET); //skip the header
 	}
@@ -1064,6 +1473,16 @@ bool savestate_save(EMUFILE &outstream, int compressionLevel)
 	//save the length of the file
 	u32 len = os.ftell();
 
+	if (dataAdler)
+	{
+		*dataLen = len;
+		*dataAdler = savestate_adler(ms.buf(), len);
+	}
+
+	//uncompressed lengths count the header
+	if (!direct && compressionLevel == Z_NO_COMPRESSION)
+		len += 32;
+
 	u32 comprlen = 0xFFFFFFFF;
 	u8* cbuf;
 
@@ -1096,10 +1515,137 @@ bool savestate_save(EMUFILE &outstream, int compressionLevel)
 		outstream.fwrite(cbuf,comprlen==(u32)-1?len:comprlen);
 		delete[] cbuf;
 	}
+	else if (!direct)
+	{
+		outstream.fwrite(ms.buf(),len-32);
+	}
+
+	return error == Z_OK;
+}
+
+bool savestate_save(EMUFILE &outstream, int compressionLevel)
+{
+	return savestate_save(outstream, compressionLevel, NULL, NULL);
+}
+
+bool savestate_save_base(EMUFILE &outstream, int compressionLevel)
+{
+	MMU_DirtyTrackingStart();
+	return savestate_save(outstream, compressionLevel, &deltaBaseLen, &deltaBaseAdler);
+}
+
+//copies the RAM that deltas page into <ram>
+static void delta_copy_ram(std::vector<u8> &ram)
+{
+	size_t total = 0;
+	for (u32 i = 0; i < ARRAY_SIZE(pagedMem); i++)
+		total += pagedMem[i].size;
+	ram.resize(total);
+
+	u8 *p = &ram[0];
+	for (u32 i = 0; i < ARRAY_SIZE(pagedMem); i++)
+	{
+		memcpy(p, pagedMem[i].ptr, pagedMem[i].size);
+		p += pagedMem[i].size;
+	}
+}
+
+//marks the pages of the RAM that deltas page where it differs from <ram>
+static void delta_compare_ram(const std::vector<u8> &ram, u8 *dirty)
+{
+	memset(dirty, 0, MMU_DIRTY_PAGES);
+	const u8 *mmuBase = (const u8 *)&MMU;
+	const u8 *p = &ram[0];
+	for (u32 i = 0; i < ARRAY_SIZE(pagedMem); i++)
+	{
+		const u8 *cur = pagedMem[i].ptr;
+		const u8 *end = cur + pagedMem[i].size;
+		while (cur < end)
+		{
+			const size_t page = (size_t)(cur - mmuBase) >> MMU_DIRTY_PAGE_SHIFT;
+			const u8 *next = std::min(end, mmuBase + ((page + 1) << MMU_DIRTY_PAGE_SHIFT));
+			if (memcmp(cur, p, next - cur) != 0)
+				dirty[page] = 1;
+			p += next - cur;
+			cur = next;
+		}
+	}
+}
+
+static bool savestate_save_delta(EMUFILE &outstream, int compressionLevel, const u8 *dirtyPages, u32 baseLen, u32 baseAdler)
+{
+	#ifndef HAVE_LIBZ
+	compressionLevel = Z_NO_COMPRESSION;
+	#endif
+
+	EMUFILE_MEMORY ms;
+	deltaDirtyPages = dirtyPages;
+	writechunks(ms, true);
+	deltaDirtyPages = NULL;
+	const u32 len = ms.size();
+
+	std::vector<u8> cbuf;
+	u32 comprlen = 0xFFFFFFFF;
+	int error = Z_OK;
+	if (compressionLevel != Z_NO_COMPRESSION)
+	{
+		uLongf comprlen2 = (len>>9)+12 + len;
+		cbuf.resize(comprlen2);
+		error = compress2(&cbuf[0],&comprlen2,ms.buf(),len,compressionLevel);
+		comprlen = (u32)comprlen2;
+	}
+
+	outstream.fwrite(deltaMagic,16);
+	outstream.write_32LE(SAVESTATE_VERSION);
+	outstream.write_32LE(EMU_DESMUME_VERSION_NUMERIC());
+	outstream.write_32LE(len); //uncompressed length, without the header
+	outstream.write_32LE(comprlen); //compressed length (-1 if it is not compressed)
+	outstream.write_32LE(baseLen);
+	outstream.write_32LE(baseAdler);
+
+	if (comprlen != 0xFFFFFFFF)
+		outstream.fwrite(&cbuf[0],comprlen);
+	else
+		outstream.fwrite(ms.buf(),len);
 
 	return error == Z_OK;
 }
 
+bool savestate_save_delta(EMUFILE &outstream, int compressionLevel)
+{
+	if (!MMU_dirty.enabled)
+		return false;
+
+#ifdef HAVE_JIT 
+	arm_jit_sync();
+#endif
+	return savestate_save_delta(outstream, compressionLevel, MMU_dirty.page, deltaBaseLen, deltaBaseAdler);
+}
+
+bool savestate_save_base(EMUFILE &outstream, SAVESTATE_DELTA_CONTEXT &ctx, int compressionLevel)
+{
+	if (!savestate_save(outstream, compressionLevel, &ctx.baseLen, &ctx.baseAdler))
+	{
+		ctx.baseRAM.clear();
+		return false;
+	}
+	delta_copy_ram(ctx.baseRAM);
+	return true;
+}
+
+bool savestate_save_delta(EMUFILE &outstream, SAVESTATE_DELTA_CONTEXT &ctx, int compressionLevel)
+{
+	if (ctx.baseRAM.empty())
+		return false;
+
+#ifdef HAVE_JIT 
+	arm_jit_sync();
+#endif
+	static u8 dirty[MMU_DIRTY_PAGES];
+	delta_compare_ram(ctx.baseRAM, dirty);
+	return savestate_save_delta(outstream, compressionLevel, dirty, ctx.baseLen, ctx.baseAdler);
+}
+
 bool savestate_save (const char *file_name)
 {
 	EMUFILE_MEMORY ms;
@@ -1119,8 +1665,12 @@ static void wifi_savestate(EMUFILE &os)
 	wifiHandler->SaveState(os);
 }
 
-static void writechunks(EMUFILE &os)
+//a delta leaves the RAM in pagedMem out of the usual chunks and adds the pages of it
+//that were dirtied since the base.
+static void writechunks(EMUFILE &os, bool delta)
 {
+	static const std::vector<SFORMAT> unpagedMem = unpaged(SF_MEM);
+	static const std::vector<SFORMAT> unpagedMMU = unpaged(SF_MMU);
 
 	DateTime tm = DateTime::get_Now();
 	svn_rev = 0;
@@ -1132,10 +1682,10 @@ static void writechunks(EMUFILE &os)
 	savestate_WriteChunk(os,1,SF_ARM9);
 	savestate_WriteChunk(os,2,SF_ARM7);
 	savestate_WriteChunk(os,3,cp15_savestate);
-	savestate_WriteChunk(os,4,SF_MEM);
+	savestate_WriteChunk(os,4,delta ? &unpagedMem[0] : SF_MEM);
 	savestate_WriteChunk(os,5,SF_NDS);
 	savestate_WriteChunk(os,51,nds_savestate);
-	savestate_WriteChunk(os,60,SF_MMU);
+	savestate_WriteChunk(os,60,delta ? &unpagedMMU[0] : SF_MMU);
 	savestate_WriteChunk(os,61,mmu_savestate);
 	savestate_WriteChunk(os,7,gpu_savestate);
 	savestate_WriteChunk(os,8,spu_savestate);
@@ -1146,7 +1696,8 @@ static void writechunks(EMUFILE &os)
 	savestate_WriteChunk(os,101,mov_savestate);
 	savestate_WriteChunk(os,111,&wifi_savestate);
 	savestate_WriteChunk(os,120,SF_RTC);
-	savestate_WriteChunk(os,130,SF_NDS_INFO);
+	if (!delta)
+		savestate_WriteChunk(os,130,SF_NDS_INFO);
 	savestate_WriteChunk(os,140,s_slot1_savestate);
 	savestate_WriteChunk(os,150,s_slot2_savestate);
 	// reserved for future versions
@@ -1154,6 +1705,8 @@ static void writechunks(EMUFILE &os)
 	savestate_WriteChunk(os,170,reserveChunks);
 	savestate_WriteChunk(os,180,reserveChunks);
 	// ============================
+	if (delta)
+		savestate_WriteChunk(os,190,paged_savestate);
 	savestate_WriteChunk(os,0xFFFFFFFF,(SFORMAT*)0);
 }
 
@@ -1220,6 +1773,7 @@ static bool ReadStateChunks(EMUFILE &is, s32 totalsize)
 				if(!ReadStateChunk(is,reserveChunks,size)) ret=false;
 			break;
 			// ============================
+			case 190: if(!paged_loadstate(is,size)) ret=false; break;
 				
 			default:
 				return false;
@@ -1286,6 +1840,9 @@ static bool ReadStateChunks(EMUFILE &is, s32 totalsize)
 
 static void loadstate()
 {
+	// VRAM was replaced underneath whatever the texture cache last read from it
+	MMU_VRAMTouchAll();
+
     // This should regenerate the vram banks
     for (int i = 0; i < 0xA; i++)
        _MMU_write08<ARMCPU_ARM9>(0x04000240+i, _MMU_read08<ARMCPU_ARM9>(0x04000240+i));
@@ -1314,23 +1871,32 @@ static void loadstate()
 	execute = !driver->EMU_IsEmulationPaused();
 }
 
-bool savestate_load(EMUFILE &is)
+//reads the header shared by savestates and deltas, which starts with <expectMagic>.
+//if <chunked> is given, the header of a chunked savestate is accepted too.
+static bool savestate_read_header(EMUFILE &is, const char *expectMagic, u32 &len, u32 &comprlen, bool *chunked = NULL)
 {
-	SAV_silent_fail_flag = false;
 	char header[16];
 	is.fread(header,16);
-	if (is.fail() || memcmp(header,magic,16))
+	if (is.fail())
+		return false;
+	if (chunked)
+		*chunked = !memcmp(header,chunkMagic,16);
+	if (memcmp(header,expectMagic,16) && !(chunked && *chunked))
 		return false;
 
-	u32 ssversion,len,comprlen;
+	u32 ssversion;
 	if (!is.read_32LE(ssversion)) return false;
 	if (!is.read_32LE(_DESMUME_version)) return false;
 	if (!is.read_32LE(len)) return false;
 	if (!is.read_32LE(comprlen)) return false;
 
-	if (ssversion != SAVESTATE_VERSION) return false;
+	return ssversion == SAVESTATE_VERSION;
+}
 
-	std::vector<u8> buf(len);
+//reads the <len> bytes of chunk data following a header, uncompressing them if needed
+static bool savestate_read_data(EMUFILE &is, u32 len, u32 comprlen, std::vector<u8> &buf)
+{
+	buf.resize(len);
 
 	if (comprlen != 0xFFFFFFFF)
 	{
@@ -1349,11 +1915,127 @@ bool savestate_load(EMUFILE &is)
 			return false;
 #endif
 	}
-	else
+	else if (len > 0)
+	{
+		is.fread(&buf[0],len);
+	}
+	return true;
+}
+
+//reads the <len> bytes of chunk data that follow a chunked savestate's header
+static bool savestate_read_blocks(EMUFILE &is, u32 len, int codec, std::vector<u8> &buf)
+{
+	if (codec != TCommonSettings::SavestateCodec_ZlibChunked && codec != TCommonSettings::SavestateCodec_Fast)
+		return false;
+
+	buf.resize(len);
+	std::vector<u8> cbuf;
+
+	for (u32 pos = 0; pos < len; )
+	{
+		u32 rawLen, storedLen;
+		if (!is.read_32LE(rawLen)) return false;
+		if (!is.read_32LE(storedLen)) return false;
+		if (rawLen == 0 || rawLen > len - pos || storedLen > rawLen) return false;
+
+		if (storedLen == rawLen)
+		{
+			is.fread(&buf[pos], rawLen);
+		}
+		else
+		{
+			cbuf.resize(storedLen);
+			if (storedLen > 0)
+				is.fread(&cbuf[0], storedLen);
+			if (is.fail()) return false;
+			if (!savestate_decompress_block(codec, storedLen ? &cbuf[0] : NULL, storedLen, &buf[pos], rawLen))
+				return false;
+		}
+		if (is.fail()) return false;
+		pos += rawLen;
+	}
+	return true;
+}
+
+//reads a savestate in either container, leaving its chunk data in <buf>
+static bool savestate_read(EMUFILE &is, std::vector<u8> &buf)
+{
+	u32 len,comprlen;
+	bool chunked;
+	if (!savestate_read_header(is, magic, len, comprlen, &chunked)) return false;
+
+	//the chunked header holds the codec instead of a compressed length
+	if (chunked)
+		return savestate_read_blocks(is, len, comprlen, buf);
+
+	//uncompressed lengths count the header
+	if (comprlen == 0xFFFFFFFF)
+	{
+		if (len < 32) return false;
+		len -= 32;
+	}
+
+	return savestate_read_data(is, len, comprlen, buf);
+}
+
+static bool savestate_restore(std::vector<u8> &buf, std::vector<u8> *delta, bool track = true);
+
+bool savestate_load(EMUFILE &is)
+{
+	SAV_silent_fail_flag = false;
+
+	std::vector<u8> buf;
+	if (!savestate_read(is, buf)) return false;
+
+	return savestate_restore(buf, NULL);
+}
+
+//<track>: go on tracking dirty pages against <base>, for the deltas of the tracked base
+static SAVESTATE_DELTA_RESULT savestate_load_delta(EMUFILE &base, EMUFILE &delta, bool track)
+{
+	SAV_silent_fail_flag = false;
+
+	std::vector<u8> buf;
+	if (!savestate_read(base, buf)) return SAVESTATE_DELTA_FAILED;
+	const u32 len = (u32)buf.size();
+
+	u32 deltaLen,deltaComprlen,baseLen,baseAdler;
+	if (!savestate_read_header(delta, deltaMagic, deltaLen, deltaComprlen)) return SAVESTATE_DELTA_FAILED;
+	if (!delta.read_32LE(baseLen)) return SAVESTATE_DELTA_FAILED;
+	if (!delta.read_32LE(baseAdler)) return SAVESTATE_DELTA_FAILED;
+
+	//a delta only holds the pages that changed since its own base.
+	//nothing has been touched yet, so the caller can retry with the right base.
+	if (baseLen != len || baseAdler != savestate_adler(len ? &buf[0] : NULL, len))
+		return SAVESTATE_DELTA_WRONG_BASE;
+
+	std::vector<u8> deltaBuf;
+	if (!savestate_read_data(delta, deltaLen, deltaComprlen, deltaBuf)) return SAVESTATE_DELTA_FAILED;
+
+	if (!savestate_restore(buf, &deltaBuf, track))
+		return SAVESTATE_DELTA_FAILED;
+
+	if (track)
 	{
-		is.fread(&buf[0],len-32);
+		deltaBaseLen = baseLen;
+		deltaBaseAdler = baseAdler;
 	}
+	return SAVESTATE_DELTA_OK;
+}
+
+SAVESTATE_DELTA_RESULT savestate_load_delta(EMUFILE &base, EMUFILE &delta)
+{
+	return savestate_load_delta(base, delta, true);
+}
+
+SAVESTATE_DELTA_RESULT savestate_load_delta(EMUFILE &base, EMUFILE &delta, SAVESTATE_DELTA_CONTEXT &ctx)
+{
+	return savestate_load_delta(base, delta, false);
+}
 
+//loads the chunks in <buf>, then those of <delta> on top of them if there is one
+static bool savestate_restore(std::vector<u8> &buf, std::vector<u8> *delta, bool track)
+{
 	//GO!! READ THE SAVESTATE
 	//THERE IS NO GOING BACK NOW
 	//reset the emulator first to clean out the host's state
@@ -1376,7 +2058,16 @@ bool savestate_load(EMUFILE &is)
 	//SPU_Reset();
 
 	EMUFILE_MEMORY mstemp(&buf);
-	bool x = ReadStateChunks(mstemp,(s32)len);
+	bool x = ReadStateChunks(mstemp,(s32)buf.size());
+
+	if (x && delta)
+	{
+		//the reset above ended any tracking, and the delta's pages are what differs from its base
+		if (track)
+			MMU_DirtyTrackingStart();
+		EMUFILE_MEMORY msdelta(delta);
+		x = ReadStateChunks(msdelta,(s32)delta->size());
+	}
 
 	if (!x && !SAV_silent_fail_flag)
 	{
@@ -1407,3 +2098,352 @@ bool savestate_load(const char *file_name)
 
 	return savestate_load(f);
 }
+
+bool savestate_save_base(const char *file_name)
+{
+	EMUFILE_MEMORY ms;
+	if (!savestate_save_base(ms))
+		return false;
+
+	EMUFILE_FILE file(file_name, "wb");
+	if(file.fail())
+		return false;
+
+	file.fwrite(ms.buf(), ms.size());
+	return true;
+}
+
+bool savestate_save_delta(const char *file_name)
+{
+	EMUFILE_MEMORY ms;
+	if (!savestate_save_delta(ms))
+		return false;
+
+	EMUFILE_FILE file(file_name, "wb");
+	if(file.fail())
+		return false;
+
+	file.fwrite(ms.buf(), ms.size());
+	return true;
+}
+
+SAVESTATE_DELTA_RESULT savestate_load_delta(const char *base_file_name, const char *delta_file_name)
+{
+	EMUFILE_FILE base(base_file_name,"rb");
+	if (base.fail()) return SAVESTATE_DELTA_FAILED;
+	EMUFILE_FILE delta(delta_file_name,"rb");
+	if (delta.fail()) return SAVESTATE_DELTA_FAILED;
+
+	return savestate_load_delta(base, delta);
+}
+
+//=========================== rewind
+
+//The newest snapshot is kept whole; every older one is only kept as the XOR of it and the
+//snapshot after it, zero-run coded, so stepping back applies one delta to the snapshot in hand.
+//Consecutive snapshots differ in a small part of RAM, so the XOR is almost all zero runs, which
+//this codec skips a word at a time instead of running a general purpose compressor over them.
+//The coding happens on a worker thread; the emulation thread only serializes the state.
+
+struct REWIND_ENTRY
+{
+	u32 ofs;        //where the coded delta starts in the ring
+	u32 size;       //its coded size
+	u32 olderLen;   //length of the snapshot before it
+	u32 newerLen;   //length of the snapshot after it
+};
+
+static bool rewindEnabled = false;
+static u32 rewindInterval = 1;
+static u32 rewindFrames = 0;
+static bool rewindLive = false; //the emulation ran since the snapshot in rewindCur was taken or loaded
+static u32 rewindAhead = 0; //entries ahead of the loaded snapshot, after stepping back
+static std::vector<u8> rewindRing;
+static std::deque<REWIND_ENTRY> rewindEntries; //oldest first. entry i turns snapshot i into i+1 and back
+static std::vector<u8> rewindCur, rewindNext, rewindCoded;
+static u32 rewindCurLen = 0, rewindNextLen = 0;
+static bool rewindHaveCur = false;
+static Task rewindTask;
+static std::atomic<bool> rewindBusy(false);
+static REWIND_STATS rewindStats;
+
+static FORCEINLINE u64 rewind_load64(const u8 *p)
+{
+	u64 v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+//appends a run header and makes room for <count> literal bytes after it
+static u8 *rewind_emit(std::vector<u8> &out, u32 skip, u32 count)
+{
+	const size_t at = out.size();
+	out.resize(at + 8 + count);
+	u8 *p = &out[at];
+	memcpy(p, &skip, 4);
+	memcpy(p + 4, &count, 4);
+	return p + 8;
+}
+
+//codes a^b as runs of {u32 zero bytes to skip, u32 count, count bytes of a^b}, where the shorter
+//buffer counts as zero padded. runs are found 8 bytes at a time.
+static void rewind_encode(const u8 *a, u32 lenA, const u8 *b, u32 lenB, std::vector<u8> &out)
+{
+	out.clear();
+	const u32 common = std::min(lenA, lenB) & ~7;
+	const u32 total = std::max(lenA, lenB);
+	u32 pos = 0, last = 0;
+
+	while (pos < common)
+	{
+		if (rewind_load64(a + pos) == rewind_load64(b + pos))
+		{
+			pos += 8;
+			continue;
+		}
+
+		const u32 start = pos;
+		while (pos < common && rewind_load64(a + pos) != rewind_load64(b + pos))
+			pos += 8;
+
+		u8 *lit = rewind_emit(out, start - last, pos - start);
+		for (u32 i = start; i < pos; i += 8)
+		{
+			const u64 x = rewind_load64(a + i) ^ rewind_load64(b + i);
+			memcpy(lit + (i - start), &x, 8);
+		}
+		last = pos;
+	}
+
+	if (common < total)
+	{
+		u8 *lit = rewind_emit(out, common - last, total - common);
+		for (u32 i = common; i < total; i++)
+			*lit++ = (i < lenA ? a[i] : 0) ^ (i < lenB ? b[i] : 0);
+	}
+}
+
+static void rewind_decode(u8 *buf, const u8 *coded, u32 size)
+{
+	const u8 *end = coded + size;
+	u32 pos = 0;
+	while (coded < end)
+	{
+		u32 skip, count;
+		memcpy(&skip, coded, 4);
+		memcpy(&count, coded + 4, 4);
+		coded += 8;
+		pos += skip;
+		for (u32 i = 0; i < count; i++)
+			buf[pos + i] ^= coded[i];
+		coded += count;
+		pos += count;
+	}
+}
+
+//stores a coded delta after the newest one, dropping the oldest ones until it fits
+static void rewind_push(const std::vector<u8> &coded, u32 olderLen, u32 newerLen)
+{
+	const u32 size = (u32)coded.size();
+	if (size > rewindRing.size())
+	{
+		//too big to keep at all, so nothing before it can be reached anymore
+		rewindStats.dropped += (u32)rewindEntries.size();
+		rewindEntries.clear();
+		return;
+	}
+
+	u32 ofs = 0;
+	while (!rewindEntries.empty())
+	{
+		const REWIND_ENTRY &front = rewindEntries.front();
+		const REWIND_ENTRY &back = rewindEntries.back();
+		const u32 tail = back.ofs + back.size;
+		if (back.ofs >= front.ofs)
+		{
+			//the used part is one block, with free space after it and before it
+			if (tail + size <= rewindRing.size()) { ofs = tail; break; }
+			if (size <= front.ofs) { ofs = 0; break; }
+		}
+		else if (tail + size <= front.ofs)
+		{
+			ofs = tail;
+			break;
+		}
+		rewindEntries.pop_front();
+		rewindStats.dropped++;
+	}
+
+	if (size > 0)
+		memcpy(&rewindRing[ofs], &coded[0], size);
+	const REWIND_ENTRY entry = { ofs, size, olderLen, newerLen };
+	rewindEntries.push_back(entry);
+}
+
+static void* rewind_encode_proc(void *)
+{
+	if (rewindHaveCur)
+	{
+		rewind_encode(&rewindCur[0], rewindCurLen, &rewindNext[0], rewindNextLen, rewindCoded);
+		rewind_push(rewindCoded, rewindCurLen, rewindNextLen);
+	}
+	rewindCur.swap(rewindNext);
+	rewindCurLen = rewindNextLen;
+	rewindHaveCur = true;
+	rewindBusy = false;
+	return NULL;
+}
+
+static void rewind_capture()
+{
+	//the worker clears rewindBusy before the task itself goes idle, and execute() on a
+	//task that is not idle yet does nothing, so wait for it to get there
+	rewindTask.finish();
+#ifdef HAVE_JIT 
+	arm_jit_sync();
+#endif
+	EMUFILE_MEMORY ms(&rewindNext);
+	writechunks(ms);
+	rewindNextLen = (u32)ms.ftell();
+
+	rewindBusy = true;
+	rewindTask.execute(rewind_encode_proc, NULL);
+	rewindStats.captured++;
+}
+
+//turns the snapshot in rewindCur into its neighbour through <entry>
+static void rewind_apply(const REWIND_ENTRY &entry, u32 toLen)
+{
+	if (toLen > rewindCur.size())
+		rewindCur.resize(toLen);
+	if (toLen > rewindCurLen)
+		memset(&rewindCur[rewindCurLen], 0, toLen - rewindCurLen);
+	if (entry.size > 0)
+		rewind_decode(&rewindCur[0], &rewindRing[entry.ofs], entry.size);
+	rewindCurLen = toLen;
+}
+
+static bool rewind_load()
+{
+	SAV_silent_fail_flag = false;
+	//the chunks end with a terminator, so whatever follows rewindCurLen is never read
+	const bool ok = savestate_restore(rewindCur, NULL);
+	rewindLive = false;
+	rewindFrames = 0;
+	return ok;
+}
+
+void rewind_enable(u32 bufferBytes, u32 interval)
+{
+	rewind_disable();
+	rewindRing.resize(bufferBytes);
+	rewindInterval = std::max(interval, 1U);
+	rewindTask.start(false, 0, "rewind");
+	rewindEnabled = true;
+}
+
+void rewind_disable()
+{
+	if (!rewindEnabled)
+		return;
+	rewind_clear();
+	rewindTask.shutdown();
+	rewindEnabled = false;
+	std::vector<u8>().swap(rewindRing);
+	std::vector<u8>().swap(rewindCur);
+	std::vector<u8>().swap(rewindNext);
+	std::vector<u8>().swap(rewindCoded);
+}
+
+bool rewind_is_enabled()
+{
+	return rewindEnabled;
+}
+
+void rewind_clear()
+{
+	if (rewindEnabled)
+		rewindTask.finish();
+	rewindEntries.clear();
+	rewindAhead = 0;
+	rewindHaveCur = false;
+	rewindCurLen = 0;
+	rewindLive = false;
+	rewindFrames = 0;
+	memset(&rewindStats, 0, sizeof(rewindStats));
+}
+
+void rewind_frame()
+{
+	if (!rewindEnabled)
+		return;
+
+	//running on from a snapshot that was stepped back to abandons the ones ahead of it.
+	//the worker is idle here, since stepping waited for it and nothing was captured since.
+	if (rewindAhead > 0)
+	{
+		rewindEntries.erase(rewindEntries.end() - rewindAhead, rewindEntries.end());
+		rewindAhead = 0;
+	}
+	rewindLive = true;
+
+	if (++rewindFrames < rewindInterval)
+		return;
+	if (rewindBusy)
+	{
+		//try again next frame rather than stall the emulation
+		rewindStats.skipped++;
+		return;
+	}
+	rewindFrames = 0;
+	rewind_capture();
+}
+
+bool rewind_step_back()
+{
+	if (!rewindEnabled)
+		return false;
+	rewindTask.finish();
+	if (!rewindHaveCur)
+		return false;
+
+	//the first step only goes back to the newest snapshot
+	if (!rewindLive)
+	{
+		const u32 cursor = (u32)rewindEntries.size() - rewindAhead;
+		if (cursor == 0)
+			return false;
+		const REWIND_ENTRY &entry = rewindEntries[cursor - 1];
+		rewind_apply(entry, entry.olderLen);
+		rewindAhead++;
+	}
+	return rewind_load();
+}
+
+bool rewind_step_forward()
+{
+	if (!rewindEnabled)
+		return false;
+	rewindTask.finish();
+	if (rewindLive || rewindAhead == 0)
+		return false;
+
+	const REWIND_ENTRY &entry = rewindEntries[rewindEntries.size() - rewindAhead];
+	rewind_apply(entry, entry.newerLen);
+	rewindAhead--;
+	return rewind_load();
+}
+
+void rewind_get_stats(REWIND_STATS *stats)
+{
+	if (rewindEnabled)
+		rewindTask.finish();
+	*stats = rewindStats;
+	stats->snapshots = rewindHaveCur ? (u32)rewindEntries.size() + 1 : 0;
+	stats->stepsBack = rewindHaveCur ? (u32)rewindEntries.size() - rewindAhead + (rewindLive ? 1 : 0) : 0;
+	stats->stepsForward = rewindLive ? 0 : rewindAhead;
+	stats->bufferBytes = (u32)rewindRing.size();
+	stats->usedBytes = 0;
+	for (size_t i = 0; i < rewindEntries.size(); i++)
+		stats->usedBytes += rewindEntries[i].size;
+}
@@ -20,6 +20,8 @@
 #ifndef _SRAM_H
 #define _SRAM_H
 
+#include <vector>
+
 #include "types.h"
 #include "zlib.h"
 
@@ -66,5 +68,72 @@ void loadstate_slot(int num);
 
 bool savestate_load(class EMUFILE &is);
 bool savestate_save(class EMUFILE &outstream, int compressionLevel = Z_DEFAULT_COMPRESSION);
+// Stops the threads that compress the blocks of chunked savestates.
+void savestate_shutdown_workers();
+
+// Incremental savestates. savestate_save_base() writes an ordinary savestate and starts
+// tracking which RAM pages get written; each savestate_save_delta() after it stores the
+// small chunks in full but only the RAM pages dirtied since that base. A delta is loaded
+// together with its base, after which deltas keep being taken against the same base.
+// Resetting or loading an ordinary savestate ends the tracking.
+// Only the memory of the MEM and MMU chunks (TCM, main RAM, palettes, OAM, VRAM banks, WRAM)
+// is paged. The GPU and GFX3D chunks (3D FIFO,
+// vertex and polygon lists, 2D engine state) are not dirty-tracked and go into every delta
+// whole, which is most of a delta's size while 3D is running.
+enum SAVESTATE_DELTA_RESULT
+{
+	SAVESTATE_DELTA_OK = 0,
+	SAVESTATE_DELTA_FAILED,      // unreadable base or delta, or their chunks didn't load
+	SAVESTATE_DELTA_WRONG_BASE   // the delta was taken against another base savestate
+};
+
+bool savestate_save_base(class EMUFILE &outstream, int compressionLevel = Z_DEFAULT_COMPRESSION);
+bool savestate_save_delta(class EMUFILE &outstream, int compressionLevel = Z_NO_COMPRESSION);
+SAVESTATE_DELTA_RESULT savestate_load_delta(class EMUFILE &base, class EMUFILE &delta);
+
+bool savestate_save_base(const char *file_name);
+bool savestate_save_delta(const char *file_name);
+SAVESTATE_DELTA_RESULT savestate_load_delta(const char *base_file_name, const char *delta_file_name);
+
+// Deltas against a base of their own, for users (movie keyframes) that must not disturb the
+// base above. Instead of tracking writes, the context keeps a copy of the base's RAM and a
+// delta stores the pages that differ from it, so stores aren't slowed down in between.
+// Loading such a delta leaves both the context and the tracked base alone.
+struct SAVESTATE_DELTA_CONTEXT
+{
+	SAVESTATE_DELTA_CONTEXT() : baseLen(0), baseAdler(0) {}
+	u32 baseLen, baseAdler;
+	std::vector<u8> baseRAM;
+};
+
+bool savestate_save_base(class EMUFILE &outstream, SAVESTATE_DELTA_CONTEXT &ctx, int compressionLevel = Z_DEFAULT_COMPRESSION);
+bool savestate_save_delta(class EMUFILE &outstream, SAVESTATE_DELTA_CONTEXT &ctx, int compressionLevel = Z_NO_COMPRESSION);
+SAVESTATE_DELTA_RESULT savestate_load_delta(class EMUFILE &base, class EMUFILE &delta, SAVESTATE_DELTA_CONTEXT &ctx);
+
+// Rewind. While enabled, a snapshot is taken every <interval> frames and kept in a ring of
+// <bufferBytes>, older ones as deltas against their successor, so the oldest fall out first.
+// rewind_step_back() loads the previous snapshot (the first step goes to the newest one) and
+// rewind_step_forward() undoes a step back; running on after stepping back drops the snapshots
+// ahead. A capture is skipped for a frame while the previous one is still being coded.
+struct REWIND_STATS
+{
+	u32 captured;       // snapshots taken
+	u32 skipped;        // frames whose capture waited on the previous one
+	u32 dropped;        // snapshots evicted to make room
+	u32 snapshots;      // snapshots held, including the newest
+	u32 stepsBack;      // steps back currently possible
+	u32 stepsForward;   // steps forward currently possible
+	u32 usedBytes;      // ring bytes held by deltas
+	u32 bufferBytes;    // ring size
+};
+
+void rewind_enable(u32 bufferBytes, u32 interval);
+void rewind_disable();
+bool rewind_is_enabled();
+void rewind_clear();
+void rewind_frame();
+bool rewind_step_back();
+bool rewind_step_forward();
+void rewind_get_stats(REWIND_STATS *stats);
 
 #endif
@@ -199,28 +199,63 @@ static MemSpan MemSpan_TexPalette(u32 ofs, u32 len, bool silent)
 	return ret;
 }
 
-static bool TextureLRUCompare(TextureStore *tex1, TextureStore *tex2)
+//the 16KB pages of MMU.ARM9_LCD that a range of texture memory is currently mapped to
+static u64 VRAMPages_TexMem(u32 ofs, u32 len)
 {
-	const size_t cacheAge1 = tex1->GetCacheAge();
-	const size_t cacheAge2 = tex2->GetCacheAge();
-	
-	if (cacheAge1 == cacheAge2)
+	u64 pages = 0;
+	for (u32 curr = ofs & ~0x3FFF; curr < ofs + len; curr += 0x4000)
 	{
-		return ( tex1->GetCacheUseCount() > tex2->GetCacheUseCount() );
+		const u8 *ptr = MMU.texInfo.textureSlotAddr[(curr >> 17) & 3] + (curr & 0x1C000);
+		pages |= (u64)1 << (((ptr - MMU.ARM9_LCD) >> 14) & (MMU_VRAM_GENERATION_PAGES - 1));
 	}
-	
-	return (cacheAge1 < cacheAge2);
+	return pages;
+}
+
+//the 16KB pages of MMU.ARM9_LCD that a range of texture palette memory is currently mapped to
+static u64 VRAMPages_TexPalette(u32 ofs, u32 len)
+{
+	u64 pages = 0;
+	for (u32 curr = ofs & ~0x3FFF; curr < ofs + len; curr += 0x4000)
+	{
+		u32 slot = (curr >> 14) & 7; //wraps the same way MemSpan_TexPalette does
+		if (slot > 5) slot -= 5;
+		pages |= (u64)1 << (((MMU.texInfo.texPalSlot[slot] - MMU.ARM9_LCD) >> 14) & (MMU_VRAM_GENERATION_PAGES - 1));
+	}
+	return pages;
+}
+
+//sums the write generations of the given pages. since the generations only ever go up,
+//the sum changes whenever any of the pages gets written.
+static u64 VRAMGeneration(u64 pages)
+{
+	u64 generation = 0;
+	for (size_t i = 0; pages != 0; i++, pages >>= 1)
+	{
+		if (pages & 1)
+		{
+			generation += MMU_vramGeneration[i];
+		}
+	}
+	return generation;
+}
+
+static FORCEINLINE size_t TextureCacheHash(const TextureCacheKey key)
+{
+	// Fibonacci hashing, so that keys which only differ in their upper (palette) bits still spread out.
+	return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32);
 }
 
 TextureCache texCache;
 
 TextureCache::TextureCache()
 {
-	_texCacheMap.clear();
-	_texCacheList.reserve(4096);
+	const TextureCacheBucket emptyBucket = {0, NULL};
+	_texCacheTable.assign(TEXCACHE_DEFAULT_TABLE_SIZE, emptyBucket);
+	_texCacheCount = 0;
+	_lruHead = NULL;
+	_lruTail = NULL;
 	_actualCacheSize = 0;
 	_cacheSizeThreshold = TEXCACHE_DEFAULT_THRESHOLD;
-	memset(_paletteDump, 0, sizeof(_paletteDump));
 }
 
 size_t TextureCache::GetActualCacheSize() const
@@ -238,28 +273,99 @@ void TextureCache::SetCacheSizeThreshold(size_t newThreshold)
 	this->_cacheSizeThreshold = newThreshold;
 }
 
-void TextureCache::Invalidate()
+size_t TextureCache::_FindBucket(const TextureCacheKey key) const
 {
-	//check whether the palette memory changed
-	//TODO - we should handle this instead by setting dirty flags in the vram memory mapping and noting whether palette memory was dirty.
-	//but this will work for now
-	MemSpan mspal = MemSpan_TexPalette(0, PALETTE_DUMP_SIZE, true);
-	const bool paletteDirty = mspal.memcmp(this->_paletteDump);
-	if (paletteDirty)
+	// Returns the bucket holding the key, or else the empty bucket that ends its probe sequence.
+	const size_t mask = this->_texCacheTable.size() - 1;
+	size_t i = TextureCacheHash(key) & mask;
+	
+	while ( (this->_texCacheTable[i].texture != NULL) && (this->_texCacheTable[i].key != key) )
 	{
-		mspal.dump(this->_paletteDump);
+		i = (i + 1) & mask;
 	}
 	
-	for (TextureCacheMap::iterator it(this->_texCacheMap.begin()); it != this->_texCacheMap.end(); ++it)
+	return i;
+}
+
+void TextureCache::_Grow()
+{
+	const TextureCacheBucket emptyBucket = {0, NULL};
+	TextureCacheTable oldTable(this->_texCacheTable.size() * 2, emptyBucket);
+	this->_texCacheTable.swap(oldTable);
+	
+	for (size_t i = 0; i < oldTable.size(); i++)
 	{
-		it->second->SetSuspectedInvalid();
-		
-		//when the palette changes, we assume all 4x4 textures are dirty.
-		//this is because each 4x4 item doesnt carry along with it a copy of the entire palette, for verification
-		//instead, we just use the one paletteDump for verifying of all 4x4 textures; and if paletteDirty is set, verification has failed
-		if( (it->second->GetPackFormat() == TEXMODE_4X4) && paletteDirty )
+		if (oldTable[i].texture != NULL)
+		{
+			this->_texCacheTable[this->_FindBucket(oldTable[i].key)] = oldTable[i];
+		}
+	}
+}
+
+void TextureCache::_LRUUnlink(TextureStore *texItem)
+{
+	if (texItem->_lruPrev != NULL)
+	{
+		texItem->_lruPrev->_lruNext = texItem->_lruNext;
+	}
+	else
+	{
+		this->_lruHead = texItem->_lruNext;
+	}
+	
+	if (texItem->_lruNext != NULL)
+	{
+		texItem->_lruNext->_lruPrev = texItem->_lruPrev;
+	}
+	else
+	{
+		this->_lruTail = texItem->_lruPrev;
+	}
+	
+	texItem->_lruPrev = NULL;
+	texItem->_lruNext = NULL;
+}
+
+void TextureCache::_LRUPushFront(TextureStore *texItem)
+{
+	texItem->_lruPrev = NULL;
+	texItem->_lruNext = this->_lruHead;
+	
+	if (this->_lruHead != NULL)
+	{
+		this->_lruHead->_lruPrev = texItem;
+	}
+	else
+	{
+		this->_lruTail = texItem;
+	}
+	
+	this->_lruHead = texItem;
+}
+
+void TextureCache::Invalidate()
+{
+	// The texture and palette mappings changed. Only the textures whose VRAM pages were
+	// written since they were last read, or whose addresses now map to different pages,
+	// need to be checked against VRAM again.
+	for (TextureStore *theTexture = this->_lruHead; theTexture != NULL; theTexture = theTexture->_lruNext)
+	{
+		if (theTexture->IsPaletteChangedInVRAM())
+		{
+			//4x4 textures dont carry along a copy of the palette for verification, so when
+			//palette memory changes, we assume that they are dirty.
+			if (theTexture->GetPackFormat() == TEXMODE_4X4)
+			{
+				theTexture->SetAssumedInvalid();
+			}
+			else
+			{
+				theTexture->SetSuspectedInvalid();
+			}
+		}
+		else if (theTexture->IsPackDataChangedInVRAM())
 		{
-			it->second->SetAssumedInvalid();
+			theTexture->SetSuspectedInvalid();
 		}
 	}
 }
@@ -272,83 +378,72 @@ void TextureCache::Evict()
 	//dont do anything unless we're over the target
 	if (this->_actualCacheSize <= this->_cacheSizeThreshold)
 	{
-		for (size_t i = 0; i < this->_texCacheList.size(); i++)
-		{
-			this->_texCacheList[i]->IncreaseCacheAge(1);
-		}
-		
 		return;
 	}
 	
 	//aim at cutting the cache to half of the max size
 	size_t targetCacheSize = this->_cacheSizeThreshold / 2;
 	
-	// Sort the textures in cache by age and usage count. Textures that we want to keep in
-	// cache are placed in the front of the list, while textures we want to evict are sorted
-	// to the back of the list.
-	std::sort(this->_texCacheList.begin(), this->_texCacheList.end(), &TextureLRUCompare);
-	
-	while (this->_actualCacheSize > targetCacheSize)
+	// The LRU list is kept in order of use, so the textures to evict are the ones at its tail.
+	while ( (this->_actualCacheSize > targetCacheSize) && (this->_lruTail != NULL) )
 	{
-		if (this->_texCacheMap.size() == 0) break; //just in case.. doesnt seem possible, cache_size wouldve been 0
-		
-		TextureStore *item = this->_texCacheList.back();
+		TextureStore *item = this->_lruTail;
 		this->Remove(item);
-		this->_texCacheList.pop_back();
 		
 		//printf("evicting! totalsize:%d\n",cache_size);
 		delete item;
 	}
-	
-	for (size_t i = 0; i < this->_texCacheList.size(); i++)
-	{
-		this->_texCacheList[i]->IncreaseCacheAge(1);
-	}
 }
 
 void TextureCache::Reset()
 {
-	for (size_t i = 0; i < this->_texCacheList.size(); i++)
+	TextureStore *theTexture = this->_lruHead;
+	while (theTexture != NULL)
 	{
-		delete this->_texCacheList[i];
+		TextureStore *nextTexture = theTexture->_lruNext;
+		delete theTexture;
+		theTexture = nextTexture;
 	}
 	
-	this->_texCacheMap.clear();
-	this->_texCacheList.clear();
+	const TextureCacheBucket emptyBucket = {0, NULL};
+	std::fill(this->_texCacheTable.begin(), this->_texCacheTable.end(), emptyBucket);
+	this->_texCacheCount = 0;
+	this->_lruHead = NULL;
+	this->_lruTail = NULL;
 	this->_actualCacheSize = 0;
-	memset(this->_paletteDump, 0, sizeof(this->_paletteDump));
 }
 
 void TextureCache::ForceReloadAllTextures()
 {
-	for (TextureCacheMap::iterator it(this->_texCacheMap.begin()); it != this->_texCacheMap.end(); ++it)
+	for (TextureStore *theTexture = this->_lruHead; theTexture != NULL; theTexture = theTexture->_lruNext)
 	{
-		it->second->SetLoadNeeded();
+		theTexture->SetLoadNeeded();
 	}
 }
 
 TextureStore* TextureCache::GetTexture(TEXIMAGE_PARAM texAttributes, u32 palAttributes)
 {
-	TextureStore *theTexture = NULL;
 	const TextureCacheKey key = TextureCache::GenerateKey(texAttributes, palAttributes);
-	const TextureCacheMap::iterator cachedTexture = this->_texCacheMap.find(key);
+	TextureStore *theTexture = this->_texCacheTable[this->_FindBucket(key)].texture;
 	
-	if (cachedTexture == this->_texCacheMap.end())
+	if (theTexture == NULL)
 	{
 		return theTexture;
 	}
-	else
+	
+	if (theTexture != this->_lruHead)
 	{
-		theTexture = cachedTexture->second;
-		
-		if (theTexture->IsAssumedInvalid())
-		{
-			theTexture->Update();
-		}
-		else if (theTexture->IsSuspectedInvalid())
-		{
-			theTexture->VRAMCompareAndUpdate();
-		}
+		this->_LRUUnlink(theTexture);
+		this->_LRUPushFront(theTexture);
+	}
+	
+	if (theTexture->IsAssumedInvalid())
+	{
+		theTexture->Update();
+	}
+	else if (theTexture->IsSuspectedInvalid())
+	{
+		theTexture->VRAMCompareAndUpdate();
 	}
 	
 	return theTexture;
@@ -357,16 +452,58 @@ TextureStore* TextureCache::GetTexture(TEXIMAGE_PARAM texAttributes, u32 palAttr
 void TextureCache::Add(TextureStore *texItem)
 {
 	const TextureCacheKey key = texItem->GetCacheKey();
-	this->_texCacheMap[key] = texItem;
-	this->_texCacheList.push_back(texItem);
+	
+	// Keep the load factor at or below 1/2 so that probe sequences stay short.
+	if ( (this->_texCacheCount + 1) * 2 > this->_texCacheTable.size() )
+	{
+		this->_Grow();
+	}
+	
+	TextureCacheBucket &bucket = this->_texCacheTable[this->_FindBucket(key)];
+	if (bucket.texture != NULL)
+	{
+		// Only happens if a texture is added without checking GetTexture() first. The old
+		// item can't be in use, since GetTexture() would have returned it.
+		TextureStore *oldItem = bucket.texture;
+		this->Remove(oldItem);
+		delete oldItem;
+		this->Add(texItem);
+		return;
+	}
+	
+	bucket.key = key;
+	bucket.texture = texItem;
+	this->_texCacheCount++;
+	this->_LRUPushFront(texItem);
 	this->_actualCacheSize += texItem->GetCacheSize();
 	//printf("allocating: up to %d with %d items\n", this->cache_size, this->cacheTable.size());
 }
 
 void TextureCache::Remove(TextureStore *texItem)
 {
-	const TextureCacheKey key = texItem->GetCacheKey();
-	this->_texCacheMap.erase(key);
+	const size_t mask = this->_texCacheTable.size() - 1;
+	size_t hole = this->_FindBucket(texItem->GetCacheKey());
+	
+	if (this->_texCacheTable[hole].texture != texItem)
+	{
+		return;
+	}
+	
+	// Backward shift deletion: pull later items of the probe sequence into the hole, as long
+	// as that doesn't move them in front of their home bucket. This leaves no tombstones behind.
+	for (size_t i = (hole + 1) & mask; this->_texCacheTable[i].texture != NULL; i = (i + 1) & mask)
+	{
+		const size_t home = TextureCacheHash(this->_texCacheTable[i].key) & mask;
+		if ( ((i - home) & mask) >= ((i - hole) & mask) )
+		{
+			this->_texCacheTable[hole] = this->_texCacheTable[i];
+			hole = i;
+		}
+	}
+	
+	this->_texCacheTable[hole].texture = NULL;
+	this->_texCacheCount--;
+	this->_LRUUnlink(texItem);
 	this->_actualCacheSize -= texItem->GetCacheSize();
 }
 
@@ -410,6 +547,14 @@ TextureStore::TextureStore()
 	_cacheSize = 0;
 	_cacheAge = 0;
 	_cacheUsageCount = 0;
+	
+	_lruPrev = NULL;
+	_lruNext = NULL;
+	
+	_vramPackPages = 0;
+	_vramPalettePages = 0;
+	_vramPackGeneration = 0;
+	_vramPaletteGeneration = 0;
 }
 
 TextureStore::TextureStore(const TEXIMAGE_PARAM texAttributes, const u32 palAttributes)
@@ -500,6 +645,11 @@ TextureStore::TextureStore(const TEXIMAGE_PARAM texAttributes, const u32 palAttr
 	_cacheSize = _packTotalSize;
 	_cacheAge = 0;
 	_cacheUsageCount = 0;
+	
+	_lruPrev = NULL;
+	_lruNext = NULL;
+	
+	this->_SaveVRAMGeneration();
 }
 
 TextureStore::~TextureStore()
@@ -755,6 +905,49 @@ void TextureStore::ResetCacheUsageCount()
 	this->_cacheUsageCount = 0;
 }
 
+void TextureStore::_GetVRAMPages(u64 &packPages, u64 &palettePages) const
+{
+	packPages = VRAMPages_TexMem(this->_packAddress, this->_packSize);
+	
+	if (this->_packFormat == TEXMODE_4X4)
+	{
+		packPages |= VRAMPages_TexMem(this->_packIndexAddress, this->_packIndexSize);
+		
+		// 4x4 textures read their palette straight from palette memory when unpacked,
+		// and any part of it may be used.
+		palettePages = VRAMPages_TexPalette(0, PALETTE_DUMP_SIZE);
+	}
+	else
+	{
+		palettePages = VRAMPages_TexPalette(this->_paletteAddress, this->_paletteSize);
+	}
+}
+
+void TextureStore::_SaveVRAMGeneration()
+{
+	this->_GetVRAMPages(this->_vramPackPages, this->_vramPalettePages);
+	this->_vramPackGeneration = VRAMGeneration(this->_vramPackPages);
+	this->_vramPaletteGeneration = VRAMGeneration(this->_vramPalettePages);
+}
+
+bool TextureStore::IsPackDataChangedInVRAM() const
+{
+	u64 packPages;
+	u64 palettePages;
+	this->_GetVRAMPages(packPages, palettePages);
+	
+	return (packPages != this->_vramPackPages) || (VRAMGeneration(packPages) != this->_vramPackGeneration);
+}
+
+bool TextureStore::IsPaletteChangedInVRAM() const
+{
+	u64 packPages;
+	u64 palettePages;
+	this->_GetVRAMPages(packPages, palettePages);
+	
+	return (palettePages != this->_vramPalettePages) || (VRAMGeneration(palettePages) != this->_vramPaletteGeneration);
+}
+
 void TextureStore::Update()
 {
 	MemSpan currentPaletteMS = MemSpan_TexPalette(this->_paletteAddress, this->_paletteSize, false);
@@ -768,6 +961,7 @@ void TextureStore::Update()
 	
 	this->SetTextureData(currentPackedTexDataMS, currentPackedTexIndexMS);
 	this->SetTexturePalette(currentPaletteMS);
+	this->_SaveVRAMGeneration();
 	
 	this->_assumedInvalid = false;
 	this->_suspectedInvalid = false;
@@ -823,6 +1017,7 @@ void TextureStore::VRAMCompareAndUpdate()
 		this->_isLoadNeeded = true;
 	}
 	
+	this->_SaveVRAMGeneration();
 	this->_assumedInvalid = false;
 	this->_suspectedInvalid = false;
 }
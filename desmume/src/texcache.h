@@ -20,7 +20,6 @@
 #ifndef _TEXCACHE_H_
 #define _TEXCACHE_H_
 
-#include <map>
 #include <vector>
 
 #include "types.h"
@@ -51,18 +50,31 @@ class MemSpan;
 class TextureStore;
 
 typedef u64 TextureCacheKey;
-typedef std::map<TextureCacheKey, TextureStore *> TextureCacheMap; // Key = A TextureCacheKey that includes a combination of the texture's NDS texture attributes and palette attributes; Value = Pointer to the texture item
-typedef std::vector<TextureStore *> TextureCacheList;
+
+struct TextureCacheBucket
+{
+	TextureCacheKey key;
+	TextureStore *texture; // NULL if the bucket is empty
+};
+typedef std::vector<TextureCacheBucket> TextureCacheTable; // Open-addressed with linear probing, indexed by a hash of the TextureCacheKey
 //typedef u32 TextureFingerprint;
 
+#define TEXCACHE_DEFAULT_TABLE_SIZE 4096 // Must be a power of two
+
 class TextureCache
 {
 protected:
-	TextureCacheMap _texCacheMap;		// Used to quickly find a texture item by using a key of type TextureCacheKey
-	TextureCacheList _texCacheList;		// Used to sort existing texture items for various operations
+	TextureCacheTable _texCacheTable;	// Used to quickly find a texture item by using a key of type TextureCacheKey
+	size_t _texCacheCount;
+	TextureStore *_lruHead;				// Most recently used texture item
+	TextureStore *_lruTail;				// Least recently used texture item, which is the first to be evicted
 	size_t _actualCacheSize;
 	size_t _cacheSizeThreshold;
-	u8 _paletteDump[PALETTE_DUMP_SIZE];
+	
+	size_t _FindBucket(const TextureCacheKey key) const;
+	void _Grow();
+	void _LRUUnlink(TextureStore *texItem);
+	void _LRUPushFront(TextureStore *texItem);
 	
 public:
 	TextureCache();
@@ -121,6 +133,22 @@ protected:
 	size_t _cacheAge; // A value of 0 means the texture was just used. The higher this value, the older the texture.
 	size_t _cacheUsageCount;
 	
+	// Links in the cache's LRU list, most recently used first.
+	TextureStore *_lruPrev;
+	TextureStore *_lruNext;
+	
+	// The 16KB VRAM pages that the packed data (along with the 4x4 index data) and the palette
+	// were read from, and the sum of those pages' write generations at the time.
+	u64 _vramPackPages;
+	u64 _vramPalettePages;
+	u64 _vramPackGeneration;
+	u64 _vramPaletteGeneration;
+	
+	void _GetVRAMPages(u64 &packPages, u64 &palettePages) const;
+	void _SaveVRAMGeneration();
+	
+	friend class TextureCache;
+	
 public:
 	TextureStore();
 	TextureStore(const TEXIMAGE_PARAM texAttributes, const u32 palAttributes);
@@ -177,6 +205,9 @@ public:
 	void IncreaseCacheUsageCount(const size_t usageCount);
 	void ResetCacheUsageCount();
 	
+	bool IsPackDataChangedInVRAM() const;
+	bool IsPaletteChangedInVRAM() const;
+	
 	void Update();
 	void VRAMCompareAndUpdate();
 	void DebugDump();
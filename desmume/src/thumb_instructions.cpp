@@ -1067,6 +1067,8 @@ TEMPLATE static  u32 FASTCALL OP_B_COND(const u32 i)
 	
 	cpu->R[15] += (u32)((s8)(i&0xFF))<<1;
 	cpu->next_instruction = cpu->R[15];
+	if(CommonSettings.idle_loop_skip && cpu->next_instruction < cpu->instruct_adr)
+		armcpu_idleLoopCheck<PROCNUM>(cpu->instruct_adr, cpu->next_instruction);
 	return 3;
 }
 
@@ -1083,6 +1085,8 @@ TEMPLATE static  u32 FASTCALL OP_B_UNCOND(const u32 i)
 
 	cpu->R[15] += (SIGNEEXT_IMM11(i)<<1);
 	cpu->next_instruction = cpu->R[15];
+	if(CommonSettings.idle_loop_skip && cpu->next_instruction < cpu->instruct_adr)
+		armcpu_idleLoopCheck<PROCNUM>(cpu->instruct_adr, cpu->next_instruction);
 	return 1;
 }
  
@@ -124,6 +124,32 @@
 	#endif
 #endif
 
+// x86 builds whose baseline is below AVX-512 also carry code paths for the higher
+// instruction sets. Those paths are compiled for their own target with the
+// SIMD_TARGET_BEGIN_*/SIMD_TARGET_END macros, and are only entered once
+// CPU_GetSIMDLevel() reports that the running CPU supports them. Define
+// DISABLE_SIMD_DISPATCH to build only the code paths of the build's baseline.
+#if defined(ENABLE_SSE2) && !defined(ENABLE_AVX512_1) && !defined(DISABLE_SIMD_DISPATCH) && \
+    (defined(_MSC_VER) || defined(__clang__) || (defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))))
+	#define ENABLE_SIMD_DISPATCH
+#endif
+
+#if defined(ENABLE_SIMD_DISPATCH) && defined(__clang__)
+	#define SIMD_TARGET_BEGIN_AVX2   _Pragma("clang attribute push (__attribute__((target(\"avx2\"))), apply_to = function)")
+	#define SIMD_TARGET_BEGIN_AVX512 _Pragma("clang attribute push (__attribute__((target(\"avx2,avx512f,avx512cd,avx512bw,avx512dq\"))), apply_to = function)")
+	#define SIMD_TARGET_END          _Pragma("clang attribute pop")
+#elif defined(ENABLE_SIMD_DISPATCH) && defined(__GNUC__)
+	#define SIMD_TARGET_BEGIN_AVX2   _Pragma("GCC push_options") _Pragma("GCC target(\"avx2\")")
+	#define SIMD_TARGET_BEGIN_AVX512 _Pragma("GCC push_options") _Pragma("GCC target(\"avx2,avx512f,avx512cd,avx512bw,avx512dq\")")
+	#define SIMD_TARGET_END          _Pragma("GCC pop_options")
+#else
+	// Nothing to do if the build's baseline already covers the target, or for MSVC,
+	// which emits any intrinsic regardless of the /arch setting.
+	#define SIMD_TARGET_BEGIN_AVX2
+	#define SIMD_TARGET_BEGIN_AVX512
+	#define SIMD_TARGET_END
+#endif
+
 #ifdef _MSC_VER 
 	#include <compat/msvc.h>
 
@@ -331,13 +357,13 @@ typedef __m128i v128s32;
 #define AVAILABLE_TYPE_v128s32
 #endif
 
-#if defined(ENABLE_AVX) || defined(ENABLE_AVX2) || defined(ENABLE_AVX512_0)
+#if defined(ENABLE_AVX) || defined(ENABLE_AVX2) || defined(ENABLE_AVX512_0) || defined(ENABLE_SIMD_DISPATCH)
 
 #include <immintrin.h>
 typedef __m256  v256f32;
 #define AVAILABLE_TYPE_v256f32
 
-#if defined(ENABLE_AVX2) || defined(ENABLE_AVX512_0)
+#if defined(ENABLE_AVX2) || defined(ENABLE_AVX512_0) || defined(ENABLE_SIMD_DISPATCH)
 typedef __m256i v256u8;
 typedef __m256i v256s8;
 typedef __m256i v256u16;
@@ -351,9 +377,9 @@ typedef __m256i v256s32;
 #define AVAILABLE_TYPE_v256s16
 #define AVAILABLE_TYPE_v256u32
 #define AVAILABLE_TYPE_v256s32
-#endif // defined(ENABLE_AVX2) || defined(ENABLE_AVX512_0)
+#endif // defined(ENABLE_AVX2) || defined(ENABLE_AVX512_0) || defined(ENABLE_SIMD_DISPATCH)
 
-#if defined(ENABLE_AVX512_0)
+#if defined(ENABLE_AVX512_0) || defined(ENABLE_SIMD_DISPATCH)
 typedef __m512i v512u8;
 typedef __m512i v512s8;
 typedef __m512i v512u16;
@@ -369,9 +395,9 @@ typedef __m512  v512f32;
 #define AVAILABLE_TYPE_v512u32
 #define AVAILABLE_TYPE_v512s32
 #define AVAILABLE_TYPE_v512f32
-#endif // defined(ENABLE_AVX512_0)
+#endif // defined(ENABLE_AVX512_0) || defined(ENABLE_SIMD_DISPATCH)
 
-#endif // defined(ENABLE_AVX) || defined(ENABLE_AVX2) || defined(ENABLE_AVX512_0)
+#endif // defined(ENABLE_AVX) || defined(ENABLE_AVX2) || defined(ENABLE_AVX512_0) || defined(ENABLE_SIMD_DISPATCH)
 
 /*---------- GPU3D fixed-points types -----------*/
 
@@ -380,6 +380,47 @@ DS_ALIGN(4096) uintptr_t compiled_funcs[1<<26] = {0};
 
 static u8 recompile_counts[(1<<26)/16];
 
+// This backend only frees code all at once, so a write simply drops the entry points
+// it hits; the page table just tells the MMU which pages are worth calling us for.
+u8 jit_page_has_code[JIT_PAGE_COUNT];
+static JIT_STATS jit_stats;
+
+// Blocks always return to the dispatcher here, so the link budget goes unused.
+JIT_LINK_STATE jit_link;
+
+void arm_jit_invalidate(u32 slot, u32 count)
+{
+	bool discarded = false;
+	for (u32 i = 0; i < count; i++)
+	{
+		if (!JIT_SLOT_BASE[slot + i]) continue;
+		JIT_SLOT_BASE[slot + i] = 0;
+		jit_stats.blocksInvalidated++;
+		discarded = true;
+	}
+	if (discarded)
+		jit_stats.invalidations++;
+}
+
+// There is no fastmem mapping in this backend, so there is nothing to refresh.
+void arm_jit_memory_changed()
+{
+}
+
+void arm_jit_check_hooks()
+{
+}
+
+void arm_jit_get_stats(JIT_STATS *stats)
+{
+	*stats = jit_stats;
+}
+
+void arm_jit_clear_stats()
+{
+	memset(&jit_stats, 0, sizeof(jit_stats));
+}
+
 static void emit_branch(int cond, int to);
 static void _armlog(u8 proc, u32 addr, u32 opcode);
 
@@ -2184,7 +2225,10 @@ static u32 FASTCALL OP_LDM_STM(u32 adr, u32 regslo, u32 regshi, int n)
 		ptr = MMU.ARM9_DTCM + (adr & 0x3FFC);
 		cycles = n * MMU_memAccessCycles<PROCNUM,32,store?MMU_AD_WRITE:MMU_AD_READ>(adr);
 		if(store)
+		{
+			MMU_MarkDirtyRange(dir > 0 ? ptr : ptr - (n-1)*4, n*4);
 			return OP_LDM_STM_main<PROCNUM, store, dir, 0>(adr, regs, n, ptr, cycles);
+		}
 	}
 	else if((adr & 0x0F000000) == 0x02000000)
 	{
@@ -2204,6 +2248,7 @@ static u32 FASTCALL OP_LDM_STM(u32 adr, u32 regslo, u32 regshi, int n)
 	else
 		return OP_LDM_STM_other<PROCNUM, store, dir>(adr, regs, n);
 
+	if(store) MMU_MarkDirtyRange(dir > 0 ? ptr : ptr - (n-1)*4, n*4);
 	return OP_LDM_STM_main<PROCNUM, store, dir, store>(adr, regs, n, ptr, cycles);
 }
 
@@ -4140,6 +4185,8 @@ static u32 compile_basicblock()
 #endif
 	
 	JIT_COMPILED_FUNC(start_adr, PROCNUM) = (uintptr_t)f;
+	jit_page_has_code[JIT_SLOT(JIT_COMPILED_FUNC(start_adr, PROCNUM)) >> JIT_PAGE_SHIFT] = 1;
+	jit_stats.compiled++;
 	
 	return interpreted_cycles;
 }
@@ -4155,6 +4202,7 @@ template<int PROCNUM> u32 arm_jit_compile()
 	{
 		ArmOpCompiled f = op_decode[PROCNUM][cpu->CPSR.bits.T];
 		JIT_COMPILED_FUNC(adr, PROCNUM) = (uintptr_t)f;
+		jit_stats.interpreted++;
 		return f();
 	}
 	recompile_counts[mask_adr >> 1] += 1 << 4*(mask_adr & 1);
@@ -4204,6 +4252,8 @@ void arm_jit_reset(bool enable, bool suppress_msg)
 			}
 #endif
 		freeFuncs();
+		memset(jit_page_has_code, 0, sizeof(jit_page_has_code));
+		jit_stats.flushes++;
 	}
 
 #if (PROFILER_JIT_LEVEL > 0)
@@ -16,14 +16,35 @@
 */
 
 #include "colorspacehandler.h"
+#include "common.h"
 #include <string.h>
 
+// When the build's baseline is lower, the AVX-512 and AVX2 handlers are compiled for
+// their own targets here, and ColorspaceHandlerInit() picks one for the running CPU.
 #if defined(ENABLE_AVX512_1)
 	#include "colorspacehandler_AVX512.cpp"
+#elif defined(ENABLE_SIMD_DISPATCH)
+// GCC's AVX-512 intrinsic headers set off false "used uninitialized" warnings when
+// they're compiled under a target pragma.
+#if defined(__GNUC__) && !defined(__clang__)
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wuninitialized"
+	#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+SIMD_TARGET_BEGIN_AVX512
+	#include "colorspacehandler_AVX512.cpp"
+SIMD_TARGET_END
+#if defined(__GNUC__) && !defined(__clang__)
+	#pragma GCC diagnostic pop
+#endif
 #endif
 
 #if defined(ENABLE_AVX2)
 	#include "colorspacehandler_AVX2.cpp"
+#elif defined(ENABLE_SIMD_DISPATCH)
+SIMD_TARGET_BEGIN_AVX2
+	#include "colorspacehandler_AVX2.cpp"
+SIMD_TARGET_END
 #endif
 
 #if defined(ENABLE_SSE2)
@@ -38,7 +59,10 @@
 	#include "colorspacehandler_AltiVec.cpp"
 #endif
 
-#if defined(ENABLE_AVX512_1)
+#if defined(ENABLE_SIMD_DISPATCH)
+	#define USEVECTORSIZE_DISPATCH
+	#define VECTORSIZE ( (_colorspaceSIMDLevel == CPUSIMDLevel_AVX512) ? 64 : ((_colorspaceSIMDLevel == CPUSIMDLevel_AVX2) ? 32 : 16) )
+#elif defined(ENABLE_AVX512_1)
 	#define USEVECTORSIZE_512
 	#define VECTORSIZE 64
 #elif defined(ENABLE_AVX2)
@@ -52,13 +76,20 @@
 // By default, the hand-coded vectorized code will be used instead of a compiler's built-in
 // autovectorization (if supported). However, if USEMANUALVECTORIZATION is not defined, then
 // the compiler will use autovectorization (if supported).
-#if defined(USEVECTORSIZE_128) || defined(USEVECTORSIZE_256) || defined(USEVECTORSIZE_512)
+#if defined(USEVECTORSIZE_128) || defined(USEVECTORSIZE_256) || defined(USEVECTORSIZE_512) || defined(USEVECTORSIZE_DISPATCH)
 	// Comment out USEMANUALVECTORIZATION to disable the hand-coded vectorized code.
 	#define USEMANUALVECTORIZATION
 #endif
 
 #ifdef USEMANUALVECTORIZATION
-	#if defined(ENABLE_AVX512_1)
+	#if defined(ENABLE_SIMD_DISPATCH)
+	static const ColorspaceHandler_AVX512 csh_AVX512;
+	static const ColorspaceHandler_AVX2 csh_AVX2;
+	static const ColorspaceHandler_SSE2 csh;
+	static CPUSIMDLevel _colorspaceSIMDLevel = CPUSIMDLevel_Baseline;
+	
+	#define COLORSPACE_HANDLER_CALL(call) ( (_colorspaceSIMDLevel == CPUSIMDLevel_AVX512) ? csh_AVX512.call : ((_colorspaceSIMDLevel == CPUSIMDLevel_AVX2) ? csh_AVX2.call : csh.call) )
+	#elif defined(ENABLE_AVX512_1)
 	static const ColorspaceHandler_AVX512 csh;
 	#elif defined(ENABLE_AVX2)
 	static const ColorspaceHandler_AVX2 csh;
@@ -75,6 +106,10 @@
 	static const ColorspaceHandler csh;
 #endif
 
+#ifndef COLORSPACE_HANDLER_CALL
+	#define COLORSPACE_HANDLER_CALL(call) csh.call
+#endif
+
 CACHE_ALIGN u16 color_5551_swap_rb[65536];
 CACHE_ALIGN u32 color_555_to_6665_opaque[32768];
 CACHE_ALIGN u32 color_555_to_6665_opaque_swap_rb[32768];
@@ -159,6 +194,10 @@ void ColorspaceHandlerInit()
 {
 	static bool needInitTables = true;
 	
+#if defined(USEMANUALVECTORIZATION) && defined(ENABLE_SIMD_DISPATCH)
+	_colorspaceSIMDLevel = CPU_GetSIMDLevel();
+#endif
+	
 	if (needInitTables)
 	{
 #define RGB15TO18_BITLOGIC(col)         ( (material_5bit_to_6bit[((col)>>10)&0x1F]<<16) | (material_5bit_to_6bit[((col)>>5)&0x1F]<<8) |  material_5bit_to_6bit[(col)&0x1F] )
@@ -198,22 +237,22 @@ void ColorspaceConvertBuffer555xTo8888Opaque(const u16 *__restrict src, u32 *__r
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer555xTo8888Opaque_SwapRB_IsUnaligned<BE_BYTESWAP>(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer555xTo8888Opaque_SwapRB_IsUnaligned<BE_BYTESWAP>(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer555xTo8888Opaque_SwapRB<BE_BYTESWAP>(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer555xTo8888Opaque_SwapRB<BE_BYTESWAP>(src, dst, pixCountVector));
 		}
 	}
 	else
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer555xTo8888Opaque_IsUnaligned<BE_BYTESWAP>(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer555xTo8888Opaque_IsUnaligned<BE_BYTESWAP>(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer555xTo8888Opaque<BE_BYTESWAP>(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer555xTo8888Opaque<BE_BYTESWAP>(src, dst, pixCountVector));
 		}
 	}
 	
@@ -254,22 +293,22 @@ void ColorspaceConvertBuffer555xTo6665Opaque(const u16 *__restrict src, u32 *__r
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer555xTo6665Opaque_SwapRB_IsUnaligned<BE_BYTESWAP>(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer555xTo6665Opaque_SwapRB_IsUnaligned<BE_BYTESWAP>(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer555xTo6665Opaque_SwapRB<BE_BYTESWAP>(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer555xTo6665Opaque_SwapRB<BE_BYTESWAP>(src, dst, pixCountVector));
 		}
 	}
 	else
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer555xTo6665Opaque_IsUnaligned<BE_BYTESWAP>(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer555xTo6665Opaque_IsUnaligned<BE_BYTESWAP>(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer555xTo6665Opaque<BE_BYTESWAP>(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer555xTo6665Opaque<BE_BYTESWAP>(src, dst, pixCountVector));
 		}
 	}
 	
@@ -311,22 +350,22 @@ void ColorspaceConvertBuffer5551To8888(const u16 *__restrict src, u32 *__restric
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer5551To8888_SwapRB_IsUnaligned<BE_BYTESWAP>(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer5551To8888_SwapRB_IsUnaligned<BE_BYTESWAP>(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer5551To8888_SwapRB<BE_BYTESWAP>(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer5551To8888_SwapRB<BE_BYTESWAP>(src, dst, pixCountVector));
 		}
 	}
 	else
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer5551To8888_IsUnaligned<BE_BYTESWAP>(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer5551To8888_IsUnaligned<BE_BYTESWAP>(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer5551To8888<BE_BYTESWAP>(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer5551To8888<BE_BYTESWAP>(src, dst, pixCountVector));
 		}
 	}
 	
@@ -367,22 +406,22 @@ void ColorspaceConvertBuffer5551To6665(const u16 *__restrict src, u32 *__restric
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer5551To6665_SwapRB_IsUnaligned<BE_BYTESWAP>(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer5551To6665_SwapRB_IsUnaligned<BE_BYTESWAP>(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer5551To6665_SwapRB<BE_BYTESWAP>(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer5551To6665_SwapRB<BE_BYTESWAP>(src, dst, pixCountVector));
 		}
 	}
 	else
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer5551To6665_IsUnaligned<BE_BYTESWAP>(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer5551To6665_IsUnaligned<BE_BYTESWAP>(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer5551To6665<BE_BYTESWAP>(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer5551To6665<BE_BYTESWAP>(src, dst, pixCountVector));
 		}
 	}
 	
@@ -423,22 +462,22 @@ void ColorspaceConvertBuffer8888To6665(const u32 *src, u32 *dst, size_t pixCount
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer8888To6665_SwapRB_IsUnaligned(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer8888To6665_SwapRB_IsUnaligned(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer8888To6665_SwapRB(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer8888To6665_SwapRB(src, dst, pixCountVector));
 		}
 	}
 	else
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer8888To6665_IsUnaligned(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer8888To6665_IsUnaligned(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer8888To6665(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer8888To6665(src, dst, pixCountVector));
 		}
 	}
 	
@@ -462,22 +501,22 @@ void ColorspaceConvertBuffer6665To8888(const u32 *src, u32 *dst, size_t pixCount
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer6665To8888_SwapRB_IsUnaligned(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer6665To8888_SwapRB_IsUnaligned(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer6665To8888_SwapRB(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer6665To8888_SwapRB(src, dst, pixCountVector));
 		}
 	}
 	else
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer6665To8888_IsUnaligned(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer6665To8888_IsUnaligned(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer6665To8888(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer6665To8888(src, dst, pixCountVector));
 		}
 	}
 	
@@ -501,22 +540,22 @@ void ColorspaceConvertBuffer8888To5551(const u32 *__restrict src, u16 *__restric
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer8888To5551_SwapRB_IsUnaligned(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer8888To5551_SwapRB_IsUnaligned(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer8888To5551_SwapRB(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer8888To5551_SwapRB(src, dst, pixCountVector));
 		}
 	}
 	else
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer8888To5551_IsUnaligned(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer8888To5551_IsUnaligned(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer8888To5551(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer8888To5551(src, dst, pixCountVector));
 		}
 	}
 	
@@ -540,22 +579,22 @@ void ColorspaceConvertBuffer6665To5551(const u32 *__restrict src, u16 *__restric
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer6665To5551_SwapRB_IsUnaligned(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer6665To5551_SwapRB_IsUnaligned(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer6665To5551_SwapRB(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer6665To5551_SwapRB(src, dst, pixCountVector));
 		}
 	}
 	else
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer6665To5551_IsUnaligned(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer6665To5551_IsUnaligned(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer6665To5551(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer6665To5551(src, dst, pixCountVector));
 		}
 	}
 	
@@ -579,22 +618,22 @@ void ColorspaceConvertBuffer888xTo8888Opaque(const u32 *src, u32 *dst, size_t pi
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer888xTo8888Opaque_SwapRB_IsUnaligned(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer888xTo8888Opaque_SwapRB_IsUnaligned(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer888xTo8888Opaque_SwapRB(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer888xTo8888Opaque_SwapRB(src, dst, pixCountVector));
 		}
 	}
 	else
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer888xTo8888Opaque_IsUnaligned(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer888xTo8888Opaque_IsUnaligned(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer888xTo8888Opaque(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer888xTo8888Opaque(src, dst, pixCountVector));
 		}
 	}
 	
@@ -618,22 +657,22 @@ void ColorspaceConvertBuffer555xTo888(const u16 *__restrict src, u8 *__restrict
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer555xTo888_SwapRB_IsUnaligned(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer555xTo888_SwapRB_IsUnaligned(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer555xTo888_SwapRB(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer555xTo888_SwapRB(src, dst, pixCountVector));
 		}
 	}
 	else
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer555xTo888_IsUnaligned(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer555xTo888_IsUnaligned(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer555xTo888(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer555xTo888(src, dst, pixCountVector));
 		}
 	}
 	
@@ -657,22 +696,22 @@ void ColorspaceConvertBuffer888xTo888(const u32 *__restrict src, u8 *__restrict
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer888xTo888_SwapRB_IsUnaligned(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer888xTo888_SwapRB_IsUnaligned(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer888xTo888_SwapRB(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer888xTo888_SwapRB(src, dst, pixCountVector));
 		}
 	}
 	else
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ConvertBuffer888xTo888_IsUnaligned(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer888xTo888_IsUnaligned(src, dst, pixCountVector));
 		}
 		else
 		{
-			i = csh.ConvertBuffer888xTo888(src, dst, pixCountVector);
+			i = COLORSPACE_HANDLER_CALL(ConvertBuffer888xTo888(src, dst, pixCountVector));
 		}
 	}
 	
@@ -700,11 +739,11 @@ void ColorspaceCopyBuffer16(const u16 *src, u16 *dst, size_t pixCount)
 	
 	if (IS_UNALIGNED)
 	{
-		i = csh.CopyBuffer16_SwapRB_IsUnaligned(src, dst, pixCountVector);
+		i = COLORSPACE_HANDLER_CALL(CopyBuffer16_SwapRB_IsUnaligned(src, dst, pixCountVector));
 	}
 	else
 	{
-		i = csh.CopyBuffer16_SwapRB(src, dst, pixCountVector);
+		i = COLORSPACE_HANDLER_CALL(CopyBuffer16_SwapRB(src, dst, pixCountVector));
 	}
 	
 #pragma LOOPVECTORIZE_DISABLE
@@ -731,11 +770,11 @@ void ColorspaceCopyBuffer32(const u32 *src, u32 *dst, size_t pixCount)
 	
 	if (IS_UNALIGNED)
 	{
-		i = csh.CopyBuffer32_SwapRB_IsUnaligned(src, dst, pixCountVector);
+		i = COLORSPACE_HANDLER_CALL(CopyBuffer32_SwapRB_IsUnaligned(src, dst, pixCountVector));
 	}
 	else
 	{
-		i = csh.CopyBuffer32_SwapRB(src, dst, pixCountVector);
+		i = COLORSPACE_HANDLER_CALL(CopyBuffer32_SwapRB(src, dst, pixCountVector));
 	}
 	
 #pragma LOOPVECTORIZE_DISABLE
@@ -758,22 +797,22 @@ void ColorspaceApplyIntensityToBuffer16(u16 *dst, size_t pixCount, float intensi
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ApplyIntensityToBuffer16_SwapRB_IsUnaligned(dst, pixCountVector, intensity);
+			i = COLORSPACE_HANDLER_CALL(ApplyIntensityToBuffer16_SwapRB_IsUnaligned(dst, pixCountVector, intensity));
 		}
 		else
 		{
-			i = csh.ApplyIntensityToBuffer16_SwapRB(dst, pixCountVector, intensity);
+			i = COLORSPACE_HANDLER_CALL(ApplyIntensityToBuffer16_SwapRB(dst, pixCountVector, intensity));
 		}
 	}
 	else
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ApplyIntensityToBuffer16_IsUnaligned(dst, pixCountVector, intensity);
+			i = COLORSPACE_HANDLER_CALL(ApplyIntensityToBuffer16_IsUnaligned(dst, pixCountVector, intensity));
 		}
 		else
 		{
-			i = csh.ApplyIntensityToBuffer16(dst, pixCountVector, intensity);
+			i = COLORSPACE_HANDLER_CALL(ApplyIntensityToBuffer16(dst, pixCountVector, intensity));
 		}
 	}
 
@@ -836,22 +875,22 @@ void ColorspaceApplyIntensityToBuffer32(u32 *dst, size_t pixCount, float intensi
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ApplyIntensityToBuffer32_SwapRB_IsUnaligned(dst, pixCountVector, intensity);
+			i = COLORSPACE_HANDLER_CALL(ApplyIntensityToBuffer32_SwapRB_IsUnaligned(dst, pixCountVector, intensity));
 		}
 		else
 		{
-			i = csh.ApplyIntensityToBuffer32_SwapRB(dst, pixCountVector, intensity);
+			i = COLORSPACE_HANDLER_CALL(ApplyIntensityToBuffer32_SwapRB(dst, pixCountVector, intensity));
 		}
 	}
 	else
 	{
 		if (IS_UNALIGNED)
 		{
-			i = csh.ApplyIntensityToBuffer32_IsUnaligned(dst, pixCountVector, intensity);
+			i = COLORSPACE_HANDLER_CALL(ApplyIntensityToBuffer32_IsUnaligned(dst, pixCountVector, intensity));
 		}
 		else
 		{
-			i = csh.ApplyIntensityToBuffer32(dst, pixCountVector, intensity);
+			i = COLORSPACE_HANDLER_CALL(ApplyIntensityToBuffer32(dst, pixCountVector, intensity));
 		}
 	}
 	
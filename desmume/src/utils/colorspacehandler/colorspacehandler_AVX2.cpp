@@ -17,7 +17,7 @@
 
 #include "colorspacehandler_AVX2.h"
 
-#ifndef ENABLE_AVX2
+#if !defined(ENABLE_AVX2) && !defined(ENABLE_SIMD_DISPATCH)
 	#error This code requires AVX2 support.
 #else
 
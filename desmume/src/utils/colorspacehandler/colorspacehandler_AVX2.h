@@ -20,7 +20,7 @@
 
 #include "colorspacehandler.h"
 
-#ifndef ENABLE_AVX2
+#if !defined(ENABLE_AVX2) && !defined(ENABLE_SIMD_DISPATCH)
 	#warning This header requires AVX2 support.
 #else
 
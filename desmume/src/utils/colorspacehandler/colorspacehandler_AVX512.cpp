@@ -17,7 +17,7 @@
 
 #include "colorspacehandler_AVX512.h"
 
-#ifndef ENABLE_AVX512_1
+#if !defined(ENABLE_AVX512_1) && !defined(ENABLE_SIMD_DISPATCH)
 	#error This code requires AVX-512 Tier-1 support.
 #else
 
@@ -115,14 +115,14 @@ FORCEINLINE void ColorspaceConvert555xTo6665Opaque_AVX512(const v512u16 &srcColo
 template <bool SWAP_RB>
 FORCEINLINE void ColorspaceConvert5551To8888_AVX512(const v512u16 &srcColor, v512u32 &dstLo, v512u32 &dstHi)
 {
-	const v512u16 srcAlphaBits16 = _mm512_and_si512( _mm512_cmpgt_epi16(_mm512_setzero_si512(), srcColor), _mm512_set1_epi16(0xFF00) );
+	const v512u16 srcAlphaBits16 = _mm512_maskz_set1_epi16( _mm512_cmplt_epi16_mask(srcColor, _mm512_setzero_si512()), 0xFF00 );
 	ColorspaceConvert555aTo8888_AVX512<SWAP_RB>(srcColor, srcAlphaBits16, dstLo, dstHi);
 }
 
 template <bool SWAP_RB>
 FORCEINLINE void ColorspaceConvert5551To6665_AVX512(const v512u16 &srcColor, v512u32 &dstLo, v512u32 &dstHi)
 {
-	const v512u16 srcAlphaBits16 = _mm512_and_si512( _mm512_cmpgt_epi16(_mm512_setzero_si512(), srcColor), _mm512_set1_epi16(0x1F00) );
+	const v512u16 srcAlphaBits16 = _mm512_maskz_set1_epi16( _mm512_cmplt_epi16_mask(srcColor, _mm512_setzero_si512()), 0x1F00 );
 	ColorspaceConvert555aTo6665_AVX512<SWAP_RB>(srcColor, srcAlphaBits16, dstLo, dstHi);
 }
 
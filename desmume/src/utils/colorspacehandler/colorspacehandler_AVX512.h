@@ -20,7 +20,7 @@
 
 #include "colorspacehandler.h"
 
-#ifndef ENABLE_AVX512_1
+#if !defined(ENABLE_AVX512_1) && !defined(ENABLE_SIMD_DISPATCH)
 	#warning This header requires AVX-512 Tier-1 support.
 #else
 